@@ -788,6 +788,31 @@ intptr_t CL_CgameSystemCalls( intptr_t *args ) {
 }
 
 
+/*
+====================
+CL_PrefetchMedia
+
+The model and sound configstrings are the server's precache list,
+have them read in the background of the cgame registering them
+====================
+*/
+static void CL_PrefetchMedia( void ) {
+	const char	*names[ MAX_MODELS + MAX_SOUNDS ];
+	const char	*s;
+	int			i, count;
+
+	count = 0;
+	for ( i = CS_MODELS ; i < CS_SOUNDS + MAX_SOUNDS ; i++ ) {
+		s = cl.gameState.stringData + cl.gameState.stringOffsets[ i ];
+		// inline models and sexed sounds don't name a file
+		if ( s[0] && s[0] != '*' ) {
+			names[ count++ ] = s;
+		}
+	}
+
+	FS_PrefetchFiles( names, count );
+}
+
 /*
 ====================
 CL_InitCGame
@@ -802,6 +827,7 @@ void CL_InitCGame( void ) {
 	vmInterpret_t		interpret;
 
 	t1 = Sys_Milliseconds();
+	FS_BeginLoadStats();
 
 	// put away the console
 	Con_Close();
@@ -825,6 +851,8 @@ void CL_InitCGame( void ) {
 	}
 	cls.state = CA_LOADING;
 
+	CL_PrefetchMedia();
+
 	// init for this gamestate
 	// use the lastExecutedServerCommand instead of the serverCommandSequence
 	// otherwise server commands sent just before a gamestate are dropped
@@ -841,6 +869,7 @@ void CL_InitCGame( void ) {
 	t2 = Sys_Milliseconds();
 
 	Com_Printf( _("CL_InitCGame: %5.2f seconds\n"), (t2-t1)/1000.0 );
+	FS_EndLoadStats( cl.mapname );
 
 	// have the renderer touch all its images, so they are present
 	// on the card even if the driver does deferred loading
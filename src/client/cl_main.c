@@ -3182,7 +3182,12 @@ void CL_InitRef( void ) {
 	ri.Hunk_FreeTempMemory = Hunk_FreeTempMemory;
 	ri.CM_DrawDebugSurface = CM_DrawDebugSurface;
 	ri.FS_ReadFile = FS_ReadFile;
+	ri.FS_FileStamp = FS_FileStamp;
 	ri.FS_FreeFile = FS_FreeFile;
+	ri.FS_MapFile = FS_MapFile;
+	ri.FS_MapHomeFile = FS_MapHomeFile;
+	ri.FS_UnmapFile = FS_UnmapFile;
+	ri.FS_PrefetchFiles = FS_PrefetchFiles;
 	ri.FS_WriteFile = FS_WriteFile;
 	ri.FS_FreeFileList = FS_FreeFileList;
 	ri.FS_ListFiles = FS_ListFiles;
@@ -115,15 +115,318 @@ gentity_t *G_CheckSpawnPoint( int spawnNum, vec3_t origin, vec3_t normal,
 
 /*
 ================
-G_FindProvider
+G_IsProvider
 
-Attempt to find power or creep for self; return qtrue and set self->parentNode if successful
+Check if a buildable can provide power or creep for others
 ================
 */
-qboolean G_FindProvider( gentity_t *self, qboolean searchUnspawned )
+static qboolean G_IsProvider( buildable_t buildable )
+{
+  return G_IsCore( buildable ) || buildable == BA_H_REPEATER ||
+         buildable == BA_A_SPAWN || BG_IsDPoint( buildable );
+}
+
+/*
+================
+G_AddProvider
+
+Add a new buildable to the list of providers, which is kept in entity number
+order so that G_FindProvider prefers providers in the same order as a scan
+of g_entities would
+================
+*/
+static void G_AddProvider( gentity_t *ent )
+{
+  int i;
+
+  if( !G_IsProvider( ent->s.modelindex ) )
+    return;
+
+  for( i = level.numProviders; i > 0 && level.providers[ i - 1 ] > ent; i-- )
+    level.providers[ i ] = level.providers[ i - 1 ];
+
+  level.providers[ i ] = ent;
+  level.numProviders++;
+}
+
+/*
+================
+G_SetParentNode
+
+Change the entity providing power or creep for self, moving the build points
+self draws from the old provider to the new one
+================
+*/
+void G_SetParentNode( gentity_t *self, gentity_t *parent )
+{
+  int buildPoints;
+
+  if( self->parentNode == parent )
+    return;
+
+  buildPoints = BG_Buildable( self->s.modelindex )->buildPoints;
+
+  if( self->parentNode )
+    self->parentNode->buildPointsDrawn[ self->buildableTeam ] -= buildPoints;
+
+  if( parent )
+    parent->buildPointsDrawn[ self->buildableTeam ] += buildPoints;
+
+  self->parentNode = parent;
+
+  G_AccountBuildable( self );
+}
+
+/*
+================
+G_BuildPointPool
+
+Find the pool the build points of a buildable are taken from
+================
+*/
+static int G_BuildPointPool( gentity_t *ent )
+{
+  gentity_t *power = ent->parentNode;
+
+  if( !power )
+    return BP_POOL_NONE;
+
+  if( !G_IsCore( power->s.modelindex ) && power->usesBuildPointZone )
+    return BP_POOL_ZONES + power->buildPointZone;
+  else if( ent->buildableTeam == TEAM_ALIENS )
+    return BP_POOL_ALIENS;
+  else if( ent->buildableTeam == TEAM_HUMANS )
+    return BP_POOL_HUMANS;
+
+  return BP_POOL_NONE;
+}
+
+/*
+================
+G_BuildPointsUsed
+
+Return the total of the build points used from a pool
+================
+*/
+static int *G_BuildPointsUsed( int pool )
+{
+  if( pool == BP_POOL_ALIENS )
+    return &level.alienBuildPointsUsed;
+  else if( pool == BP_POOL_HUMANS )
+    return &level.humanBuildPointsUsed;
+  else if( pool >= BP_POOL_ZONES && pool - BP_POOL_ZONES < g_zoneMax.integer )
+    return &level.buildPointZones[ pool - BP_POOL_ZONES ].usedBuildPoints;
+
+  return NULL;
+}
+
+/*
+================
+G_UnaccountBuildable
+
+Take a buildable out of the spawn counts and build point totals
+================
+*/
+static void G_UnaccountBuildable( gentity_t *ent )
+{
+  int *used;
+
+  if( ent->accountedSpawn )
+  {
+    if( ent->s.modelindex == BA_A_SPAWN )
+      level.numAlienSpawns--;
+    else if( ent->s.modelindex == BA_H_SPAWN )
+      level.numHumanSpawns--;
+
+    ent->accountedSpawn = qfalse;
+  }
+
+  if( ent->accountedZone && ent->accountedZone - 1 < g_zoneMax.integer )
+    level.buildPointZones[ ent->accountedZone - 1 ].numBuildables--;
+
+  ent->accountedZone = 0;
+
+  if( ( used = G_BuildPointsUsed( ent->buildPointPool ) ) )
+    *used -= BG_Buildable( ent->s.modelindex )->buildPoints;
+
+  ent->buildPointPool = BP_POOL_NONE;
+}
+
+/*
+================
+G_AccountBuildable
+
+Bring the spawn counts and build point totals up to date after something
+that decides what a buildable counts towards has changed
+================
+*/
+void G_AccountBuildable( gentity_t *ent )
+{
+  int *used;
+
+  G_UnaccountBuildable( ent );
+
+  if( !ent->inuse || ent->s.eType != ET_BUILDABLE )
+    return;
+
+  if( ent->health > 0 &&
+      ( ent->s.modelindex == BA_A_SPAWN || ent->s.modelindex == BA_H_SPAWN ) )
+  {
+    if( ent->s.modelindex == BA_A_SPAWN )
+      level.numAlienSpawns++;
+    else
+      level.numHumanSpawns++;
+
+    ent->accountedSpawn = qtrue;
+  }
+
+  // dead buildables don't use any build points
+  if( ent->s.eFlags & EF_DEAD )
+    return;
+
+  // a zone is active as long as the buildable owning it is
+  if( ent->usesBuildPointZone )
+  {
+    level.buildPointZones[ ent->buildPointZone ].numBuildables++;
+    ent->accountedZone = ent->buildPointZone + 1;
+  }
+
+  ent->buildPointPool = G_BuildPointPool( ent );
+
+  if( ( used = G_BuildPointsUsed( ent->buildPointPool ) ) )
+    *used += BG_Buildable( ent->s.modelindex )->buildPoints;
+}
+
+/*
+================
+G_AccountState
+
+Summarise everything that decides what a buildable counts towards, and
+whether others can draw power or creep from it
+================
+*/
+static int G_AccountState( gentity_t *ent )
+{
+  int state = 1;
+
+  if( ent->health > 0 )
+    state |= 2;
+
+  if( ent->s.eFlags & EF_DEAD )
+    state |= 4;
+
+  if( ent->spawned )
+    state |= 8;
+
+  if( ent->powered )
+    state |= 16;
+
+  state |= ent->dominationTeam << 5;
+
+  if( ent->usesBuildPointZone )
+    state |= 128 | ( ent->buildPointZone << 8 );
+
+  return state;
+}
+
+/*
+================
+G_CheckAccount
+
+Called whenever the state of a buildable may have changed; if it did, update
+what it counts towards and, for providers, let every buildable find its
+power or creep again like the old per frame recalculation did
+================
+*/
+void G_CheckAccount( gentity_t *self )
+{
+  int       i;
+  int       state = G_AccountState( self );
+  gentity_t *ent;
+
+  if( state == self->accountState )
+    return;
+
+  self->accountState = state;
+  G_AccountBuildable( self );
+
+  if( !G_IsProvider( self->s.modelindex ) )
+    return;
+
+  for( i = MAX_CLIENTS, ent = g_entities + i; i < level.num_entities; i++, ent++ )
+  {
+    if( ent->s.eType != ET_BUILDABLE || ent->s.eFlags & EF_DEAD )
+      continue;
+
+    if( ent->buildableTeam != self->buildableTeam && !BG_IsDPoint( self->s.modelindex ) )
+      continue;
+
+    G_FindProvider( ent, qfalse );
+
+    // the zone of the provider may have changed without the provider
+    if( ent->parentNode == self )
+      G_AccountBuildable( ent );
+  }
+}
+
+/*
+================
+G_RemoveBuildable
+
+Called when a buildable entity is freed, drop it from the provider list and
+the build point totals, and find new providers for everything it was
+providing for
+================
+*/
+void G_RemoveBuildable( gentity_t *ent )
+{
+  int       i;
+  gentity_t *other;
+
+  G_SetParentNode( ent, NULL );
+
+  // the entity is about to be cleared, make sure nothing can use it any more
+  ent->inuse = qfalse;
+  ent->health = 0;
+  ent->powered = qfalse;
+  G_AccountBuildable( ent );
+
+  if( !G_IsProvider( ent->s.modelindex ) )
+    return;
+
+  for( i = 0; i < level.numProviders; i++ )
+  {
+    if( level.providers[ i ] == ent )
+    {
+      level.numProviders--;
+      memmove( level.providers + i, level.providers + i + 1,
+               ( level.numProviders - i ) * sizeof( level.providers[ 0 ] ) );
+      break;
+    }
+  }
+
+  for( i = MAX_CLIENTS, other = g_entities + i; i < level.num_entities; i++, other++ )
+  {
+    if( other->s.eType == ET_BUILDABLE && other->parentNode == ent )
+    {
+      G_SetParentNode( other, NULL );
+      G_FindProvider( other, qfalse );
+    }
+  }
+}
+
+/*
+================
+G_SearchProvider
+
+Find the entity that would provide power or creep for self without changing
+anything, NULL if there is none
+================
+*/
+gentity_t *G_SearchProvider( gentity_t *self, qboolean searchUnspawned )
 {
   int       i, j;
-  gentity_t *ent, *ent2;
+  gentity_t *ent;
   gentity_t *closestProvider = NULL;
   int       distance = 0;
   int       minDistance = INFINITE, requiredDistance = REACTOR_BASESIZE;
@@ -134,26 +437,21 @@ qboolean G_FindProvider( gentity_t *self, qboolean searchUnspawned )
 
   // Core buildables are always powered
   if( G_IsCore( self->s.modelindex ) )
-  {
-    self->parentNode = self;
-
-    return qtrue;
-  }
+    return self;
 
   // Handle power buildables
   if( self->s.modelindex == BA_A_SPAWN || self->s.modelindex == BA_H_REPEATER || BG_IsDPoint( self->s.modelindex ) )
   {
     if( self->buildableTeam == TEAM_ALIENS )
-      return ( self->parentNode = G_Overmind( ) ) != NULL;
+      return G_Overmind( );
     else
-      return ( self->parentNode = G_Reactor( )  ) != NULL;
+      return G_Reactor( );
   }
 
-  // Iterate through entities
-  for( i = MAX_CLIENTS, ent = g_entities + i; i < level.num_entities; i++, ent++ )
+  // Iterate through providers
+  for( i = 0; i < level.numProviders; i++ )
   {
-    if( ent->s.eType != ET_BUILDABLE )
-      continue;
+    ent = level.providers[ i ];
 
     if( self->buildableTeam != ent->buildableTeam  && !BG_IsDPoint( ent->s.modelindex ) )
       continue;
@@ -181,9 +479,8 @@ qboolean G_FindProvider( gentity_t *self, qboolean searchUnspawned )
         break;
     }
 
-    // If entity is a providing item calculate the distance to it
-    if( ( G_IsCore( ent->s.modelindex ) || ent->s.modelindex == BA_H_REPEATER || ent->s.modelindex == BA_A_SPAWN || BG_IsDPoint( ent->s.modelindex ) ) &&
-        ( searchUnspawned || ent->spawned ) && ent->powered && ent->health > 0 )
+    // If entity is a usable provider calculate the distance to it
+    if( ( searchUnspawned || ent->spawned ) && ent->powered && ent->health > 0 )
     {
       VectorSubtract( self->s.origin, ent->s.origin, temp_v );
       distance = VectorLength( temp_v );
@@ -198,27 +495,11 @@ qboolean G_FindProvider( gentity_t *self, qboolean searchUnspawned )
 
           buildPoints *= buildPointModifier;
 
-          // Scan the buildables in the same zone and look at the BP remaining
-          for( j = MAX_CLIENTS, ent2 = g_entities + j; j < level.num_entities; j++, ent2++ )
-          {
-            gentity_t *powerEntity;
+          // Look at the BP remaining after the buildables of our team in the same zone
+          buildPoints -= ent->buildPointsDrawn[ self->buildableTeam ];
 
-            if( ent2->s.eType != ET_BUILDABLE )
-              continue;
-
-            if( ent2->buildableTeam != self->buildableTeam )
-              continue;
-
-            if( ent2 == self )
-              continue;
-
-            powerEntity = ent2->parentNode;
-
-            if( powerEntity && powerEntity == ent )
-            {
-              buildPoints -= BG_Buildable( ent2->s.modelindex )->buildPoints;
-            }
-          }
+          if( self->parentNode == ent )
+            buildPoints += BG_Buildable( self->s.modelindex )->buildPoints;
 
           buildPoints -= ent->buildableTeam == TEAM_ALIENS ? level.alienBuildPointQueue : level.humanBuildPointQueue;
 
@@ -227,9 +508,7 @@ qboolean G_FindProvider( gentity_t *self, qboolean searchUnspawned )
           if( buildPoints >= 0 || DOMINATION_ALWAYS_POWER )
           {
             // Return immediately
-            self->parentNode = ent;
-
-            return qtrue;
+            return ent;
           }
           else
           {
@@ -247,24 +526,12 @@ qboolean G_FindProvider( gentity_t *self, qboolean searchUnspawned )
 
           buildPoints *= buildPointModifier;
 
-          // Scan the buildables in the same zone
-          for( j = MAX_CLIENTS, ent2 = g_entities + j; j < level.num_entities; j++, ent2++ )
-          {
-            gentity_t *powerEntity;
-
-            if( ent2->s.eType != ET_BUILDABLE )
-              continue;
+          // Subtract the buildables in the same zone
+          for( j = 0; j < NUM_TEAMS; j++ )
+            buildPoints -= ent->buildPointsDrawn[ j ];
 
-            if( ent2 == self )
-              continue;
-
-            powerEntity = ent2->parentNode;
-
-            if( powerEntity && powerEntity == ent )
-            {
-              buildPoints -= BG_Buildable( ent2->s.modelindex )->buildPoints;
-            }
-          }
+          if( self->parentNode == ent )
+            buildPoints += BG_Buildable( self->s.modelindex )->buildPoints;
 
           if( self->usesBuildPointZone && level.buildPointZones[ ent->buildPointZone ].active )
             buildPoints -= level.buildPointZones[ ent->buildPointZone ].queuedBuildPoints;
@@ -287,7 +554,20 @@ qboolean G_FindProvider( gentity_t *self, qboolean searchUnspawned )
     }
   }
 
-  self->parentNode = closestProvider;
+  return closestProvider;
+}
+
+/*
+================
+G_FindProvider
+
+Attempt to find power or creep for self; return qtrue and set self->parentNode if successful
+================
+*/
+qboolean G_FindProvider( gentity_t *self, qboolean searchUnspawned )
+{
+  G_SetParentNode( self, G_SearchProvider( self, searchUnspawned ) );
+
   return self->parentNode != NULL;
 }
 
@@ -295,7 +575,7 @@ qboolean G_FindProvider( gentity_t *self, qboolean searchUnspawned )
 ================
 G_ProvidingEntityForPoint
 
-Simple wrapper to G_ProvidingEntityForEntity to find the entity providing
+Simple wrapper to G_SearchProvider to find the entity providing
 power for the specified point
 ================
 */
@@ -303,13 +583,14 @@ gentity_t *G_ProvidingEntityForPoint( const vec3_t origin, team_t team )
 {
   gentity_t dummy;
 
+  memset( &dummy, 0, sizeof( dummy ) );
   dummy.parentNode = NULL;
   dummy.buildableTeam = team;
   dummy.s.modelindex = BA_NONE;
   dummy.s.eType      = ET_BUILDABLE;
   VectorCopy( origin, dummy.s.origin );
 
-  return G_ProvidingEntityForEntity( &dummy );
+  return G_SearchProvider( &dummy, qfalse );
 }
 
 /*
@@ -664,6 +945,7 @@ void AGeneric_CreepRecede( gentity_t *self )
   if( !( self->s.eFlags & EF_DEAD ) )
   {
     self->s.eFlags |= EF_DEAD;
+    G_CheckAccount( self );
     G_QueueBuildPoints( self );
 
     G_RewardAttackers( self );
@@ -1757,6 +2039,7 @@ void HRepeater_Think( gentity_t *self )
 
         self->buildPointZone = zone - level.buildPointZones;
         self->usesBuildPointZone = qtrue;
+        G_CheckAccount( self );
 
         break;
       }
@@ -2178,7 +2461,7 @@ void Domination_Think( gentity_t *self )
       // We need to update all buildings depending on us for power/creep
       for( i = 0, ent = g_entities + i; i < level.num_entities; i++, ent++ )
         if( ent->parentNode == self )
-          ent->parentNode = NULL;
+          G_SetParentNode( ent, NULL );
 
       // free build point zone
       if( self->usesBuildPointZone )
@@ -2189,6 +2472,8 @@ void Domination_Think( gentity_t *self )
         self->usesBuildPointZone = qfalse;
       }
 
+      G_CheckAccount( self );
+
       // update all zones
       for( i = 0; i < g_zoneMax.integer; i++ )
       {
@@ -3079,6 +3364,8 @@ void G_BuildableThink( gentity_t *ent, int msec )
       }
     }
   }
+
+  G_CheckAccount( ent );
 }
 
 
@@ -3099,6 +3386,8 @@ void G_BuildableDie( gentity_t *ent )
     zone->active = qfalse;
     ent->usesBuildPointZone = qfalse;
   }
+
+  G_CheckAccount( ent );
 }
 
 
@@ -3867,6 +4156,7 @@ static gentity_t *G_Build( gentity_t *builder, buildable_t buildable, vec3_t ori
   built->classname = BG_Buildable( buildable )->entityName;
   built->s.modelindex = buildable;
   built->buildableTeam = built->s.modelindex2 = BG_Buildable( buildable )->team;
+  G_AddProvider( built );
   BG_BuildableBoundingBox( buildable, built->r.mins, built->r.maxs );
 
   // detect the buildable's normal vector
@@ -4124,6 +4414,8 @@ static gentity_t *G_Build( gentity_t *builder, buildable_t buildable, vec3_t ori
   if( log )
     G_BuildLogSet( log, built );
 
+  G_CheckAccount( built );
+
   return built;
 }
 
@@ -1171,63 +1171,101 @@ void G_Damage( gentity_t *targ, gentity_t *inflictor, gentity_t *attacker,
 }
 
 
+#define CANDAMAGE_CORNERS 4
+
+// offsets from the midpoint of the target tried when the midpoint is blocked,
+// this should probably check in the plane of projection, rather than in world
+// coordinate, and also include Z
+static const float canDamageCorners[ CANDAMAGE_CORNERS ][ 2 ] =
+{
+  { 15.0f, 15.0f }, { 15.0f, -15.0f }, { -15.0f, 15.0f }, { -15.0f, -15.0f }
+};
+
+/*
+============
+G_CanDamageRequest
+============
+*/
+static void G_CanDamageRequest( traceRequest_t *req, vec3_t origin,
+                                vec3_t midpoint, float dx, float dy )
+{
+  VectorCopy( origin, req->start );
+  VectorClear( req->mins );
+  VectorClear( req->maxs );
+  VectorCopy( midpoint, req->end );
+  req->end[ 0 ] += dx;
+  req->end[ 1 ] += dy;
+  req->passEntityNum = ENTITYNUM_NONE;
+  req->contentmask = MASK_SOLID;
+}
+
 /*
 ============
 CanDamage
 
 Returns qtrue if the inflictor can directly damage the target.  Used for
-explosions and melee attacks.
+explosions and melee attacks.  The corners are only needed when the
+midpoint is blocked, they are traced together in one batch.
 ============
 */
 qboolean CanDamage( gentity_t *targ, vec3_t origin )
 {
-  vec3_t  dest;
-  trace_t tr;
-  vec3_t  midpoint;
+  vec3_t          midpoint;
+  traceRequest_t  requests[ CANDAMAGE_CORNERS ];
+  trace_t         results[ CANDAMAGE_CORNERS ];
+  int             i;
 
   // use the midpoint of the bounds instead of the origin, because
   // bmodels may have their origin is 0,0,0
   VectorAdd( targ->r.absmin, targ->r.absmax, midpoint );
   VectorScale( midpoint, 0.5, midpoint );
 
-  VectorCopy( midpoint, dest );
-  trap_Trace( &tr, origin, vec3_origin, vec3_origin, dest, ENTITYNUM_NONE, MASK_SOLID );
-  if( tr.fraction == 1.0  || tr.entityNum == targ->s.number )
-    return qtrue;
-
-  // this should probably check in the plane of projection,
-  // rather than in world coordinate, and also include Z
-  VectorCopy( midpoint, dest );
-  dest[ 0 ] += 15.0;
-  dest[ 1 ] += 15.0;
-  trap_Trace( &tr, origin, vec3_origin, vec3_origin, dest, ENTITYNUM_NONE, MASK_SOLID );
-  if( tr.fraction == 1.0 )
+  trap_Trace( &results[ 0 ], origin, vec3_origin, vec3_origin, midpoint, ENTITYNUM_NONE, MASK_SOLID );
+  if( results[ 0 ].fraction == 1.0f || results[ 0 ].entityNum == targ->s.number )
     return qtrue;
 
-  VectorCopy( midpoint, dest );
-  dest[ 0 ] += 15.0;
-  dest[ 1 ] -= 15.0;
-  trap_Trace( &tr, origin, vec3_origin, vec3_origin, dest, ENTITYNUM_NONE, MASK_SOLID );
-  if( tr.fraction == 1.0 )
-    return qtrue;
+  for( i = 0; i < CANDAMAGE_CORNERS; i++ )
+  {
+    G_CanDamageRequest( &requests[ i ], origin, midpoint,
+                        canDamageCorners[ i ][ 0 ], canDamageCorners[ i ][ 1 ] );
+  }
 
-  VectorCopy( midpoint, dest );
-  dest[ 0 ] -= 15.0;
-  dest[ 1 ] += 15.0;
-  trap_Trace( &tr, origin, vec3_origin, vec3_origin, dest, ENTITYNUM_NONE, MASK_SOLID );
-  if( tr.fraction == 1.0 )
-    return qtrue;
+  trap_TraceBatch( results, requests, CANDAMAGE_CORNERS );
 
-  VectorCopy( midpoint, dest );
-  dest[ 0 ] -= 15.0;
-  dest[ 1 ] -= 15.0;
-  trap_Trace( &tr, origin, vec3_origin, vec3_origin, dest, ENTITYNUM_NONE, MASK_SOLID );
-  if( tr.fraction == 1.0 )
-    return qtrue;
+  for( i = 0; i < CANDAMAGE_CORNERS; i++ )
+  {
+    if( results[ i ].fraction == 1.0f )
+      return qtrue;
+  }
 
   return qfalse;
 }
 
+/*
+============
+G_RadiusDistance
+
+Distance from origin to the edge of the bounding box of ent
+============
+*/
+static float G_RadiusDistance( gentity_t *ent, vec3_t origin )
+{
+  vec3_t  v;
+  int     i;
+
+  for( i = 0; i < 3; i++ )
+  {
+    if( origin[ i ] < ent->r.absmin[ i ] )
+      v[ i ] = ent->r.absmin[ i ] - origin[ i ];
+    else if( origin[ i ] > ent->r.absmax[ i ] )
+      v[ i ] = origin[ i ] - ent->r.absmax[ i ];
+    else
+      v[ i ] = 0;
+  }
+
+  return VectorLength( v );
+}
+
 /*
 ============
 G_SelectiveRadiusDamage
@@ -1241,7 +1279,6 @@ qboolean G_SelectiveRadiusDamage( vec3_t origin, gentity_t *attacker, float dama
   int       entityList[ MAX_GENTITIES ];
   int       numListedEntities;
   vec3_t    mins, maxs;
-  vec3_t    v;
   vec3_t    dir;
   int       i, e;
   qboolean  hitClient = qfalse;
@@ -1257,6 +1294,8 @@ qboolean G_SelectiveRadiusDamage( vec3_t origin, gentity_t *attacker, float dama
 
   numListedEntities = trap_EntitiesInBox( mins, maxs, entityList, MAX_GENTITIES );
 
+  // each target is checked when it is reached, damage dealt to an earlier
+  // one can kill or move it or whatever was blocking the line of sight
   for( e = 0; e < numListedEntities; e++ )
   {
     ent = &g_entities[ entityList[ e ] ];
@@ -1270,34 +1309,25 @@ qboolean G_SelectiveRadiusDamage( vec3_t origin, gentity_t *attacker, float dama
     if( ent->flags & FL_NOTARGET )
       continue;
 
-    // find the distance from the edge of the bounding box
-    for( i = 0 ; i < 3 ; i++ )
-    {
-      if( origin[ i ] < ent->r.absmin[ i ] )
-        v[ i ] = ent->r.absmin[ i ] - origin[ i ];
-      else if( origin[ i ] > ent->r.absmax[ i ] )
-        v[ i ] = origin[ i ] - ent->r.absmax[ i ];
-      else
-        v[ i ] = 0;
-    }
+    if( !ent->client || ent->client->ps.stats[ STAT_TEAM ] == team )
+      continue;
 
-    dist = VectorLength( v );
+    dist = G_RadiusDistance( ent, origin );
     if( dist >= radius )
       continue;
 
+    if( !CanDamage( ent, origin ) )
+      continue;
+
     points = damage * ( 1.0 - dist / radius );
 
-    if( CanDamage( ent, origin ) && ent->client &&
-        ent->client->ps.stats[ STAT_TEAM ] != team )
-    {
-      VectorSubtract( ent->r.currentOrigin, origin, dir );
-      // push the center of mass higher than the origin so players
-      // get knocked into the air more
-      dir[ 2 ] += 24;
-      hitClient = qtrue;
-      G_Damage( ent, NULL, attacker, dir, origin,
-          (int)points, DAMAGE_RADIUS|DAMAGE_NO_LOCDAMAGE, mod );
-    }
+    VectorSubtract( ent->r.currentOrigin, origin, dir );
+    // push the center of mass higher than the origin so players
+    // get knocked into the air more
+    dir[ 2 ] += 24;
+    hitClient = qtrue;
+    G_Damage( ent, NULL, attacker, dir, origin,
+        (int)points, DAMAGE_RADIUS|DAMAGE_NO_LOCDAMAGE, mod );
   }
 
   return hitClient;
@@ -1317,7 +1347,6 @@ qboolean G_RadiusDamage( vec3_t origin, gentity_t *attacker, float damage,
   int       entityList[ MAX_GENTITIES ];
   int       numListedEntities;
   vec3_t    mins, maxs;
-  vec3_t    v;
   vec3_t    dir;
   int       i, e;
   qboolean  hitClient = qfalse;
@@ -1333,6 +1362,8 @@ qboolean G_RadiusDamage( vec3_t origin, gentity_t *attacker, float damage,
 
   numListedEntities = trap_EntitiesInBox( mins, maxs, entityList, MAX_GENTITIES );
 
+  // each target is checked when it is reached, damage dealt to an earlier
+  // one can kill or move it or whatever was blocking the line of sight
   for( e = 0; e < numListedEntities; e++ )
   {
     ent = &g_entities[ entityList[ e ] ];
@@ -1343,33 +1374,22 @@ qboolean G_RadiusDamage( vec3_t origin, gentity_t *attacker, float damage,
     if( !ent->takedamage )
       continue;
 
-    // find the distance from the edge of the bounding box
-    for( i = 0; i < 3; i++ )
-    {
-      if( origin[ i ] < ent->r.absmin[ i ] )
-        v[ i ] = ent->r.absmin[ i ] - origin[ i ];
-      else if( origin[ i ] > ent->r.absmax[ i ] )
-        v[ i ] = origin[ i ] - ent->r.absmax[ i ];
-      else
-        v[ i ] = 0;
-    }
-
-    dist = VectorLength( v );
+    dist = G_RadiusDistance( ent, origin );
     if( dist >= radius )
       continue;
 
+    if( !CanDamage( ent, origin ) )
+      continue;
+
     points = damage * ( 1.0 - dist / radius );
 
-    if( CanDamage( ent, origin ) )
-    {
-      VectorSubtract( ent->r.currentOrigin, origin, dir );
-      // push the center of mass higher than the origin so players
-      // get knocked into the air more
-      dir[ 2 ] += 24;
-      hitClient = qtrue;
-      G_Damage( ent, NULL, attacker, dir, origin,
-          (int)points, DAMAGE_RADIUS|DAMAGE_NO_LOCDAMAGE, mod );
-    }
+    VectorSubtract( ent->r.currentOrigin, origin, dir );
+    // push the center of mass higher than the origin so players
+    // get knocked into the air more
+    dir[ 2 ] += 24;
+    hitClient = qtrue;
+    G_Damage( ent, NULL, attacker, dir, origin,
+        (int)points, DAMAGE_RADIUS|DAMAGE_NO_LOCDAMAGE, mod );
   }
 
   return hitClient;
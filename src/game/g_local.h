@@ -196,7 +196,12 @@ struct gentity_s
   stage_t           stageStage;
 
   team_t            buildableTeam;      // buildable item team
-  gentity_t         *parentNode;        // for creep and defence/spawn dependencies
+  gentity_t         *parentNode;        // for creep and defence/spawn dependencies, see G_SetParentNode
+  int               buildPointsDrawn[ NUM_TEAMS ]; // BP of the buildables this one provides for
+  int               accountState;       // state last seen by G_CheckAccount
+  int               buildPointPool;     // BP_POOL_* the BP of this buildable are counted in
+  int               accountedZone;      // zone + 1 this buildable is counted as active in
+  qboolean          accountedSpawn;     // counted in level.num*Spawns
   qboolean          active;             // for power repeater, but could be useful elsewhere
   qboolean          locked;             // used for turret tracking
   qboolean          powered;            // for human buildables
@@ -480,11 +485,20 @@ typedef struct
   int    active;
 
   int    totalBuildPoints;
+  int    usedBuildPoints;   // by the buildables powered from this zone
   int    queuedBuildPoints;
   int    nextQueueTime;
   team_t team;
+
+  int    numBuildables;     // live buildables owning this zone
 } buildPointZone_t;
 
+// where the build points of a buildable are counted, zones follow BP_POOL_ZONES
+#define BP_POOL_NONE    0
+#define BP_POOL_ALIENS  1
+#define BP_POOL_HUMANS  2
+#define BP_POOL_ZONES   3
+
 // store locational damage regions
 typedef struct damageRegion_s
 {
@@ -623,9 +637,11 @@ typedef struct
   int               numLiveHumanClients;
 
   int               alienBuildPoints;
+  int               alienBuildPointsUsed;
   int               alienBuildPointQueue;
   int               alienNextQueueTime;
   int               humanBuildPoints;
+  int               humanBuildPointsUsed;
   int               humanBuildPointQueue;
   int               humanNextQueueTime;
 
@@ -633,6 +649,9 @@ typedef struct
 
   int               dominationPoints[ NUM_TEAMS ];
 
+  gentity_t         *providers[ MAX_GENTITIES ];  // power and creep buildables by entity number
+  int               numProviders;
+
   gentity_t         *markedBuildables[ MAX_GENTITIES ];
   int               numBuildablesForRemoval;
 
@@ -656,6 +675,7 @@ typedef struct
   int               alienStage3Time;
   int               humanStage2Time;
   int               humanStage3Time;
+  char              stagesConfigstring[ NUM_TEAMS ][ MAX_QPATH ]; // last sent CS_*_STAGES
 
   qboolean          uncondAlienWin;
   qboolean          uncondHumanWin;
@@ -806,7 +826,12 @@ void              G_BaseSelfDestruct( team_t team );
 int               G_NextQueueTime( int queuedBP, int totalBP, int queueBaseRate );
 void              G_QueueBuildPoints( gentity_t *self );
 int               G_GetBuildPoints( const vec3_t pos, team_t team, int dist );
+gentity_t         *G_SearchProvider( gentity_t *self, qboolean searchUnspawned );
 qboolean          G_FindProvider( gentity_t *self, qboolean searchUnspawned );
+void              G_SetParentNode( gentity_t *self, gentity_t *parent );
+void              G_RemoveBuildable( gentity_t *ent );
+void              G_AccountBuildable( gentity_t *ent );
+void              G_CheckAccount( gentity_t *self );
 gentity_t         *G_ProvidingEntityForPoint( const vec3_t origin, team_t team );
 gentity_t         *G_ProvidingEntityForEntity( gentity_t *ent );
 gentity_t         *G_RepeaterEntityForPoint( vec3_t origin );
@@ -1128,6 +1153,7 @@ extern  vmCvar_t  g_zoneHumanBuildPoints;
 extern  vmCvar_t  g_zoneAlienBuildQueueTime;
 extern  vmCvar_t  g_zoneHumanBuildQueueTime;
 extern  vmCvar_t  g_zoneMax;
+extern  vmCvar_t  g_verifyBuildPoints;
 extern  vmCvar_t  g_humanStage;
 extern  vmCvar_t  g_humanCredits;
 extern  vmCvar_t  g_humanMaxStage;
@@ -1217,6 +1243,7 @@ void      trap_GetServerinfo( char *buffer, int bufferSize );
 void      trap_SetBrushModel( gentity_t *ent, const char *name );
 void      trap_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs,
                       const vec3_t end, int passEntityNum, int contentmask );
+void      trap_TraceBatch( trace_t *results, const traceRequest_t *requests, int count );
 int       trap_PointContents( const vec3_t point, int passEntityNum );
 qboolean  trap_InPVS( const vec3_t p1, const vec3_t p2 );
 qboolean  trap_InPVSIgnorePortals( const vec3_t p1, const vec3_t p2 );
@@ -83,6 +83,7 @@ vmCvar_t  g_zoneHumanBuildPoints;
 vmCvar_t  g_zoneAlienBuildQueueTime;
 vmCvar_t  g_zoneHumanBuildQueueTime;
 vmCvar_t  g_zoneMax;
+vmCvar_t  g_verifyBuildPoints;
 vmCvar_t  g_humanStage;
 vmCvar_t  g_humanCredits;
 vmCvar_t  g_humanMaxStage;
@@ -212,6 +213,7 @@ static cvarTable_t   gameCvarTable[ ] =
   { &g_zoneAlienBuildQueueTime, "g_zoneAlienBuildQueueTime", DEFAULT_ALIEN_ZONE_QUEUE_TIME, CVAR_ARCHIVE, 0, qfalse  },
   { &g_zoneHumanBuildQueueTime, "g_zoneHumanBuildQueueTime", DEFAULT_HUMAN_ZONE_QUEUE_TIME, CVAR_ARCHIVE, 0, qfalse  },
   { &g_zoneMax, "g_zoneMax", "1024", CVAR_ARCHIVE, 0, qfalse  },
+  { &g_verifyBuildPoints, "g_verifyBuildPoints", "0", CVAR_CHEAT, 0, qfalse  },
   { &g_humanStage, "g_humanStage", "0", 0, 0, qfalse  },
   { &g_humanCredits, "g_humanCredits", "0", 0, 0, qfalse  },
   { &g_humanMaxStage, "g_humanMaxStage", DEFAULT_HUMAN_MAX_STAGE, 0, 0, qfalse  },
@@ -278,7 +280,6 @@ void G_RunFrame( int levelTime );
 void G_ShutdownGame( int restart );
 void CheckExitRules( void );
 
-void G_CountSpawns( void );
 void G_CalculateBuildPoints( void );
 
 /*
@@ -637,9 +638,6 @@ void G_InitGame( int levelTime, int randomSeed, int restart )
 
   G_Printf( "-----------------------------------\n" );
 
-  // So the server counts the spawns without a client attached
-  G_CountSpawns( );
-
   G_UpdateTeamConfigStrings( );
   
   if( g_lockTeamsAtStart.integer )
@@ -1025,34 +1023,6 @@ void G_SpawnClients( team_t team )
   }
 }
 
-/*
-============
-G_CountSpawns
- 
-Counts the number of spawns for each team
-============
-*/
-void G_CountSpawns( void )
-{
-  int i;
-  gentity_t *ent;
-
-  level.numAlienSpawns = 0;
-  level.numHumanSpawns = 0;
-  for( i = 1, ent = g_entities + i ; i < level.num_entities ; i++, ent++ )
-  {
-    if( !ent->inuse || ent->s.eType != ET_BUILDABLE || ent->health <= 0 )
-      continue;
-
-    if( ent->s.modelindex == BA_A_SPAWN )
-      level.numAlienSpawns++;
-
-    if( ent->s.modelindex == BA_H_SPAWN )
-      level.numHumanSpawns++;
-  }
-}
-
-
 /*
 ============
 G_TimeTilSuddenDeath
@@ -1071,6 +1041,97 @@ int G_TimeTilSuddenDeath( void )
 
 #define PLAYER_COUNT_MOD 5.0f
 
+/*
+============
+G_VerifyBuildPoints
+
+Debug check of the spawn counts and BP totals kept by G_AccountBuildable:
+recount them from scratch and search the provider of every buildable again,
+the way it used to be done every frame, only reporting what differs.  A
+buildable only looks for a provider again when something it depends on
+changes or it thinks, so one that could use a provider only since the BP
+queue drained shows up until then.
+============
+*/
+static void G_VerifyBuildPoints( void )
+{
+  static int        *zoneUsed;
+  static int        zoneUsedSize;
+  int               i;
+  int               numAlienSpawns = 0, numHumanSpawns = 0;
+  int               alienUsed = 0, humanUsed = 0;
+  gentity_t         *ent, *power;
+  buildPointZone_t  *zone;
+
+  if( zoneUsedSize != g_zoneMax.integer )
+  {
+    if( zoneUsed )
+      BG_Free( zoneUsed );
+
+    zoneUsedSize = g_zoneMax.integer;
+    zoneUsed = BG_Alloc( 2 * zoneUsedSize * sizeof( int ) );
+  }
+
+  memset( zoneUsed, 0, 2 * zoneUsedSize * sizeof( int ) );
+
+  for( i = 1, ent = g_entities + i; i < level.num_entities; i++, ent++ )
+  {
+    if( !ent->inuse || ent->s.eType != ET_BUILDABLE )
+      continue;
+
+    if( ent->health > 0 )
+    {
+      if( ent->s.modelindex == BA_A_SPAWN )
+        numAlienSpawns++;
+
+      if( ent->s.modelindex == BA_H_SPAWN )
+        numHumanSpawns++;
+    }
+
+    if( ent->s.eFlags & EF_DEAD )
+      continue;
+
+    if( ent->usesBuildPointZone )
+      zoneUsed[ 2 * ent->buildPointZone + 1 ]++;
+
+    if( G_SearchProvider( ent, qfalse ) != ent->parentNode )
+      G_Printf( S_COLOR_YELLOW "WARNING: buildable %d is using the wrong provider\n", i );
+
+    // the totals have to match the providers the buildables are using
+    power = ent->parentNode;
+
+    if( power )
+    {
+      int cost = BG_Buildable( ent->s.modelindex )->buildPoints;
+
+      if( !G_IsCore( power->s.modelindex ) && power->usesBuildPointZone )
+        zoneUsed[ 2 * power->buildPointZone ] += cost;
+      else if( ent->buildableTeam == TEAM_ALIENS )
+        alienUsed += cost;
+      else if( ent->buildableTeam == TEAM_HUMANS )
+        humanUsed += cost;
+    }
+  }
+
+  if( numAlienSpawns != level.numAlienSpawns || numHumanSpawns != level.numHumanSpawns )
+    G_Printf( S_COLOR_YELLOW "WARNING: spawn counts are %d/%d, should be %d/%d\n",
+              level.numAlienSpawns, level.numHumanSpawns, numAlienSpawns, numHumanSpawns );
+
+  if( alienUsed != level.alienBuildPointsUsed || humanUsed != level.humanBuildPointsUsed )
+    G_Printf( S_COLOR_YELLOW "WARNING: used BP are %d/%d, should be %d/%d\n",
+              level.alienBuildPointsUsed, level.humanBuildPointsUsed, alienUsed, humanUsed );
+
+  for( i = 0; i < g_zoneMax.integer; i++ )
+  {
+    zone = &level.buildPointZones[ i ];
+
+    if( zone->usedBuildPoints != zoneUsed[ 2 * i ] ||
+        zone->numBuildables != zoneUsed[ 2 * i + 1 ] )
+      G_Printf( S_COLOR_YELLOW "WARNING: zone %d uses %d BP with %d buildables, should be %d with %d\n",
+                i, zone->usedBuildPoints, zone->numBuildables, zoneUsed[ 2 * i ], zoneUsed[ 2 * i + 1 ] );
+  }
+}
+
 /*
 ============
 G_CalculateBuildPoints
@@ -1118,92 +1179,44 @@ void G_CalculateBuildPoints( void )
     level.suddenDeathWarning = TW_IMMINENT;
   }
 
-  level.alienBuildPoints = DOMINATION_SCALE_BP( TEAM_ALIENS ) * g_alienBuildPoints.integer - level.alienBuildPointQueue;
-  level.humanBuildPoints = DOMINATION_SCALE_BP( TEAM_HUMANS ) * g_humanBuildPoints.integer - level.humanBuildPointQueue;
+  if( g_verifyBuildPoints.integer )
+    G_VerifyBuildPoints( );
 
-  // Reset buildPointZones
+  // The BP used by the buildables are kept up to date by G_AccountBuildable
+  level.alienBuildPoints = DOMINATION_SCALE_BP( TEAM_ALIENS ) * g_alienBuildPoints.integer -
+    level.alienBuildPointQueue - level.alienBuildPointsUsed;
+  level.humanBuildPoints = DOMINATION_SCALE_BP( TEAM_HUMANS ) * g_humanBuildPoints.integer -
+    level.humanBuildPointQueue - level.humanBuildPointsUsed;
+
+  // Update buildPointZones and their queues
   for( i = 0; i < g_zoneMax.integer; i++ )
   {
-    buildPointZone_t *zone  = &level.buildPointZones[ i ];
+    zone = &level.buildPointZones[ i ];
 
-    zone->active = qfalse;
+    zone->active = zone->numBuildables > 0;
     zone->totalBuildPoints = DOMINATION_SCALE_BP( zone->team ) *
-      ( zone->team == TEAM_ALIENS ? g_zoneAlienBuildPoints.integer : g_zoneHumanBuildPoints.integer );
-  }
-
-  // Iterate through entities
-  for( i = MAX_CLIENTS; i < level.num_entities; i++ )
-  {
-    gentity_t         *ent = &g_entities[ i ], *power;
-    buildPointZone_t  *zone;
-    buildable_t       buildable;
-    int               cost;
+      ( zone->team == TEAM_ALIENS ? g_zoneAlienBuildPoints.integer : g_zoneHumanBuildPoints.integer ) -
+      zone->usedBuildPoints;
 
-    if( ent->s.eType != ET_BUILDABLE || ent->s.eFlags & EF_DEAD )
+    if( !zone->active )
       continue;
 
-    // mark a zone as active
-    if( ent->usesBuildPointZone )
+    if( G_TimeTilSuddenDeath( ) > 0 )
     {
-      assert( ent->buildPointZone >= 0 && ent->buildPointZone < g_zoneMax.integer );
-
-      zone = &level.buildPointZones[ ent->buildPointZone ];
-      zone->active = qtrue;
-    }
-
-    // Subtract the BP from the appropriate pool
-    buildable = ent->s.modelindex;
-    cost = BG_Buildable( buildable )->buildPoints;
-
-    power = G_ProvidingEntityForEntity( ent );
-
-    if( power )
-    {
-      if( !G_IsCore( power->s.modelindex ) && power->usesBuildPointZone )
+      // BP queue updates
+      while( zone->queuedBuildPoints > 0 &&
+             zone->nextQueueTime < level.time )
       {
-        level.buildPointZones[ power->buildPointZone ].totalBuildPoints -= cost;
-      }
-      else if( ent->buildableTeam == TEAM_ALIENS )
-      {
-        level.alienBuildPoints -= cost;
-      }
-      else if( ent->buildableTeam == TEAM_HUMANS )
-      {
-        level.humanBuildPoints -= cost;
+        zone->nextQueueTime += G_NextQueueTime( zone->queuedBuildPoints,
+            zone->totalBuildPoints,
+            DOMINATION_SCALE_BPQUEUE_PERIOD( zone->team ) * ( zone->team == TEAM_ALIENS ? g_zoneAlienBuildQueueTime.integer : g_zoneHumanBuildQueueTime.integer ) );
+
+        zone->queuedBuildPoints--;
       }
     }
-  }
-
-  // Finally, update repeater zones and their queues
-  // note that this has to be done after the used BP is calculated
-  for( i = MAX_CLIENTS; i < level.num_entities; i++ )
-  {
-    gentity_t *ent = &g_entities[ i ];
-
-    if( ent->s.eType != ET_BUILDABLE || ent->s.eFlags & EF_DEAD )
-      continue;
-
-    if( ent->usesBuildPointZone && level.buildPointZones[ ent->buildPointZone ].active )
+    else
     {
-      zone = &level.buildPointZones[ ent->buildPointZone ];
-
-      if( G_TimeTilSuddenDeath( ) > 0 )
-      {
-        // BP queue updates
-        while( zone->queuedBuildPoints > 0 &&
-               zone->nextQueueTime < level.time )
-        {
-          zone->nextQueueTime += G_NextQueueTime( zone->queuedBuildPoints,
-              zone->totalBuildPoints,
-              DOMINATION_SCALE_BPQUEUE_PERIOD( zone->team ) * ( zone->team == TEAM_ALIENS ? g_zoneAlienBuildQueueTime.integer : g_zoneHumanBuildQueueTime.integer ) );
-
-          zone->queuedBuildPoints--;
-        }
-      }
-      else
-      {
-        zone->totalBuildPoints = zone->queuedBuildPoints = 0;
-      }
+      zone->totalBuildPoints = zone->queuedBuildPoints = 0;
     }
   }
 
@@ -1214,6 +1227,23 @@ void G_CalculateBuildPoints( void )
     level.alienBuildPoints = 0;
 }
 
+/*
+============
+G_SetStagesConfigstring
+
+Only send the stages of a team to the server when they have changed
+============
+*/
+static void G_SetStagesConfigstring( team_t team, const char *stages )
+{
+  if( !strcmp( level.stagesConfigstring[ team ], stages ) )
+    return;
+
+  Q_strncpyz( level.stagesConfigstring[ team ], stages,
+              sizeof( level.stagesConfigstring[ team ] ) );
+  trap_SetConfigstring( team == TEAM_ALIENS ? CS_ALIEN_STAGES : CS_HUMAN_STAGES, stages );
+}
+
 /*
 ============
 G_CalculateStages
@@ -1318,11 +1348,11 @@ void G_CalculateStages( void )
   if( humanNextStageThreshold > 0 )
     humanNextStageThreshold = ceil( (float)humanNextStageThreshold / 100 ) * 100;
 
-  trap_SetConfigstring( CS_ALIEN_STAGES, va( "%d %d %d",
+  G_SetStagesConfigstring( TEAM_ALIENS, va( "%d %d %d",
         g_alienStage.integer, g_alienCredits.integer,
         alienNextStageThreshold ) );
 
-  trap_SetConfigstring( CS_HUMAN_STAGES, va( "%d %d %d",
+  G_SetStagesConfigstring( TEAM_HUMANS, va( "%d %d %d",
         g_humanStage.integer, g_humanCredits.integer,
         humanNextStageThreshold ) );
 }
@@ -2388,7 +2418,6 @@ void G_RunFrame( int levelTime )
   // save position information for all active clients
   G_UnlaggedStore( );
 
-  G_CountSpawns( );
   G_CalculateBuildPoints( );
   G_CalculateStages( );
   G_SpawnClients( TEAM_ALIENS );
@@ -88,6 +88,17 @@ typedef struct {
   entityShared_t  r;        // shared by both the server system and game
 } sharedEntity_t;
 
+// one trace of a G_TRACE_BATCH call
+typedef struct
+{
+  vec3_t  start;
+  vec3_t  mins;
+  vec3_t  maxs;
+  vec3_t  end;
+  int     passEntityNum;
+  int     contentmask;
+} traceRequest_t;
+
 
 
 //===============================================================
@@ -227,6 +238,10 @@ typedef enum {
   G_ADDCOMMAND,
   G_REMOVECOMMAND,
 
+  G_TRACE_BATCH,  // ( trace_t *results, const traceRequest_t *requests, int count );
+  // the same as a G_TRACE for each request, but the entities near the
+  // traces are only looked up once for the whole batch
+
   G_GETTEXT = 300
 } gameImport_t;
 
@@ -523,6 +523,139 @@ static void Svcmd_G_AdvanceMapRotation_f( void )
   G_AdvanceMapRotation( 0 );
 }
 
+/*
+===================
+Svcmd_TraceBench_f
+
+Times the corner traces CanDamage falls back to when the midpoint of a
+target is blocked, for a splash of damage around every player and
+buildable.  First with a trap_Trace for each, then with a trap_TraceBatch
+of the four corners of each target, the way CanDamage does.  Splash
+damage traces the midpoints one at a time because damage to one target
+can change what the next one sees, so those aren't batched at all.
+===================
+*/
+#define TRACEBENCH_RADIUS   512
+#define TRACEBENCH_TRACES   2048
+#define TRACEBENCH_CORNERS  4
+
+static traceRequest_t traceBenchRequests[ TRACEBENCH_TRACES ];
+static trace_t        traceBenchSingle[ TRACEBENCH_TRACES ];
+static trace_t        traceBenchBatched[ TRACEBENCH_TRACES ];
+static int            traceBenchGroups[ TRACEBENCH_TRACES / TRACEBENCH_CORNERS + 1 ];
+
+// the same offsets from the midpoint of the target CanDamage uses
+static const float traceBenchCorners[ TRACEBENCH_CORNERS ][ 2 ] =
+{
+  { 15.0f, 15.0f }, { 15.0f, -15.0f }, { -15.0f, 15.0f }, { -15.0f, -15.0f }
+};
+
+static void Svcmd_TraceBench_f( void )
+{
+  char            arg[ 16 ];
+  int             entityList[ MAX_GENTITIES ];
+  traceRequest_t  *req;
+  trace_t         *a, *b;
+  gentity_t       *ent, *targ;
+  vec3_t          mins, maxs, range;
+  int             iterations, numGroups, numTraces;
+  int             i, j, k, n, num, start;
+  int             singleMsec, batchedMsec, mismatches;
+
+  trap_Argv( 1, arg, sizeof( arg ) );
+  iterations = arg[ 0 ] ? atoi( arg ) : 100;
+  if( iterations <= 0 )
+  {
+    G_Printf( "usage: traceBench [iterations]\n" );
+    return;
+  }
+
+  // gather the traces once, grouped by the target they go to
+  VectorSet( range, TRACEBENCH_RADIUS, TRACEBENCH_RADIUS, TRACEBENCH_RADIUS );
+  numGroups = numTraces = 0;
+  for( i = 0, ent = g_entities; i < level.num_entities; i++, ent++ )
+  {
+    if( !ent->inuse || ( !ent->client && ent->s.eType != ET_BUILDABLE ) )
+      continue;
+
+    VectorAdd( ent->r.currentOrigin, range, maxs );
+    VectorSubtract( ent->r.currentOrigin, range, mins );
+    num = trap_EntitiesInBox( mins, maxs, entityList, MAX_GENTITIES );
+
+    for( j = 0; j < num && numTraces + TRACEBENCH_CORNERS <= TRACEBENCH_TRACES; j++ )
+    {
+      targ = &g_entities[ entityList[ j ] ];
+      if( targ == ent || !targ->takedamage )
+        continue;
+
+      traceBenchGroups[ numGroups++ ] = numTraces;
+      for( k = 0; k < TRACEBENCH_CORNERS; k++ )
+      {
+        req = &traceBenchRequests[ numTraces++ ];
+        VectorCopy( ent->r.currentOrigin, req->start );
+        VectorClear( req->mins );
+        VectorClear( req->maxs );
+        VectorAdd( targ->r.absmin, targ->r.absmax, req->end );
+        VectorScale( req->end, 0.5f, req->end );
+        req->end[ 0 ] += traceBenchCorners[ k ][ 0 ];
+        req->end[ 1 ] += traceBenchCorners[ k ][ 1 ];
+        req->passEntityNum = ENTITYNUM_NONE;
+        req->contentmask = MASK_SOLID;
+      }
+    }
+  }
+  traceBenchGroups[ numGroups ] = numTraces;
+
+  if( !numTraces )
+  {
+    G_Printf( "traceBench: nothing to trace\n" );
+    return;
+  }
+
+  start = trap_Milliseconds( );
+  for( n = 0; n < iterations; n++ )
+  {
+    for( i = 0; i < numTraces; i++ )
+    {
+      req = &traceBenchRequests[ i ];
+      trap_Trace( &traceBenchSingle[ i ], req->start, req->mins, req->maxs,
+                  req->end, req->passEntityNum, req->contentmask );
+    }
+  }
+  singleMsec = trap_Milliseconds( ) - start;
+
+  start = trap_Milliseconds( );
+  for( n = 0; n < iterations; n++ )
+  {
+    for( i = 0; i < numGroups; i++ )
+    {
+      trap_TraceBatch( &traceBenchBatched[ traceBenchGroups[ i ] ],
+                       &traceBenchRequests[ traceBenchGroups[ i ] ],
+                       traceBenchGroups[ i + 1 ] - traceBenchGroups[ i ] );
+    }
+  }
+  batchedMsec = trap_Milliseconds( ) - start;
+
+  mismatches = 0;
+  for( i = 0; i < numTraces; i++ )
+  {
+    a = &traceBenchSingle[ i ];
+    b = &traceBenchBatched[ i ];
+    if( a->fraction != b->fraction || a->entityNum != b->entityNum ||
+        a->allsolid != b->allsolid || a->startsolid != b->startsolid ||
+        !VectorCompare( a->endpos, b->endpos ) )
+      mismatches++;
+  }
+
+  G_Printf( "%d corner traces to %d targets, %d iterations:\n", numTraces, numGroups, iterations );
+  G_Printf( "  trap_Trace:      %d msec, %.0f ns/trace\n", singleMsec,
+            singleMsec * 1000000.0f / ( (float)numTraces * iterations ) );
+  G_Printf( "  trap_TraceBatch: %d msec, %.0f ns/trace\n", batchedMsec,
+            batchedMsec * 1000000.0f / ( (float)numTraces * iterations ) );
+  if( mismatches )
+    G_Printf( S_COLOR_YELLOW "WARNING: %d batched traces differ\n", mismatches );
+}
+
 struct svcmd
 {
   char     *cmd;
@@ -553,7 +686,8 @@ struct svcmd
   { "say_team", qtrue, Svcmd_TeamMessage_f },
   { "status", qfalse, Svcmd_Status_f },
   { "stopMapRotation", qfalse, G_StopMapRotation },
-  { "suddendeath", qfalse, Svcmd_SuddenDeath_f }
+  { "suddendeath", qfalse, Svcmd_SuddenDeath_f },
+  { "traceBench", qfalse, Svcmd_TraceBench_f }
 };
 
 /*
@@ -55,6 +55,8 @@ equ trap_SendGameStat                 -49
 equ trap_AddCommand                   -50
 equ trap_RemoveCommand                -51
 
+equ trap_TraceBatch                   -52
+
 equ memset                            -101
 equ memcpy                            -102
 equ strncpy                           -103
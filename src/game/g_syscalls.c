@@ -297,6 +297,11 @@ void trap_RemoveCommand( const char *cmdName )
   syscall( G_REMOVECOMMAND, cmdName );
 }
 
+void trap_TraceBatch( trace_t *results, const traceRequest_t *requests, int count )
+{
+  syscall( G_TRACE_BATCH, results, requests, count );
+}
+
 void trap_Gettext( char *buffer, const char *msgid, int bufferLength )
 {
   static int engineState = 0;
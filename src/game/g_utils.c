@@ -493,6 +493,9 @@ void G_FreeEntity( gentity_t *ent )
   if( ent->neverFree )
     return;
 
+  if( ent->s.eType == ET_BUILDABLE )
+    G_RemoveBuildable( ent );
+
   memset( ent, 0, sizeof( *ent ) );
   ent->classname = "freent";
   ent->freetime = level.time;
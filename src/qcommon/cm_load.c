@@ -63,6 +63,8 @@ byte		*cmod_base;
 cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
+cvar_t		*cm_debugSurfaceUpdate;
+cvar_t		*cm_simd;
 #endif
 
 cmodel_t	box_model;
@@ -225,6 +227,55 @@ void CM_BoundBrush( cbrush_t *b ) {
 }
 
 
+#if CM_SIMD
+/*
+=================
+CM_SetPlane4
+=================
+*/
+void CM_SetPlane4( cplanes4_t *planes4, int lane, const vec3_t normal, float dist, int signbits, qboolean border ) {
+	int		j;
+
+	for ( j = 0 ; j < 3 ; j++ ) {
+		planes4->normal[j][lane] = normal[j];
+		planes4->corner[j][lane] = ( signbits & ( 1 << j ) ) ? ~0u : 0;
+	}
+	planes4->dist[lane] = dist;
+	planes4->border[lane] = border ? 0x80000000u : 0;
+}
+
+/*
+=================
+CMod_BuildBrushSides4
+
+Copies the side planes of every brush into blocks of four for the SSE2
+trace kernels
+=================
+*/
+void CMod_BuildBrushSides4( void ) {
+	cbrush_t	*b;
+	cplanes4_t	*planes4;
+	cplane_t	*plane;
+	int			i, j, count;
+
+	count = 0;
+	for ( i = 0, b = cm.brushes ; i < cm.numBrushes ; i++, b++ ) {
+		count += ( b->numsides + 3 ) >> 2;
+	}
+
+	planes4 = Hunk_Alloc( count * sizeof( *planes4 ), h_high );
+
+	for ( i = 0, b = cm.brushes ; i < cm.numBrushes ; i++, b++ ) {
+		b->sides4 = planes4;
+		for ( j = 0 ; j < b->numsides ; j++ ) {
+			plane = b->sides[j].plane;
+			CM_SetPlane4( &planes4[j >> 2], j & 3, plane->normal, plane->dist, plane->signbits, qfalse );
+		}
+		planes4 += ( b->numsides + 3 ) >> 2;
+	}
+}
+#endif
+
 /*
 =================
 CMod_LoadBrushes
@@ -731,6 +782,9 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	cm_noAreas = Cvar_Get ("cm_noAreas", "0", CVAR_CHEAT);
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE|CVAR_CHEAT );
+	// registered here rather than on first use so traces never touch the cvar list
+	cm_debugSurfaceUpdate = Cvar_Get ("r_debugSurfaceUpdate", "1", 0);
+	cm_simd = Cvar_Get ("cm_simd", "1", CVAR_CHEAT);
 #endif
 	Com_DPrintf( "CM_LoadMap( %s, %i )\n", name, clientload );
 
@@ -756,7 +810,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	// load the file
 	//
 #ifndef BSPC
-	length = FS_ReadFile( name, &buf.v );
+	length = FS_MapFile( name, &buf.v );
 #else
 	length = LoadQuakeFile((quakefile_t *) name, &buf.v);
 #endif
@@ -788,6 +842,9 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	CMod_LoadPlanes (&header.lumps[LUMP_PLANES]);
 	CMod_LoadBrushSides (&header.lumps[LUMP_BRUSHSIDES]);
 	CMod_LoadBrushes (&header.lumps[LUMP_BRUSHES]);
+#if CM_SIMD
+	CMod_BuildBrushSides4( );
+#endif
 	CMod_LoadSubmodels (&header.lumps[LUMP_MODELS]);
 	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
@@ -796,8 +853,11 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 
 	CMod_CreateBrushSideWindings( );
 
-	// we are NOT freeing the file, because it is cached for the ref
-	FS_FreeFile (buf.v);
+#ifndef BSPC
+	FS_UnmapFile( buf.v );
+#else
+	FS_FreeFile( buf.v );
+#endif
 
 	CM_InitBoxHull ();
 
@@ -65,21 +65,38 @@ typedef struct {
 	winding_t			*winding;
 } cbrushside_t;
 
+// the SSE2 trace kernels round exactly like the scalar code only where the
+// scalar float math is done in SSE registers as well
+#if !defined( BSPC ) && ( defined( __x86_64__ ) || defined( _M_X64 ) )
+#define CM_SIMD 1
+#else
+#define CM_SIMD 0
+#endif
+
+// four planes in structure of arrays form, so the SSE2 trace kernels can
+// expand and test them against the trace all at once
+typedef struct {
+	float			normal[3][4];
+	float			dist[4];
+	unsigned int	corner[3][4];	// ~0 where signbits picks size[1] for the axis
+	unsigned int	border[4];		// sign bit where the expansion is added as fabs()
+} cplanes4_t;
+
 typedef struct {
 	int			shaderNum;		// the shader that determined the contents
 	int			contents;
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
-	int			checkcount;		// to avoid repeated testings
-	qboolean	collided; // marker for optimisation
 	cbrushedge_t	*edges;
 	int						numEdges;
+#if CM_SIMD
+	cplanes4_t	*sides4;		// ( numsides + 3 ) / 4 blocks, NULL for the box brush
+#endif
 } cbrush_t;
 
 
 typedef struct {
-	int			checkcount;				// to avoid repeated testings
 	int			surfaceFlags;
 	int			contents;
 	struct patchCollide_s	*pc;
@@ -137,7 +154,6 @@ typedef struct {
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
 	int			floodvalid;
-	int			checkcount;					// incremented on each trace
 } clipMap_t;
 
 
@@ -151,9 +167,55 @@ extern	int			c_traces, c_brush_traces, c_patch_traces;
 extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
+extern	cvar_t		*cm_debugSurfaceUpdate;
+extern	cvar_t		*cm_simd;
 
 // cm_test.c
 
+// brushes and patches already tested by the current trace or query, so one
+// touching several leafs is only tested once; each thread has its own set
+// so the collision model can be queried from several threads at once
+typedef struct {
+	int			generation;		// bumped for each trace or query
+	int			maxBrushes;
+	int			maxPatches;
+	int			*brushes;		// generation each brush was last tested in
+	int			*collided;		// generation each brush was last hit in
+	int			*patches;		// generation each patch was last tested in
+} cmVisited_t;
+
+cmVisited_t *CM_BeginVisit( void );
+
+/*
+==================
+CM_VisitBrush
+
+Returns qfalse if the brush was already tested by this trace
+==================
+*/
+static ID_INLINE qboolean CM_VisitBrush( cmVisited_t *visited, int brushnum ) {
+	if ( visited->brushes[ brushnum ] == visited->generation ) {
+		return qfalse;
+	}
+	visited->brushes[ brushnum ] = visited->generation;
+	return qtrue;
+}
+
+/*
+==================
+CM_VisitPatch
+
+Returns qfalse if the patch was already tested by this trace
+==================
+*/
+static ID_INLINE qboolean CM_VisitPatch( cmVisited_t *visited, int surfacenum ) {
+	if ( visited->patches[ surfacenum ] == visited->generation ) {
+		return qfalse;
+	}
+	visited->patches[ surfacenum ] = visited->generation;
+	return qtrue;
+}
+
 typedef struct
 {
 	float		startRadius;
@@ -184,6 +246,7 @@ typedef struct {
 	sphere_t		sphere;		// sphere for oriendted capsule collision
 	biSphere_t	biSphere;
 	qboolean		testLateralCollision; // whether or not to test for lateral collision
+	cmVisited_t	*visited;	// brushes and patches tested so far
 } traceWork_t;
 
 typedef struct leafList_s {
@@ -193,6 +256,7 @@ typedef struct leafList_s {
 	int		*list;
 	vec3_t	bounds[2];
 	int		lastLeaf;		// for overflows where each leaf can't be stored individually
+	cmVisited_t	*visited;	// only used by CM_StoreBrushes
 	void	(*storeLeafs)( struct leafList_s *ll, int nodenum );
 } leafList_t;
 
@@ -208,6 +272,23 @@ cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle );
 qboolean CM_BoundsIntersect( const vec3_t mins, const vec3_t maxs, const vec3_t mins2, const vec3_t maxs2 );
 qboolean CM_BoundsIntersectPoint( const vec3_t mins, const vec3_t maxs, const vec3_t point );
 
+#if CM_SIMD
+// what the SSE2 trace kernel found clipping a trace against a run of planes
+typedef struct {
+	float		enterFrac;		// latest crossing towards the interior, -1 if none
+	float		leaveFrac;		// earliest crossing towards the exterior
+	int			enterPlane;		// plane that set enterFrac, -1 if none
+	float		enterDist;		// its distance adjusted for the trace volume
+	qboolean	startout;		// start point in front of some plane
+	qboolean	getout;			// end point in front of some plane
+	qboolean	crossed;		// some plane crossed before the kernel gave up
+} planeClip4_t;
+
+void CM_SetPlane4( cplanes4_t *planes4, int lane, const vec3_t normal, float dist, int signbits, qboolean border );
+qboolean CM_ClipToPlanes4( const traceWork_t *tw, traceType_t type, const cplanes4_t *planes4, int numPlanes, planeClip4_t *clip );
+qboolean CM_InFrontOfPlanes4( const traceWork_t *tw, traceType_t type, const cplanes4_t *planes4, int first, int numPlanes );
+#endif
+
 // cm_patch.c
 
 struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points );
@@ -974,6 +974,53 @@ typedef enum {
 	EN_LEFT
 } edgeName_t;
 
+#if CM_SIMD
+/*
+==================
+CM_SetFacetPlanes4
+
+Copies the surface and border planes of every facet into blocks of four for
+the SSE2 trace kernel, with the inward borders already flipped
+==================
+*/
+static void CM_SetFacetPlanes4( patchCollide_t *pf ) {
+	facet_t		*facet;
+	cplanes4_t	*planes4;
+	patchPlane_t	*p;
+	vec3_t		normal;
+	float		dist;
+	int			i, j, count;
+
+	count = 0;
+	for ( i = 0, facet = pf->facets ; i < pf->numFacets ; i++, facet++ ) {
+		count += ( facet->numBorders + 4 ) >> 2;
+	}
+
+	planes4 = Hunk_Alloc( count * sizeof( *planes4 ), h_high );
+
+	for ( i = 0, facet = pf->facets ; i < pf->numFacets ; i++, facet++ ) {
+		facet->planes4 = planes4;
+
+		p = &pf->planes[ facet->surfacePlane ];
+		CM_SetPlane4( planes4, 0, p->plane, p->plane[3], p->signbits, qfalse );
+
+		for ( j = 0 ; j < facet->numBorders ; j++ ) {
+			p = &pf->planes[ facet->borderPlanes[j] ];
+			if ( facet->borderInward[j] ) {
+				VectorNegate( p->plane, normal );
+				dist = -p->plane[3];
+			} else {
+				VectorCopy( p->plane, normal );
+				dist = p->plane[3];
+			}
+			CM_SetPlane4( &planes4[ ( j + 1 ) >> 2 ], ( j + 1 ) & 3, normal, dist, p->signbits, qtrue );
+		}
+
+		planes4 += ( facet->numBorders + 4 ) >> 2;
+	}
+}
+#endif
+
 /*
 ==================
 CM_PatchCollideFromGrid
@@ -1134,6 +1181,10 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 	Com_Memcpy( pf->facets, facets, numFacets * sizeof( *pf->facets ) );
 	pf->planes = Hunk_Alloc( numPlanes * sizeof( *pf->planes ), h_high );
 	Com_Memcpy( pf->planes, planes, numPlanes * sizeof( *pf->planes ) );
+
+#if CM_SIMD
+	CM_SetFacetPlanes4( pf );
+#endif
 }
 
 
@@ -1239,9 +1290,6 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 	int			i, j, k;
 	float		offset;
 	float		d1, d2;
-#ifndef BSPC
-	static cvar_t *cv;
-#endif //BSPC
 
 #ifndef BSPC
 	if ( !cm_playerCurveClip->integer || !tw->isPoint ) {
@@ -1299,10 +1347,7 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 		if ( j == facet->numBorders ) {
 			// we hit this facet
 #ifndef BSPC
-			if (!cv) {
-				cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-			}
-			if (cv->integer) {
+			if (cm_debugSurfaceUpdate->integer) {
 				debugPatchCollide = pc;
 				debugFacet = facet;
 			}
@@ -1373,39 +1418,62 @@ int CM_CheckFacetPlane(float *plane, vec3_t start, vec3_t end, float *enterFrac,
 
 /*
 ====================
-CM_TraceThroughPatchCollide
+CM_CheckFacetPlanes
+
+Clips the trace against the surface plane and the border planes of a facet,
+returns qfalse if it is completely in front of any of them
 ====================
 */
-void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc ) {
-	int i, j, hit, hitnum;
-	float offset, enterFrac, leaveFrac, t;
-	patchPlane_t *planes;
-	facet_t	*facet;
-	float plane[4] = {0, 0, 0, 0}, bestplane[4] = {0, 0, 0, 0};
+static qboolean CM_CheckFacetPlanes( traceWork_t *tw, const struct patchCollide_s *pc, const facet_t *facet,
+	float *bestplane, float *enterFrac, float *leaveFrac, int *hitnum ) {
+	int j, hit;
+	float offset, t;
+	const patchPlane_t *planes;
+	float plane[4] = {0, 0, 0, 0};
 	vec3_t startp, endp;
-#ifndef BSPC
-	static cvar_t *cv;
-#endif //BSPC
 
-	if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
-				pc->bounds[0], pc->bounds[1] ) ) {
-		return;
+	planes = &pc->planes[ facet->surfacePlane ];
+	VectorCopy(planes->plane, plane);
+	plane[3] = planes->plane[3];
+	if ( tw->type == TT_CAPSULE ) {
+		// adjust the plane distance apropriately for radius
+		plane[3] += tw->sphere.radius;
+
+		// find the closest point on the capsule to the plane
+		t = DotProduct( plane, tw->sphere.offset );
+		if ( t > 0.0f ) {
+			VectorSubtract( tw->start, tw->sphere.offset, startp );
+			VectorSubtract( tw->end, tw->sphere.offset, endp );
+		}
+		else {
+			VectorAdd( tw->start, tw->sphere.offset, startp );
+			VectorAdd( tw->end, tw->sphere.offset, endp );
+		}
+	}
+	else {
+		offset = DotProduct( tw->offsets[ planes->signbits ], plane);
+		plane[3] -= offset;
+		VectorCopy( tw->start, startp );
+		VectorCopy( tw->end, endp );
 	}
 
-	if (tw->isPoint) {
-		CM_TracePointThroughPatchCollide( tw, pc );
-		return;
+	if (!CM_CheckFacetPlane(plane, startp, endp, enterFrac, leaveFrac, &hit)) {
+		return qfalse;
+	}
+	if (hit) {
+		Vector4Copy(plane, bestplane);
 	}
 
-	facet = pc->facets;
-	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
-		enterFrac = -1.0;
-		leaveFrac = 1.0;
-		hitnum = -1;
-		//
-		planes = &pc->planes[ facet->surfacePlane ];
-		VectorCopy(planes->plane, plane);
-		plane[3] = planes->plane[3];
+	for ( j = 0; j < facet->numBorders; j++ ) {
+		planes = &pc->planes[ facet->borderPlanes[j] ];
+		if (facet->borderInward[j]) {
+			VectorNegate(planes->plane, plane);
+			plane[3] = -planes->plane[3];
+		}
+		else {
+			VectorCopy(planes->plane, plane);
+			plane[3] = planes->plane[3];
+		}
 		if ( tw->type == TT_CAPSULE ) {
 			// adjust the plane distance apropriately for radius
 			plane[3] += tw->sphere.radius;
@@ -1422,61 +1490,100 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 			}
 		}
 		else {
+			// NOTE: this works even though the plane might be flipped because the bbox is centered
 			offset = DotProduct( tw->offsets[ planes->signbits ], plane);
-			plane[3] -= offset;
+			plane[3] += fabs(offset);
 			VectorCopy( tw->start, startp );
 			VectorCopy( tw->end, endp );
 		}
 
-		if (!CM_CheckFacetPlane(plane, startp, endp, &enterFrac, &leaveFrac, &hit)) {
-			continue;
+		if (!CM_CheckFacetPlane(plane, startp, endp, enterFrac, leaveFrac, &hit)) {
+			return qfalse;
 		}
 		if (hit) {
+			*hitnum = j;
 			Vector4Copy(plane, bestplane);
 		}
+	}
+	return qtrue;
+}
 
-		for ( j = 0; j < facet->numBorders; j++ ) {
-			planes = &pc->planes[ facet->borderPlanes[j] ];
-			if (facet->borderInward[j]) {
-				VectorNegate(planes->plane, plane);
-				plane[3] = -planes->plane[3];
-			}
-			else {
-				VectorCopy(planes->plane, plane);
-				plane[3] = planes->plane[3];
-			}
-			if ( tw->type == TT_CAPSULE ) {
-				// adjust the plane distance apropriately for radius
-				plane[3] += tw->sphere.radius;
+#if CM_SIMD
+/*
+====================
+CM_CheckFacetPlanes4
 
-				// find the closest point on the capsule to the plane
-				t = DotProduct( plane, tw->sphere.offset );
-				if ( t > 0.0f ) {
-					VectorSubtract( tw->start, tw->sphere.offset, startp );
-					VectorSubtract( tw->end, tw->sphere.offset, endp );
-				}
-				else {
-					VectorAdd( tw->start, tw->sphere.offset, startp );
-					VectorAdd( tw->end, tw->sphere.offset, endp );
-				}
-			}
-			else {
-				// NOTE: this works even though the plane might be flipped because the bbox is centered
-				offset = DotProduct( tw->offsets[ planes->signbits ], plane);
-				plane[3] += fabs(offset);
-				VectorCopy( tw->start, startp );
-				VectorCopy( tw->end, endp );
-			}
+Same as CM_CheckFacetPlanes, with the planes clipped four at a time
+====================
+*/
+static qboolean CM_CheckFacetPlanes4( traceWork_t *tw, const facet_t *facet,
+	float *bestplane, float *enterFrac, float *leaveFrac, int *hitnum ) {
+	planeClip4_t clip;
+	const cplanes4_t *planes4;
+	int lane;
+
+	// bisphere traces are expanded by the box here, as in CM_CheckFacetPlanes
+	if ( !CM_ClipToPlanes4( tw, tw->type == TT_CAPSULE ? TT_CAPSULE : TT_AABB,
+		facet->planes4, facet->numBorders + 1, &clip ) ) {
+		return qfalse;
+	}
 
-			if (!CM_CheckFacetPlane(plane, startp, endp, &enterFrac, &leaveFrac, &hit)) {
-				break;
-			}
-			if (hit) {
-				hitnum = j;
-				Vector4Copy(plane, bestplane);
+	*enterFrac = clip.enterFrac;
+	*leaveFrac = clip.leaveFrac;
+
+	// plane 0 is the surface plane and plane j the border j - 1
+	if ( clip.enterPlane >= 0 ) {
+		if ( clip.enterPlane ) {
+			*hitnum = clip.enterPlane - 1;
+		}
+		planes4 = &facet->planes4[ clip.enterPlane >> 2 ];
+		lane = clip.enterPlane & 3;
+		bestplane[0] = planes4->normal[0][lane];
+		bestplane[1] = planes4->normal[1][lane];
+		bestplane[2] = planes4->normal[2][lane];
+		bestplane[3] = clip.enterDist;
+	}
+	return qtrue;
+}
+#endif
+
+/*
+====================
+CM_TraceThroughPatchCollide
+====================
+*/
+void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc ) {
+	int i, hitnum;
+	float enterFrac, leaveFrac;
+	facet_t	*facet;
+	float bestplane[4] = {0, 0, 0, 0};
+
+	if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
+				pc->bounds[0], pc->bounds[1] ) ) {
+		return;
+	}
+
+	if (tw->isPoint) {
+		CM_TracePointThroughPatchCollide( tw, pc );
+		return;
+	}
+
+	facet = pc->facets;
+	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
+		enterFrac = -1.0;
+		leaveFrac = 1.0;
+		hitnum = -1;
+		//
+#if CM_SIMD
+		if ( cm_simd->integer ) {
+			if ( !CM_CheckFacetPlanes4( tw, facet, bestplane, &enterFrac, &leaveFrac, &hitnum ) ) {
+				continue;
 			}
+		} else
+#endif
+		if ( !CM_CheckFacetPlanes( tw, pc, facet, bestplane, &enterFrac, &leaveFrac, &hitnum ) ) {
+			continue;
 		}
-		if (j < facet->numBorders) continue;
 		//never clip against the back side
 		if (hitnum == facet->numBorders - 1) continue;
 
@@ -1486,10 +1593,7 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 					enterFrac = 0;
 				}
 #ifndef BSPC
-				if (!cv) {
-					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-				}
-				if (cv && cv->integer) {
+				if (cm_debugSurfaceUpdate->integer) {
 					debugPatchCollide = pc;
 					debugFacet = facet;
 				}
@@ -1531,6 +1635,16 @@ qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchColli
 	//
 	facet = pc->facets;
 	for ( i = 0 ; i < pc->numFacets ; i++, facet++ ) {
+#if CM_SIMD
+		if ( cm_simd->integer ) {
+			if ( CM_InFrontOfPlanes4( tw, tw->type == TT_CAPSULE ? TT_CAPSULE : TT_AABB,
+				facet->planes4, 0, facet->numBorders + 1 ) ) {
+				continue;
+			}
+			// inside this patch facet
+			return qtrue;
+		}
+#endif
 		planes = &pc->planes[ facet->surfacePlane ];
 		VectorCopy(planes->plane, plane);
 		plane[3] = planes->plane[3];
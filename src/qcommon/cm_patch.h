@@ -75,6 +75,9 @@ typedef struct {
 	int			borderPlanes[4+6+16];
 	int			borderInward[4+6+16];
 	qboolean	borderNoAdjust[4+6+16];
+#if CM_SIMD
+	cplanes4_t	*planes4;		// surface plane in the first lane, then the borders
+#endif
 } facet_t;
 
 typedef struct patchCollide_s {
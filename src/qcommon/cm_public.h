@@ -54,6 +54,14 @@ void		CM_TransformedBiSphereTrace( trace_t *results, const vec3_t start,
 							clipHandle_t model, int mask,
 							const vec3_t origin );
 
+// checks traces from worker threads against the same traces from the main thread
+void		CM_TraceStress_f( void );
+// checks the SSE2 trace kernels against the scalar plane math
+void		CM_TraceSimd_f( void );
+// frees what the calling thread allocated for its traces, called by worker
+// threads before they exit
+void		CM_FreeThreadData( void );
+
 byte		*CM_ClusterPVS (int cluster);
 
 int			CM_PointLeafnum( const vec3_t p );
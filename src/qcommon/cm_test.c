@@ -22,6 +22,72 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "cm_local.h"
 
+#ifdef _MSC_VER
+#define CM_THREAD_LOCAL	__declspec( thread )
+#else
+#define CM_THREAD_LOCAL	__thread
+#endif
+
+static CM_THREAD_LOCAL cmVisited_t	cm_visited;
+
+/*
+==================
+CM_BeginVisit
+
+Returns the calling thread's visited set with every brush and patch
+unmarked.  The stamps are allocated with malloc rather than on the zone,
+which isn't thread safe, and stay around until CM_FreeThreadData.
+==================
+*/
+cmVisited_t *CM_BeginVisit( void ) {
+	cmVisited_t	*visited = &cm_visited;
+	int			numBrushes;
+
+	numBrushes = cm.numBrushes + 1;		// the box brush follows the map brushes
+
+	if ( visited->maxBrushes < numBrushes || visited->maxPatches < cm.numSurfaces ) {
+		free( visited->brushes );
+		free( visited->collided );
+		free( visited->patches );
+
+		visited->maxBrushes = numBrushes;
+		visited->maxPatches = cm.numSurfaces > 0 ? cm.numSurfaces : 1;
+		visited->brushes = calloc( visited->maxBrushes, sizeof( int ) );
+		visited->collided = calloc( visited->maxBrushes, sizeof( int ) );
+		visited->patches = calloc( visited->maxPatches, sizeof( int ) );
+		if ( !visited->brushes || !visited->collided || !visited->patches ) {
+			Com_Error( ERR_FATAL, "CM_BeginVisit: failed on allocation of %i brushes", numBrushes );
+		}
+		visited->generation = 0;
+	}
+
+	// stamps from earlier maps or traces are always older than the
+	// generation, so they only need clearing when it wraps
+	if ( visited->generation == INT_MAX ) {
+		Com_Memset( visited->brushes, 0, visited->maxBrushes * sizeof( int ) );
+		Com_Memset( visited->collided, 0, visited->maxBrushes * sizeof( int ) );
+		Com_Memset( visited->patches, 0, visited->maxPatches * sizeof( int ) );
+		visited->generation = 0;
+	}
+
+	visited->generation++;
+	return visited;
+}
+
+/*
+==================
+CM_FreeThreadData
+==================
+*/
+void CM_FreeThreadData( void ) {
+	cmVisited_t	*visited = &cm_visited;
+
+	free( visited->brushes );
+	free( visited->collided );
+	free( visited->patches );
+	Com_Memset( visited, 0, sizeof( *visited ) );
+}
+
 
 /*
 ==================
@@ -101,11 +167,10 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum ) {
 
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
-		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( !CM_VisitBrush( ll->visited, brushnum ) ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		b = &cm.brushes[brushnum];
 		for ( i = 0 ; i < 3 ; i++ ) {
 			if ( b->bounds[0][i] >= ll->bounds[1][i] || b->bounds[1][i] <= ll->bounds[0][i] ) {
 				break;
@@ -173,8 +238,6 @@ CM_BoxLeafnums
 int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsize, int *lastLeaf) {
 	leafList_t	ll;
 
-	cm.checkcount++;
-
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
 	ll.count = 0;
@@ -183,6 +246,7 @@ int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsiz
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
+	ll.visited = NULL;
 
 	CM_BoxLeafnums_r( &ll, 0 );
 
@@ -198,8 +262,6 @@ CM_BoxBrushes
 int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int listsize ) {
 	leafList_t	ll;
 
-	cm.checkcount++;
-
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
 	ll.count = 0;
@@ -208,6 +270,7 @@ int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int li
 	ll.storeLeafs = CM_StoreBrushes;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
+	ll.visited = CM_BeginVisit();
 	
 	CM_BoxLeafnums_r( &ll, 0 );
 
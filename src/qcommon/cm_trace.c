@@ -22,6 +22,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "cm_local.h"
 
+#if CM_SIMD
+#include <emmintrin.h>
+#endif
+
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
 // always use capsule vs. capsule collision and never capsule vs. bbox or vice versa
@@ -145,6 +149,255 @@ float SquareRootFloat(float number) {
 	return number * y;
 }
 
+#if CM_SIMD
+/*
+================
+CM_Select4
+
+Picks a in the lanes where mask is set and b elsewhere
+================
+*/
+static ID_INLINE __m128 CM_Select4( __m128 mask, __m128 a, __m128 b ) {
+	return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+
+/*
+================
+CM_DotProduct4
+
+DotProduct of four vectors with four plane normals, added up in the same
+order as the DotProduct macro
+================
+*/
+static ID_INLINE __m128 CM_DotProduct4( __m128 x, __m128 y, __m128 z, __m128 nx, __m128 ny, __m128 nz ) {
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, nx ), _mm_mul_ps( y, ny ) ), _mm_mul_ps( z, nz ) );
+}
+
+/*
+================
+CM_PlaneDistances4
+
+Adjusts four planes for the trace volume and returns the adjusted plane
+distances and the distances of the trace start and end points in front of
+them.  The operations are done in the same order as the scalar loops, so the
+results are bit identical to them.  d2 may be NULL for position tests.
+================
+*/
+static ID_INLINE void CM_PlaneDistances4( const traceWork_t *tw, traceType_t type, const cplanes4_t *planes4,
+	__m128 *dist, __m128 *d1, __m128 *d2 ) {
+	__m128	nx, ny, nz;
+	__m128	d, t, sub, corner;
+	int		j;
+
+	nx = _mm_loadu_ps( planes4->normal[0] );
+	ny = _mm_loadu_ps( planes4->normal[1] );
+	nz = _mm_loadu_ps( planes4->normal[2] );
+
+	if ( type == TT_BISPHERE ) {
+		d = _mm_loadu_ps( planes4->dist );
+		*dist = d;
+
+		// adjust the plane distance apropriately for radius
+		*d1 = _mm_sub_ps( CM_DotProduct4( _mm_set1_ps( tw->start[0] ), _mm_set1_ps( tw->start[1] ),
+			_mm_set1_ps( tw->start[2] ), nx, ny, nz ), _mm_add_ps( d, _mm_set1_ps( tw->biSphere.startRadius ) ) );
+		if ( d2 ) {
+			*d2 = _mm_sub_ps( CM_DotProduct4( _mm_set1_ps( tw->end[0] ), _mm_set1_ps( tw->end[1] ),
+				_mm_set1_ps( tw->end[2] ), nx, ny, nz ), _mm_add_ps( d, _mm_set1_ps( tw->biSphere.endRadius ) ) );
+		}
+	} else if ( type == TT_CAPSULE ) {
+		// adjust the plane distance apropriately for radius
+		d = _mm_add_ps( _mm_loadu_ps( planes4->dist ), _mm_set1_ps( tw->sphere.radius ) );
+		*dist = d;
+
+		// find the closest point on the capsule to each plane
+		t = CM_DotProduct4( _mm_set1_ps( tw->sphere.offset[0] ), _mm_set1_ps( tw->sphere.offset[1] ),
+			_mm_set1_ps( tw->sphere.offset[2] ), nx, ny, nz );
+		sub = _mm_cmpgt_ps( t, _mm_setzero_ps( ) );
+
+		*d1 = _mm_sub_ps( CM_DotProduct4(
+			CM_Select4( sub, _mm_set1_ps( tw->start[0] - tw->sphere.offset[0] ), _mm_set1_ps( tw->start[0] + tw->sphere.offset[0] ) ),
+			CM_Select4( sub, _mm_set1_ps( tw->start[1] - tw->sphere.offset[1] ), _mm_set1_ps( tw->start[1] + tw->sphere.offset[1] ) ),
+			CM_Select4( sub, _mm_set1_ps( tw->start[2] - tw->sphere.offset[2] ), _mm_set1_ps( tw->start[2] + tw->sphere.offset[2] ) ),
+			nx, ny, nz ), d );
+		if ( d2 ) {
+			*d2 = _mm_sub_ps( CM_DotProduct4(
+				CM_Select4( sub, _mm_set1_ps( tw->end[0] - tw->sphere.offset[0] ), _mm_set1_ps( tw->end[0] + tw->sphere.offset[0] ) ),
+				CM_Select4( sub, _mm_set1_ps( tw->end[1] - tw->sphere.offset[1] ), _mm_set1_ps( tw->end[1] + tw->sphere.offset[1] ) ),
+				CM_Select4( sub, _mm_set1_ps( tw->end[2] - tw->sphere.offset[2] ), _mm_set1_ps( tw->end[2] + tw->sphere.offset[2] ) ),
+				nx, ny, nz ), d );
+		}
+	} else {
+		// adjust the plane distance apropriately for mins/maxs, taking the
+		// box corner from the corner masks like tw->offsets[ signbits ]
+		__m128	c[3];
+
+		for ( j = 0 ; j < 3 ; j++ ) {
+			corner = _mm_castsi128_ps( _mm_loadu_si128( (const __m128i *)planes4->corner[j] ) );
+			c[j] = CM_Select4( corner, _mm_set1_ps( tw->size[1][j] ), _mm_set1_ps( tw->size[0][j] ) );
+		}
+		t = CM_DotProduct4( c[0], c[1], c[2], nx, ny, nz );
+
+		// patch facet borders add fabs( offset ), so subtract -fabs( offset )
+		t = _mm_or_ps( t, _mm_castsi128_ps( _mm_loadu_si128( (const __m128i *)planes4->border ) ) );
+
+		d = _mm_sub_ps( _mm_loadu_ps( planes4->dist ), t );
+		*dist = d;
+
+		*d1 = _mm_sub_ps( CM_DotProduct4( _mm_set1_ps( tw->start[0] ), _mm_set1_ps( tw->start[1] ),
+			_mm_set1_ps( tw->start[2] ), nx, ny, nz ), d );
+		if ( d2 ) {
+			*d2 = _mm_sub_ps( CM_DotProduct4( _mm_set1_ps( tw->end[0] ), _mm_set1_ps( tw->end[1] ),
+				_mm_set1_ps( tw->end[2] ), nx, ny, nz ), d );
+		}
+	}
+}
+
+/*
+================
+CM_ClipToPlanes4
+
+Clips the trace against numPlanes planes four at a time, doing what the
+scalar brush and facet loops do for every plane: getout and startout, the
+early out when the trace is completely in front of a plane, and the enter
+and leave fractions.  Each lane keeps its own latest entry and earliest
+exit, and the lanes are merged at the end so the lowest plane wins ties,
+like the first plane does in the scalar loops.
+
+Returns qfalse if the trace is completely in front of one of the planes.
+================
+*/
+qboolean CM_ClipToPlanes4( const traceWork_t *tw, traceType_t type, const cplanes4_t *planes4, int numPlanes, planeClip4_t *clip ) {
+	__m128	zero, one, dist, d1, d2, lanes, cross, enter, update;
+	__m128	eps, delta, f;
+	__m128	enterFrac, enterDist, leaveFrac;
+	__m128i	plane, enterPlane;
+	__m128d	lo, hi;
+	float	enterFracs[4], enterDists[4], leaveFracs[4];
+	int		enterPlanes[4];
+	int		i, out;
+
+	zero = _mm_setzero_ps( );
+	one = _mm_set1_ps( 1.0f );
+	enterFrac = _mm_set1_ps( -1.0f );
+	enterDist = zero;
+	enterPlane = _mm_set1_epi32( -1 );
+	leaveFrac = one;
+
+	clip->startout = qfalse;
+	clip->getout = qfalse;
+	clip->crossed = qfalse;
+
+	plane = _mm_setr_epi32( 0, 1, 2, 3 );
+	for ( i = 0 ; i < numPlanes ; i += 4, planes4++, plane = _mm_add_epi32( plane, _mm_set1_epi32( 4 ) ) ) {
+		CM_PlaneDistances4( tw, type, planes4, &dist, &d1, &d2 );
+
+		// the last block may be padded
+		lanes = _mm_castsi128_ps( _mm_cmplt_epi32( plane, _mm_set1_epi32( numPlanes ) ) );
+
+		// if it doesn't cross the plane, the plane isn't relevent
+		cross = _mm_and_ps( lanes, _mm_or_ps( _mm_cmpnle_ps( d1, zero ), _mm_cmpnle_ps( d2, zero ) ) );
+
+		// if completely in front of face, no intersection with the entire brush
+		out = _mm_movemask_ps( _mm_and_ps( _mm_and_ps( lanes, _mm_cmpgt_ps( d1, zero ) ),
+			_mm_or_ps( _mm_cmpge_ps( d2, _mm_set1_ps( SURFACE_CLIP_EPSILON ) ), _mm_cmpge_ps( d2, d1 ) ) ) );
+		if ( out ) {
+			// the scalar loops stop at the first such plane
+			if ( _mm_movemask_ps( cross ) & ( ( out & -out ) - 1 ) ) {
+				clip->crossed = qtrue;
+			}
+			return qfalse;
+		}
+
+		if ( _mm_movemask_ps( _mm_and_ps( lanes, _mm_cmpgt_ps( d2, zero ) ) ) ) {
+			clip->getout = qtrue;	// endpoint is not in solid
+		}
+		if ( _mm_movemask_ps( _mm_and_ps( lanes, _mm_cmpgt_ps( d1, zero ) ) ) ) {
+			clip->startout = qtrue;
+		}
+		if ( !_mm_movemask_ps( cross ) ) {
+			continue;
+		}
+		clip->crossed = qtrue;
+
+		// crosses face, entering where d1 > d2 and leaving elsewhere.  The
+		// scalar code divides in double because SURFACE_CLIP_EPSILON is one,
+		// so do the same to round f the same way.
+		enter = _mm_cmpgt_ps( d1, d2 );
+		eps = CM_Select4( enter, _mm_set1_ps( SURFACE_CLIP_EPSILON ), _mm_set1_ps( -SURFACE_CLIP_EPSILON ) );
+		delta = _mm_sub_ps( d1, d2 );
+		lo = _mm_div_pd( _mm_sub_pd( _mm_cvtps_pd( d1 ), _mm_cvtps_pd( eps ) ), _mm_cvtps_pd( delta ) );
+		d1 = _mm_movehl_ps( d1, d1 );
+		eps = _mm_movehl_ps( eps, eps );
+		delta = _mm_movehl_ps( delta, delta );
+		hi = _mm_div_pd( _mm_sub_pd( _mm_cvtps_pd( d1 ), _mm_cvtps_pd( eps ) ), _mm_cvtps_pd( delta ) );
+		f = _mm_movelh_ps( _mm_cvtpd_ps( lo ), _mm_cvtpd_ps( hi ) );
+
+		// clamp entering fractions below at 0, leaving -0 alone as the
+		// scalar f < 0 test does, and leaving fractions above at 1
+		f = CM_Select4( enter, _mm_andnot_ps( _mm_cmplt_ps( f, zero ), f ),
+			CM_Select4( _mm_cmpgt_ps( f, one ), one, f ) );
+
+		update = _mm_and_ps( _mm_and_ps( cross, enter ), _mm_cmpgt_ps( f, enterFrac ) );
+		enterFrac = CM_Select4( update, f, enterFrac );
+		enterDist = CM_Select4( update, dist, enterDist );
+		enterPlane = _mm_or_si128( _mm_and_si128( _mm_castps_si128( update ), plane ),
+			_mm_andnot_si128( _mm_castps_si128( update ), enterPlane ) );
+
+		// _mm_min_ps( a, b ) is a < b ? a : b, like the scalar f < leaveFrac
+		leaveFrac = _mm_min_ps( CM_Select4( _mm_andnot_ps( enter, cross ), f, leaveFrac ), leaveFrac );
+	}
+
+	_mm_storeu_ps( enterFracs, enterFrac );
+	_mm_storeu_ps( enterDists, enterDist );
+	_mm_storeu_si128( (__m128i *)enterPlanes, enterPlane );
+	_mm_storeu_ps( leaveFracs, leaveFrac );
+
+	clip->enterFrac = -1.0f;
+	clip->enterPlane = -1;
+	clip->enterDist = 0;
+	clip->leaveFrac = 1.0f;
+	for ( i = 0 ; i < 4 ; i++ ) {
+		if ( enterPlanes[i] >= 0 && ( enterFracs[i] > clip->enterFrac ||
+			( enterFracs[i] == clip->enterFrac && enterPlanes[i] < clip->enterPlane ) ) ) {
+			clip->enterFrac = enterFracs[i];
+			clip->enterDist = enterDists[i];
+			clip->enterPlane = enterPlanes[i];
+		}
+		if ( leaveFracs[i] < clip->leaveFrac ) {
+			clip->leaveFrac = leaveFracs[i];
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+================
+CM_InFrontOfPlanes4
+
+Returns qtrue if the trace start is in front of any of the planes from
+first up to numPlanes, testing four planes at a time
+================
+*/
+qboolean CM_InFrontOfPlanes4( const traceWork_t *tw, traceType_t type, const cplanes4_t *planes4, int first, int numPlanes ) {
+	__m128	dist, d1, lanes;
+	__m128i	plane;
+	int		i;
+
+	plane = _mm_setr_epi32( first & ~3, ( first & ~3 ) + 1, ( first & ~3 ) + 2, ( first & ~3 ) + 3 );
+	for ( i = first & ~3, planes4 += first >> 2 ; i < numPlanes ; i += 4, planes4++, plane = _mm_add_epi32( plane, _mm_set1_epi32( 4 ) ) ) {
+		CM_PlaneDistances4( tw, type, planes4, &dist, &d1, NULL );
+
+		lanes = _mm_castsi128_ps( _mm_and_si128( _mm_cmpgt_epi32( plane, _mm_set1_epi32( first - 1 ) ),
+			_mm_cmplt_epi32( plane, _mm_set1_epi32( numPlanes ) ) ) );
+		if ( _mm_movemask_ps( _mm_and_ps( lanes, _mm_cmpgt_ps( d1, _mm_setzero_ps( ) ) ) ) ) {
+			return qtrue;
+		}
+	}
+	return qfalse;
+}
+#endif
+
 
 /*
 ===============================================================================
@@ -183,6 +436,16 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 		return;
 	}
 
+#if CM_SIMD
+	if ( brush->sides4 && cm_simd->integer ) {
+		// the first six planes are the axial planes, so we only
+		// need to test the remainder
+		if ( CM_InFrontOfPlanes4( tw, tw->type == TT_CAPSULE ? TT_CAPSULE : TT_AABB,
+			brush->sides4, 6, brush->numsides ) ) {
+			return;
+		}
+	} else
+#endif
    if ( tw->type == TT_CAPSULE ) {
 		// the first six planes are the axial planes, so we only
 		// need to test the remainder
@@ -243,17 +506,17 @@ CM_TestInLeaf
 void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
 	int			brushnum;
+	int			surfacenum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
 	// test box position against all brushes in the leaf
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
-		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
+		if ( !CM_VisitBrush( tw->visited, brushnum ) ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		b = &cm.brushes[brushnum];
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -272,14 +535,14 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif //BSPC
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfacenum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfacenum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( !CM_VisitPatch( tw->visited, surfacenum ) ) {
 				continue;	// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -428,14 +691,10 @@ void CM_PositionTest( traceWork_t *tw ) {
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
-
-	cm.checkcount++;
+	ll.visited = NULL;
 
 	CM_BoxLeafnums_r( &ll, 0 );
 
-
-	cm.checkcount++;
-
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
 		CM_TestInLeaf( tw, &cm.leafs[leafs[i]] );
@@ -507,6 +766,30 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 
 	leadside = NULL;
 
+#if CM_SIMD
+	if ( brush->sides4 && cm_simd->integer ) {
+		planeClip4_t	clip;
+		qboolean		inFront;
+
+		// all planes four at a time, with the same results as the loops below
+		inFront = !CM_ClipToPlanes4( tw, tw->type, brush->sides4, brush->numsides, &clip );
+		if ( clip.crossed ) {
+			tw->visited->collided[ brush - cm.brushes ] = tw->visited->generation;
+		}
+		if ( inFront ) {
+			return;
+		}
+
+		getout = clip.getout;
+		startout = clip.startout;
+		enterFrac = clip.enterFrac;
+		leaveFrac = clip.leaveFrac;
+		if ( clip.enterPlane >= 0 ) {
+			leadside = brush->sides + clip.enterPlane;
+			clipplane = leadside->plane;
+		}
+	} else
+#endif
 	if( tw->type == TT_BISPHERE )
 	{
 		//
@@ -539,7 +822,7 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 			if( d1 <= 0 && d2 <= 0 )
 				continue;
 
-			brush->collided = qtrue;
+			tw->visited->collided[ brush - cm.brushes ] = tw->visited->generation;
 
 			// crosses face
 			if( d1 > d2 )
@@ -616,7 +899,7 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 				continue;
 			}
 
-			brush->collided = qtrue;
+			tw->visited->collided[ brush - cm.brushes ] = tw->visited->generation;
 
 			// crosses face
 			if (d1 > d2) {	// enter
@@ -672,7 +955,7 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 				continue;
 			}
 
-			brush->collided = qtrue;
+			tw->visited->collided[ brush - cm.brushes ] = tw->visited->generation;
 
 			// crosses face
 			if (d1 > d2) {	// enter
@@ -747,6 +1030,7 @@ static void CM_ProximityToBrush( traceWork_t *tw, cbrush_t *brush )
 	VectorClear( tw2.sphere.offset );
 	VectorCopy( tw->start, tw2.start );
 	VectorCopy( tw->end, tw2.end );
+	tw2.visited = tw->visited;
 
 	CM_TraceThroughBrush( &tw2, brush );
 
@@ -825,6 +1109,7 @@ CM_TraceThroughLeaf
 void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
 	int			brushnum;
+	int			surfacenum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
@@ -832,18 +1117,15 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 
-		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( !CM_VisitBrush( tw->visited, brushnum ) ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		b = &cm.brushes[brushnum];
 
 		if ( !(b->contents & tw->contents) ) {
 			continue;
 		}
 
-		b->collided = qfalse;
-
 		if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
 					b->bounds[0], b->bounds[1] ) ) {
 			continue;
@@ -863,14 +1145,14 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfacenum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfacenum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( !CM_VisitPatch( tw->visited, surfacenum ) ) {
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -894,7 +1176,7 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 			b = &cm.brushes[ brushnum ];
 
 			// This brush never collided, so don't bother
-			if( !b->collided )
+			if( tw->visited->collided[ brushnum ] != tw->visited->generation )
 				continue;
 
 			if( !( b->contents & tw->contents ) )
@@ -1351,12 +1633,11 @@ void CM_Trace( trace_t *results, const vec3_t start,
 
 	cmod = CM_ClipHandleToModel( model );
 
-	cm.checkcount++;		// for multi-check avoidance
-
 	c_traces++;				// for statistics, may be zeroed
 
 	// fill in a default trace
 	Com_Memset( &tw, 0, sizeof(tw) );
+	tw.visited = CM_BeginVisit();	// for multi-check avoidance
 	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
 	VectorCopy(origin, tw.modelOrigin);
 	tw.type = type;
@@ -1682,12 +1963,11 @@ void CM_BiSphereTrace( trace_t *results, const vec3_t start,
 
 	cmod = CM_ClipHandleToModel( model );
 
-	cm.checkcount++;		// for multi-check avoidance
-
 	c_traces++;				// for statistics, may be zeroed
 
 	// fill in a default trace
 	Com_Memset( &tw, 0, sizeof( tw ) );
+	tw.visited = CM_BeginVisit();	// for multi-check avoidance
 	tw.trace.fraction = 1.0f; // assume it goes the entire distance until shown otherwise
 	VectorCopy( vec3_origin, tw.modelOrigin );
 	tw.type = TT_BISPHERE;
@@ -1791,3 +2071,321 @@ void CM_TransformedBiSphereTrace( trace_t *results, const vec3_t start,
 
 	*results = trace;
 }
+
+//======================================================================
+
+#define	STRESS_BATCH_TRACES	8192
+#define	STRESS_JOB_TRACES	256
+
+typedef struct {
+	vec3_t			start;
+	vec3_t			end;
+	vec3_t			mins;
+	vec3_t			maxs;
+	vec3_t			angles;
+	clipHandle_t	model;
+	int				mask;
+	traceType_t		type;
+	trace_t			reference;	// result traced the reference way
+	trace_t			result;		// result traced the way being tested
+} stressTrace_t;
+
+typedef struct {
+	stressTrace_t	*traces;
+	int				count;		// the last job may get fewer than STRESS_JOB_TRACES
+} stressBatch_t;
+
+/*
+==================
+CM_StressRand
+
+Returns 0 to n - 1 from the better high bits of Q_rand
+==================
+*/
+static int CM_StressRand( int *seed, int n ) {
+	return ( ( Q_rand( seed ) >> 16 ) & 0x7fff ) % n;
+}
+
+/*
+==================
+CM_StressCorpus
+
+Fills in a batch of random boxes, capsules and bispheres to trace through the
+world and the inline models
+==================
+*/
+static void CM_StressCorpus( stressTrace_t *traces, int count, int *seed ) {
+	stressTrace_t	*st;
+	vec3_t			worldMins, worldMaxs;
+	float			size;
+	int				i, j;
+
+	CM_ModelBounds( 0, worldMins, worldMaxs );
+
+	for ( i = 0, st = traces ; i < count ; i++, st++ ) {
+		for ( j = 0 ; j < 3 ; j++ ) {
+			st->start[j] = worldMins[j] + Q_random( seed ) * ( worldMaxs[j] - worldMins[j] );
+			st->end[j] = st->start[j] + Q_crandom( seed ) * 1024;
+		}
+		// some position tests and point traces
+		switch ( CM_StressRand( seed, 8 ) ) {
+		case 0:
+			VectorCopy( st->start, st->end );
+			size = 16;
+			break;
+		case 1:
+			size = 0;
+			break;
+		default:
+			size = Q_random( seed ) * 48;
+			break;
+		}
+		// off center like a player box, so the box gets recentered
+		VectorSet( st->mins, -size, -size, -size );
+		VectorSet( st->maxs, size, size, size * 1.5f );
+		VectorClear( st->angles );
+
+		st->model = 0;
+		if ( CM_NumInlineModels( ) > 1 && !CM_StressRand( seed, 4 ) ) {
+			st->model = CM_InlineModel( 1 + CM_StressRand( seed, CM_NumInlineModels( ) - 1 ) );
+			if ( CM_StressRand( seed, 2 ) ) {
+				st->angles[YAW] = Q_random( seed ) * 360;
+			}
+		}
+
+		st->mask = CM_StressRand( seed, 2 ) ? -1 : CONTENTS_SOLID | CONTENTS_PLAYERCLIP;
+		st->type = TT_AABB + CM_StressRand( seed, 3 );	// TT_AABB, TT_CAPSULE or TT_BISPHERE
+		if ( st->type == TT_BISPHERE ) {
+			st->mins[0] = Q_random( seed ) * 32;
+			st->maxs[0] = Q_random( seed ) * 32;
+		}
+	}
+}
+
+/*
+==================
+CM_StressTrace
+==================
+*/
+static void CM_StressTrace( stressTrace_t *st, trace_t *results ) {
+	if ( st->type == TT_BISPHERE ) {
+		CM_TransformedBiSphereTrace( results, st->start, st->end,
+			st->mins[0], st->maxs[0], st->model, st->mask, vec3_origin );
+	} else {
+		CM_TransformedBoxTrace( results, st->start, st->end, st->mins, st->maxs,
+			st->model, st->mask, vec3_origin, st->angles, st->type );
+	}
+}
+
+/*
+==================
+CM_StressTraceJob
+==================
+*/
+static void CM_StressTraceJob( void *data, int index, int thread ) {
+	stressBatch_t	*batch = data;
+	stressTrace_t	*st;
+	int				i, count;
+
+	st = batch->traces + index * STRESS_JOB_TRACES;
+	count = batch->count - index * STRESS_JOB_TRACES;
+	if ( count > STRESS_JOB_TRACES ) {
+		count = STRESS_JOB_TRACES;
+	}
+
+	for ( i = 0 ; i < count ; i++, st++ ) {
+		CM_StressTrace( st, &st->result );
+	}
+}
+
+/*
+==================
+CM_TracesMatch
+==================
+*/
+static qboolean CM_TracesMatch( const trace_t *a, const trace_t *b ) {
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid &&
+		a->fraction == b->fraction && VectorCompare( a->endpos, b->endpos ) &&
+		VectorCompare( a->plane.normal, b->plane.normal ) && a->plane.dist == b->plane.dist &&
+		a->surfaceFlags == b->surfaceFlags && a->contents == b->contents &&
+		a->lateralFraction == b->lateralFraction;
+}
+
+/*
+==================
+CM_TraceStress_f
+
+Traces random boxes, capsules and bispheres through the world and the inline
+models from several worker threads at once and checks every result against
+the same trace made from the main thread
+==================
+*/
+void CM_TraceStress_f( void ) {
+	static workerPool_t	*pool;
+	stressTrace_t	*traces, *st;
+	stressBatch_t	jobs;
+	int				total, threads, done, batch;
+	int				i, seed, mismatches;
+	int				singleMsec, threadedMsec, start;
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "No map loaded\n" );
+		return;
+	}
+
+	total = 1000000;
+	threads = 4;
+	if ( Cmd_Argc( ) > 1 ) {
+		total = atoi( Cmd_Argv( 1 ) );
+	}
+	if ( Cmd_Argc( ) > 2 ) {
+		threads = atoi( Cmd_Argv( 2 ) );
+	}
+	if ( total <= 0 || threads <= 0 ) {
+		Com_Printf( "usage: cm_traceStress [traces] [threads]\n" );
+		return;
+	}
+
+	// worker threads keep their visited sets until they exit, so keep the
+	// pool around between runs
+	if ( Sys_WorkerPoolThreads( pool ) != threads ) {
+		Sys_DestroyWorkerPool( pool );
+		pool = Sys_CreateWorkerPool( threads );
+		if ( !pool ) {
+			Com_Printf( "Couldn't start any worker threads\n" );
+			return;
+		}
+	}
+
+	traces = Z_Malloc( STRESS_BATCH_TRACES * sizeof( *traces ) );
+
+	seed = 0x5eed;
+	mismatches = 0;
+	singleMsec = threadedMsec = 0;
+
+	for ( done = 0 ; done < total ; done += batch ) {
+		batch = total - done;
+		if ( batch > STRESS_BATCH_TRACES ) {
+			batch = STRESS_BATCH_TRACES;
+		}
+
+		CM_StressCorpus( traces, batch, &seed );
+
+		start = Sys_Milliseconds( );
+		for ( i = 0, st = traces ; i < batch ; i++, st++ ) {
+			CM_StressTrace( st, &st->reference );
+		}
+		singleMsec += Sys_Milliseconds( ) - start;
+
+		start = Sys_Milliseconds( );
+		jobs.traces = traces;
+		jobs.count = batch;
+		Sys_RunWorkerJobs( pool, CM_StressTraceJob, &jobs,
+			( batch + STRESS_JOB_TRACES - 1 ) / STRESS_JOB_TRACES );
+		threadedMsec += Sys_Milliseconds( ) - start;
+
+		for ( i = 0, st = traces ; i < batch ; i++, st++ ) {
+			if ( CM_TracesMatch( &st->reference, &st->result ) ) {
+				continue;
+			}
+			if ( !mismatches ) {
+				Com_Printf( "mismatch: model %i type %i from (%f %f %f) to (%f %f %f): "
+					"fraction %f / %f\n", st->model, st->type,
+					st->start[0], st->start[1], st->start[2],
+					st->end[0], st->end[1], st->end[2],
+					st->reference.fraction, st->result.fraction );
+			}
+			mismatches++;
+		}
+	}
+
+	Z_Free( traces );
+
+	Com_Printf( "%i traces: %i msec single, %i msec on %i+1 threads, %i mismatches\n",
+		done, singleMsec, threadedMsec, Sys_WorkerPoolThreads( pool ), mismatches );
+}
+
+/*
+==================
+CM_TraceSimd_f
+
+Traces the same random boxes, capsules and bispheres with the scalar plane
+loops and with the SSE2 kernels and checks that every trace_t comes out bit
+identical
+==================
+*/
+void CM_TraceSimd_f( void ) {
+#if CM_SIMD
+	stressTrace_t	*traces, *st;
+	char			simd[ MAX_CVAR_VALUE_STRING ];
+	int				total, done, batch;
+	int				i, seed, mismatches;
+	int				scalarMsec, simdMsec, start;
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "No map loaded\n" );
+		return;
+	}
+
+	total = 1000000;
+	if ( Cmd_Argc( ) > 1 ) {
+		total = atoi( Cmd_Argv( 1 ) );
+	}
+	if ( total <= 0 ) {
+		Com_Printf( "usage: cm_traceSimd [traces]\n" );
+		return;
+	}
+
+	Q_strncpyz( simd, cm_simd->string, sizeof( simd ) );
+	traces = Z_Malloc( STRESS_BATCH_TRACES * sizeof( *traces ) );
+
+	seed = 0x5eed;
+	mismatches = 0;
+	scalarMsec = simdMsec = 0;
+
+	for ( done = 0 ; done < total ; done += batch ) {
+		batch = total - done;
+		if ( batch > STRESS_BATCH_TRACES ) {
+			batch = STRESS_BATCH_TRACES;
+		}
+
+		CM_StressCorpus( traces, batch, &seed );
+
+		Cvar_Set( "cm_simd", "0" );
+		start = Sys_Milliseconds( );
+		for ( i = 0, st = traces ; i < batch ; i++, st++ ) {
+			CM_StressTrace( st, &st->reference );
+		}
+		scalarMsec += Sys_Milliseconds( ) - start;
+
+		Cvar_Set( "cm_simd", "1" );
+		start = Sys_Milliseconds( );
+		for ( i = 0, st = traces ; i < batch ; i++, st++ ) {
+			CM_StressTrace( st, &st->result );
+		}
+		simdMsec += Sys_Milliseconds( ) - start;
+
+		for ( i = 0, st = traces ; i < batch ; i++, st++ ) {
+			if ( !memcmp( &st->reference, &st->result, sizeof( trace_t ) ) ) {
+				continue;
+			}
+			if ( !mismatches ) {
+				Com_Printf( "mismatch: model %i type %i from (%f %f %f) to (%f %f %f): "
+					"fraction %f / %f\n", st->model, st->type,
+					st->start[0], st->start[1], st->start[2],
+					st->end[0], st->end[1], st->end[2],
+					st->reference.fraction, st->result.fraction );
+			}
+			mismatches++;
+		}
+	}
+
+	Cvar_Set( "cm_simd", simd );
+	Z_Free( traces );
+
+	Com_Printf( "%i traces: %i msec scalar, %i msec simd, %i mismatches\n",
+		done, scalarMsec, simdMsec, mismatches );
+#else
+	Com_Printf( "The SIMD trace kernels are not built on this platform\n" );
+#endif
+}
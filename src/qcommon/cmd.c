@@ -310,9 +310,11 @@ void Cmd_Echo_f (void)
 =============================================================================
 */
 
+#define	CMD_HASH_SIZE	512
+
 typedef struct cmd_function_s
 {
-	struct cmd_function_s	*next;
+	struct cmd_function_s	*next;		// next in the same hash chain
 	char					*name;
 	xcommand_t				function;
 	completionFunc_t	complete;
@@ -329,7 +331,12 @@ typedef struct cmdContext_s
 
 static cmdContext_t		cmd;
 static cmdContext_t		savedCmd;
-static cmd_function_t	*cmd_functions;		// possible commands to execute
+
+// possible commands to execute, hashed case insensitively for dispatch and
+// also kept sorted by name so completion only visits the matching range
+static cmd_function_t	*cmd_hashTable[CMD_HASH_SIZE];
+static cmd_function_t	**cmd_sorted;
+static int				cmd_numSorted, cmd_maxSorted;
 
 /*
 ============
@@ -602,16 +609,61 @@ void Cmd_TokenizeStringIgnoreQuotes( const char *text_in ) {
 	Cmd_TokenizeString2( text_in, qtrue );
 }
 
+/*
+============
+Cmd_HashValue
+
+Case insensitive, so every spelling Q_stricmp accepts lands in one chain
+============
+*/
+static int Cmd_HashValue( const char *name ) {
+	int		i;
+	long	hash;
+
+	hash = 0;
+	for ( i = 0; name[i]; i++ ) {
+		hash += (long)tolower( name[i] ) * ( i + 119 );
+	}
+	hash ^= hash >> 10;
+	return hash & ( CMD_HASH_SIZE - 1 );
+}
+
+/*
+============
+Cmd_SortedIndex
+
+Returns the first position in cmd_sorted whose name is not below name
+============
+*/
+static int Cmd_SortedIndex( const char *name ) {
+	int		low, high, mid;
+
+	low = 0;
+	high = cmd_numSorted;
+	while ( low < high ) {
+		mid = ( low + high ) >> 1;
+		if ( Q_stricmp( cmd_sorted[mid]->name, name ) < 0 ) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
 /*
 ============
 Cmd_AddCommand
 ============
 */
 void	Cmd_AddCommand( const char *cmd_name, xcommand_t function ) {
-	cmd_function_t	*cmd;
+	cmd_function_t	*cmd, **sorted;
+	int				hash, i;
 	
+	hash = Cmd_HashValue( cmd_name );
+
 	// fail if the command already exists
-	for ( cmd = cmd_functions ; cmd ; cmd=cmd->next ) {
+	for ( cmd = cmd_hashTable[hash] ; cmd ; cmd=cmd->next ) {
 		if ( !strcmp( cmd_name, cmd->name ) ) {
 			// allow completion-only commands to be silently doubled
 			if ( function != NULL ) {
@@ -621,13 +673,30 @@ void	Cmd_AddCommand( const char *cmd_name, xcommand_t function ) {
 		}
 	}
 
+	// commands are added before the main zone exists, so the index
+	// goes in the small zone like everything else here
+	if ( cmd_numSorted == cmd_maxSorted ) {
+		sorted = S_Malloc( ( cmd_maxSorted + 128 ) * sizeof( *sorted ) );
+		if ( cmd_sorted ) {
+			Com_Memcpy( sorted, cmd_sorted, cmd_numSorted * sizeof( *sorted ) );
+			Z_Free( cmd_sorted );
+		}
+		cmd_sorted = sorted;
+		cmd_maxSorted += 128;
+	}
+
 	// use a small malloc to avoid zone fragmentation
 	cmd = S_Malloc (sizeof(cmd_function_t));
 	cmd->name = CopyString( cmd_name );
 	cmd->function = function;
 	cmd->complete = NULL;
-	cmd->next = cmd_functions;
-	cmd_functions = cmd;
+	cmd->next = cmd_hashTable[hash];
+	cmd_hashTable[hash] = cmd;
+
+	i = Cmd_SortedIndex( cmd_name );
+	memmove( &cmd_sorted[i + 1], &cmd_sorted[i], ( cmd_numSorted - i ) * sizeof( *cmd_sorted ) );
+	cmd_sorted[i] = cmd;
+	cmd_numSorted++;
 }
 
 /*
@@ -638,7 +707,7 @@ Cmd_SetCommandCompletionFunc
 void Cmd_SetCommandCompletionFunc( const char *command, completionFunc_t complete ) {
 	cmd_function_t	*cmd;
 
-	for( cmd = cmd_functions; cmd; cmd = cmd->next ) {
+	for( cmd = cmd_hashTable[Cmd_HashValue( command )]; cmd; cmd = cmd->next ) {
 		if( !Q_stricmp( command, cmd->name ) ) {
 			cmd->complete = complete;
 		}
@@ -652,8 +721,9 @@ Cmd_RemoveCommand
 */
 void	Cmd_RemoveCommand( const char *cmd_name ) {
 	cmd_function_t	*cmd, **back;
+	int				i;
 
-	back = &cmd_functions;
+	back = &cmd_hashTable[Cmd_HashValue( cmd_name )];
 	while( 1 ) {
 		cmd = *back;
 		if ( !cmd ) {
@@ -662,6 +732,16 @@ void	Cmd_RemoveCommand( const char *cmd_name ) {
 		}
 		if ( !strcmp( cmd_name, cmd->name ) ) {
 			*back = cmd->next;
+
+			// names that only differ in case sort next to each other
+			for ( i = Cmd_SortedIndex( cmd_name ); i < cmd_numSorted; i++ ) {
+				if ( cmd_sorted[i] == cmd ) {
+					cmd_numSorted--;
+					memmove( &cmd_sorted[i], &cmd_sorted[i + 1], ( cmd_numSorted - i ) * sizeof( *cmd_sorted ) );
+					break;
+				}
+			}
+
 			if (cmd->name) {
 				Z_Free(cmd->name);
 			}
@@ -679,10 +759,29 @@ Cmd_CommandCompletion
 ============
 */
 void	Cmd_CommandCompletion( void(*callback)(const char *s) ) {
-	cmd_function_t	*cmd;
+	int		i;
 	
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next) {
-		callback( cmd->name );
+	for ( i = 0 ; i < cmd_numSorted ; i++ ) {
+		callback( cmd_sorted[i]->name );
+	}
+}
+
+/*
+============
+Cmd_PrefixCompletion
+
+Like Cmd_CommandCompletion, but only for the commands starting with prefix
+============
+*/
+void	Cmd_PrefixCompletion( const char *prefix, void(*callback)(const char *s) ) {
+	int		i, len;
+
+	len = strlen( prefix );
+	for ( i = Cmd_SortedIndex( prefix ) ; i < cmd_numSorted ; i++ ) {
+		if ( Q_stricmpn( cmd_sorted[i]->name, prefix, len ) ) {
+			break;
+		}
+		callback( cmd_sorted[i]->name );
 	}
 }
 
@@ -694,7 +793,7 @@ Cmd_CompleteArgument
 void Cmd_CompleteArgument( const char *command, char *args, int argNum ) {
 	cmd_function_t	*cmd;
 
-	for( cmd = cmd_functions; cmd; cmd = cmd->next ) {
+	for( cmd = cmd_hashTable[Cmd_HashValue( command )]; cmd; cmd = cmd->next ) {
 		if( !Q_stricmp( command, cmd->name ) && cmd->complete ) {
 			cmd->complete( args, argNum );
 		}
@@ -710,7 +809,7 @@ A complete command line has been parsed, so try to execute it
 ============
 */
 void	Cmd_ExecuteString( const char *text ) {	
-	cmd_function_t	*cmdFunc, **prev;
+	cmd_function_t	*cmdFunc, **prev, **head;
 
 	// execute the command line
 	Cmd_TokenizeString( text );		
@@ -719,14 +818,15 @@ void	Cmd_ExecuteString( const char *text ) {
 	}
 
 	// check registered command functions	
-	for ( prev = &cmd_functions ; *prev ; prev = &cmdFunc->next ) {
+	head = &cmd_hashTable[Cmd_HashValue( cmd.argv[0] )];
+	for ( prev = head ; *prev ; prev = &cmdFunc->next ) {
 		cmdFunc = *prev;
 		if ( !Q_stricmp( cmd.argv[0], cmdFunc->name ) ) {
 			// rearrange the links so that the command will be
-			// near the head of the list next time it is used
+			// near the head of the chain next time it is used
 			*prev = cmdFunc->next;
-			cmdFunc->next = cmd_functions;
-			cmd_functions = cmdFunc;
+			cmdFunc->next = *head;
+			*head = cmdFunc;
 
 			// perform the action
 			if ( !cmdFunc->function ) {
@@ -772,7 +872,7 @@ Cmd_List_f
 void Cmd_List_f (void)
 {
 	cmd_function_t	*cmd;
-	int				i;
+	int				i, j;
 	char			*match;
 
 	if ( Cmd_Argc() > 1 ) {
@@ -782,7 +882,8 @@ void Cmd_List_f (void)
 	}
 
 	i = 0;
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next) {
+	for (j = 0 ; j < cmd_numSorted ; j++) {
+		cmd = cmd_sorted[j];
 		if (match && !Com_Filter(match, cmd->name, qfalse)) continue;
 
 		Com_Printf ("%s\n", cmd->name);
@@ -802,6 +903,148 @@ void Cmd_CompleteCfgName( char *args, int argNum ) {
 	}
 }
 
+#define CBUFBENCH_LINES		50000
+#define CBUFBENCH_PASSES	4
+
+static int		cmd_benchCalls;
+
+static void Cmd_BenchNop_f( void ) {
+	cmd_benchCalls++;
+}
+
+/*
+============
+Cmd_BenchScript
+
+Feeds a script through the command buffer in pieces it can hold and
+returns the microseconds spent executing it
+============
+*/
+static int64_t Cmd_BenchScript( const char *script, int len ) {
+	char	chunk[MAX_CMD_BUFFER / 2];
+	int		i, n;
+	int64_t	start;
+
+	start = Sys_Microseconds();
+	for ( i = 0; i < len; i += n ) {
+		n = len - i;
+		if ( n > (int)sizeof( chunk ) - 1 ) {
+			// end the piece on a line break when there is one
+			for ( n = sizeof( chunk ) - 1; n > 1 && script[i + n - 1] != '\n'; n-- ) {
+			}
+			if ( n == 1 ) {
+				n = sizeof( chunk ) - 1;
+			}
+		}
+		Com_Memcpy( chunk, script + i, n );
+		chunk[n] = 0;
+
+		Cbuf_AddText( chunk );
+		Cbuf_Execute();
+	}
+	return Sys_Microseconds() - start;
+}
+
+/*
+============
+Cmd_Bench_f
+
+cbufbench [script | -] [passes]
+
+Times Cbuf_Execute over a large script.  Without a script, one is made of
+calls to a do nothing command and cvar assignments, which go through the
+command lookup and miss it before Cvar_Command picks them up.  The command
+and the cvar are removed again afterwards.  Whatever was left in the
+command buffer is put aside while the script runs.
+============
+*/
+static void Cmd_Bench_f( void ) {
+	static byte	saved[MAX_CMD_BUFFER];
+	int			savedSize, savedWait;
+	char		*script, *p;
+	void		*file;
+	cvar_t		*var;
+	qboolean	createdVar;
+	int			len, lines, passes, pass, i;
+	int64_t		usec, best;
+
+	passes = CBUFBENCH_PASSES;
+	if ( Cmd_Argc() > 2 ) {
+		passes = atoi( Cmd_Argv( 2 ) );
+		if ( passes < 1 ) {
+			passes = 1;
+		}
+	}
+
+	file = NULL;
+	var = NULL;
+	createdVar = qfalse;
+	if ( Cmd_Argc() > 1 && strcmp( Cmd_Argv( 1 ), "-" ) ) {
+		len = FS_ReadFile( Cmd_Argv( 1 ), &file );
+		if ( !file ) {
+			Com_Printf( "Couldn't read %s\n", Cmd_Argv( 1 ) );
+			return;
+		}
+		script = file;
+	} else {
+		createdVar = Cvar_Flags( "cbufbench_var" ) == CVAR_NONEXISTENT;
+		var = Cvar_Get( "cbufbench_var", "0", CVAR_TEMP );
+		Cmd_AddCommand( "cbufbench_nop", Cmd_BenchNop_f );
+
+		script = p = Z_Malloc( CBUFBENCH_LINES * 32 );
+		for ( i = 0; i < CBUFBENCH_LINES; i++ ) {
+			if ( i & 1 ) {
+				Com_sprintf( p, 32, "cbufbench_var %i\n", i );
+			} else {
+				Com_sprintf( p, 32, "cbufbench_nop %i\n", i );
+			}
+			p += strlen( p );
+		}
+		len = p - script;
+	}
+
+	for ( i = 0, lines = 0; i < len; i++ ) {
+		if ( script[i] == '\n' ) {
+			lines++;
+		}
+	}
+
+	savedSize = cmd_text.cursize;
+	savedWait = cmd_wait;
+	Com_Memcpy( saved, cmd_text.data, savedSize );
+	cmd_text.cursize = 0;
+	cmd_wait = 0;
+
+	best = 0;
+	cmd_benchCalls = 0;
+	for ( pass = 0; pass < passes; pass++ ) {
+		usec = Cmd_BenchScript( script, len );
+		if ( !pass || usec < best ) {
+			best = usec;
+		}
+	}
+
+	// a wait in the script leaves the rest of it behind
+	cmd_text.cursize = savedSize;
+	cmd_wait = savedWait;
+	Com_Memcpy( cmd_text.data, saved, savedSize );
+
+	Com_Printf( "%i lines, best of %i passes: %i usec, %.1f nsec/line, %.0f lines/sec\n",
+		lines, passes, (int)best, lines ? best * 1000.0 / lines : 0.0,
+		best ? lines * 1000000.0 / best : 0.0 );
+
+	if ( file ) {
+		FS_FreeFile( file );
+	} else {
+		Com_Printf( "%i command calls\n", cmd_benchCalls );
+		Cmd_RemoveCommand( "cbufbench_nop" );
+		if ( createdVar ) {
+			Cvar_Unset( var );
+		}
+		Z_Free( script );
+	}
+}
+
 /*
 ============
 Cmd_Init
@@ -815,5 +1058,6 @@ void Cmd_Init (void) {
 	Cmd_SetCommandCompletionFunc( "vstr", Cvar_CompleteCvarName );
 	Cmd_AddCommand ("echo",Cmd_Echo_f);
 	Cmd_AddCommand ("wait", Cmd_Wait_f);
+	Cmd_AddCommand ("cbufbench", Cmd_Bench_f);
 }
 
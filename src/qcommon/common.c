@@ -728,7 +728,13 @@ int Com_RealTime(qtime_t *qtime) {
 There is never any space between memblocks, and there will never be two
 contiguous free memblocks.
 
-The rover can be left pointing at a non-empty block
+Free blocks are also kept on segregated free lists, one for each size class,
+so an allocation never has to walk past the used blocks.  A size class is
+a power of two split into ZONE_SL_COUNT linear steps, and two bitmaps record
+which classes have free blocks.  An allocation is rounded up to the next
+class so the first block on any non-empty class that large will fit, which
+makes both Z_TagMalloc and Z_Free constant time regardless of how
+fragmented the zone gets over a long uptime.
 
 The zone calls are pretty much only used for small strings and structures,
 all big things are allocated on the hunk.
@@ -738,6 +744,10 @@ all big things are allocated on the hunk.
 #define	ZONEID	0x1d4a11
 #define MINFRAGMENT	64
 
+#define ZONE_SL_BITS	3
+#define ZONE_SL_COUNT	( 1 << ZONE_SL_BITS )	// linear classes per power of two
+#define ZONE_FL_COUNT	31						// power of two classes, block sizes are ints
+
 typedef struct zonedebug_s {
 	char *label;
 	char *file;
@@ -755,11 +765,29 @@ typedef struct memblock_s {
 #endif
 } memblock_t;
 
+// the free list links are kept in the body of a free block
+typedef struct {
+	memblock_t	*next, *prev;
+} memfree_t;
+
+// every block must be able to hold the free list links once it is freed
+#define ZONE_MINBLOCK	PAD( sizeof( memblock_t ) + sizeof( memfree_t ), sizeof( intptr_t ) )
+
+// Z_ZoneMalloc splits off a remainder of more than MINFRAGMENT bytes as a
+// free block, and block sizes are multiples of sizeof( intptr_t ), so the
+// smallest such fragment has to hold the links too.  This fails to compile
+// if it can't.
+typedef char zoneFragmentCheck_t[ PAD( MINFRAGMENT + 1, sizeof( intptr_t ) ) >= ZONE_MINBLOCK ? 1 : -1 ];
+
 typedef struct {
 	int		size;			// total bytes malloced, including header
 	int		used;			// total bytes used
 	memblock_t	blocklist;	// start / end cap for linked list
-	memblock_t	*rover;
+	memblock_t	*rover;		// next fit position, only used by zonebench
+
+	unsigned int	flBitmap;					// power of two classes with free blocks
+	unsigned int	slBitmap[ZONE_FL_COUNT];	// linear classes with free blocks
+	memblock_t	*freelist[ZONE_FL_COUNT][ZONE_SL_COUNT];
 } memzone_t;
 
 // main zone for all "dynamic" memory allocation
@@ -769,6 +797,174 @@ memzone_t	*mainzone;
 memzone_t	*smallzone;
 
 void Z_CheckHeap( void );
+static void Z_TraceAlloc( memblock_t *block, int size, int tag );
+static void Z_TraceFree( memblock_t *block );
+
+static qboolean	zoneTracing;
+
+/*
+========================
+Z_LowBit / Z_HighBit
+========================
+*/
+static ID_INLINE int Z_LowBit( unsigned int bits ) {
+#ifdef __GNUC__
+	return __builtin_ctz( bits );
+#else
+	int		i;
+
+	for ( i = 0; !( bits & 1 ); i++ ) {
+		bits >>= 1;
+	}
+	return i;
+#endif
+}
+
+static ID_INLINE int Z_HighBit( unsigned int bits ) {
+#ifdef __GNUC__
+	return 31 - __builtin_clz( bits );
+#else
+	int		i;
+
+	for ( i = -1; bits; i++ ) {
+		bits >>= 1;
+	}
+	return i;
+#endif
+}
+
+/*
+========================
+Z_SizeClass
+
+Finds the class a free block of the given size is filed under
+========================
+*/
+static ID_INLINE void Z_SizeClass( int size, int *fl, int *sl ) {
+	*fl = Z_HighBit( size );
+	*sl = ( size >> ( *fl - ZONE_SL_BITS ) ) - ZONE_SL_COUNT;
+}
+
+/*
+========================
+Z_LinkFree
+========================
+*/
+static void Z_LinkFree( memzone_t *zone, memblock_t *block ) {
+	memfree_t	*links;
+	int			fl, sl;
+
+	Z_SizeClass( block->size, &fl, &sl );
+
+	links = (memfree_t *)( block + 1 );
+	links->prev = NULL;
+	links->next = zone->freelist[fl][sl];
+	if ( links->next ) {
+		( (memfree_t *)( links->next + 1 ) )->prev = block;
+	}
+	zone->freelist[fl][sl] = block;
+
+	zone->flBitmap |= 1u << fl;
+	zone->slBitmap[fl] |= 1u << sl;
+}
+
+/*
+========================
+Z_UnlinkFree
+========================
+*/
+static void Z_UnlinkFree( memzone_t *zone, memblock_t *block ) {
+	memfree_t	*links;
+	int			fl, sl;
+
+	Z_SizeClass( block->size, &fl, &sl );
+
+	links = (memfree_t *)( block + 1 );
+	if ( links->next ) {
+		( (memfree_t *)( links->next + 1 ) )->prev = links->prev;
+	}
+	if ( links->prev ) {
+		( (memfree_t *)( links->prev + 1 ) )->next = links->next;
+	} else {
+		zone->freelist[fl][sl] = links->next;
+		if ( !links->next ) {
+			zone->slBitmap[fl] &= ~( 1u << sl );
+			if ( !zone->slBitmap[fl] ) {
+				zone->flBitmap &= ~( 1u << fl );
+			}
+		}
+	}
+}
+
+/*
+========================
+Z_FindFree
+
+Returns a free block of at least size bytes, or NULL
+========================
+*/
+static memblock_t *Z_FindFree( memzone_t *zone, int size ) {
+	memblock_t	*block;
+	unsigned int	bits;
+	int			fl, sl;
+
+	// round up to the next class, so any block filed there is big enough
+	Z_SizeClass( size + ( 1 << ( Z_HighBit( size ) - ZONE_SL_BITS ) ) - 1, &fl, &sl );
+
+	if ( fl < ZONE_FL_COUNT ) {
+		bits = zone->slBitmap[fl] & ( ~0u << sl );
+		if ( !bits ) {
+			bits = zone->flBitmap & ( ~0u << ( fl + 1 ) );
+			if ( bits ) {
+				fl = Z_LowBit( bits );
+				bits = zone->slBitmap[fl];
+			}
+		}
+		if ( bits ) {
+			return zone->freelist[fl][Z_LowBit( bits )];
+		}
+	}
+
+	// nothing in a larger class, but the class the size itself falls
+	// in may still hold a big enough block when the zone is nearly full
+	Z_SizeClass( size, &fl, &sl );
+	for ( block = zone->freelist[fl][sl]; block; block = ( (memfree_t *)( block + 1 ) )->next ) {
+		if ( block->size >= size ) {
+			return block;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+========================
+Z_FindFirstFit
+
+The original rover scan over every block, kept so zonebench can
+compare against it
+========================
+*/
+static memblock_t *Z_FindFirstFit( memzone_t *zone, int size ) {
+	memblock_t	*start, *rover, *base;
+
+	base = rover = zone->rover;
+	start = base->prev;
+
+	do {
+		if ( rover == start ) {
+			// scaned all the way around the list
+			return NULL;
+		}
+		if ( rover->tag ) {
+			base = rover = rover->next;
+		} else {
+			rover = rover->next;
+		}
+	} while ( base->tag || base->size < size );
+
+	return base;
+}
 
 /*
 ========================
@@ -788,11 +984,17 @@ void Z_ClearZone( memzone_t *zone, int size ) {
 	zone->rover = block;
 	zone->size = size;
 	zone->used = 0;
+
+	zone->flBitmap = 0;
+	Com_Memset( zone->slBitmap, 0, sizeof( zone->slBitmap ) );
+	Com_Memset( zone->freelist, 0, sizeof( zone->freelist ) );
 	
 	block->prev = block->next = &zone->blocklist;
 	block->tag = 0;			// free block
 	block->id = ZONEID;
 	block->size = size - sizeof(memzone_t);
+
+	Z_LinkFree( zone, block );
 }
 
 /*
@@ -813,13 +1015,60 @@ int Z_AvailableMemory( void ) {
 	return Z_AvailableZoneMemory( mainzone );
 }
 
+/*
+========================
+Z_ZoneFree
+
+Returns a checked block to its zone
+========================
+*/
+static void Z_ZoneFree( memzone_t *zone, memblock_t *block ) {
+	memblock_t	*other;
+
+	zone->used -= block->size;
+	// set the block to something that should cause problems
+	// if it is referenced...
+	Com_Memset( block + 1, 0xaa, block->size - sizeof( *block ) );
+
+	block->tag = 0;		// mark as free
+	
+	other = block->prev;
+	if (!other->tag) {
+		// merge with previous free block
+		Z_UnlinkFree( zone, other );
+		other->size += block->size;
+		other->next = block->next;
+		other->next->prev = other;
+		if (block == zone->rover) {
+			zone->rover = other;
+		}
+		block = other;
+	}
+
+	zone->rover = block;
+
+	other = block->next;
+	if ( !other->tag ) {
+		// merge the next free block onto the end
+		Z_UnlinkFree( zone, other );
+		block->size += other->size;
+		block->next = other->next;
+		block->next->prev = block;
+		if (other == zone->rover) {
+			zone->rover = block;
+		}
+	}
+
+	Z_LinkFree( zone, block );
+}
+
 /*
 ========================
 Z_Free
 ========================
 */
 void Z_Free( void *ptr ) {
-	memblock_t	*block, *other;
+	memblock_t	*block;
 	memzone_t *zone;
 	
 	if (!ptr) {
@@ -850,37 +1099,11 @@ void Z_Free( void *ptr ) {
 		zone = mainzone;
 	}
 
-	zone->used -= block->size;
-	// set the block to something that should cause problems
-	// if it is referenced...
-	Com_Memset( ptr, 0xaa, block->size - sizeof( *block ) );
-
-	block->tag = 0;		// mark as free
-	
-	other = block->prev;
-	if (!other->tag) {
-		// merge with previous free block
-		other->size += block->size;
-		other->next = block->next;
-		other->next->prev = other;
-		if (block == zone->rover) {
-			zone->rover = other;
-		}
-		block = other;
+	if ( zoneTracing ) {
+		Z_TraceFree( block );
 	}
 
-	zone->rover = block;
-
-	other = block->next;
-	if ( !other->tag ) {
-		// merge the next free block onto the end
-		block->size += other->size;
-		block->next = other->next;
-		block->next->prev = block;
-		if (other == zone->rover) {
-			zone->rover = block;
-		}
-	}
+	Z_ZoneFree( zone, block );
 }
 
 
@@ -892,6 +1115,7 @@ Z_FreeTags
 void Z_FreeTags( int tag ) {
 	int			count;
 	memzone_t	*zone;
+	memblock_t	*block, *prev;
 
 	if ( tag == TAG_SMALL ) {
 		zone = smallzone;
@@ -900,73 +1124,59 @@ void Z_FreeTags( int tag ) {
 		zone = mainzone;
 	}
 	count = 0;
-	// use the rover as our pointer, because
-	// Z_Free automatically adjusts it
-	zone->rover = zone->blocklist.next;
-	do {
-		if ( zone->rover->tag == tag ) {
+	block = zone->blocklist.next;
+	while ( block != &zone->blocklist ) {
+		if ( block->tag == tag ) {
 			count++;
-			Z_Free( (void *)(zone->rover + 1) );
-			continue;
+			// the freed block may be merged into the one before it,
+			// either way what follows the merged free block is in use
+			prev = block->prev;
+			Z_Free( (void *)(block + 1) );
+			block = prev->tag ? prev->next : prev;
 		}
-		zone->rover = zone->rover->next;
-	} while ( zone->rover != &zone->blocklist );
+		block = block->next;
+	}
 }
 
 
 /*
 ================
-Z_TagMalloc
+Z_BlockSize
+
+Bytes a block needs to hold size bytes for the caller
 ================
 */
-#ifdef ZONE_DEBUG
-void *Z_TagMallocDebug( int size, int tag, char *label, char *file, int line ) {
-#else
-void *Z_TagMalloc( int size, int tag ) {
-#endif
-	int		extra, allocSize;
-	memblock_t	*start, *rover, *new, *base;
-	memzone_t *zone;
-
-	if (!tag) {
-		Com_Error( ERR_FATAL, "Z_TagMalloc: tried to use a 0 tag" );
+static int Z_BlockSize( int size ) {
+	size += sizeof(memblock_t);	// account for size of block header
+	size += 4;					// space for memory trash tester
+	size = PAD(size, sizeof(intptr_t));		// align to 32/64 bit boundary
+	if ( size < (int)ZONE_MINBLOCK ) {
+		size = ZONE_MINBLOCK;	// room for the free list links
 	}
+	return size;
+}
 
-	if ( tag == TAG_SMALL ) {
-		zone = smallzone;
+/*
+================
+Z_ZoneMalloc
+
+Takes a block of size bytes, header and trash tester included, from
+the zone, or returns NULL when the zone is full
+================
+*/
+static memblock_t *Z_ZoneMalloc( memzone_t *zone, int size, int tag, qboolean firstFit ) {
+	int		extra;
+	memblock_t	*new, *base;
+
+	if ( firstFit ) {
+		base = Z_FindFirstFit( zone, size );
+	} else {
+		base = Z_FindFree( zone, size );
 	}
-	else {
-		zone = mainzone;
+	if ( !base ) {
+		return NULL;
 	}
-
-	allocSize = size;
-	//
-	// scan through the block list looking for the first free block
-	// of sufficient size
-	//
-	size += sizeof(memblock_t);	// account for size of block header
-	size += 4;					// space for memory trash tester
-	size = PAD(size, sizeof(intptr_t));		// align to 32/64 bit boundary
-	
-	base = rover = zone->rover;
-	start = base->prev;
-	
-	do {
-		if (rover == start)	{
-#ifdef ZONE_DEBUG
-			Z_LogHeap();
-#endif
-			// scaned all the way around the list
-			Com_Error( ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
-								size, zone == smallzone ? "small" : "main");
-			return NULL;
-		}
-		if (rover->tag) {
-			base = rover = rover->next;
-		} else {
-			rover = rover->next;
-		}
-	} while (base->tag || base->size < size);
+	Z_UnlinkFree( zone, base );
 	
 	//
 	// found a block big enough
@@ -983,15 +1193,60 @@ void *Z_TagMalloc( int size, int tag ) {
 		new->next->prev = new;
 		base->next = new;
 		base->size = size;
+		Z_LinkFree( zone, new );
 	}
 	
 	base->tag = tag;			// no longer a free block
 	
-	zone->rover = base->next;	// next allocation will start looking here
+	zone->rover = base->next;	// next first fit will start looking here
 	zone->used += base->size;	//
 	
 	base->id = ZONEID;
 
+	// marker for memory trash testing
+	*(int *)((byte *)base + base->size - 4) = ZONEID;
+
+	return base;
+}
+
+/*
+================
+Z_TagMalloc
+================
+*/
+#ifdef ZONE_DEBUG
+void *Z_TagMallocDebug( int size, int tag, char *label, char *file, int line ) {
+#else
+void *Z_TagMalloc( int size, int tag ) {
+#endif
+	int		allocSize;
+	memblock_t	*base;
+	memzone_t *zone;
+
+	if (!tag) {
+		Com_Error( ERR_FATAL, "Z_TagMalloc: tried to use a 0 tag" );
+	}
+
+	if ( tag == TAG_SMALL ) {
+		zone = smallzone;
+	}
+	else {
+		zone = mainzone;
+	}
+
+	allocSize = size;
+	size = Z_BlockSize( size );
+
+	base = Z_ZoneMalloc( zone, size, tag, qfalse );
+	if ( !base ) {
+#ifdef ZONE_DEBUG
+		Z_LogHeap();
+#endif
+		Com_Error( ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
+							size, zone == smallzone ? "small" : "main");
+		return NULL;
+	}
+
 #ifdef ZONE_DEBUG
 	base->d.label = label;
 	base->d.file = file;
@@ -999,8 +1254,9 @@ void *Z_TagMalloc( int size, int tag ) {
 	base->d.allocSize = allocSize;
 #endif
 
-	// marker for memory trash testing
-	*(int *)((byte *)base + base->size - 4) = ZONEID;
+	if ( zoneTracing ) {
+		Z_TraceAlloc( base, size, tag );
+	}
 
 	return (void *) ((byte *)base + sizeof(memblock_t));
 }
@@ -1041,14 +1297,19 @@ void *S_Malloc( int size ) {
 
 /*
 ========================
-Z_CheckHeap
+Z_CheckZone
 ========================
 */
-void Z_CheckHeap( void ) {
+static void Z_CheckZone( memzone_t *zone ) {
 	memblock_t	*block;
+	int			fl, sl, freeBlocks;
 	
-	for (block = mainzone->blocklist.next ; ; block = block->next) {
-		if (block->next == &mainzone->blocklist) {
+	freeBlocks = 0;
+	for (block = zone->blocklist.next ; ; block = block->next) {
+		if ( !block->tag ) {
+			freeBlocks++;
+		}
+		if (block->next == &zone->blocklist) {
 			break;			// all blocks have been hit
 		}
 		if ( (byte *)block + block->size != (byte *)block->next)
@@ -1060,6 +1321,40 @@ void Z_CheckHeap( void ) {
 			Com_Error( ERR_FATAL, "Z_CheckHeap: two consecutive free blocks\n" );
 		}
 	}
+
+	// every free block must be on the list for its class
+	for ( fl = 0; fl < ZONE_FL_COUNT; fl++ ) {
+		for ( sl = 0; sl < ZONE_SL_COUNT; sl++ ) {
+			int		bfl, bsl;
+
+			if ( !zone->freelist[fl][sl] != !( zone->slBitmap[fl] & ( 1u << sl ) ) ) {
+				Com_Error( ERR_FATAL, "Z_CheckHeap: free list bitmap out of sync\n" );
+			}
+			for ( block = zone->freelist[fl][sl]; block; block = ( (memfree_t *)( block + 1 ) )->next ) {
+				Z_SizeClass( block->size, &bfl, &bsl );
+				if ( block->tag || bfl != fl || bsl != sl ) {
+					Com_Error( ERR_FATAL, "Z_CheckHeap: block on the wrong free list\n" );
+				}
+				freeBlocks--;
+			}
+		}
+		if ( !zone->slBitmap[fl] != !( zone->flBitmap & ( 1u << fl ) ) ) {
+			Com_Error( ERR_FATAL, "Z_CheckHeap: free list bitmap out of sync\n" );
+		}
+	}
+	if ( freeBlocks ) {
+		Com_Error( ERR_FATAL, "Z_CheckHeap: free block missing from the free lists\n" );
+	}
+}
+
+/*
+========================
+Z_CheckHeap
+========================
+*/
+void Z_CheckHeap( void ) {
+	Z_CheckZone( mainzone );
+	Z_CheckZone( smallzone );
 }
 
 /*
@@ -1333,6 +1628,439 @@ void Com_Meminfo_f( void ) {
 	Com_Printf( "        %8i bytes in small Zone memory\n", smallZoneBytes );
 }
 
+/*
+==============================================================================
+
+						ZONE ALLOCATION TRACES
+
+"zonetrace start" records the layout of both zones, then every zone
+allocation and free, and "zonetrace stop [file]" turns the block addresses
+into replay slots and optionally writes the trace out.  zonebench replays
+a trace against private zones, once with the size class lists and once
+with the old first fit scan.  The layout comes first in the trace as
+the allocations and frees that rebuild it in an empty zone, so a replay
+starts out exactly as fragmented as the zones were.
+==============================================================================
+*/
+
+#define ZONETRACE_IDENT		(('C'<<24)+('R'<<16)+('T'<<8)+'Z')	// "ZTRC"
+#define ZONETRACE_VERSION	1
+#define ZONEBENCH_PASSES	4
+
+typedef struct {
+	memblock_t	*block;
+	int		size;				// block bytes asked for
+	int		tag;				// 0 for a free
+} zoneTraceRecord_t;
+
+typedef struct {
+	int		slot;				// replay pointer allocated or freed
+	int		size;
+	int		tag;				// 0 for a free
+} zoneTraceEvent_t;
+
+static zoneTraceRecord_t	*zoneTraceRecords;
+static int		zoneTraceNumRecords, zoneTraceMaxRecords;
+
+static zoneTraceEvent_t		*zoneTraceEvents;
+static int		zoneTraceNumEvents, zoneTraceNumSlots;
+static int		zoneTraceZoneSize, zoneTraceSmallZoneSize;
+static int		zoneTraceLayoutEvents;	// leading events that rebuild the layout
+
+/*
+================
+Z_TraceRecord
+================
+*/
+static void Z_TraceRecord( memblock_t *block, int size, int tag ) {
+	zoneTraceRecord_t	*r;
+
+	if ( zoneTraceNumRecords == zoneTraceMaxRecords ) {
+		r = realloc( zoneTraceRecords, ( zoneTraceMaxRecords + 65536 ) * sizeof( *r ) );
+		if ( !r ) {
+			// stop before printing, the console may allocate
+			zoneTracing = qfalse;
+			Com_Printf( S_COLOR_YELLOW "WARNING: zone trace out of memory, stopped after %i events\n",
+				zoneTraceNumRecords );
+			return;
+		}
+		zoneTraceRecords = r;
+		zoneTraceMaxRecords += 65536;
+	}
+
+	r = &zoneTraceRecords[zoneTraceNumRecords++];
+	r->block = block;
+	r->size = size;
+	r->tag = tag;
+}
+
+static void Z_TraceAlloc( memblock_t *block, int size, int tag ) {
+	Z_TraceRecord( block, size, tag );
+}
+
+static void Z_TraceFree( memblock_t *block ) {
+	Z_TraceRecord( block, 0, 0 );
+}
+
+/*
+================
+Z_TraceLayout
+
+An empty zone is carved up from the front by either allocator, so taking
+every block in order, free ones included, and then freeing the free ones
+rebuilds the same layout
+================
+*/
+static void Z_TraceLayout( memzone_t *zone, int freeTag ) {
+	memblock_t	*block;
+
+	for ( block = zone->blocklist.next; block != &zone->blocklist; block = block->next ) {
+		Z_TraceRecord( block, block->size, block->tag ? block->tag : freeTag );
+	}
+	for ( block = zone->blocklist.next; block != &zone->blocklist; block = block->next ) {
+		if ( !block->tag ) {
+			Z_TraceRecord( block, 0, 0 );
+		}
+	}
+}
+
+/*
+================
+Z_TraceFinish
+
+Maps the recorded block addresses to replay slots, reusing the slots of
+freed blocks so there are only as many as the peak number of live blocks
+================
+*/
+static void Z_TraceFinish( void ) {
+	typedef struct {
+		memblock_t	*block;
+		int			slot;		// -1 once freed
+	} traceHash_t;
+	traceHash_t		*hash, *h;
+	int				*freeSlots, numFree;
+	int				hashSize, i;
+	zoneTraceRecord_t	*r;
+	zoneTraceEvent_t	*e;
+
+	free( zoneTraceEvents );
+	zoneTraceEvents = NULL;
+	zoneTraceNumEvents = zoneTraceNumSlots = 0;
+
+	for ( hashSize = 1024; hashSize < 2 * zoneTraceNumRecords; hashSize <<= 1 ) {
+	}
+	hash = calloc( hashSize, sizeof( *hash ) );
+	freeSlots = malloc( ( zoneTraceNumRecords + 1 ) * sizeof( *freeSlots ) );
+	zoneTraceEvents = malloc( ( zoneTraceNumRecords + 1 ) * sizeof( *zoneTraceEvents ) );
+	if ( !hash || !freeSlots || !zoneTraceEvents ) {
+		Com_Printf( "Zone trace out of memory\n" );
+		free( hash );
+		free( freeSlots );
+		free( zoneTraceEvents );
+		zoneTraceEvents = NULL;
+		return;
+	}
+
+	numFree = 0;
+	for ( i = 0, r = zoneTraceRecords; i < zoneTraceNumRecords; i++, r++ ) {
+		// blocks are at least pointer aligned, so drop the low bits
+		h = &hash[( (uintptr_t)r->block >> 3 ) & ( hashSize - 1 )];
+		while ( h->block && h->block != r->block ) {
+			if ( ++h == hash + hashSize ) {
+				h = hash;
+			}
+		}
+
+		if ( r->tag ) {
+			h->block = r->block;
+			h->slot = numFree ? freeSlots[--numFree] : zoneTraceNumSlots++;
+		} else if ( !h->block || h->slot < 0 ) {
+			continue;
+		}
+
+		e = &zoneTraceEvents[zoneTraceNumEvents++];
+		e->slot = h->slot;
+		e->size = r->size;
+		e->tag = r->tag;
+
+		if ( !r->tag ) {
+			freeSlots[numFree++] = h->slot;
+			h->slot = -1;
+		}
+	}
+
+	free( hash );
+	free( freeSlots );
+	free( zoneTraceRecords );
+	zoneTraceRecords = NULL;
+	zoneTraceNumRecords = zoneTraceMaxRecords = 0;
+}
+
+/*
+================
+Z_Trace_f
+
+zonetrace start
+zonetrace stop [file]
+================
+*/
+static void Z_Trace_f( void ) {
+	fileHandle_t	f;
+	int				header[7], i;
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "start" ) ) {
+		free( zoneTraceRecords );
+		zoneTraceRecords = NULL;
+		zoneTraceNumRecords = zoneTraceMaxRecords = 0;
+		zoneTraceZoneSize = mainzone->size;
+		zoneTraceSmallZoneSize = smallzone->size;
+		zoneTracing = qtrue;
+		Z_TraceLayout( mainzone, TAG_GENERAL );
+		Z_TraceLayout( smallzone, TAG_SMALL );
+		zoneTraceLayoutEvents = zoneTraceNumRecords;
+		Com_Printf( "Zone trace started\n" );
+		return;
+	}
+
+	if ( Q_stricmp( Cmd_Argv( 1 ), "stop" ) ) {
+		Com_Printf( "usage: zonetrace <start | stop [file]>\n" );
+		return;
+	}
+
+	if ( zoneTracing ) {
+		zoneTracing = qfalse;
+		Z_TraceFinish();
+	}
+	if ( !zoneTraceEvents ) {
+		Com_Printf( "No zone trace recorded\n" );
+		return;
+	}
+	Com_Printf( "Zone trace: %i events, %i slots\n", zoneTraceNumEvents, zoneTraceNumSlots );
+
+	if ( Cmd_Argc() < 3 ) {
+		return;
+	}
+
+	f = FS_FOpenFileWrite( Cmd_Argv( 2 ) );
+	if ( !f ) {
+		Com_Printf( "Couldn't write %s\n", Cmd_Argv( 2 ) );
+		return;
+	}
+	header[0] = LittleLong( ZONETRACE_IDENT );
+	header[1] = LittleLong( ZONETRACE_VERSION );
+	header[2] = LittleLong( zoneTraceZoneSize );
+	header[3] = LittleLong( zoneTraceSmallZoneSize );
+	header[4] = LittleLong( zoneTraceNumSlots );
+	header[5] = LittleLong( zoneTraceNumEvents );
+	header[6] = LittleLong( zoneTraceLayoutEvents );
+	FS_Write( header, sizeof( header ), f );
+	for ( i = 0; i < zoneTraceNumEvents; i++ ) {
+		int		ev[3];
+
+		ev[0] = LittleLong( zoneTraceEvents[i].slot );
+		ev[1] = LittleLong( zoneTraceEvents[i].size );
+		ev[2] = LittleLong( zoneTraceEvents[i].tag );
+		FS_Write( ev, sizeof( ev ), f );
+	}
+	FS_FCloseFile( f );
+
+	Com_Printf( "Wrote %s\n", Cmd_Argv( 2 ) );
+}
+
+/*
+================
+Z_Replay
+
+Runs the trace against the two zones, returns the microseconds taken
+by the events after the layout or -1 if a zone ran out of memory
+================
+*/
+static int64_t Z_Replay( memzone_t *zone, memzone_t *small, memblock_t **slots,
+		zoneTraceEvent_t *events, int numEvents, int layoutEvents, int passes,
+		qboolean firstFit, int64_t *worst ) {
+	zoneTraceEvent_t	*e;
+	memblock_t	*block;
+	memzone_t	*z;
+	int64_t		start, total, t0, t;
+	int			pass, i;
+	qboolean	timed;
+
+	*worst = 0;
+	total = 0;
+	start = 0;
+
+	for ( pass = 0; pass < passes; pass++ ) {
+		Z_ClearZone( zone, zone->size );
+		Z_ClearZone( small, small->size );
+
+		// only the last pass times each call, so the clock reads
+		// don't swamp the totals
+		timed = qfalse;
+		t0 = 0;
+
+		for ( i = 0, e = events; i < numEvents; i++, e++ ) {
+			if ( i == layoutEvents ) {
+				start = Sys_Microseconds();
+				timed = ( pass == passes - 1 );
+			}
+			if ( timed ) {
+				t0 = Sys_Microseconds();
+			}
+
+			if ( e->tag ) {
+				z = ( e->tag == TAG_SMALL ) ? small : zone;
+				slots[e->slot] = Z_ZoneMalloc( z, e->size, e->tag, firstFit );
+				if ( !slots[e->slot] ) {
+					Com_Printf( "  out of %s zone memory at event %i\n",
+						z == small ? "small" : "main", i );
+					return -1;
+				}
+			} else {
+				block = slots[e->slot];
+				Z_ZoneFree( block->tag == TAG_SMALL ? small : zone, block );
+			}
+
+			if ( timed ) {
+				t = Sys_Microseconds() - t0;
+				if ( t > *worst ) {
+					*worst = t;
+				}
+			}
+		}
+		if ( layoutEvents < numEvents ) {
+			total += Sys_Microseconds() - start;
+		}
+	}
+
+	Z_CheckZone( zone );
+	Z_CheckZone( small );
+
+	return total;
+}
+
+/*
+================
+Z_Bench_f
+
+zonebench [file | -] [passes]
+
+Replays a zone trace, the one written by "zonetrace stop <file>" or the
+last one recorded, against private zones the size of the traced ones.
+================
+*/
+static void Z_Bench_f( void ) {
+	zoneTraceEvent_t	*events, *e;
+	memblock_t	**slots;
+	memzone_t	*zone, *small;
+	int			zoneSize, smallZoneSize, numEvents, numSlots, layoutEvents, passes, i;
+	int64_t		usec[2], worst[2];
+	int			*data, len;
+
+	passes = ZONEBENCH_PASSES;
+	if ( Cmd_Argc() > 2 ) {
+		passes = atoi( Cmd_Argv( 2 ) );
+		if ( passes < 1 ) {
+			passes = 1;
+		}
+	}
+
+	if ( Cmd_Argc() > 1 && strcmp( Cmd_Argv( 1 ), "-" ) ) {
+		len = FS_ReadFile( Cmd_Argv( 1 ), (void **)&data );
+		if ( !data ) {
+			Com_Printf( "Couldn't read %s\n", Cmd_Argv( 1 ) );
+			return;
+		}
+		numEvents = -1;
+		if ( len >= 7 * (int)sizeof( int ) && LittleLong( data[0] ) == ZONETRACE_IDENT &&
+			LittleLong( data[1] ) == ZONETRACE_VERSION ) {
+			zoneSize = LittleLong( data[2] );
+			smallZoneSize = LittleLong( data[3] );
+			numSlots = LittleLong( data[4] );
+			numEvents = LittleLong( data[5] );
+			layoutEvents = LittleLong( data[6] );
+		}
+		if ( numEvents < 0 || numSlots < 0 || ( len / (int)sizeof( int ) - 7 ) / 3 < numEvents ||
+			layoutEvents < 0 || layoutEvents > numEvents ||
+			zoneSize < (int)sizeof( memzone_t ) || smallZoneSize < (int)sizeof( memzone_t ) ) {
+			Com_Printf( "%s is not a zone trace\n", Cmd_Argv( 1 ) );
+			FS_FreeFile( data );
+			return;
+		}
+
+		events = malloc( ( numEvents + 1 ) * sizeof( *events ) );
+		if ( !events ) {
+			FS_FreeFile( data );
+			Com_Printf( "Zone trace out of memory\n" );
+			return;
+		}
+		for ( i = 0; i < numEvents; i++ ) {
+			events[i].slot = LittleLong( data[7 + i * 3] );
+			events[i].size = LittleLong( data[7 + i * 3 + 1] );
+			events[i].tag = LittleLong( data[7 + i * 3 + 2] );
+		}
+		FS_FreeFile( data );
+	} else {
+		if ( zoneTracing ) {
+			Com_Printf( "Stop the zone trace first\n" );
+			return;
+		}
+		if ( !zoneTraceEvents ) {
+			Com_Printf( "usage: zonebench [file | -] [passes], or record a trace with zonetrace\n" );
+			return;
+		}
+		events = zoneTraceEvents;
+		numEvents = zoneTraceNumEvents;
+		numSlots = zoneTraceNumSlots;
+		zoneSize = zoneTraceZoneSize;
+		smallZoneSize = zoneTraceSmallZoneSize;
+		layoutEvents = zoneTraceLayoutEvents;
+	}
+
+	zone = calloc( zoneSize, 1 );
+	small = calloc( smallZoneSize, 1 );
+	slots = calloc( numSlots + 1, sizeof( *slots ) );
+
+	// a replay trusts the trace, so check every free has a live block
+	// and every block is big enough for the free list links
+	for ( i = 0, e = events; i < numEvents && slots; i++, e++ ) {
+		if ( e->slot < 0 || e->slot >= numSlots || ( e->tag && e->size < (int)ZONE_MINBLOCK ) ||
+			!slots[e->slot] == !e->tag ) {
+			Com_Printf( "Zone trace is corrupt at event %i\n", i );
+			break;
+		}
+		slots[e->slot] = e->tag ? (memblock_t *)e : NULL;
+	}
+
+	if ( !zone || !small || !slots ) {
+		Com_Printf( "Zone bench out of memory\n" );
+	} else if ( i == numEvents ) {
+		zone->size = zoneSize;
+		small->size = smallZoneSize;
+
+		Com_Printf( "Replaying %i events on %i slots after %i layout events, %i passes\n",
+			numEvents - layoutEvents, numSlots, layoutEvents, passes );
+		usec[0] = Z_Replay( zone, small, slots, events, numEvents, layoutEvents, passes, qfalse, &worst[0] );
+		usec[1] = Z_Replay( zone, small, slots, events, numEvents, layoutEvents, passes, qtrue, &worst[1] );
+
+		for ( i = 0; i < 2; i++ ) {
+			if ( usec[i] < 0 ) {
+				continue;
+			}
+			Com_Printf( "%-11s %8i usec, %6.1f nsec/op, worst %i usec\n",
+				i ? "first fit:" : "size class:", (int)usec[i],
+				numEvents > layoutEvents ? usec[i] * 1000.0 / ( (double)( numEvents - layoutEvents ) * passes ) : 0.0,
+				(int)worst[i] );
+		}
+	}
+
+	free( zone );
+	free( small );
+	free( slots );
+	if ( events != zoneTraceEvents ) {
+		free( events );
+	}
+}
+
 /*
 ===============
 Com_TouchMemory
@@ -1549,6 +2277,8 @@ void Com_InitHunkMemory( void ) {
 	Hunk_Clear();
 
 	Cmd_AddCommand( "meminfo", Com_Meminfo_f );
+	Cmd_AddCommand( "zonetrace", Z_Trace_f );
+	Cmd_AddCommand( "zonebench", Z_Bench_f );
 #ifdef ZONE_DEBUG
 	Cmd_AddCommand( "zonelog", Z_LogHeap );
 #endif
@@ -1952,7 +2682,41 @@ EVENT LOOP
 static sysEvent_t  eventQueue[ MAX_QUEUED_EVENTS ];
 static int         eventHead = 0;
 static int         eventTail = 0;
-static byte        sys_packetReceived[ MAX_MSGLEN ];
+
+// packets are received straight into a ring of slots and processed there,
+// a slot stays queued until the event loop is done with its packet
+#define MAX_PACKET_SLOTS  64
+#define MASK_PACKET_SLOTS ( MAX_PACKET_SLOTS - 1 )
+#define MAX_PACKET_BATCH  32
+
+static netadr_t    packetFrom[ MAX_PACKET_SLOTS ];
+static msg_t       packetMsg[ MAX_PACKET_SLOTS ];
+static byte        packetData[ MAX_PACKET_SLOTS ][ MAX_MSGLEN ];
+static qboolean    packetQueued[ MAX_PACKET_SLOTS ];
+static int         packetHead = 0;
+
+// for com_speeds
+static int         com_packetsReceived;
+static int         com_packetsDropped;
+
+/*
+================
+Com_FreeEvent
+
+Releases the data of an event that has been handled or discarded
+================
+*/
+static void Com_FreeEvent( sysEvent_t *ev )
+{
+	if ( ev->evPtr )
+	{
+		Z_Free( ev->evPtr );
+	}
+	else if ( ev->evType == SE_PACKET )
+	{
+		packetQueued[ ev->evValue ] = qfalse;
+	}
+}
 
 /*
 ================
@@ -1973,10 +2737,7 @@ void Com_QueueEvent( int time, sysEventType_t type, int value, int value2, int p
 	{
 		Com_Printf("Com_QueueEvent: overflow\n");
 		// we are discarding an event, but don't leak memory
-		if ( ev->evPtr )
-		{
-			Z_Free( ev->evPtr );
-		}
+		Com_FreeEvent( ev );
 		eventTail++;
 	}
 
@@ -1995,6 +2756,65 @@ void Com_QueueEvent( int time, sysEventType_t type, int value, int value2, int p
 	ev->evPtr = ptr;
 }
 
+/*
+================
+Com_GetPackets
+
+Receives as many packets as there are free slots after packetHead
+and queues an event for each of them
+================
+*/
+static void Com_GetPackets( void )
+{
+	int   first, count, received, dropped;
+	int   time, i;
+
+	first = packetHead & MASK_PACKET_SLOTS;
+	for ( count = 0; count < MAX_PACKET_BATCH && first + count < MAX_PACKET_SLOTS; count++ )
+	{
+		if ( packetQueued[ first + count ] )
+			break;
+
+		MSG_Init( &packetMsg[ first + count ], packetData[ first + count ], MAX_MSGLEN );
+	}
+
+	// everything is still waiting to be processed, leave new
+	// packets in the socket buffers for now
+	if ( !count )
+		return;
+
+	dropped = 0;
+	received = Sys_GetPackets( &packetFrom[ first ], &packetMsg[ first ], count, &dropped );
+	com_packetsReceived += received;
+	com_packetsDropped += dropped;
+
+	if ( !received )
+		return;
+
+	time = Sys_Milliseconds();
+	for ( i = first; i < first + received; i++ )
+	{
+		// the journal needs the data in the event itself
+		if ( com_journal && com_journal->integer )
+		{
+			netadr_t  *buf;
+			int       len;
+
+			len = sizeof( netadr_t ) + packetMsg[ i ].cursize;
+			buf = Z_Malloc( len );
+			*buf = packetFrom[ i ];
+			memcpy( buf+1, packetMsg[ i ].data, packetMsg[ i ].cursize );
+			Com_QueueEvent( time, SE_PACKET, 0, 0, len, buf );
+			continue;
+		}
+
+		packetQueued[ i ] = qtrue;
+		Com_QueueEvent( time, SE_PACKET, i, 0, 0, NULL );
+	}
+
+	packetHead += received;
+}
+
 /*
 ================
 Com_GetSystemEvent
@@ -2005,8 +2825,6 @@ sysEvent_t Com_GetSystemEvent( void )
 {
 	sysEvent_t  ev;
 	char        *s;
-	msg_t       netmsg;
-	netadr_t    adr;
 
 	// return if we have data
 	if ( eventHead > eventTail )
@@ -2029,19 +2847,7 @@ sysEvent_t Com_GetSystemEvent( void )
 	}
 
 	// check for network packets
-	MSG_Init( &netmsg, sys_packetReceived, sizeof( sys_packetReceived ) );
-	if ( Sys_GetPacket ( &adr, &netmsg ) )
-	{
-		netadr_t  *buf;
-		int       len;
-
-		// copy out to a seperate buffer for qeueing
-		len = sizeof( netadr_t ) + netmsg.cursize;
-		buf = Z_Malloc( len );
-		*buf = adr;
-		memcpy( buf+1, netmsg.data, netmsg.cursize );
-		Com_QueueEvent( 0, SE_PACKET, 0, 0, len, buf );
-	}
+	Com_GetPackets();
 
 	// return if we have data
 	if ( eventHead > eventTail )
@@ -2136,9 +2942,7 @@ void Com_PushEvent( sysEvent_t *event ) {
 			Com_Printf( "WARNING: Com_PushEvent overflow\n" );
 		}
 
-		if ( ev->evPtr ) {
-			Z_Free( ev->evPtr );
-		}
+		Com_FreeEvent( ev );
 		com_pushedEventsTail++;
 	} else {
 		printedWarning = qfalse;
@@ -2197,7 +3001,7 @@ int Com_EventLoop( void ) {
 	sysEvent_t	ev;
 	netadr_t	evFrom;
 	byte		bufData[MAX_MSGLEN];
-	msg_t		buf;
+	msg_t		buf, *packet;
 
 	MSG_Init( &buf, bufData, sizeof( bufData ) );
 
@@ -2257,30 +3061,37 @@ int Com_EventLoop( void ) {
 				}
 			}
 
-			evFrom = *(netadr_t *)ev.evPtr;
-			buf.cursize = ev.evPtrLength - sizeof( evFrom );
+			if ( ev.evPtr ) {
+				evFrom = *(netadr_t *)ev.evPtr;
+				buf.cursize = ev.evPtrLength - sizeof( evFrom );
 
-			// we must copy the contents of the message out, because
-			// the event buffers are only large enough to hold the
-			// exact payload, but channel messages need to be large
-			// enough to hold fragment reassembly
-			if ( (unsigned)buf.cursize > buf.maxsize ) {
-				Com_Printf("Com_EventLoop: oversize packet\n");
-				continue;
+				// we must copy the contents of the message out, because
+				// the event buffers are only large enough to hold the
+				// exact payload, but channel messages need to be large
+				// enough to hold fragment reassembly
+				if ( (unsigned)buf.cursize > buf.maxsize ) {
+					Com_Printf("Com_EventLoop: oversize packet\n");
+					break;
+				}
+				Com_Memcpy( buf.data, (byte *)((netadr_t *)ev.evPtr + 1), buf.cursize );
+				packet = &buf;
+			} else {
+				// packet slots are full sized messages, so they
+				// are processed right where they were received
+				evFrom = packetFrom[ ev.evValue ];
+				packet = &packetMsg[ ev.evValue ];
 			}
-			Com_Memcpy( buf.data, (byte *)((netadr_t *)ev.evPtr + 1), buf.cursize );
+
 			if ( com_sv_running->integer ) {
-				Com_RunAndTimeServerPacket( &evFrom, &buf );
+				Com_RunAndTimeServerPacket( &evFrom, packet );
 			} else {
-				CL_PacketEvent( evFrom, &buf );
+				CL_PacketEvent( evFrom, packet );
 			}
 			break;
 		}
 
-		// free any block data
-		if ( ev.evPtr ) {
-			Z_Free( ev.evPtr );
-		}
+		// free any block data or packet slot
+		Com_FreeEvent( &ev );
 	}
 
 	return 0;	// never reached
@@ -2524,7 +3335,7 @@ void Com_Init( char *commandLine ) {
 
 	// Clear queues
 	Com_Memset( &eventQueue[ 0 ], 0, MAX_QUEUED_EVENTS * sizeof( sysEvent_t ) );
-	Com_Memset( &sys_packetReceived[ 0 ], 0, MAX_MSGLEN * sizeof( byte ) );
+	Com_Memset( &packetQueued[ 0 ], 0, MAX_PACKET_SLOTS * sizeof( qboolean ) );
 
 	// initialize the weak pseudo-random number generator for use later.
 	Com_InitRand();
@@ -2568,6 +3379,9 @@ void Com_Init( char *commandLine ) {
 	}
 	Cmd_AddCommand ("quit", Com_Quit_f);
 	Cmd_AddCommand ("changeVectors", MSG_ReportChangeVectors_f );
+	Cmd_AddCommand ("huffbench", MSG_HuffmanBench_f );
+	Cmd_AddCommand ("cm_traceStress", CM_TraceStress_f );
+	Cmd_AddCommand ("cm_traceSimd", CM_TraceSimd_f );
 	Cmd_AddCommand ("writeconfig", Com_WriteConfig_f );
 	Cmd_SetCommandCompletionFunc( "writeconfig", Cmd_CompleteCfgName );
 	Cmd_AddCommand("game_restart", Com_GameRestart_f);
@@ -2861,6 +3675,9 @@ void Com_Frame( void ) {
 		} else {
 			minMsec = 1;
 		}
+	} else if ( com_dedicated->integer ) {
+		// dedicated servers pace their own frames in SV_Frame
+		minMsec = 0;
 	} else {
 		minMsec = 1;
 	}
@@ -2953,10 +3770,14 @@ void Com_Frame( void ) {
 	}
 #endif
 
+	// send whatever the event loop and the client have queued up
+	Sys_FlushPackets();
+
 	//
 	// report timing information
 	//
 	if ( com_speeds->integer ) {
+		static int	packetTime, packetRate;
 		int			all, sv, ev, cl;
 
 		all = timeAfter - timeBeforeServer;
@@ -2966,8 +3787,16 @@ void Com_Frame( void ) {
 		sv -= time_game;
 		cl -= time_frontend + time_backend;
 
-		Com_Printf ("frame:%i all:%3i sv:%3i ev:%3i cl:%3i gm:%3i rf:%3i bk:%3i\n", 
-					 com_frameNumber, all, sv, ev, cl, time_game, time_frontend, time_backend );
+		// packets per second over the last second or so
+		if ( timeAfter - packetTime >= 1000 ) {
+			packetRate = com_packetsReceived * 1000 / ( timeAfter - packetTime );
+			packetTime = timeAfter;
+			com_packetsReceived = 0;
+		}
+
+		Com_Printf ("frame:%i all:%3i sv:%3i ev:%3i cl:%3i gm:%3i rf:%3i bk:%3i pk:%4i/s dr:%i\n", 
+					 com_frameNumber, all, sv, ev, cl, time_game, time_frontend, time_backend,
+					 packetRate, com_packetsDropped );
 	}	
 
 	//
@@ -3281,7 +4110,7 @@ void Field_CompleteCommand( char *cmd,
 			return;
 
 		if( doCommands )
-			Cmd_CommandCompletion( FindMatches );
+			Cmd_PrefixCompletion( completionString, FindMatches );
 
 		if( doCvars )
 			Cvar_CommandCompletion( FindMatches );
@@ -3290,7 +4119,7 @@ void Field_CompleteCommand( char *cmd,
 		{
 			// run through again, printing matches
 			if( doCommands )
-				Cmd_CommandCompletion( PrintMatches );
+				Cmd_PrefixCompletion( shortestMatch, PrintMatches );
 
 			if( doCvars )
 				Cvar_CommandCompletion( PrintCvarMatches );
@@ -219,6 +219,11 @@ typedef struct {
 	int				hashSize;					// hash table size (power of 2)
 	fileInPack_t*	*hashTable;					// hash table
 	fileInPack_t*	buildBuffer;				// buffer with the filenames etc.
+	int				namesLen;					// length of the filenames after the entries
+	int				numHeaderLongs;				// checksum feed, then the crc of every non empty file
+	int				*headerLongs;
+	int				fileSize;					// pk3 size and mtime the pak index is keyed by,
+	int				fileTime;					// size -1 if it shouldn't go into the index
 } pack_t;
 
 typedef struct {
@@ -231,6 +236,7 @@ typedef struct searchpath_s {
 
 	pack_t		*pack;		// only one of pack / dir will be non NULL
 	directory_t	*dir;
+	int			order;		// position on the search path when the file table was built
 } searchpath_t;
 
 static	char		fs_gamedir[MAX_OSPATH];	// this will be a single file name with no separators
@@ -348,6 +354,281 @@ int FS_LoadStack( void )
 	return fs_loadStack;
 }
 
+/*
+==========================================================================
+
+FILE TABLE
+
+FS_FOpenFileRead used to walk the whole search path for every file, hashing
+the name again for each pak and calling fopen in each directory, so a
+missing optional file cost hundreds of probes.  The file table maps every
+name in the paks to the highest priority pak holding it, with the pure
+server filtering already applied, so only the directories above that pak
+still have to be tried.  Directory misses are remembered for a couple of
+seconds, or until something is written through the filesystem or the search
+path changes.
+
+==========================================================================
+*/
+
+#define	MAX_DIRMISSES		4096
+#define	DIRMISS_HASH_SIZE	1024
+#define	MAX_DIRMISS_DIRS	32		// directories past this aren't remembered
+#define	DIRMISS_LIFETIME	2000	// msec, files can show up without the engine writing them
+
+typedef struct {
+	fileInPack_t	*file;			// highest priority file of this name
+	fileInPack_t	*pureFile;		// the same among the paks allowed by a pure server
+	unsigned short	search;			// fs_tableSearchPaths index of the paks holding them
+	unsigned short	pureSearch;
+	int				next;			// next entry in the hash chain, -1 at the end
+} fileTableEntry_t;
+
+typedef struct dirMiss_s {
+	char				name[MAX_QPATH];
+	unsigned int		dirs;		// bit set for every directory it isn't in
+	struct dirMiss_s	*next;
+} dirMiss_t;
+
+static	fileTableEntry_t	*fs_fileTable;
+static	int					*fs_fileTableHash;
+static	int					fs_fileTableHashSize;
+static	searchpath_t		**fs_tableSearchPaths;	// in search order
+static	searchpath_t		**fs_tableDirs;			// the directories among them
+static	int					fs_numTableDirs;
+
+static	dirMiss_t			fs_dirMisses[MAX_DIRMISSES];
+static	dirMiss_t			*fs_dirMissHash[DIRMISS_HASH_SIZE];
+static	int					fs_numDirMisses;
+static	int					fs_dirMissTime;		// when the first of them was remembered
+
+/*
+================
+FS_HashQPath
+
+Hashes the whole path the way FS_FilenameCompare compares it
+================
+*/
+static int FS_HashQPath( const char *qpath, int hashSize ) {
+	unsigned	hash;
+	int			c;
+
+	hash = 0;
+	while ( ( c = *qpath++ ) != 0 ) {
+		if ( c >= 'a' && c <= 'z' ) {
+			c -= ( 'a' - 'A' );
+		}
+		if ( c == '\\' || c == ':' ) {
+			c = '/';
+		}
+		hash = hash * 31 + c;
+	}
+	hash ^= hash >> 16;
+	return hash & ( hashSize - 1 );
+}
+
+/*
+================
+FS_ClearDirMisses
+================
+*/
+static void FS_ClearDirMisses( void ) {
+	if ( fs_numDirMisses ) {
+		Com_Memset( fs_dirMissHash, 0, sizeof( fs_dirMissHash ) );
+		fs_numDirMisses = 0;
+	}
+}
+
+/*
+================
+FS_FindDirMiss
+================
+*/
+static dirMiss_t *FS_FindDirMiss( const char *filename, qboolean create ) {
+	dirMiss_t	*miss;
+	int			hash;
+
+	hash = FS_HashQPath( filename, DIRMISS_HASH_SIZE );
+	for ( miss = fs_dirMissHash[hash] ; miss ; miss = miss->next ) {
+		if ( !FS_FilenameCompare( miss->name, filename ) ) {
+			return miss;
+		}
+	}
+
+	if ( !create || strlen( filename ) >= MAX_QPATH ) {
+		return NULL;
+	}
+	if ( fs_numDirMisses == MAX_DIRMISSES ) {
+		FS_ClearDirMisses( );
+	}
+	if ( !fs_numDirMisses ) {
+		fs_dirMissTime = Sys_Milliseconds( );
+	}
+
+	miss = &fs_dirMisses[fs_numDirMisses++];
+	Q_strncpyz( miss->name, filename, sizeof( miss->name ) );
+	miss->dirs = 0;
+	miss->next = fs_dirMissHash[hash];
+	fs_dirMissHash[hash] = miss;
+	return miss;
+}
+
+/*
+================
+FS_OpenInTableDir
+
+fopens filename in the ith directory of the file table, remembering misses
+================
+*/
+static FILE *FS_OpenInTableDir( const char *filename, int i ) {
+	directory_t	*dir;
+	dirMiss_t	*miss;
+	FILE		*f;
+
+	// they only save the fopens of a burst of lookups like a map load,
+	// so a file copied in by hand is found again soon after
+	if ( fs_numDirMisses && Sys_Milliseconds( ) - fs_dirMissTime >= DIRMISS_LIFETIME ) {
+		FS_ClearDirMisses( );
+	}
+
+	miss = FS_FindDirMiss( filename, qfalse );
+	if ( miss && i < MAX_DIRMISS_DIRS && ( miss->dirs & ( 1u << i ) ) ) {
+		return NULL;
+	}
+
+	dir = fs_tableDirs[i]->dir;
+	f = fopen( FS_BuildOSPath( dir->path, dir->gamedir, filename ), "rb" );
+	if ( !f && i < MAX_DIRMISS_DIRS ) {
+		if ( !miss ) {
+			miss = FS_FindDirMiss( filename, qtrue );
+		}
+		if ( miss ) {
+			miss->dirs |= 1u << i;
+		}
+	}
+	return f;
+}
+
+/*
+================
+FS_FreeFileTable
+================
+*/
+static void FS_FreeFileTable( void ) {
+	if ( fs_fileTable ) {
+		Z_Free( fs_fileTable );
+		Z_Free( fs_fileTableHash );
+		Z_Free( fs_tableSearchPaths );
+	}
+	fs_fileTable = NULL;
+	fs_fileTableHash = NULL;
+	fs_tableSearchPaths = fs_tableDirs = NULL;
+	fs_numTableDirs = 0;
+	FS_ClearDirMisses( );
+}
+
+/*
+================
+FS_BuildFileTable
+
+Called whenever the search path or the pure pak list changes
+================
+*/
+static void FS_BuildFileTable( void ) {
+	searchpath_t		*search;
+	fileTableEntry_t	*entry;
+	fileInPack_t		*file;
+	qboolean			pure;
+	int					i, j, k, hash, count, numSearchPaths, numEntries;
+
+	FS_FreeFileTable( );
+
+	count = numSearchPaths = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			count += search->pack->numfiles;
+		} else {
+			fs_numTableDirs++;
+		}
+		numSearchPaths++;
+	}
+
+	fs_fileTableHashSize = 1;
+	while ( fs_fileTableHashSize < count ) {
+		fs_fileTableHashSize <<= 1;
+	}
+
+	fs_fileTable = Z_Malloc( ( count + 1 ) * sizeof( *fs_fileTable ) );
+	fs_fileTableHash = Z_Malloc( fs_fileTableHashSize * sizeof( *fs_fileTableHash ) );
+	for ( i = 0 ; i < fs_fileTableHashSize ; i++ ) {
+		fs_fileTableHash[i] = -1;
+	}
+	fs_tableSearchPaths = Z_Malloc( ( numSearchPaths + fs_numTableDirs + 1 ) * sizeof( *fs_tableSearchPaths ) );
+	fs_tableDirs = fs_tableSearchPaths + numSearchPaths;
+
+	numEntries = fs_numTableDirs = 0;
+	for ( search = fs_searchpaths, i = 0 ; search ; search = search->next, i++ ) {
+		search->order = i;
+		fs_tableSearchPaths[i] = search;
+
+		if ( search->dir ) {
+			fs_tableDirs[fs_numTableDirs++] = search;
+			continue;
+		}
+
+		pure = FS_PakIsPure( search->pack );
+		for ( j = 0, file = search->pack->buildBuffer ; j < search->pack->numfiles ; j++, file++ ) {
+			if ( !file->name ) {
+				continue;	// past a damaged directory entry
+			}
+
+			hash = FS_HashQPath( file->name, fs_fileTableHashSize );
+			for ( entry = NULL, k = fs_fileTableHash[hash] ; k >= 0 ; k = entry->next ) {
+				entry = &fs_fileTable[k];
+				if ( !FS_FilenameCompare( entry->file->name, file->name ) ) {
+					break;
+				}
+			}
+
+			if ( k < 0 ) {
+				// not in any higher priority pak
+				entry = &fs_fileTable[numEntries];
+				entry->file = file;
+				entry->search = i;
+				entry->pureFile = NULL;
+				entry->next = fs_fileTableHash[hash];
+				fs_fileTableHash[hash] = numEntries++;
+			}
+			if ( pure && !entry->pureFile ) {
+				entry->pureFile = file;
+				entry->pureSearch = i;
+			}
+		}
+	}
+}
+
+/*
+================
+FS_FindFileTableEntry
+================
+*/
+static fileTableEntry_t *FS_FindFileTableEntry( const char *filename ) {
+	fileTableEntry_t	*entry;
+	int					i;
+
+	if ( !fs_fileTable ) {
+		return NULL;
+	}
+
+	for ( i = fs_fileTableHash[FS_HashQPath( filename, fs_fileTableHashSize )] ; i >= 0 ; i = entry->next ) {
+		entry = &fs_fileTable[i];
+		if ( !FS_FilenameCompare( entry->file->name, filename ) ) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
 /*
 ================
 return a hash value for the filename
@@ -688,6 +969,7 @@ fileHandle_t FS_SV_FOpenFileWrite( const char *filename ) {
 	}
 
 	FS_CheckFilenameIsNotExecutable( ospath, __func__ );
+	FS_ClearDirMisses( );
 
 	if( FS_CreatePath( ospath ) ) {
 		return 0;
@@ -799,6 +1081,7 @@ void FS_SV_Rename( const char *from, const char *to ) {
 	}
 
 	FS_CheckFilenameIsNotExecutable( to_ospath, __func__ );
+	FS_ClearDirMisses( );
 
 	if (rename( from_ospath, to_ospath )) {
 		// Failed, try copying it and deleting the original
@@ -833,6 +1116,7 @@ void FS_Rename( const char *from, const char *to ) {
 	}
 
 	FS_CheckFilenameIsNotExecutable( to_ospath, __func__ );
+	FS_ClearDirMisses( );
 
 	if (rename( from_ospath, to_ospath )) {
 		// Failed, try copying it and deleting the original
@@ -896,6 +1180,7 @@ fileHandle_t FS_FOpenFileWrite( const char *filename ) {
 	}
 
 	FS_CheckFilenameIsNotExecutable( ospath, __func__ );
+	FS_ClearDirMisses( );
 
 	if( FS_CreatePath( ospath ) ) {
 		return 0;
@@ -944,6 +1229,7 @@ fileHandle_t FS_FOpenFileAppend( const char *filename ) {
 	}
 
 	FS_CheckFilenameIsNotExecutable( ospath, __func__ );
+	FS_ClearDirMisses( );
 
 	if( FS_CreatePath( ospath ) ) {
 		return 0;
@@ -993,6 +1279,81 @@ qboolean FS_FilenameCompare( const char *s1, const char *s2 ) {
 	return qfalse;		// strings are equal
 }
 
+/*
+===========
+FS_DirFileAllowed
+
+If we are running restricted, the only files we will allow to come from
+the directory are .cfg files
+===========
+*/
+static qboolean FS_DirFileAllowed( const char *filename ) {
+	char	demoExt[16];
+	int		l;
+
+	// FIXME TTimo I'm not sure about the fs_numServerPaks test
+	// if you are using FS_ReadFile to find out if a file exists,
+	//   this test can make the search fail although the file is in the directory
+	// I had the problem on https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=8
+	// turned out I used FS_FileExists instead
+	if ( !fs_numServerPaks ) {
+		return qtrue;
+	}
+
+	Com_sprintf (demoExt, sizeof(demoExt), ".dm_%d",PROTOCOL_VERSION );
+	l = strlen( filename );
+	if ( Q_stricmp( filename + l - 4, ".cfg" )		// for config files
+		&& Q_stricmp( filename + l - 4, ".otf" )
+		&& Q_stricmp( filename + l - 4, ".ttf" )
+		&& Q_stricmp( filename + l - 5, ".menu" )	// menu files
+		&& Q_stricmp( filename + l - 5, ".game" )	// menu files
+		&& Q_stricmp( filename + l - strlen(demoExt), demoExt )	// menu files
+		&& Q_stricmp( filename + l - 4, ".dat" ) ) {	// for journal files
+		return qfalse;
+	}
+	return qtrue;
+}
+
+/*
+===========
+FS_ReferencePakFile
+
+Mark the pak as having been referenced and mark specifics on cgame and ui
+===========
+*/
+static void FS_ReferencePakFile( pack_t *pak, const char *filename ) {
+	int		l;
+
+	// shaders, txt, arena files  by themselves do not count as a reference as 
+	// these are loaded from all pk3s 
+	// from every pk3 file.. 
+	l = strlen( filename );
+	if ( !(pak->referenced & FS_GENERAL_REF)) {
+		if ( Q_stricmp(filename + l - 7, ".shader") != 0 &&
+			Q_stricmp(filename + l - 4, ".txt") != 0 &&
+			Q_stricmp(filename + l - 4, ".ttf") != 0 &&
+			Q_stricmp(filename + l - 4, ".otf") != 0 &&
+			Q_stricmp(filename + l - 4, ".cfg") != 0 &&
+			Q_stricmp(filename + l - 7, ".config") != 0 &&
+			strstr(filename, "levelshots") == NULL &&
+			Q_stricmp(filename + l - 4, ".bot") != 0 &&
+			Q_stricmp(filename + l - 6, ".arena") != 0 &&
+			Q_stricmp(filename + l - 5, ".menu") != 0) {
+			pak->referenced |= FS_GENERAL_REF;
+		}
+	}
+
+	if (!(pak->referenced & FS_QAGAME_REF) && strstr(filename, "game.qvm")) {
+		pak->referenced |= FS_QAGAME_REF;
+	}
+	if (!(pak->referenced & FS_CGAME_REF) && strstr(filename, "cgame.qvm")) {
+		pak->referenced |= FS_CGAME_REF;
+	}
+	if (!(pak->referenced & FS_UI_REF) && strstr(filename, "ui.qvm")) {
+		pak->referenced |= FS_UI_REF;
+	}
+}
+
 /*
 ===========
 FS_FOpenFileRead
@@ -1006,50 +1367,26 @@ separate file or a ZIP file.
 extern qboolean		com_fullyInitialized;
 
 int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueFILE ) {
+	fileTableEntry_t	*entry;
 	searchpath_t	*search;
-	char			*netpath;
 	pack_t			*pak;
 	fileInPack_t	*pakFile;
 	directory_t		*dir;
-	long			hash;
 	FILE			*temp;
-	int				l;
-	char demoExt[16];
-
-	hash = 0;
+	int				i;
 
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
 	}
 
 	if ( file == NULL ) {
-		// just wants to see if file is there
-		for ( search = fs_searchpaths ; search ; search = search->next ) {
-			//
-			if ( search->pack ) {
-				hash = FS_HashFileName(filename, search->pack->hashSize);
-			}
-			// is the element a pak file?
-			if ( search->pack && search->pack->hashTable[hash] ) {
-				// look through all the pak file elements
-				pak = search->pack;
-				pakFile = pak->hashTable[hash];
-				do {
-					// case and separator insensitive comparisons
-					if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-						// found it!
-						return qtrue;
-					}
-					pakFile = pakFile->next;
-				} while(pakFile != NULL);
-			} else if ( search->dir ) {
-				dir = search->dir;
-			
-				netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
-				temp = fopen (netpath, "rb");
-				if ( !temp ) {
-					continue;
-				}
+		// just wants to see if file is there, in any pak or directory
+		if ( FS_FindFileTableEntry( filename ) ) {
+			return qtrue;
+		}
+		for ( i = 0 ; i < fs_numTableDirs ; i++ ) {
+			temp = FS_OpenInTableDir( filename, i );
+			if ( temp ) {
 				fclose(temp);
 				return qtrue;
 			}
@@ -1061,7 +1398,6 @@ int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueF
 		Com_Error( ERR_FATAL, "FS_FOpenFileRead: NULL 'filename' parameter passed\n" );
 	}
 
-	Com_sprintf (demoExt, sizeof(demoExt), ".dm_%d",PROTOCOL_VERSION );
 	// qpaths are not supposed to have a leading slash
 	if ( filename[0] == '/' || filename[0] == '\\' ) {
 		filename++;
@@ -1075,129 +1411,71 @@ int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueF
 		return -1;
 	}
 
-	//
-	// search through the path, one element at a time
-	//
-
 	*file = FS_HandleForFile();
 	fsh[*file].handleFiles.unique = uniqueFILE;
 
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		//
-		if ( search->pack ) {
-			hash = FS_HashFileName(filename, search->pack->hashSize);
-		}
-		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[hash] ) {
-			// disregard if it doesn't match one of the allowed pure pak files
-			if ( !FS_PakIsPure(search->pack) ) {
-				continue;
-			}
+	// the file table has the highest priority pure pak holding the file,
+	// only the directories above that pak need to be searched
+	search = NULL;
+	pakFile = NULL;
+	entry = FS_FindFileTableEntry( filename );
+	if ( entry && entry->pureFile ) {
+		search = fs_tableSearchPaths[entry->pureSearch];
+		pakFile = entry->pureFile;
+	}
 
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					// found it!
+	for ( i = 0 ; i < fs_numTableDirs ; i++ ) {
+		dir = fs_tableDirs[i]->dir;
+		if ( search && fs_tableDirs[i]->order > search->order ) {
+			break;
+		}
 
-					// mark the pak as having been referenced and mark specifics on cgame and ui
-					// shaders, txt, arena files  by themselves do not count as a reference as 
-					// these are loaded from all pk3s 
-					// from every pk3 file.. 
-					l = strlen( filename );
-					if ( !(pak->referenced & FS_GENERAL_REF)) {
-						if ( Q_stricmp(filename + l - 7, ".shader") != 0 &&
-							Q_stricmp(filename + l - 4, ".txt") != 0 &&
-							Q_stricmp(filename + l - 4, ".ttf") != 0 &&
-							Q_stricmp(filename + l - 4, ".otf") != 0 &&
-							Q_stricmp(filename + l - 4, ".cfg") != 0 &&
-							Q_stricmp(filename + l - 7, ".config") != 0 &&
-							strstr(filename, "levelshots") == NULL &&
-							Q_stricmp(filename + l - 4, ".bot") != 0 &&
-							Q_stricmp(filename + l - 6, ".arena") != 0 &&
-							Q_stricmp(filename + l - 5, ".menu") != 0) {
-							pak->referenced |= FS_GENERAL_REF;
-						}
-					}
+		// check a file in the directory tree
+		if ( !FS_DirFileAllowed( filename ) ) {
+			continue;
+		}
 
-					if (!(pak->referenced & FS_QAGAME_REF) && strstr(filename, "game.qvm")) {
-						pak->referenced |= FS_QAGAME_REF;
-					}
-					if (!(pak->referenced & FS_CGAME_REF) && strstr(filename, "cgame.qvm")) {
-						pak->referenced |= FS_CGAME_REF;
-					}
-					if (!(pak->referenced & FS_UI_REF) && strstr(filename, "ui.qvm")) {
-						pak->referenced |= FS_UI_REF;
-					}
+		fsh[*file].handleFiles.file.o = FS_OpenInTableDir( filename, i );
+		if ( !fsh[*file].handleFiles.file.o ) {
+			continue;
+		}
 
-					if ( uniqueFILE ) {
-						// open a new file on the pakfile
-						fsh[*file].handleFiles.file.z = unzOpen (pak->pakFilename);
-						if (fsh[*file].handleFiles.file.z == NULL) {
-							Com_Error (ERR_FATAL, "Couldn't open %s", pak->pakFilename);
-						}
-					} else {
-						fsh[*file].handleFiles.file.z = pak->handle;
-					}
-					Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
-					fsh[*file].zipFile = qtrue;
-					// set the file position in the zip file (also sets the current file info)
-					unzSetOffset(fsh[*file].handleFiles.file.z, pakFile->pos);
-					// open the file in the zip
-					unzOpenCurrentFile( fsh[*file].handleFiles.file.z );
-					fsh[*file].zipFilePos = pakFile->pos;
-
-					if ( fs_debug->integer ) {
-						Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n", 
-							filename, pak->pakFilename );
-					}
-					return pakFile->len;
-				}
-				pakFile = pakFile->next;
-			} while(pakFile != NULL);
-		} else if ( search->dir ) {
-			// check a file in the directory tree
-
-			// if we are running restricted, the only files we
-			// will allow to come from the directory are .cfg files
-			l = strlen( filename );
-			// FIXME TTimo I'm not sure about the fs_numServerPaks test
-			// if you are using FS_ReadFile to find out if a file exists,
-			//   this test can make the search fail although the file is in the directory
-			// I had the problem on https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=8
-			// turned out I used FS_FileExists instead
-			if ( fs_numServerPaks ) {
+		Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
+		fsh[*file].zipFile = qfalse;
+		if ( fs_debug->integer ) {
+			Com_Printf( "FS_FOpenFileRead: %s (found in '%s/%s')\n", filename,
+				dir->path, dir->gamedir );
+		}
 
-				if ( Q_stricmp( filename + l - 4, ".cfg" )		// for config files
-					&& Q_stricmp( filename + l - 4, ".otf" )
-					&& Q_stricmp( filename + l - 4, ".ttf" )
-					&& Q_stricmp( filename + l - 5, ".menu" )	// menu files
-					&& Q_stricmp( filename + l - 5, ".game" )	// menu files
-					&& Q_stricmp( filename + l - strlen(demoExt), demoExt )	// menu files
-					&& Q_stricmp( filename + l - 4, ".dat" ) ) {	// for journal files
-					continue;
-				}
-			}
+		return FS_filelength (*file);
+	}
 
-			dir = search->dir;
-			
-			netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
-			fsh[*file].handleFiles.file.o = fopen (netpath, "rb");
-			if ( !fsh[*file].handleFiles.file.o ) {
-				continue;
-			}
+	if ( pakFile ) {
+		pak = search->pack;
+		FS_ReferencePakFile( pak, filename );
 
-			Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
-			fsh[*file].zipFile = qfalse;
-			if ( fs_debug->integer ) {
-				Com_Printf( "FS_FOpenFileRead: %s (found in '%s/%s')\n", filename,
-					dir->path, dir->gamedir );
+		if ( uniqueFILE ) {
+			// open a new file on the pakfile
+			fsh[*file].handleFiles.file.z = unzOpen (pak->pakFilename);
+			if (fsh[*file].handleFiles.file.z == NULL) {
+				Com_Error (ERR_FATAL, "Couldn't open %s", pak->pakFilename);
 			}
-
-			return FS_filelength (*file);
-		}		
+		} else {
+			fsh[*file].handleFiles.file.z = pak->handle;
+		}
+		Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
+		fsh[*file].zipFile = qtrue;
+		// set the file position in the zip file (also sets the current file info)
+		unzSetOffset(fsh[*file].handleFiles.file.z, pakFile->pos);
+		// open the file in the zip
+		unzOpenCurrentFile( fsh[*file].handleFiles.file.z );
+		fsh[*file].zipFilePos = pakFile->pos;
+
+		if ( fs_debug->integer ) {
+			Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n", 
+				filename, pak->pakFilename );
+		}
+		return pakFile->len;
 	}
 	
 #ifdef FS_MISSING
@@ -1493,182 +1771,1229 @@ int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
 }
 
 /*
-============
-FS_ReadFile
+===========
+FS_FileStamp
 
-Filename are relative to the quake search path
-a null buffer will just return the file length without loading
-============
+Finds qpath the way FS_FOpenFileRead does, without reading any of it.
+Returns its length or -1 if there is no such file, and sets stamp to
+something that changes along with its contents: the checksum of the pak
+holding it, or the modification time of a loose file.
+===========
 */
-int FS_ReadFile( const char *qpath, void **buffer ) {
-	fileHandle_t	h;
-	byte*			buf;
-	qboolean		isConfig;
-	int				len;
+int FS_FileStamp( const char *qpath, int *stamp ) {
+	fileTableEntry_t	*entry;
+	searchpath_t		*search;
+	directory_t			*dir;
+	FILE				*f;
+	int					i, len, mtime;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	// qpaths are not supposed to have a leading slash
+	if ( qpath[0] == '/' || qpath[0] == '\\' ) {
+		qpath++;
+	}
+
+	if ( strstr( qpath, ".." ) || strstr( qpath, "::" ) ) {
+		return -1;
+	}
+
+	search = NULL;
+	entry = FS_FindFileTableEntry( qpath );
+	if ( entry && entry->pureFile ) {
+		search = fs_tableSearchPaths[entry->pureSearch];
+	}
+
+	for ( i = 0 ; i < fs_numTableDirs && FS_DirFileAllowed( qpath ) ; i++ ) {
+		if ( search && fs_tableDirs[i]->order > search->order ) {
+			break;
+		}
+
+		// the fopen goes through the directory misses
+		f = FS_OpenInTableDir( qpath, i );
+		if ( !f ) {
+			continue;
+		}
+		fclose( f );
+
+		dir = fs_tableDirs[i]->dir;
+		if ( !Sys_FileStat( FS_BuildOSPath( dir->path, dir->gamedir, qpath ), &len, &mtime ) ) {
+			return -1;
+		}
+		*stamp = mtime;
+		return len;
+	}
+
+	if ( !search ) {
+		return -1;
+	}
+
+	FS_ReferencePakFile( search->pack, qpath );
+	*stamp = search->pack->checksum;
+	return entry->pureFile->len;
+}
+
+/*
+=================================================================================
+
+PREFETCH
+
+Loaders that know their file lists up front hand them to FS_PrefetchFiles,
+which inflates the pk3 entries on the worker threads into a bounded cache.
+FS_ReadFile then only has to copy them out. The cache lives outside the zone,
+it is short lived and may well be larger than what the zone has free.
+
+=================================================================================
+*/
+
+#define	MAX_PREFETCH_FILES	1024
+#define	MAX_LOAD_STATS		8
+
+typedef struct {
+	const char	*pakFilename;
+	unzFile		zip;			// pak->handle, with pos identifies the entry
+	int			pos;
+	int			len;
+	byte		*buffer;		// NULL once read
+	qboolean	ready;			// inflated without errors
+} prefetchFile_t;
+
+typedef struct {
+	char		name[MAX_QPATH];
+	int			threads;
+	int			msec;
+	int			files;			// through FS_ReadFile
+	int			bytes;
+	int			prefetchFiles;
+	int			prefetchBytes;
+	int			prefetchMsec;
+	int			hits;			// reads served from the prefetch cache
+} loadStats_t;
+
+static	cvar_t			*fs_prefetchThreads;
+static	cvar_t			*fs_prefetchMegs;
+static	workerPool_t	*fs_prefetchWorkers;
+static	prefetchFile_t	fs_prefetchFiles[MAX_PREFETCH_FILES];
+static	int				fs_numPrefetchFiles;
+
+// every thread reads through its own zip handle
+static	unzFile			fs_prefetchZips[MAX_WORKER_THREADS + 1];
+static	const char		*fs_prefetchZipNames[MAX_WORKER_THREADS + 1];
+
+static	loadStats_t		fs_loadStats;		// the load in progress
+static	int				fs_loadStatsStart;
+static	loadStats_t		fs_loadStatsHistory[MAX_LOAD_STATS];
+static	int				fs_numLoadStats;
+
+/*
+=============
+FS_PakForZip
+=============
+*/
+static pack_t *FS_PakForZip( unzFile zip )
+{
+	searchpath_t	*search;
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack && search->pack->handle == zip ) {
+			return search->pack;
+		}
+	}
+	return NULL;
+}
+
+/*
+=============
+FS_PrefetchJob
+
+Runs on the worker threads
+=============
+*/
+static void FS_PrefetchJob( void *data, int index, int thread )
+{
+	prefetchFile_t	*file = (prefetchFile_t *)data + index;
+	unzFile			zip;
+
+	if ( fs_prefetchZipNames[thread] != file->pakFilename ) {
+		if ( fs_prefetchZips[thread] ) {
+			unzClose( fs_prefetchZips[thread] );
+		}
+		fs_prefetchZips[thread] = unzOpen( file->pakFilename );
+		fs_prefetchZipNames[thread] = file->pakFilename;
+	}
+
+	zip = fs_prefetchZips[thread];
+	if ( !zip || unzSetOffset( zip, file->pos ) != UNZ_OK || unzOpenCurrentFile( zip ) != UNZ_OK ) {
+		return;
+	}
+	file->ready = unzReadCurrentFile( zip, file->buffer, file->len ) == file->len;
+	if ( unzCloseCurrentFile( zip ) != UNZ_OK ) {
+		file->ready = qfalse;		// crc mismatch
+	}
+}
+
+/*
+=============
+FS_FlushPrefetch
+=============
+*/
+void FS_FlushPrefetch( void )
+{
+	int		i;
+
+	for ( i = 0 ; i < fs_numPrefetchFiles ; i++ ) {
+		if ( fs_prefetchFiles[i].buffer ) {
+			free( fs_prefetchFiles[i].buffer );
+		}
+	}
+	fs_numPrefetchFiles = 0;
+}
+
+/*
+=============
+FS_PrefetchFiles
+
+Names that are missing or not in a pk3 are skipped, directory reads
+are cheap enough already
+=============
+*/
+void FS_PrefetchFiles( const char **qpaths, int count )
+{
+	prefetchFile_t	*file;
+	fileHandle_t	h;
+	pack_t			*pak;
+	int				i, j, first, len, bytes, budget, start;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	if ( Sys_WorkerPoolThreads( fs_prefetchWorkers ) != fs_prefetchThreads->integer ) {
+		Sys_DestroyWorkerPool( fs_prefetchWorkers );
+		fs_prefetchWorkers = Sys_CreateWorkerPool( fs_prefetchThreads->integer );
+	}
+	if ( !fs_prefetchWorkers ) {
+		return;
+	}
+
+	start = Sys_Milliseconds( );
+
+	budget = fs_prefetchMegs->integer * 1024 * 1024;
+	for ( i = 0, bytes = 0 ; i < fs_numPrefetchFiles ; i++ ) {
+		if ( fs_prefetchFiles[i].buffer ) {
+			bytes += fs_prefetchFiles[i].len;
+		}
+	}
+
+	// drop what was already read, the rest stays cached
+	for ( i = 0, j = 0 ; i < fs_numPrefetchFiles ; i++ ) {
+		if ( fs_prefetchFiles[i].buffer ) {
+			fs_prefetchFiles[j++] = fs_prefetchFiles[i];
+		}
+	}
+	fs_numPrefetchFiles = j;
+	first = j;
+
+	for ( i = 0 ; i < count && fs_numPrefetchFiles < MAX_PREFETCH_FILES ; i++ ) {
+		len = FS_FOpenFileRead( qpaths[i], &h, qfalse );
+		if ( !h ) {
+			continue;
+		}
+
+		if ( fsh[h].zipFile && len > 0 && bytes + len <= budget ) {
+			for ( j = 0 ; j < fs_numPrefetchFiles ; j++ ) {
+				if ( fs_prefetchFiles[j].zip == fsh[h].handleFiles.file.z
+					&& fs_prefetchFiles[j].pos == fsh[h].zipFilePos ) {
+					break;
+				}
+			}
+			pak = FS_PakForZip( fsh[h].handleFiles.file.z );
+
+			file = &fs_prefetchFiles[fs_numPrefetchFiles];
+			if ( j == fs_numPrefetchFiles && pak && ( file->buffer = malloc( len ) ) ) {
+				file->pakFilename = pak->pakFilename;
+				file->zip = pak->handle;
+				file->pos = fsh[h].zipFilePos;
+				file->len = len;
+				file->ready = qfalse;
+				fs_numPrefetchFiles++;
+				bytes += len;
+			}
+		}
+		FS_FCloseFile( h );
+	}
+
+	Sys_RunWorkerJobs( fs_prefetchWorkers, FS_PrefetchJob, fs_prefetchFiles + first,
+		fs_numPrefetchFiles - first );
+
+	for ( j = 0 ; j <= MAX_WORKER_THREADS ; j++ ) {
+		if ( fs_prefetchZips[j] ) {
+			unzClose( fs_prefetchZips[j] );
+		}
+		fs_prefetchZips[j] = NULL;
+		fs_prefetchZipNames[j] = NULL;
+	}
+
+	for ( i = first ; i < fs_numPrefetchFiles ; i++ ) {
+		file = &fs_prefetchFiles[i];
+		if ( file->ready ) {
+			fs_loadStats.prefetchFiles++;
+			fs_loadStats.prefetchBytes += file->len;
+		} else {
+			// FS_ReadFile falls back to reading it itself
+			free( file->buffer );
+			file->buffer = NULL;
+		}
+	}
+	fs_loadStats.prefetchMsec += Sys_Milliseconds( ) - start;
+}
+
+/*
+=============
+FS_ReadPrefetched
+
+Copies the entry open in h out of the prefetch cache
+=============
+*/
+static qboolean FS_ReadPrefetched( fileHandle_t h, byte *buffer, int len )
+{
+	prefetchFile_t	*file;
+	int				i;
+
+	if ( !fsh[h].zipFile ) {
+		return qfalse;
+	}
+
+	for ( i = 0, file = fs_prefetchFiles ; i < fs_numPrefetchFiles ; i++, file++ ) {
+		if ( file->zip == fsh[h].handleFiles.file.z && file->pos == fsh[h].zipFilePos ) {
+			break;
+		}
+	}
+	if ( i == fs_numPrefetchFiles || !file->buffer || file->len != len ) {
+		return qfalse;
+	}
+
+	Com_Memcpy( buffer, file->buffer, len );
+	free( file->buffer );
+	file->buffer = NULL;
+	fs_loadStats.hits++;
+	return qtrue;
+}
+
+/*
+=============
+FS_BeginLoadStats
+=============
+*/
+void FS_BeginLoadStats( void )
+{
+	Com_Memset( &fs_loadStats, 0, sizeof( fs_loadStats ) );
+	fs_loadStatsStart = Sys_Milliseconds( );
+}
+
+/*
+=============
+FS_EndLoadStats
+
+Also drops whatever was prefetched but never read
+=============
+*/
+void FS_EndLoadStats( const char *name )
+{
+	FS_FlushPrefetch( );
+
+	Q_strncpyz( fs_loadStats.name, name, sizeof( fs_loadStats.name ) );
+	fs_loadStats.threads = Sys_WorkerPoolThreads( fs_prefetchWorkers );
+	fs_loadStats.msec = Sys_Milliseconds( ) - fs_loadStatsStart;
+
+	fs_loadStatsHistory[fs_numLoadStats % MAX_LOAD_STATS] = fs_loadStats;
+	fs_numLoadStats++;
+}
+
+/*
+=============
+FS_LoadStats_f
+=============
+*/
+static void FS_LoadStats_f( void )
+{
+	loadStats_t	*stats;
+	int			i;
+
+	if ( !fs_numLoadStats ) {
+		Com_Printf( "no loads yet\n" );
+		return;
+	}
+
+	Com_Printf( "threads  msec  files     KB  prefetched     KB  msec  hits  name\n" );
+	i = fs_numLoadStats > MAX_LOAD_STATS ? fs_numLoadStats - MAX_LOAD_STATS : 0;
+	for ( ; i < fs_numLoadStats ; i++ ) {
+		stats = &fs_loadStatsHistory[i % MAX_LOAD_STATS];
+		Com_Printf( "%7i %5i %6i %6i %11i %6i %5i %5i  %s\n", stats->threads, stats->msec,
+			stats->files, stats->bytes / 1024, stats->prefetchFiles, stats->prefetchBytes / 1024,
+			stats->prefetchMsec, stats->hits, stats->name );
+	}
+}
+
+/*
+============
+FS_ReadFile
+
+Filename are relative to the quake search path
+a null buffer will just return the file length without loading
+============
+*/
+int FS_ReadFile( const char *qpath, void **buffer ) {
+	fileHandle_t	h;
+	byte*			buf;
+	qboolean		isConfig;
+	int				len;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_ReadFile with empty name\n" );
+	}
+
+	buf = NULL;	// quiet compiler warning
+
+	// if this is a .cfg file and we are playing back a journal, read
+	// it from the journal file
+	if ( strstr( qpath, ".cfg" ) ) {
+		isConfig = qtrue;
+		if ( com_journal && com_journal->integer == 2 ) {
+			int		r;
+
+			Com_DPrintf( "Loading %s from journal file.\n", qpath );
+			r = FS_Read( &len, sizeof( len ), com_journalDataFile );
+			if ( r != sizeof( len ) ) {
+				if (buffer != NULL) *buffer = NULL;
+				return -1;
+			}
+			// if the file didn't exist when the journal was created
+			if (!len) {
+				if (buffer == NULL) {
+					return 1;			// hack for old journal files
+				}
+				*buffer = NULL;
+				return -1;
+			}
+			if (buffer == NULL) {
+				return len;
+			}
+
+			buf = Hunk_AllocateTempMemory(len+1);
+			*buffer = buf;
+
+			r = FS_Read( buf, len, com_journalDataFile );
+			if ( r != len ) {
+				Com_Error( ERR_FATAL, "Read from journalDataFile failed" );
+			}
+
+			fs_loadCount++;
+			fs_loadStack++;
+
+			// guarantee that it will have a trailing 0 for string operations
+			buf[len] = 0;
+
+			return len;
+		}
+	} else {
+		isConfig = qfalse;
+	}
+
+	// look for it in the filesystem or pack files
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( h == 0 ) {
+		if ( buffer ) {
+			*buffer = NULL;
+		}
+		// if we are journalling and it is a config file, write a zero to the journal file
+		if ( isConfig && com_journal && com_journal->integer == 1 ) {
+			Com_DPrintf( "Writing zero for %s to journal file.\n", qpath );
+			len = 0;
+			FS_Write( &len, sizeof( len ), com_journalDataFile );
+			FS_Flush( com_journalDataFile );
+		}
+		return -1;
+	}
+	
+	if ( !buffer ) {
+		if ( isConfig && com_journal && com_journal->integer == 1 ) {
+			Com_DPrintf( "Writing len for %s to journal file.\n", qpath );
+			FS_Write( &len, sizeof( len ), com_journalDataFile );
+			FS_Flush( com_journalDataFile );
+		}
+		FS_FCloseFile( h);
+		return len;
+	}
+
+	fs_loadCount++;
+	fs_loadStack++;
+
+	buf = Hunk_AllocateTempMemory(len+1);
+	*buffer = buf;
+
+	if ( !FS_ReadPrefetched( h, buf, len ) ) {
+		FS_Read (buf, len, h);
+	}
+	fs_loadStats.files++;
+	fs_loadStats.bytes += len;
+
+	// guarantee that it will have a trailing 0 for string operations
+	buf[len] = 0;
+	FS_FCloseFile( h );
+
+	// if we are journalling and it is a config file, write it to the journal file
+	if ( isConfig && com_journal && com_journal->integer == 1 ) {
+		Com_DPrintf( "Writing %s to journal file.\n", qpath );
+		FS_Write( &len, sizeof( len ), com_journalDataFile );
+		FS_Write( buf, len, com_journalDataFile );
+		FS_Flush( com_journalDataFile );
+	}
+	return len;
+}
+
+/*
+=============
+FS_FreeFile
+=============
+*/
+void FS_FreeFile( void *buffer ) {
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+	if ( !buffer ) {
+		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+	}
+	fs_loadStack--;
+
+	Hunk_FreeTempMemory( buffer );
+
+	// if all of our temp files are free, clear all of our space
+	if ( fs_loadStack == 0 ) {
+		Hunk_ClearTempMemory();
+	}
+}
+
+/*
+=================================================================================
+
+MAPPED FILES
+
+Entries stored without compression in a pk3 are mapped read-only straight from
+the pk3, so several servers loading the same bsp share the page cache instead
+of each copying it onto the hunk.  Caches the engine writes below the
+homepath are mapped the same way.
+
+=================================================================================
+*/
+
+#define	MAX_MAPPED_FILES	16
+
+// the bsp loaders read ints and floats straight out of the buffer
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define	MAPPED_FILE_ALIGN	1
+#else
+#define	MAPPED_FILE_ALIGN	4
+#endif
+
+typedef struct {
+	void		*data;
+	int			offset;
+	int			length;
+} mappedFile_t;
+
+static mappedFile_t	fs_mappedFiles[MAX_MAPPED_FILES];
+
+/*
+=============
+FS_MapPakFile
+
+Maps the pk3 entry open in h, NULL if it has to be copied
+=============
+*/
+static void *FS_MapPakFile( fileHandle_t h, int len, int *offset )
+{
+	pack_t			*pak;
+	unz_file_info	info;
+	unzFile			z;
+
+	z = fsh[h].handleFiles.file.z;
+	if ( unzGetCurrentFileInfo( z, &info, NULL, 0, NULL, 0, NULL, 0 ) != UNZ_OK ) {
+		return NULL;
+	}
+	if ( info.compression_method != 0 || ( info.flag & 1 ) || info.compressed_size != (uLong)len ) {
+		return NULL;	// deflated or encrypted
+	}
+
+	*offset = unzGetCurrentFileDataOffset( z );
+	if ( !*offset || ( *offset & ( MAPPED_FILE_ALIGN - 1 ) ) ) {
+		return NULL;
+	}
+
+	pak = FS_PakForZip( z );
+	if ( !pak ) {
+		return NULL;
+	}
+	return Sys_MapFile( pak->pakFilename, *offset, len );
+}
+
+/*
+=============
+FS_MapFile
+
+Falls back to FS_ReadFile for anything that can't be mapped
+=============
+*/
+int FS_MapFile( const char *qpath, void **buffer )
+{
+	fileHandle_t	h;
+	mappedFile_t	*mapped;
+	void			*data;
+	int				i, len, offset;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_MapFile with empty name\n" );
+	}
+
+	// config files may have to go through the journal
+	if ( !buffer || strstr( qpath, ".cfg" ) ) {
+		return FS_ReadFile( qpath, buffer );
+	}
+
+	for ( i = 0, mapped = NULL ; i < MAX_MAPPED_FILES ; i++ ) {
+		if ( !fs_mappedFiles[i].data ) {
+			mapped = &fs_mappedFiles[i];
+			break;
+		}
+	}
+
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( h == 0 ) {
+		*buffer = NULL;
+		return -1;
+	}
+
+	data = NULL;
+	if ( mapped && fsh[h].zipFile ) {
+		data = FS_MapPakFile( h, len, &offset );
+	}
+	FS_FCloseFile( h );
+
+	if ( !data ) {
+		return FS_ReadFile( qpath, buffer );
+	}
+
+	fs_loadCount++;
+	fs_loadStack++;
+
+	mapped->data = data;
+	mapped->offset = offset;
+	mapped->length = len;
+	*buffer = data;
+
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_MapFile: %s (%i bytes mapped)\n", qpath, len );
+	}
+	return len;
+}
+
+/*
+=============
+FS_MapHomeFile
+
+Maps a file below fs_homepath/fs_gamedir without going through the
+search paths or the pure checks, for caches the engine writes there
+itself.  Returns -1 if the file is missing or can't be mapped.
+=============
+*/
+int FS_MapHomeFile( const char *qpath, void **buffer )
+{
+	mappedFile_t	*mapped;
+	char			*ospath;
+	FILE			*f;
+	void			*data;
+	int				i, len;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	if ( !qpath || !qpath[0] || !buffer ) {
+		Com_Error( ERR_FATAL, "FS_MapHomeFile with empty name\n" );
+	}
+
+	*buffer = NULL;
+
+	for ( i = 0, mapped = NULL ; i < MAX_MAPPED_FILES ; i++ ) {
+		if ( !fs_mappedFiles[i].data ) {
+			mapped = &fs_mappedFiles[i];
+			break;
+		}
+	}
+	if ( !mapped ) {
+		return -1;
+	}
+
+	ospath = FS_BuildOSPath( fs_homepath->string, fs_gamedir, qpath );
+	f = fopen( ospath, "rb" );
+	if ( !f ) {
+		return -1;
+	}
+	fseek( f, 0, SEEK_END );
+	len = ftell( f );
+	fclose( f );
+
+	if ( len <= 0 ) {
+		return -1;
+	}
+
+	data = Sys_MapFile( ospath, 0, len );
+	if ( !data ) {
+		return -1;
+	}
+
+	fs_loadCount++;
+	fs_loadStack++;
+
+	mapped->data = data;
+	mapped->offset = 0;
+	mapped->length = len;
+	*buffer = data;
+
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_MapHomeFile: %s (%i bytes mapped)\n", ospath, len );
+	}
+	return len;
+}
+
+/*
+=============
+FS_UnmapFile
+=============
+*/
+void FS_UnmapFile( void *buffer )
+{
+	int		i;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+	if ( !buffer ) {
+		Com_Error( ERR_FATAL, "FS_UnmapFile( NULL )" );
+	}
+
+	for ( i = 0 ; i < MAX_MAPPED_FILES ; i++ ) {
+		if ( fs_mappedFiles[i].data == buffer ) {
+			break;
+		}
+	}
+	if ( i == MAX_MAPPED_FILES ) {
+		// it was copied
+		FS_FreeFile( buffer );
+		return;
+	}
+
+	Sys_UnmapFile( buffer, fs_mappedFiles[i].offset, fs_mappedFiles[i].length );
+	fs_mappedFiles[i].data = NULL;
+
+	fs_loadStack--;
+	if ( fs_loadStack == 0 ) {
+		Hunk_ClearTempMemory();
+	}
+}
+
+/*
+============
+FS_WriteFile
+
+Filename are reletive to the quake search path
+============
+*/
+void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
+	fileHandle_t f;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	if ( !qpath || !buffer ) {
+		Com_Error( ERR_FATAL, "FS_WriteFile: NULL parameter" );
+	}
+
+	f = FS_FOpenFileWrite( qpath );
+	if ( !f ) {
+		Com_Printf( "Failed to open %s\n", qpath );
+		return;
+	}
+
+	FS_Write( buffer, size, f );
+
+	FS_FCloseFile( f );
+}
+
+
+
+/*
+==========================================================================
+
+ZIP FILE LOADING
+
+==========================================================================
+*/
+
+/*
+=================
+FS_AllocPak
+
+Allocates a pak with room for numfiles entries and their names
+=================
+*/
+static pack_t *FS_AllocPak( const char *zipfile, const char *basename, unzFile uf, int numfiles, int namesLen )
+{
+	pack_t			*pack;
+	int				i;
+
+	// get the hash table size from the number of files in the zip
+	// because lots of custom pk3 files have less than 32 or 64 files
+	for (i = 1; i <= MAX_FILEHASH_SIZE; i <<= 1) {
+		if (i > numfiles) {
+			break;
+		}
+	}
+
+	pack = Z_Malloc( sizeof( pack_t ) + i * sizeof(fileInPack_t *) );
+	pack->hashSize = i;
+	pack->hashTable = (fileInPack_t **) (((char *) pack) + sizeof( pack_t ));
+	for(i = 0; i < pack->hashSize; i++) {
+		pack->hashTable[i] = NULL;
+	}
+
+	Q_strncpyz( pack->pakFilename, zipfile, sizeof( pack->pakFilename ) );
+	Q_strncpyz( pack->pakBasename, basename, sizeof( pack->pakBasename ) );
+
+	// strip .pk3 if needed
+	if ( strlen( pack->pakBasename ) > 4 && !Q_stricmp( pack->pakBasename + strlen( pack->pakBasename ) - 4, ".pk3" ) ) {
+		pack->pakBasename[strlen( pack->pakBasename ) - 4] = 0;
+	}
+
+	pack->handle = uf;
+	pack->numfiles = numfiles;
+	pack->buildBuffer = Z_Malloc( (numfiles * sizeof( fileInPack_t )) + namesLen );
+	pack->namesLen = namesLen;
+	pack->headerLongs = Z_Malloc( ( numfiles + 1 ) * sizeof(int) );
+	pack->headerLongs[ pack->numHeaderLongs++ ] = LittleLong( fs_checksumFeed );
+
+	return pack;
+}
+
+/*
+=================
+FS_SetPakChecksums
+=================
+*/
+static void FS_SetPakChecksums( pack_t *pack )
+{
+	pack->headerLongs[0] = LittleLong( fs_checksumFeed );
+	pack->checksum = Com_BlockChecksum( &pack->headerLongs[ 1 ], sizeof(*pack->headerLongs) * ( pack->numHeaderLongs - 1 ) );
+	pack->pure_checksum = Com_BlockChecksum( pack->headerLongs, sizeof(*pack->headerLongs) * pack->numHeaderLongs );
+	pack->checksum = LittleLong( pack->checksum );
+	pack->pure_checksum = LittleLong( pack->pure_checksum );
+}
+
+static void FS_FreePak(pack_t *thepak);
+
+/*
+==========================================================================
+
+PAK INDEX
+
+FS_LoadZipFile has to walk the whole central directory of every pk3, which
+is most of what FS_Restart costs with a few hundred paks installed.  What it
+finds there only changes when the pk3 does, so it is kept in the pak index in
+fs_homepath, keyed by the path, size and mtime of each pk3.  Unchanged paks
+are set up from the index without reading their directory.
+
+==========================================================================
+*/
+
+#define	PAKINDEX_NAME		"pakindex.dat"
+#define	PAKINDEX_IDENT		(('X'<<24)+('D'<<16)+('I'<<8)+'P')
+#define	PAKINDEX_VERSION	1
+#define	PAKINDEX_DIRENTRY	46		// size of a central directory entry without its name
+
+typedef struct {
+	const char	*pakFilename;
+	int			fileSize;
+	int			fileTime;
+	int			numfiles;
+	int			numCrcs;
+	int			namesLen;
+	const int	*entries;		// pos and len of every file
+	const int	*crcs;
+	const char	*names;
+	qboolean	used;
+} pakIndexRecord_t;
+
+static	cvar_t				*fs_pakIndex;
+static	byte				*fs_pakIndexData;		// the index file as it was loaded
+static	pakIndexRecord_t	*fs_pakIndexRecords;
+static	int					fs_numPakIndexRecords;
+static	int					fs_pakIndexNext;		// paks are usually loaded in the order they were written
+static	int					fs_pakIndexHits;
+static	int					fs_pakIndexMisses;
+static	int					fs_startupMsec;
+
+/*
+=================
+FS_PakIndexPath
+=================
+*/
+static char *FS_PakIndexPath( void )
+{
+	static char	path[MAX_OSPATH];
+
+	Com_sprintf( path, sizeof( path ), "%s%c%s", fs_homepath->string, PATH_SEP, PAKINDEX_NAME );
+	return path;
+}
+
+/*
+=================
+FS_PakIndexSkip
+
+Returns the data at the read position and skips size bytes, or NULL if the
+index is shorter than that
+=================
+*/
+static const byte *FS_PakIndexSkip( const byte **p, const byte *end, int size )
+{
+	const byte	*data;
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	if ( size < 0 || end - *p < size ) {
+		return NULL;
 	}
 
-	if ( !qpath || !qpath[0] ) {
-		Com_Error( ERR_FATAL, "FS_ReadFile with empty name\n" );
+	data = *p;
+	*p += ( size + 3 ) & ~3;
+	if ( *p > end ) {
+		*p = end;
 	}
+	return data;
+}
 
-	buf = NULL;	// quiet compiler warning
+/*
+=================
+FS_LoadPakIndex
+=================
+*/
+static void FS_LoadPakIndex( void )
+{
+	FILE				*f;
+	const byte			*p, *end;
+	const int			*header;
+	pakIndexRecord_t	*record;
+	int					i, len, count, pathLen;
 
-	// if this is a .cfg file and we are playing back a journal, read
-	// it from the journal file
-	if ( strstr( qpath, ".cfg" ) ) {
-		isConfig = qtrue;
-		if ( com_journal && com_journal->integer == 2 ) {
-			int		r;
+	fs_pakIndexHits = fs_pakIndexMisses = 0;
 
-			Com_DPrintf( "Loading %s from journal file.\n", qpath );
-			r = FS_Read( &len, sizeof( len ), com_journalDataFile );
-			if ( r != sizeof( len ) ) {
-				if (buffer != NULL) *buffer = NULL;
-				return -1;
-			}
-			// if the file didn't exist when the journal was created
-			if (!len) {
-				if (buffer == NULL) {
-					return 1;			// hack for old journal files
-				}
-				*buffer = NULL;
-				return -1;
-			}
-			if (buffer == NULL) {
-				return len;
-			}
+	if ( !fs_pakIndex->integer || !fs_homepath->string[0] ) {
+		return;
+	}
 
-			buf = Hunk_AllocateTempMemory(len+1);
-			*buffer = buf;
+	f = fopen( FS_PakIndexPath( ), "rb" );
+	if ( !f ) {
+		return;
+	}
 
-			r = FS_Read( buf, len, com_journalDataFile );
-			if ( r != len ) {
-				Com_Error( ERR_FATAL, "Read from journalDataFile failed" );
-			}
+	fseek( f, 0, SEEK_END );
+	len = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	if ( len < (int)( 3 * sizeof( int ) ) ) {
+		fclose( f );
+		return;
+	}
 
-			fs_loadCount++;
-			fs_loadStack++;
+	fs_pakIndexData = Z_Malloc( len );
+	if ( fread( fs_pakIndexData, len, 1, f ) != 1 ) {
+		fclose( f );
+		return;
+	}
+	fclose( f );
 
-			// guarantee that it will have a trailing 0 for string operations
-			buf[len] = 0;
+	header = (int *)fs_pakIndexData;
+	count = LittleLong( header[2] );
+	if ( LittleLong( header[0] ) != PAKINDEX_IDENT || LittleLong( header[1] ) != PAKINDEX_VERSION ||
+		count <= 0 || count > MAX_SEARCH_PATHS ) {
+		return;
+	}
 
-			return len;
+	fs_pakIndexRecords = Z_Malloc( count * sizeof( *fs_pakIndexRecords ) );
+
+	p = fs_pakIndexData + 3 * sizeof( int );
+	end = fs_pakIndexData + len;
+	for ( i = 0, record = fs_pakIndexRecords ; i < count ; i++, record++ ) {
+		if ( !( header = (const int *)FS_PakIndexSkip( &p, end, sizeof( int ) ) ) ) {
+			break;
+		}
+		pathLen = LittleLong( header[0] );
+		if ( pathLen <= 0 || pathLen > MAX_OSPATH ||
+			!( record->pakFilename = (const char *)FS_PakIndexSkip( &p, end, pathLen ) ) ||
+			record->pakFilename[ pathLen - 1 ] ) {
+			break;
 		}
-	} else {
-		isConfig = qfalse;
-	}
 
-	// look for it in the filesystem or pack files
-	len = FS_FOpenFileRead( qpath, &h, qfalse );
-	if ( h == 0 ) {
-		if ( buffer ) {
-			*buffer = NULL;
+		if ( !( header = (const int *)FS_PakIndexSkip( &p, end, 5 * sizeof( int ) ) ) ) {
+			break;
 		}
-		// if we are journalling and it is a config file, write a zero to the journal file
-		if ( isConfig && com_journal && com_journal->integer == 1 ) {
-			Com_DPrintf( "Writing zero for %s to journal file.\n", qpath );
-			len = 0;
-			FS_Write( &len, sizeof( len ), com_journalDataFile );
-			FS_Flush( com_journalDataFile );
+		record->fileSize = LittleLong( header[0] );
+		record->fileTime = LittleLong( header[1] );
+		record->numfiles = LittleLong( header[2] );
+		record->numCrcs = LittleLong( header[3] );
+		record->namesLen = LittleLong( header[4] );
+		if ( record->numfiles < 0 || record->numfiles > ( end - p ) / (int)( 2 * sizeof( int ) ) ||
+			record->numCrcs < 0 || record->numCrcs > record->numfiles ) {
+			break;
 		}
-		return -1;
-	}
-	
-	if ( !buffer ) {
-		if ( isConfig && com_journal && com_journal->integer == 1 ) {
-			Com_DPrintf( "Writing len for %s to journal file.\n", qpath );
-			FS_Write( &len, sizeof( len ), com_journalDataFile );
-			FS_Flush( com_journalDataFile );
+
+		if ( !( record->entries = (const int *)FS_PakIndexSkip( &p, end, record->numfiles * 2 * sizeof( int ) ) ) ||
+			!( record->crcs = (const int *)FS_PakIndexSkip( &p, end, record->numCrcs * sizeof( int ) ) ) ||
+			!( record->names = (const char *)FS_PakIndexSkip( &p, end, record->namesLen ) ) ) {
+			break;
 		}
-		FS_FCloseFile( h);
-		return len;
 	}
 
-	fs_loadCount++;
-	fs_loadStack++;
-
-	buf = Hunk_AllocateTempMemory(len+1);
-	*buffer = buf;
+	if ( i < count ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %s is damaged, rebuilding it\n", FS_PakIndexPath( ) );
+	}
+	fs_numPakIndexRecords = i;
+	fs_pakIndexNext = 0;
+}
 
-	FS_Read (buf, len, h);
+/*
+=================
+FS_FreePakIndex
+=================
+*/
+static void FS_FreePakIndex( void )
+{
+	if ( fs_pakIndexRecords ) {
+		Z_Free( fs_pakIndexRecords );
+		fs_pakIndexRecords = NULL;
+	}
+	if ( fs_pakIndexData ) {
+		Z_Free( fs_pakIndexData );
+		fs_pakIndexData = NULL;
+	}
+	fs_numPakIndexRecords = 0;
+}
 
-	// guarantee that it will have a trailing 0 for string operations
-	buf[len] = 0;
-	FS_FCloseFile( h );
+/*
+=================
+FS_FindPakIndexRecord
+=================
+*/
+static pakIndexRecord_t *FS_FindPakIndexRecord( const char *zipfile, int fileSize, int fileTime )
+{
+	pakIndexRecord_t	*record;
+	int					i, n;
 
-	// if we are journalling and it is a config file, write it to the journal file
-	if ( isConfig && com_journal && com_journal->integer == 1 ) {
-		Com_DPrintf( "Writing %s to journal file.\n", qpath );
-		FS_Write( &len, sizeof( len ), com_journalDataFile );
-		FS_Write( buf, len, com_journalDataFile );
-		FS_Flush( com_journalDataFile );
+	for ( i = 0 ; i < fs_numPakIndexRecords ; i++ ) {
+		n = ( fs_pakIndexNext + i ) % fs_numPakIndexRecords;
+		record = &fs_pakIndexRecords[ n ];
+		if ( strcmp( record->pakFilename, zipfile ) ) {
+			continue;
+		}
+		if ( record->used || record->fileSize != fileSize || record->fileTime != fileTime ) {
+			return NULL;
+		}
+		fs_pakIndexNext = n + 1;
+		return record;
 	}
-	return len;
+
+	return NULL;
 }
 
 /*
-=============
-FS_FreeFile
-=============
+=================
+FS_LoadIndexedZipFile
+
+Sets up a pak from its pak index record, returns NULL if the record doesn't
+make sense for it.  Every entry has to lie in the central directory of the
+zip, after the one before it, or the pak is read the slow way.
+=================
 */
-void FS_FreeFile( void *buffer ) {
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+static pack_t *FS_LoadIndexedZipFile( const char *zipfile, const char *basename, unzFile uf,
+	pakIndexRecord_t *record )
+{
+	pack_t			*pack;
+	fileInPack_t	*buildBuffer;
+	const char		*name, *end;
+	char			*namePtr;
+	int				i, pos, len;
+	uLong			dirOffset, dirSize, minPos;
+	long			hash;
+
+	if ( unzGetCentralDir( uf, &dirOffset, &dirSize ) != UNZ_OK ) {
+		return NULL;
 	}
-	if ( !buffer ) {
-		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+	minPos = dirOffset;
+
+	pack = FS_AllocPak( zipfile, basename, uf, record->numfiles, record->namesLen );
+	buildBuffer = pack->buildBuffer;
+	namePtr = (char *)( buildBuffer + record->numfiles );
+	Com_Memcpy( namePtr, record->names, record->namesLen );
+
+	name = namePtr;
+	for ( i = 0; i < record->numfiles; i++ ) {
+		end = memchr( name, 0, namePtr + record->namesLen - name );
+		if ( !end || end - name >= MAX_ZPATH ) {
+			break;
+		}
+		pos = LittleLong( record->entries[ i * 2 ] );
+		len = LittleLong( record->entries[ i * 2 + 1 ] );
+		if ( pos < 0 || (uLong)pos < minPos || len < 0 ) {
+			break;
+		}
+		minPos = (uLong)pos + PAKINDEX_DIRENTRY + ( end - name );
+		if ( minPos > dirOffset + dirSize ) {
+			break;
+		}
+		hash = FS_HashFileName( name, pack->hashSize );
+		buildBuffer[i].name = (char *)name;
+		buildBuffer[i].pos = pos;
+		buildBuffer[i].len = len;
+		buildBuffer[i].next = pack->hashTable[hash];
+		pack->hashTable[hash] = &buildBuffer[i];
+		name = end + 1;
+	}
+	if ( i < record->numfiles ) {
+		// leave the zip open for reading its directory instead
+		pack->handle = NULL;
+		FS_FreePak( pack );
+		return NULL;
 	}
-	fs_loadStack--;
 
-	Hunk_FreeTempMemory( buffer );
+	Com_Memcpy( pack->headerLongs + 1, record->crcs, record->numCrcs * sizeof( int ) );
+	pack->numHeaderLongs += record->numCrcs;
+	FS_SetPakChecksums( pack );
 
-	// if all of our temp files are free, clear all of our space
-	if ( fs_loadStack == 0 ) {
-		Hunk_ClearTempMemory();
+	record->used = qtrue;
+	return pack;
+}
+
+/*
+=================
+FS_PakIndexWrite
+=================
+*/
+static qboolean FS_PakIndexWrite( FILE *f, const void *data, int size )
+{
+	static const byte	pad[4];
+
+	if ( size && fwrite( data, size, 1, f ) != 1 ) {
+		return qfalse;
+	}
+	// keep everything after it aligned
+	if ( size & 3 ) {
+		return fwrite( pad, 4 - ( size & 3 ), 1, f ) == 1;
 	}
+	return qtrue;
 }
 
 /*
-============
-FS_WriteFile
+=================
+FS_WritePakIndex
 
-Filename are reletive to the quake search path
-============
+Writes the index for the paks on the search path if anything changed since
+it was loaded
+=================
 */
-void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
-	fileHandle_t f;
+static void FS_WritePakIndex( void )
+{
+	static pack_t	*packs[MAX_SEARCH_PATHS];
+	searchpath_t	*search;
+	pack_t			*pack;
+	char			path[MAX_OSPATH];
+	char			tmpPath[MAX_OSPATH];
+	FILE			*f;
+	int				i, j, count, header[5];
+	qboolean		ok;
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	if ( !fs_pakIndex->integer || !fs_homepath->string[0] ) {
+		return;
 	}
 
-	if ( !qpath || !buffer ) {
-		Com_Error( ERR_FATAL, "FS_WriteFile: NULL parameter" );
+	// the search path is newest first, write them in the order they load
+	count = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack && search->pack->fileSize >= 0 && count < MAX_SEARCH_PATHS ) {
+			packs[count++] = search->pack;
+		}
+	}
+	if ( !fs_pakIndexMisses && fs_pakIndexHits == fs_numPakIndexRecords && count == fs_pakIndexHits ) {
+		return;
 	}
 
-	f = FS_FOpenFileWrite( qpath );
+	Q_strncpyz( path, FS_PakIndexPath( ), sizeof( path ) );
+	Com_sprintf( tmpPath, sizeof( tmpPath ), "%s.tmp", path );
+
+	// write to another file first so a crash never leaves half an index
+	f = fopen( tmpPath, "wb" );
 	if ( !f ) {
-		Com_Printf( "Failed to open %s\n", qpath );
+		Com_Printf( S_COLOR_YELLOW "WARNING: can't write %s\n", tmpPath );
 		return;
 	}
 
-	FS_Write( buffer, size, f );
+	header[0] = LittleLong( PAKINDEX_IDENT );
+	header[1] = LittleLong( PAKINDEX_VERSION );
+	header[2] = LittleLong( count );
+	ok = FS_PakIndexWrite( f, header, 3 * sizeof( int ) );
 
-	FS_FCloseFile( f );
-}
+	for ( i = count - 1 ; i >= 0 && ok ; i-- ) {
+		pack = packs[i];
 
+		header[0] = LittleLong( strlen( pack->pakFilename ) + 1 );
+		ok = FS_PakIndexWrite( f, header, sizeof( int ) ) &&
+			FS_PakIndexWrite( f, pack->pakFilename, strlen( pack->pakFilename ) + 1 );
 
+		header[0] = LittleLong( pack->fileSize );
+		header[1] = LittleLong( pack->fileTime );
+		header[2] = LittleLong( pack->numfiles );
+		header[3] = LittleLong( pack->numHeaderLongs - 1 );
+		header[4] = LittleLong( pack->namesLen );
+		ok = ok && FS_PakIndexWrite( f, header, 5 * sizeof( int ) );
 
-/*
-==========================================================================
+		for ( j = 0 ; j < pack->numfiles && ok ; j++ ) {
+			header[0] = LittleLong( pack->buildBuffer[j].pos );
+			header[1] = LittleLong( pack->buildBuffer[j].len );
+			ok = FS_PakIndexWrite( f, header, 2 * sizeof( int ) );
+		}
 
-ZIP FILE LOADING
+		ok = ok && FS_PakIndexWrite( f, pack->headerLongs + 1, ( pack->numHeaderLongs - 1 ) * sizeof( int ) ) &&
+			FS_PakIndexWrite( f, pack->buildBuffer + pack->numfiles, pack->namesLen );
+	}
 
-==========================================================================
-*/
+	ok = !fclose( f ) && ok;
+
+	if ( ok && rename( tmpPath, path ) ) {
+		// windows won't rename over an existing file
+		remove( path );
+		ok = !rename( tmpPath, path );
+	}
+	if ( !ok ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: can't write %s\n", path );
+		remove( tmpPath );
+	}
+}
 
 /*
 =================
@@ -1689,11 +3014,9 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename)
 	unz_file_info	file_info;
 	int				i, len;
 	long			hash;
-	int				fs_numHeaderLongs;
-	int				*fs_headerLongs;
 	char			*namePtr;
-
-	fs_numHeaderLongs = 0;
+	int				fileSize, fileTime;
+	pakIndexRecord_t	*record;
 
 	uf = unzOpen(zipfile);
 	err = unzGetGlobalInfo (uf,&gi);
@@ -1701,6 +3024,25 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename)
 	if (err != UNZ_OK)
 		return NULL;
 
+	if ( !Sys_FileStat( zipfile, &fileSize, &fileTime ) ) {
+		fileSize = -1;
+		fileTime = 0;
+	}
+
+	if ( fileSize >= 0 ) {
+		record = FS_FindPakIndexRecord( zipfile, fileSize, fileTime );
+		if ( record && record->numfiles == gi.number_entry ) {
+			pack = FS_LoadIndexedZipFile( zipfile, basename, uf, record );
+			if ( pack ) {
+				pack->fileSize = fileSize;
+				pack->fileTime = fileTime;
+				fs_pakIndexHits++;
+				return pack;
+			}
+		}
+	}
+	fs_pakIndexMisses++;
+
 	len = 0;
 	unzGoToFirstFile(uf);
 	for (i = 0; i < gi.number_entry; i++)
@@ -1713,36 +3055,10 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename)
 		unzGoToNextFile(uf);
 	}
 
-	buildBuffer = Z_Malloc( (gi.number_entry * sizeof( fileInPack_t )) + len );
+	pack = FS_AllocPak( zipfile, basename, uf, gi.number_entry, len );
+	buildBuffer = pack->buildBuffer;
 	namePtr = ((char *) buildBuffer) + gi.number_entry * sizeof( fileInPack_t );
-	fs_headerLongs = Z_Malloc( ( gi.number_entry + 1 ) * sizeof(int) );
-	fs_headerLongs[ fs_numHeaderLongs++ ] = LittleLong( fs_checksumFeed );
-
-	// get the hash table size from the number of files in the zip
-	// because lots of custom pk3 files have less than 32 or 64 files
-	for (i = 1; i <= MAX_FILEHASH_SIZE; i <<= 1) {
-		if (i > gi.number_entry) {
-			break;
-		}
-	}
-
-	pack = Z_Malloc( sizeof( pack_t ) + i * sizeof(fileInPack_t *) );
-	pack->hashSize = i;
-	pack->hashTable = (fileInPack_t **) (((char *) pack) + sizeof( pack_t ));
-	for(i = 0; i < pack->hashSize; i++) {
-		pack->hashTable[i] = NULL;
-	}
-
-	Q_strncpyz( pack->pakFilename, zipfile, sizeof( pack->pakFilename ) );
-	Q_strncpyz( pack->pakBasename, basename, sizeof( pack->pakBasename ) );
-
-	// strip .pk3 if needed
-	if ( strlen( pack->pakBasename ) > 4 && !Q_stricmp( pack->pakBasename + strlen( pack->pakBasename ) - 4, ".pk3" ) ) {
-		pack->pakBasename[strlen( pack->pakBasename ) - 4] = 0;
-	}
 
-	pack->handle = uf;
-	pack->numfiles = gi.number_entry;
 	unzGoToFirstFile(uf);
 
 	for (i = 0; i < gi.number_entry; i++)
@@ -1752,7 +3068,7 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename)
 			break;
 		}
 		if (file_info.uncompressed_size > 0) {
-			fs_headerLongs[fs_numHeaderLongs++] = LittleLong(file_info.crc);
+			pack->headerLongs[pack->numHeaderLongs++] = LittleLong(file_info.crc);
 		}
 		Q_strlwr( filename_inzip );
 		hash = FS_HashFileName(filename_inzip, pack->hashSize);
@@ -1767,14 +3083,12 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename)
 		unzGoToNextFile(uf);
 	}
 
-	pack->checksum = Com_BlockChecksum( &fs_headerLongs[ 1 ], sizeof(*fs_headerLongs) * ( fs_numHeaderLongs - 1 ) );
-	pack->pure_checksum = Com_BlockChecksum( fs_headerLongs, sizeof(*fs_headerLongs) * fs_numHeaderLongs );
-	pack->checksum = LittleLong( pack->checksum );
-	pack->pure_checksum = LittleLong( pack->pure_checksum );
+	FS_SetPakChecksums( pack );
 
-	Z_Free(fs_headerLongs);
+	// a damaged directory is read differently every time, keep it out of the index
+	pack->fileSize = i < gi.number_entry ? -1 : fileSize;
+	pack->fileTime = fileTime;
 
-	pack->buildBuffer = buildBuffer;
 	return pack;
 }
 
@@ -1788,7 +3102,9 @@ Frees a pak structure and releases all associated resources
 
 static void FS_FreePak(pack_t *thepak)
 {
-	unzClose(thepak->handle);
+	if (thepak->handle)
+		unzClose(thepak->handle);
+	Z_Free(thepak->headerLongs);
 	Z_Free(thepak->buildBuffer);
 	Z_Free(thepak);
 }
@@ -2435,6 +3751,9 @@ void FS_Path_f( void ) {
 		}
 	}
 
+	Com_Printf( "\nsearch path built in %i msec, %i paks from the pak index, %i read\n",
+		fs_startupMsec, fs_pakIndexHits, fs_pakIndexMisses );
+
 
 	Com_Printf( "\n" );
 	for ( i = 1 ; i < MAX_FILE_HANDLES ; i++ ) {
@@ -2784,6 +4103,20 @@ void FS_Shutdown( qboolean closemfp ) {
 		}
 	}
 
+	FS_FlushPrefetch();
+	if (closemfp) {
+		Sys_DestroyWorkerPool(fs_prefetchWorkers);
+		fs_prefetchWorkers = NULL;
+	}
+
+	// an error drop in the middle of a load leaves its mapping behind
+	for(i = 0; i < MAX_MAPPED_FILES; i++) {
+		if (fs_mappedFiles[i].data) {
+			Sys_UnmapFile(fs_mappedFiles[i].data, fs_mappedFiles[i].offset, fs_mappedFiles[i].length);
+			fs_mappedFiles[i].data = NULL;
+		}
+	}
+
 	// free everything
 	for(p = fs_searchpaths; p; p = next)
 	{
@@ -2797,6 +4130,8 @@ void FS_Shutdown( qboolean closemfp ) {
 		Z_Free(p);
 	}
 
+	FS_FreeFileTable();
+
 	// any FS_ calls will now be an error until reinitialized
 	fs_searchpaths = NULL;
 
@@ -2804,6 +4139,7 @@ void FS_Shutdown( qboolean closemfp ) {
 	Cmd_RemoveCommand( "dir" );
 	Cmd_RemoveCommand( "fdir" );
 	Cmd_RemoveCommand( "touchFile" );
+	Cmd_RemoveCommand( "loadstats" );
 
 #ifdef FS_MISSING
 	if (closemfp) {
@@ -2860,6 +4196,7 @@ FS_Startup
 static void FS_Startup( const char *gameName )
 {
 	const char *homePath;
+	int			start;
 
 	Com_Printf( "----- FS_Startup -----\n" );
 
@@ -2874,6 +4211,13 @@ static void FS_Startup( const char *gameName )
 	}
 	fs_homepath = Cvar_Get ("fs_homepath", homePath, CVAR_INIT );
 	fs_gamedirvar = Cvar_Get ("fs_game", "", CVAR_INIT|CVAR_SYSTEMINFO );
+	fs_pakIndex = Cvar_Get ("fs_pakIndex", "1", 0 );
+	fs_prefetchThreads = Cvar_Get ("fs_prefetchThreads", "2", CVAR_ARCHIVE );
+	Cvar_CheckRange( fs_prefetchThreads, 0, MAX_WORKER_THREADS, qtrue );
+	fs_prefetchMegs = Cvar_Get ("fs_prefetchMegs", "16", CVAR_ARCHIVE );
+
+	start = Sys_Milliseconds( );
+	FS_LoadPakIndex( );
 
 	// add search path elements in reverse priority order
 	if (fs_basepath->string[0]) {
@@ -2914,16 +4258,22 @@ static void FS_Startup( const char *gameName )
 		}
 	}
 
+	FS_WritePakIndex( );
+	FS_FreePakIndex( );
+	fs_startupMsec = Sys_Milliseconds( ) - start;
+
 	// add our commands
 	Cmd_AddCommand ("path", FS_Path_f);
 	Cmd_AddCommand ("dir", FS_Dir_f );
 	Cmd_AddCommand ("fdir", FS_NewDir_f );
 	Cmd_AddCommand ("touchFile", FS_TouchFile_f );
 	Cmd_AddCommand ("which", FS_Which_f );
+	Cmd_AddCommand ("loadstats", FS_LoadStats_f );
 
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=506
 	// reorder the pure pk3 files according to server order
 	FS_ReorderPurePaks();
+	FS_BuildFileTable();
 
 	// print the current search paths
 	FS_Path_f();
@@ -3201,6 +4551,11 @@ void FS_PureServerSetLoadedPaks( const char *pakSums, const char *pakNames ) {
 		fs_serverPaks[i] = atoi( Cmd_Argv( i ) );
 	}
 
+	// the file table only holds the paks allowed now
+	if ( fs_searchpaths ) {
+		FS_BuildFileTable();
+	}
+
 	if (fs_numServerPaks) {
 		Com_DPrintf( "Connected to a pure server.\n" );
 	}
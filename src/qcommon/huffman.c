@@ -28,52 +28,31 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "q_shared.h"
 #include "qcommon.h"
 
-static int			bloc = 0;
+/* Add a bit to the output file (buffered) */
+static ID_INLINE void add_bit (char bit, byte *fout, int *offset) {
+	int	bloc = *offset;
 
-void	Huff_putBit( int bit, byte *fout, int *offset) {
-	bloc = *offset;
 	if ((bloc&7) == 0) {
 		fout[(bloc>>3)] = 0;
 	}
 	fout[(bloc>>3)] |= bit << (bloc&7);
-	bloc++;
-	*offset = bloc;
+	*offset = bloc + 1;
 }
 
-int		Huff_getBloc(void)
-{
-	return bloc;
-}
-
-void	Huff_setBloc(int _bloc)
-{
-	bloc = _bloc;
-}
+/* Receive one bit from the input file (buffered) */
+static ID_INLINE int get_bit (byte *fin, int *offset) {
+	int	bloc = *offset;
 
-int		Huff_getBit( byte *fin, int *offset) {
-	int t;
-	bloc = *offset;
-	t = (fin[(bloc>>3)] >> (bloc&7)) & 0x1;
-	bloc++;
-	*offset = bloc;
-	return t;
+	*offset = bloc + 1;
+	return (fin[(bloc>>3)] >> (bloc&7)) & 0x1;
 }
 
-/* Add a bit to the output file (buffered) */
-static void add_bit (char bit, byte *fout) {
-	if ((bloc&7) == 0) {
-		fout[(bloc>>3)] = 0;
-	}
-	fout[(bloc>>3)] |= bit << (bloc&7);
-	bloc++;
+void	Huff_putBit( int bit, byte *fout, int *offset) {
+	add_bit(bit, fout, offset);
 }
 
-/* Receive one bit from the input file (buffered) */
-static int get_bit (byte *fin) {
-	int t;
-	t = (fin[(bloc>>3)] >> (bloc&7)) & 0x1;
-	bloc++;
-	return t;
+int		Huff_getBit( byte *fin, int *offset) {
+	return get_bit(fin, offset);
 }
 
 static node_t **get_ppnode(huff_t* huff) {
@@ -264,9 +243,9 @@ void Huff_addRef(huff_t* huff, byte ch) {
 }
 
 /* Get a symbol */
-int Huff_Receive (node_t *node, int *ch, byte *fin) {
+int Huff_Receive (node_t *node, int *ch, byte *fin, int *offset) {
 	while (node && node->symbol == INTERNAL_NODE) {
-		if (get_bit(fin)) {
+		if (get_bit(fin, offset)) {
 			node = node->right;
 		} else {
 			node = node->left;
@@ -281,9 +260,10 @@ int Huff_Receive (node_t *node, int *ch, byte *fin) {
 
 /* Get a symbol */
 void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset) {
-	bloc = *offset;
+	int	bloc = *offset;
+
 	while (node && node->symbol == INTERNAL_NODE) {
-		if (get_bit(fin)) {
+		if (get_bit(fin, &bloc)) {
 			node = node->right;
 		} else {
 			node = node->left;
@@ -299,41 +279,39 @@ void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset) {
 }
 
 /* Send the prefix code for this node */
-static void send(node_t *node, node_t *child, byte *fout) {
+static void send(node_t *node, node_t *child, byte *fout, int *offset) {
 	if (node->parent) {
-		send(node->parent, node, fout);
+		send(node->parent, node, fout, offset);
 	}
 	if (child) {
 		if (node->right == child) {
-			add_bit(1, fout);
+			add_bit(1, fout, offset);
 		} else {
-			add_bit(0, fout);
+			add_bit(0, fout, offset);
 		}
 	}
 }
 
 /* Send a symbol */
-void Huff_transmit (huff_t *huff, int ch, byte *fout) {
+void Huff_transmit (huff_t *huff, int ch, byte *fout, int *offset) {
 	int i;
 	if (huff->loc[ch] == NULL) { 
 		/* node_t hasn't been transmitted, send a NYT, then the symbol */
-		Huff_transmit(huff, NYT, fout);
+		Huff_transmit(huff, NYT, fout, offset);
 		for (i = 7; i >= 0; i--) {
-			add_bit((char)((ch >> i) & 0x1), fout);
+			add_bit((char)((ch >> i) & 0x1), fout, offset);
 		}
 	} else {
-		send(huff->loc[ch], NULL, fout);
+		send(huff->loc[ch], NULL, fout, offset);
 	}
 }
 
 void Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset) {
-	bloc = *offset;
-	send(huff->loc[ch], NULL, fout);
-	*offset = bloc;
+	send(huff->loc[ch], NULL, fout, offset);
 }
 
 void Huff_Decompress(msg_t *mbuf, int offset) {
-	int			ch, cch, i, j, size;
+	int			ch, cch, i, j, size, bloc;
 	byte		seq[65536];
 	byte*		buffer;
 	huff_t		huff;
@@ -368,11 +346,11 @@ void Huff_Decompress(msg_t *mbuf, int offset) {
 			seq[j] = 0;
 			break;
 		}
-		Huff_Receive(huff.tree, &ch, buffer);				/* Get a character */
+		Huff_Receive(huff.tree, &ch, buffer, &bloc);		/* Get a character */
 		if ( ch == NYT ) {								/* We got a NYT, get the symbol associated with it */
 			ch = 0;
 			for ( i = 0; i < 8; i++ ) {
-				ch = (ch<<1) + get_bit(buffer);
+				ch = (ch<<1) + get_bit(buffer, &bloc);
 			}
 		}
     
@@ -384,10 +362,8 @@ void Huff_Decompress(msg_t *mbuf, int offset) {
 	Com_Memcpy(mbuf->data + offset, seq, cch);
 }
 
-extern 	int oldsize;
-
 void Huff_Compress(msg_t *mbuf, int offset) {
-	int			i, ch, size;
+	int			i, ch, size, bloc;
 	byte		seq[65536];
 	byte*		buffer;
 	huff_t		huff;
@@ -415,7 +391,7 @@ void Huff_Compress(msg_t *mbuf, int offset) {
 
 	for (i=0; i<size; i++ ) {
 		ch = buffer[i];
-		Huff_transmit(&huff, ch, seq);						/* Transmit symbol */
+		Huff_transmit(&huff, ch, seq, &bloc);				/* Transmit symbol */
 		Huff_addRef(&huff, (byte)ch);								/* Do update */
 	}
 
@@ -425,6 +401,198 @@ void Huff_Compress(msg_t *mbuf, int offset) {
 	Com_Memcpy(mbuf->data+offset, seq, (bloc>>3));
 }
 
+/*
+==============================================================================
+
+Table driven coding
+
+Once a tree stops adapting, every symbol has a fixed prefix code, so it can
+be written with a single store and read back with a single lookup.  Bits
+are packed exactly as Huff_putBit does, least significant bit first.
+==============================================================================
+*/
+
+/* Store len bits of code at *offset */
+static ID_INLINE void Huff_writeCode( uint64_t code, int len, byte *fout, int *offset, int maxsize ) {
+	int		pos, i;
+
+	pos = *offset;
+
+#ifdef Q3_LITTLE_ENDIAN
+	if ( (pos>>3) + 8 <= maxsize ) {
+		uint64_t	word, keep;
+		int			shift, end;
+
+		shift = pos&7;
+		end = (shift + len + 7) & ~7;
+
+		// keep the bits already written in this byte and any bytes
+		// past the last one touched, which Huff_putBit wouldn't clear
+		keep = ((uint64_t)1 << shift) - 1;
+		if ( end < 64 ) {
+			keep |= ~(uint64_t)0 << end;
+		}
+
+		Com_Memcpy( &word, fout + (pos>>3), 8 );
+		word = ( word & keep ) | ( code << shift );
+		Com_Memcpy( fout + (pos>>3), &word, 8 );
+
+		*offset = pos + len;
+		return;
+	}
+#endif
+
+	for ( i = 0; i < len; i++ ) {
+		if ((pos&7) == 0) {
+			fout[(pos>>3)] = 0;
+		}
+		fout[(pos>>3)] |= ((code >> i) & 1) << (pos&7);
+		pos++;
+	}
+	*offset = pos;
+}
+
+/* Fetch up to HUFF_LOOKUP_BITS bits at offset without consuming them */
+static ID_INLINE int Huff_peekCode( byte *fin, int offset, int maxsize ) {
+	int		pos, value, i;
+
+	pos = offset>>3;
+	if ( pos + 3 <= maxsize ) {
+		value = fin[pos] | ( fin[pos+1] << 8 ) | ( fin[pos+2] << 16 );
+		return ( value >> (offset&7) ) & ( ( 1 << HUFF_LOOKUP_BITS ) - 1 );
+	}
+
+	// don't read past the end of the buffer
+	value = 0;
+	for ( i = 0; i < HUFF_LOOKUP_BITS && ( (offset+i) >> 3 ) < maxsize; i++ ) {
+		value |= ( ( fin[(offset+i)>>3] >> ((offset+i)&7) ) & 1 ) << i;
+	}
+	return value;
+}
+
+void Huff_BuildEncodeTable( huff_t *huff, huffEncodeTable_t *table ) {
+	int		ch, len;
+	node_t	*node;
+	uint64_t	code;
+
+	Com_Memset( table, 0, sizeof( *table ) );
+
+	for ( ch = 0; ch < HMAX; ch++ ) {
+		if ( !huff->loc[ch] ) {
+			continue;
+		}
+
+		// collect the path from the leaf up, then it is already
+		// in transmission order with the root's branch in bit 0
+		code = 0;
+		len = 0;
+		for ( node = huff->loc[ch]; node->parent; node = node->parent ) {
+			if ( len == HUFF_MAX_TABLE_CODE ) {
+				break;
+			}
+			code <<= 1;
+			if ( node->parent->right == node ) {
+				code |= 1;
+			}
+			len++;
+		}
+		if ( node->parent ) {
+			continue;	// too long, leave it to the tree
+		}
+
+		table->code[ch] = code;
+		table->length[ch] = len;
+	}
+}
+
+void Huff_BuildDecodeTable( huff_t *huff, huffDecodeTable_t *table ) {
+	int		i, bit;
+	node_t	*node;
+	huffDecodeEntry_t	*entry;
+
+	table->huff = huff;
+
+	for ( i = 0; i < ( 1 << HUFF_LOOKUP_BITS ); i++ ) {
+		entry = &table->entries[i];
+
+		node = huff->tree;
+		for ( bit = 0; bit < HUFF_LOOKUP_BITS; bit++ ) {
+			if ( !node || node->symbol != INTERNAL_NODE ) {
+				break;
+			}
+			if ( ( i >> bit ) & 1 ) {
+				node = node->right;
+			} else {
+				node = node->left;
+			}
+		}
+
+		if ( node && node->symbol != INTERNAL_NODE ) {
+			entry->node = NULL;
+			entry->symbol = node->symbol;
+			entry->length = bit;
+		} else {
+			entry->node = node;
+			entry->symbol = 0;
+			entry->length = 0;
+		}
+	}
+}
+
+/* Send a symbol using a table built from huff */
+void Huff_tableTransmit( const huffEncodeTable_t *table, huff_t *huff, int ch, byte *fout, int *offset, int maxsize ) {
+	if ( !table->length[ch] ) {
+		Huff_offsetTransmit( huff, ch, fout, offset );
+		return;
+	}
+	Huff_writeCode( table->code[ch], table->length[ch], fout, offset, maxsize );
+}
+
+/* Get a symbol using a table, continuing down the tree for long codes */
+void Huff_tableReceive( const huffDecodeTable_t *table, int *ch, byte *fin, int *offset, int maxsize ) {
+	const huffDecodeEntry_t	*entry;
+	node_t	*node;
+	int		pos;
+
+	entry = &table->entries[ Huff_peekCode( fin, *offset, maxsize ) ];
+	if ( entry->length ) {
+		*ch = entry->symbol;
+		*offset += entry->length;
+		return;
+	}
+
+	pos = *offset + HUFF_LOOKUP_BITS;
+	node = entry->node;
+	while (node && node->symbol == INTERNAL_NODE) {
+		if ((fin[(pos>>3)] >> (pos&7)) & 0x1) {
+			node = node->right;
+		} else {
+			node = node->left;
+		}
+		pos++;
+	}
+	if (!node) {
+		*ch = 0;
+		return;
+	}
+	*ch = node->symbol;
+	*offset = pos;
+}
+
+/* Write up to 32 raw bits */
+void Huff_putBits( int value, int bits, byte *fout, int *offset, int maxsize ) {
+	Huff_writeCode( (uint32_t)value & ( 0xffffffffu >> ( 32 - bits ) ), bits, fout, offset, maxsize );
+}
+
+/* Read up to HUFF_LOOKUP_BITS raw bits */
+int Huff_getBits( int bits, byte *fin, int *offset, int maxsize ) {
+	int		value;
+
+	value = Huff_peekCode( fin, *offset, maxsize ) & ( ( 1 << bits ) - 1 );
+	*offset += bits;
+	return value;
+}
+
 void Huff_Init(huffman_t *huff) {
 
 	Com_Memset(&huff->compressor, 0, sizeof(huff_t));
@@ -24,6 +24,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "qcommon.h"
 
 static huffman_t		msgHuff;
+static huffEncodeTable_t	msgHuffEncode;
+static huffDecodeTable_t	msgHuffDecode;
 
 static qboolean			msgInit = qfalse;
 
@@ -38,8 +40,6 @@ Handles byte ordering and avoids alignment errors
 ==============================================================================
 */
 
-int oldsize = 0;
-
 void MSG_initHuffman( void );
 
 void MSG_Init( msg_t *buf, byte *data, int length ) {
@@ -102,14 +102,12 @@ bit functions
 =============================================================================
 */
 
-int	overflows;
-
 // negative bit values include signs
 void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	int	i;
 //	FILE*	fp;
 
-	oldsize += bits;
+	msg->uncompsize += bits;
 
 	// this isn't an exact overflow check, but close enough
 	if ( msg->maxsize - msg->cursize < 4 ) {
@@ -125,7 +123,7 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	if ( bits != 32 ) {
 		if ( bits > 0 ) {
 			if ( value > ( ( 1 << bits ) - 1 ) || value < 0 ) {
-				overflows++;
+				msg->overflows++;
 			}
 		} else {
 			int	r;
@@ -133,7 +131,7 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 			r = 1 << (bits-1);
 
 			if ( value >  r - 1 || value < -r ) {
-				overflows++;
+				msg->overflows++;
 			}
 		}
 	}
@@ -164,16 +162,14 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 		if (bits&7) {
 			int nbits;
 			nbits = bits&7;
-			for(i=0;i<nbits;i++) {
-				Huff_putBit((value&1), msg->data, &msg->bit);
-				value = (value>>1);
-			}
+			Huff_putBits(value, nbits, msg->data, &msg->bit, msg->maxsize);
+			value = (value>>nbits);
 			bits = bits - nbits;
 		}
 		if (bits) {
 			for(i=0;i<bits;i+=8) {
 //				fwrite(bp, 1, 1, fp);
-				Huff_offsetTransmit (&msgHuff.compressor, (value&0xff), msg->data, &msg->bit);
+				Huff_tableTransmit (&msgHuffEncode, &msgHuff.compressor, (value&0xff), msg->data, &msg->bit, msg->maxsize);
 				value = (value>>8);
 			}
 		}
@@ -182,6 +178,35 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	}
 }
 
+/*
+=================
+MSG_WriteCodedBits
+
+Appends part of another message's bitstream as it is, without coding
+it again, so a block written once can be shared between messages
+=================
+*/
+void MSG_WriteCodedBits( msg_t *msg, const msg_t *src, int startBit, int endBit ) {
+	int		bit, bits;
+
+	msg->uncompsize += endBit - startBit;
+
+	if ( msg->maxsize - msg->cursize < ( ( endBit - startBit ) >> 3 ) + 4 ) {
+		msg->overflowed = qtrue;
+		return;
+	}
+
+	for ( bit = startBit; bit < endBit; ) {
+		bits = endBit - bit;
+		if ( bits > 8 ) {
+			bits = 8;
+		}
+		Huff_putBits( Huff_getBits( bits, src->data, &bit, src->maxsize ), bits,
+			msg->data, &msg->bit, msg->maxsize );
+	}
+	msg->cursize = (msg->bit>>3)+1;
+}
+
 int MSG_ReadBits( msg_t *msg, int bits ) {
 	int			value;
 	int			get;
@@ -220,15 +245,13 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 		nbits = 0;
 		if (bits&7) {
 			nbits = bits&7;
-			for(i=0;i<nbits;i++) {
-				value |= (Huff_getBit(msg->data, &msg->bit)<<i);
-			}
+			value = Huff_getBits(nbits, msg->data, &msg->bit, msg->maxsize);
 			bits = bits - nbits;
 		}
 		if (bits) {
 //			fp = fopen("c:\\netchan.bin", "a");
 			for(i=0;i<bits;i+=8) {
-				Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
+				Huff_tableReceive (&msgHuffDecode, &get, msg->data, &msg->bit, msg->maxsize);
 //				fwrite(&get, 1, 1, fp);
 				value |= (get<<(i+nbits));
 			}
@@ -373,11 +396,9 @@ int MSG_ReadByte( msg_t *msg ) {
 }
 
 int MSG_LookaheadByte( msg_t *msg ) {
-	const int bloc = Huff_getBloc();
 	const int readcount = msg->readcount;
 	const int bit = msg->bit;
 	int c = MSG_ReadByte(msg);
-	Huff_setBloc(bloc);
 	msg->readcount = readcount;
 	msg->bit = bit;
 	return c;
@@ -695,7 +716,7 @@ void MSG_WriteDeltaUsercmdKey( msg_t *msg, int key, usercmd_t *from, usercmd_t *
 		from->buttons == to->buttons &&
 		from->weapon == to->weapon) {
 			MSG_WriteBits( msg, 0, 1 );				// no change
-			oldsize += 7;
+			msg->uncompsize += 7;
 			return;
 	}
 	key ^= to->serverTime;
@@ -909,7 +930,7 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 
 	MSG_WriteByte( msg, lc );	// # of changes
 
-	oldsize += numFields;
+	msg->uncompsize += numFields;
 
 	for ( i = 0, field = entityStateFields ; i < lc ; i++, field++ ) {
 		fromF = (int *)( (byte *)from + field->offset );
@@ -929,7 +950,7 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 
 			if (fullFloat == 0.0f) {
 					MSG_WriteBits( msg, 0, 1 );
-					oldsize += FLOAT_INT_BITS;
+					msg->uncompsize += FLOAT_INT_BITS;
 			} else {
 				MSG_WriteBits( msg, 1, 1 );
 				if ( trunc == fullFloat && trunc + FLOAT_INT_BIAS >= 0 && 
@@ -1186,7 +1207,7 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 
 	MSG_WriteByte( msg, lc );	// # of changes
 
-	oldsize += numFields - lc;
+	msg->uncompsize += numFields - lc;
 
 	for ( i = 0, field = playerStateFields ; i < lc ; i++, field++ ) {
 		fromF = (int *)( (byte *)from + field->offset );
@@ -1247,7 +1268,7 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 
 	if (!statsbits && !persistantbits && !miscbits) {
 		MSG_WriteBits( msg, 0, 1 );	// no change
-		oldsize += 4;
+		msg->uncompsize += 4;
 		return;
 	}
 	MSG_WriteBits( msg, 1, 1 );	// changed
@@ -1685,6 +1706,10 @@ void MSG_initHuffman( void ) {
 			Huff_addRef(&msgHuff.decompressor,	(byte)i);			// Do update
 		}
 	}
+
+	// the trees are fixed from here on
+	Huff_BuildEncodeTable(&msgHuff.compressor, &msgHuffEncode);
+	Huff_BuildDecodeTable(&msgHuff.decompressor, &msgHuffDecode);
 }
 
 /*
@@ -1723,3 +1748,187 @@ void MSG_NUinitHuffman() {
 */
 
 //===========================================================================
+
+/*
+=================
+MSG_HuffEncode
+
+Codes a whole payload the way MSG_WriteBits does, either through the
+lookup tables or by walking the tree.  Returns the number of bits written.
+=================
+*/
+static int MSG_HuffEncode( const byte *in, int len, byte *out, int maxsize, qboolean tables ) {
+	int		i, bit;
+
+	bit = 0;
+	for ( i = 0; i < len; i++ ) {
+		if ( tables ) {
+			Huff_tableTransmit( &msgHuffEncode, &msgHuff.compressor, in[i], out, &bit, maxsize );
+		} else {
+			Huff_offsetTransmit( &msgHuff.compressor, in[i], out, &bit );
+		}
+	}
+	return bit;
+}
+
+/*
+=================
+MSG_HuffDecode
+
+Reads len symbols back, returns the number of bits consumed
+=================
+*/
+static int MSG_HuffDecode( byte *in, int maxsize, byte *out, int len, qboolean tables ) {
+	int		i, bit, ch;
+
+	bit = 0;
+	for ( i = 0; i < len; i++ ) {
+		if ( tables ) {
+			Huff_tableReceive( &msgHuffDecode, &ch, in, &bit, maxsize );
+		} else {
+			Huff_offsetReceive( msgHuff.decompressor.tree, &ch, in, &bit );
+		}
+		out[i] = ch;
+	}
+	return bit;
+}
+
+#define HUFFBENCH_MAX_PAYLOADS	4096
+#define HUFFBENCH_PASSES		64
+
+/*
+=================
+MSG_HuffmanBench_f
+
+huffbench [demo]
+
+Checks that the table driven coder produces the same bytes as the tree
+walk and times both.  With a demo the recorded server messages are used
+as payloads, otherwise random payloads following msg_hData are generated.
+=================
+*/
+void MSG_HuffmanBench_f( void ) {
+	byte	*payloads[HUFFBENCH_MAX_PAYLOADS];
+	int		lengths[HUFFBENCH_MAX_PAYLOADS];
+	int		numPayloads, totalBytes;
+	byte	treeBuf[MAX_MSGLEN], tableBuf[MAX_MSGLEN], decoded[MAX_MSGLEN];
+	int		treeBits, tableBits;
+	int		i, j, pass, start, msec[4];
+	int		mismatches;
+	void	*demo;
+	int		demoLen;
+
+	if ( !msgInit ) {
+		MSG_initHuffman();
+	}
+
+	numPayloads = 0;
+	totalBytes = 0;
+
+	if ( Cmd_Argc() > 1 ) {
+		byte	*p, *end;
+		int		len;
+
+		demoLen = FS_ReadFile( Cmd_Argv( 1 ), &demo );
+		if ( !demo ) {
+			Com_Printf( "Couldn't read %s\n", Cmd_Argv( 1 ) );
+			return;
+		}
+
+		// each message is a sequence number, a length and the bitstream,
+		// which is decoded back to the symbols the server wrote
+		p = demo;
+		end = p + demoLen;
+		while ( p + 8 <= end && numPayloads < HUFFBENCH_MAX_PAYLOADS ) {
+			len = LittleLong( ((int *)p)[1] );
+			p += 8;
+			if ( len <= 0 || len > MAX_MSGLEN || p + len > end ) {
+				break;
+			}
+
+			Com_Memset( treeBuf, 0, sizeof( treeBuf ) );
+			Com_Memcpy( treeBuf, p, len );
+			p += len;
+
+			for ( j = 0, treeBits = 0; treeBits < len * 8 && j < MAX_MSGLEN; j++ ) {
+				int ch;
+
+				Huff_offsetReceive( msgHuff.decompressor.tree, &ch, treeBuf, &treeBits );
+				decoded[j] = ch;
+			}
+
+			payloads[numPayloads] = Z_Malloc( j );
+			Com_Memcpy( payloads[numPayloads], decoded, j );
+			lengths[numPayloads++] = j;
+			totalBytes += j;
+		}
+		FS_FreeFile( demo );
+	} else {
+		int		total, r;
+
+		for ( i = 0, total = 0; i < 256; i++ ) {
+			total += msg_hData[i];
+		}
+
+		srand( 1 );
+		for ( numPayloads = 0; numPayloads < 256; numPayloads++ ) {
+			lengths[numPayloads] = 200 + rand() % 1200;
+			payloads[numPayloads] = Z_Malloc( lengths[numPayloads] );
+			for ( j = 0; j < lengths[numPayloads]; j++ ) {
+				r = ( ( rand() << 15 ) ^ rand() ) % total;
+				for ( i = 0; r >= msg_hData[i]; i++ ) {
+					r -= msg_hData[i];
+				}
+				payloads[numPayloads][j] = i;
+			}
+			totalBytes += lengths[numPayloads];
+		}
+	}
+
+	if ( !numPayloads ) {
+		Com_Printf( "No payloads\n" );
+		return;
+	}
+
+	// the encoded bytes and the decoded symbols must match exactly
+	mismatches = 0;
+	for ( i = 0; i < numPayloads; i++ ) {
+		Com_Memset( treeBuf, 0xa5, sizeof( treeBuf ) );
+		Com_Memset( tableBuf, 0xa5, sizeof( tableBuf ) );
+		treeBits = MSG_HuffEncode( payloads[i], lengths[i], treeBuf, sizeof( treeBuf ), qfalse );
+		tableBits = MSG_HuffEncode( payloads[i], lengths[i], tableBuf, sizeof( tableBuf ), qtrue );
+		if ( treeBits != tableBits || memcmp( treeBuf, tableBuf, ( treeBits >> 3 ) + 1 ) ) {
+			mismatches++;
+			continue;
+		}
+
+		if ( MSG_HuffDecode( treeBuf, sizeof( treeBuf ), decoded, lengths[i], qtrue ) != treeBits ||
+			memcmp( decoded, payloads[i], lengths[i] ) ) {
+			mismatches++;
+		}
+	}
+
+	for ( j = 0; j < 4; j++ ) {
+		start = Sys_Milliseconds();
+		for ( pass = 0; pass < HUFFBENCH_PASSES; pass++ ) {
+			for ( i = 0; i < numPayloads; i++ ) {
+				if ( j < 2 ) {
+					MSG_HuffEncode( payloads[i], lengths[i], treeBuf, sizeof( treeBuf ), j & 1 );
+				} else {
+					MSG_HuffEncode( payloads[i], lengths[i], treeBuf, sizeof( treeBuf ), qtrue );
+					MSG_HuffDecode( treeBuf, sizeof( treeBuf ), decoded, lengths[i], j & 1 );
+				}
+			}
+		}
+		msec[j] = Sys_Milliseconds() - start;
+	}
+
+	Com_Printf( "%i payloads, %i bytes, %i passes, %i mismatches\n",
+		numPayloads, totalBytes, HUFFBENCH_PASSES, mismatches );
+	Com_Printf( "encode: tree %i msec, table %i msec\n", msec[0], msec[1] );
+	Com_Printf( "decode: tree %i msec, table %i msec (including table encode)\n", msec[2], msec[3] );
+
+	for ( i = 0; i < numPayloads; i++ ) {
+		Z_Free( payloads[i] );
+	}
+}
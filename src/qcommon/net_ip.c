@@ -21,6 +21,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 
+#ifdef __linux__
+#define _GNU_SOURCE		// recvmmsg, sendmmsg
+#endif
+
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
 
@@ -81,6 +85,16 @@ static qboolean	winsockInitialized = qfalse;
 #		include <sys/filio.h>
 #	endif
 
+#	ifdef __linux__
+		// read and write a whole batch of datagrams per system call
+#		define NET_BATCH_RECV
+#		define NET_BATCH_SEND
+		// wait for packets and frame deadlines with epoll and a timerfd
+#		define NET_EPOLL
+#		include <sys/epoll.h>
+#		include <sys/timerfd.h>
+#	endif
+
 typedef int SOCKET;
 #	define INVALID_SOCKET		-1
 #	define SOCKET_ERROR			-1
@@ -108,6 +122,10 @@ static cvar_t	*net_port6;
 static cvar_t	*net_mcast6addr;
 static cvar_t	*net_mcast6iface;
 
+#ifdef NET_BATCH_SEND
+static cvar_t	*net_sendBatch;
+#endif
+
 static struct sockaddr	socksRelayAddr;
 
 static SOCKET	ip_socket = INVALID_SOCKET;
@@ -115,6 +133,44 @@ static SOCKET	ip6_socket = INVALID_SOCKET;
 static SOCKET	socks_socket = INVALID_SOCKET;
 static SOCKET	multicast6_socket = INVALID_SOCKET;
 
+#ifdef NET_BATCH_RECV
+// receive queue overflows the kernel last reported for each socket
+static unsigned int	ip_drops;
+static unsigned int	ip6_drops;
+static unsigned int	multicast6_drops;
+#endif
+
+#ifdef NET_BATCH_SEND
+// outgoing packets waiting for Sys_FlushPackets
+#define	MAX_SEND_BATCH		64
+#define	SEND_BATCH_BYTES	( 128 * 1024 )
+
+typedef struct {
+	SOCKET		sock;
+	qboolean	broadcast;
+	struct sockaddr_storage	addr;
+	socklen_t	addrlen;
+	int			offset;
+	int			length;
+} sendPacket_t;
+
+static sendPacket_t	sendBatch[ MAX_SEND_BATCH ];
+static byte			sendBatchData[ SEND_BATCH_BYTES ];
+static int			sendBatchCount;
+static int			sendBatchBytes;
+#endif
+
+// for net_sendbench
+static int		netPacketsSent;
+static int		netSendCalls;
+
+#ifdef NET_EPOLL
+// watches the sockets for NET_Sleep, set up when it is first needed,
+// -2 if that failed and NET_Sleep should stick to select
+static int		net_epoll = -1;
+static int		net_timer = -1;
+#endif
+
 // Keep track of currently joined multicast group.
 static struct ipv6_mreq curgroup;
 // And the currently bound address.
@@ -639,23 +695,225 @@ qboolean Sys_GetPacket( netadr_t *net_from, msg_t *net_message ) {
 			return qtrue;
 		}
 	}
-	
-	
+
+
 	return qfalse;
 }
 
+#ifdef NET_BATCH_RECV
+#define	MAX_RECV_BATCH	32
+
+/*
+==================
+NET_RecvBatch
+
+Reads up to count datagrams from sock with a single recvmmsg, straight
+into the callers messages.  Returns the number of messages filled.
+==================
+*/
+static int NET_RecvBatch( SOCKET sock, unsigned int *drops, netadr_t *net_from, msg_t *net_messages, int count, int *dropped ) {
+	struct mmsghdr	hdrs[ MAX_RECV_BATCH ];
+	struct iovec	iovs[ MAX_RECV_BATCH ];
+	struct sockaddr_storage	from[ MAX_RECV_BATCH ];
+	union {
+		struct cmsghdr	align;
+		char			buf[ CMSG_SPACE( sizeof( uint32_t ) ) ];
+	} control[ MAX_RECV_BATCH ];
+	struct cmsghdr	*cmsg;
+	msg_t	*msg;
+	int		ret, len, err;
+	int		i, filled;
+
+	if( count > MAX_RECV_BATCH )
+		count = MAX_RECV_BATCH;
+
+	for( i = 0; i < count; i++ )
+	{
+		iovs[i].iov_base = net_messages[i].data;
+		iovs[i].iov_len = net_messages[i].maxsize;
+
+		memset( &hdrs[i], 0, sizeof( hdrs[i] ) );
+		hdrs[i].msg_hdr.msg_name = &from[i];
+		hdrs[i].msg_hdr.msg_namelen = sizeof( from[i] );
+		hdrs[i].msg_hdr.msg_iov = &iovs[i];
+		hdrs[i].msg_hdr.msg_iovlen = 1;
+		hdrs[i].msg_hdr.msg_control = control[i].buf;
+		hdrs[i].msg_hdr.msg_controllen = sizeof( control[i].buf );
+	}
+
+	ret = recvmmsg( sock, hdrs, count, MSG_DONTWAIT, NULL );
+
+	if( ret == SOCKET_ERROR )
+	{
+		err = socketError;
+
+		if( err != EAGAIN && err != ECONNRESET )
+			Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
+
+		return 0;
+	}
+
+	filled = 0;
+
+	for( i = 0; i < ret; i++ )
+	{
+		len = hdrs[i].msg_len;
+		msg = &net_messages[filled];
+
+		// the running total of datagrams the socket had to throw away
+		// because we did not read them fast enough
+		for( cmsg = CMSG_FIRSTHDR( &hdrs[i].msg_hdr ); cmsg; cmsg = CMSG_NXTHDR( &hdrs[i].msg_hdr, cmsg ) )
+		{
+#ifdef SO_RXQ_OVFL
+			if( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL )
+			{
+				uint32_t	total;
+
+				memcpy( &total, CMSG_DATA( cmsg ), sizeof( total ) );
+				if( total > *drops )
+				{
+					*dropped += total - *drops;
+					*drops = total;
+				}
+			}
+#endif
+		}
+
+		// packets that were rejected leave a hole, close it up
+		if( i != filled )
+			memcpy( msg->data, net_messages[i].data, len );
+
+		if( sock == ip_socket && usingSocks && memcmp( &from[i], &socksRelayAddr, hdrs[i].msg_hdr.msg_namelen ) == 0 )
+		{
+			if ( len < 10 || msg->data[0] != 0 || msg->data[1] != 0 || msg->data[2] != 0 || msg->data[3] != 1 ) {
+				continue;
+			}
+			net_from[filled].type = NA_IP;
+			net_from[filled].ip[0] = msg->data[4];
+			net_from[filled].ip[1] = msg->data[5];
+			net_from[filled].ip[2] = msg->data[6];
+			net_from[filled].ip[3] = msg->data[7];
+			net_from[filled].port = *(short *)&msg->data[8];
+			msg->readcount = 10;
+		}
+		else
+		{
+			if( from[i].ss_family == AF_INET )
+				memset( ((struct sockaddr_in *)&from[i])->sin_zero, 0, 8 );
+
+			SockadrToNetadr( (struct sockaddr *) &from[i], &net_from[filled] );
+			msg->readcount = 0;
+		}
+
+		if( len == msg->maxsize || ( hdrs[i].msg_hdr.msg_flags & MSG_TRUNC ) )
+		{
+			Com_Printf( "Oversize packet from %s\n", NET_AdrToString( net_from[filled] ) );
+			(*dropped)++;
+			continue;
+		}
+
+		msg->cursize = len;
+		filled++;
+	}
+
+	return filled;
+}
+#endif
+
+/*
+==================
+Sys_GetPackets
+
+Reads up to count waiting packets into net_messages, which must have been
+initialized, and adds the number of packets that were lost before they
+could be read to dropped.  Returns the number of packets read.
+==================
+*/
+int Sys_GetPackets( netadr_t *net_from, msg_t *net_messages, int count, int *dropped ) {
+	int		n = 0;
+
+#ifdef NET_BATCH_RECV
+	if( ip_socket != INVALID_SOCKET && n < count )
+		n += NET_RecvBatch( ip_socket, &ip_drops, net_from + n, net_messages + n, count - n, dropped );
+
+	if( ip6_socket != INVALID_SOCKET && n < count )
+		n += NET_RecvBatch( ip6_socket, &ip6_drops, net_from + n, net_messages + n, count - n, dropped );
+
+	if( multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket && n < count )
+		n += NET_RecvBatch( multicast6_socket, &multicast6_drops, net_from + n, net_messages + n, count - n, dropped );
+#else
+	while( n < count && Sys_GetPacket( &net_from[n], &net_messages[n] ) )
+		n++;
+#endif
+
+	return n;
+}
+
 //=============================================================================
 
 static char socksBuf[4096];
 
+/*
+==================
+NET_SendError
+==================
+*/
+static void NET_SendError( int err, qboolean broadcast ) {
+	// wouldblock is silent
+	if( err == EAGAIN ) {
+		return;
+	}
+
+	// some PPP links do not allow broadcasts and return an error
+	if( ( err == EADDRNOTAVAIL ) && broadcast ) {
+		return;
+	}
+
+	Com_Printf( "NET_SendPacket: %s\n", NET_ErrorString() );
+}
+
+#ifdef NET_BATCH_SEND
+/*
+==================
+NET_BatchPacket
+
+Copies a packet into the transmit batch
+==================
+*/
+static void NET_BatchPacket( SOCKET sock, struct sockaddr_storage *addr, socklen_t addrlen,
+	const void *data, int length, qboolean broadcast ) {
+	sendPacket_t	*packet;
+
+	if( sendBatchCount == MAX_SEND_BATCH || sendBatchBytes + length > SEND_BATCH_BYTES ) {
+		Sys_FlushPackets();
+	}
+
+	packet = &sendBatch[ sendBatchCount++ ];
+	packet->sock = sock;
+	packet->broadcast = broadcast;
+	packet->addr = *addr;
+	packet->addrlen = addrlen;
+	packet->offset = sendBatchBytes;
+	packet->length = length;
+
+	memcpy( sendBatchData + sendBatchBytes, data, length );
+	sendBatchBytes += length;
+}
+#endif
+
 /*
 ==================
 Sys_SendPacket
+
+Where batching is available the packet only goes out
+with the next Sys_FlushPackets
 ==================
 */
 void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 	int				ret = SOCKET_ERROR;
 	struct sockaddr_storage	addr;
+	SOCKET			sock;
+	socklen_t		addrlen;
 
 	if( to.type != NA_BROADCAST && to.type != NA_IP && to.type != NA_IP6 && to.type != NA_MULTICAST6)
 	{
@@ -675,6 +933,9 @@ void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 	NetadrToSockadr( &to, (struct sockaddr *) &addr );
 
 	if( usingSocks && to.type == NA_IP ) {
+		// keep the order of anything that is already batched
+		Sys_FlushPackets();
+
 		socksBuf[0] = 0;	// reserved
 		socksBuf[1] = 0;
 		socksBuf[2] = 0;	// fragment (not fragmented)
@@ -683,28 +944,99 @@ void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 		*(short *)&socksBuf[8] = ((struct sockaddr_in *)&addr)->sin_port;
 		memcpy( &socksBuf[10], data, length );
 		ret = sendto( ip_socket, socksBuf, length+10, 0, &socksRelayAddr, sizeof(socksRelayAddr) );
+		netPacketsSent++;
+		netSendCalls++;
 	}
 	else {
-		if(addr.ss_family == AF_INET)
-			ret = sendto( ip_socket, data, length, 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in) );
-		else if(addr.ss_family == AF_INET6)
-			ret = sendto( ip6_socket, data, length, 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in6) );
-	}
-	if( ret == SOCKET_ERROR ) {
-		int err = socketError;
+		if(addr.ss_family == AF_INET) {
+			sock = ip_socket;
+			addrlen = sizeof(struct sockaddr_in);
+		}
+		else if(addr.ss_family == AF_INET6) {
+			sock = ip6_socket;
+			addrlen = sizeof(struct sockaddr_in6);
+		}
+		else
+			return;
 
-		// wouldblock is silent
-		if( err == EAGAIN ) {
+#ifdef NET_BATCH_SEND
+		if( net_sendBatch->integer ) {
+			NET_BatchPacket( sock, &addr, addrlen, data, length, to.type == NA_BROADCAST );
 			return;
 		}
+#endif
 
-		// some PPP links do not allow broadcasts and return an error
-		if( ( err == EADDRNOTAVAIL ) && ( ( to.type == NA_BROADCAST ) ) ) {
-			return;
+		ret = sendto( sock, data, length, 0, (struct sockaddr *) &addr, addrlen );
+		netPacketsSent++;
+		netSendCalls++;
+	}
+	if( ret == SOCKET_ERROR ) {
+		NET_SendError( socketError, to.type == NA_BROADCAST );
+	}
+}
+
+/*
+==================
+Sys_FlushPackets
+
+Sends the transmit batch, one sendmmsg for each run
+of packets that go out through the same socket
+==================
+*/
+void Sys_FlushPackets( void ) {
+#ifdef NET_BATCH_SEND
+	struct mmsghdr	hdrs[ MAX_SEND_BATCH ];
+	struct iovec	iovs[ MAX_SEND_BATCH ];
+	sendPacket_t	*packet;
+	int				i, first, last, ret;
+
+	if( !sendBatchCount )
+		return;
+
+	for( i = 0; i < sendBatchCount; i++ )
+	{
+		packet = &sendBatch[i];
+
+		iovs[i].iov_base = sendBatchData + packet->offset;
+		iovs[i].iov_len = packet->length;
+
+		memset( &hdrs[i], 0, sizeof( hdrs[i] ) );
+		hdrs[i].msg_hdr.msg_name = &packet->addr;
+		hdrs[i].msg_hdr.msg_namelen = packet->addrlen;
+		hdrs[i].msg_hdr.msg_iov = &iovs[i];
+		hdrs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	first = 0;
+	while( first < sendBatchCount )
+	{
+		for( last = first + 1; last < sendBatchCount; last++ )
+		{
+			if( sendBatch[last].sock != sendBatch[first].sock )
+				break;
 		}
 
-		Com_Printf( "NET_SendPacket: %s\n", NET_ErrorString() );
+		ret = sendmmsg( sendBatch[first].sock, &hdrs[first], last - first, 0 );
+		netSendCalls++;
+
+		if( ret <= 0 )
+		{
+			// sendmmsg stops at the first packet that fails,
+			// report it and carry on with the ones after it
+			NET_SendError( socketError, sendBatch[first].broadcast );
+			netPacketsSent++;
+			first++;
+		}
+		else
+		{
+			netPacketsSent += ret;
+			first += ret;
+		}
 	}
+
+	sendBatchCount = 0;
+	sendBatchBytes = 0;
+#endif
 }
 
 
@@ -858,6 +1190,13 @@ int NET_IPSocket( char *net_interface, int port, int *err ) {
 //		return newsocket;
 	}
 
+#if defined( NET_BATCH_RECV ) && defined( SO_RXQ_OVFL )
+	// have the kernel report how many packets it had to drop
+	if( setsockopt( newsocket, SOL_SOCKET, SO_RXQ_OVFL, (char *) &i, sizeof(i) ) == SOCKET_ERROR ) {
+		Com_DPrintf( "WARNING: NET_IPSocket: setsockopt SO_RXQ_OVFL: %s\n", NET_ErrorString() );
+	}
+#endif
+
 	if( !net_interface || !net_interface[0]) {
 		address.sin_family = AF_INET;
 		address.sin_addr.s_addr = INADDR_ANY;
@@ -938,6 +1277,16 @@ int NET_IP6Socket( char *net_interface, int port, struct sockaddr_in6 *bindto, i
 	}
 #endif
 
+#if defined( NET_BATCH_RECV ) && defined( SO_RXQ_OVFL )
+	{
+		int i = 1;
+
+		// have the kernel report how many packets it had to drop
+		if(setsockopt(newsocket, SOL_SOCKET, SO_RXQ_OVFL, (char *) &i, sizeof(i)) == SOCKET_ERROR)
+			Com_DPrintf("WARNING: NET_IP6Socket: setsockopt SO_RXQ_OVFL: %s\n", NET_ErrorString());
+	}
+#endif
+
 	if( !net_interface || !net_interface[0]) {
 		address.sin6_family = AF_INET6;
 		address.sin6_addr = in6addr_any;
@@ -1071,6 +1420,9 @@ void NET_LeaveMulticast6()
 			setsockopt(multicast6_socket, IPPROTO_IPV6, IPV6_LEAVE_GROUP, (char *) &curgroup, sizeof(curgroup));
 
 		multicast6_socket = INVALID_SOCKET;
+#ifdef NET_BATCH_RECV
+		multicast6_drops = 0;
+#endif
 	}
 }
 
@@ -1499,6 +1851,11 @@ static qboolean NET_GetCvars( void ) {
 	modified += net_socksPassword->modified; 
 	net_socksPassword->modified = qfalse;
 
+#ifdef NET_BATCH_SEND
+	// doesn't need the sockets reopened
+	net_sendBatch = Cvar_Get( "net_sendBatch", "1", CVAR_ARCHIVE );
+#endif
+
 	return modified ? qtrue : qfalse;
 }
 
@@ -1548,6 +1905,17 @@ void NET_Config( qboolean enableNetworking ) {
 	}
 
 	if( stop ) {
+		// the batch can't outlive the sockets it goes out through
+		Sys_FlushPackets();
+
+#ifdef NET_EPOLL
+		// socket numbers get reused, so start over with a new set
+		if( net_epoll >= 0 ) {
+			close( net_epoll );
+		}
+		net_epoll = -1;
+#endif
+
 		if ( ip_socket != INVALID_SOCKET ) {
 			closesocket( ip_socket );
 			ip_socket = INVALID_SOCKET;
@@ -1570,6 +1938,10 @@ void NET_Config( qboolean enableNetworking ) {
 			closesocket( socks_socket );
 			socks_socket = INVALID_SOCKET;
 		}
+
+#ifdef NET_BATCH_RECV
+		ip_drops = ip6_drops = multicast6_drops = 0;
+#endif
 		
 	}
 
@@ -1584,6 +1956,138 @@ void NET_Config( qboolean enableNetworking ) {
 }
 
 
+/*
+====================
+NET_SendBench_f
+
+Sends frames of packets to a socket of our own on the loopback
+interface, once one sendto at a time and once batched
+====================
+*/
+static void NET_SendBench_f( void ) {
+#ifdef NET_BATCH_SEND
+	netadr_t	from[ MAX_RECV_BATCH ];
+	msg_t		msgs[ MAX_RECV_BATCH ];
+	struct sockaddr_storage	address;
+	struct sockaddr_in	*sin = (struct sockaddr_in *)&address;
+	socklen_t	addrlen;
+	netadr_t	to;
+	SOCKET		sock;
+	u_long		_true = 1;
+	char		batch[ MAX_CVAR_VALUE_STRING ];
+	byte		*packet, *recvData;
+	unsigned int	drops;
+	int			frames, count, size, bufsize;
+	int			mode, f, i, n, received, dropped;
+	int			start, msec, sent, calls;
+
+	frames = 1000;
+	count = 128;
+	size = 1400;
+	if ( Cmd_Argc( ) > 1 ) {
+		frames = atoi( Cmd_Argv( 1 ) );
+	}
+	if ( Cmd_Argc( ) > 2 ) {
+		count = atoi( Cmd_Argv( 2 ) );
+	}
+	if ( Cmd_Argc( ) > 3 ) {
+		size = atoi( Cmd_Argv( 3 ) );
+	}
+	if ( frames <= 0 || count <= 0 || size <= 0 || size >= MAX_MSGLEN ) {
+		Com_Printf( "usage: net_sendbench [frames] [packets per frame] [packet size]\n" );
+		return;
+	}
+
+	if ( ip_socket == INVALID_SOCKET || usingSocks ) {
+		Com_Printf( "net_sendbench needs IPv4 networking without a SOCKS proxy\n" );
+		return;
+	}
+
+	// the receiving end
+	sock = socket( PF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if ( sock == INVALID_SOCKET ) {
+		Com_Printf( "net_sendbench: socket: %s\n", NET_ErrorString() );
+		return;
+	}
+
+	memset( &address, 0, sizeof( address ) );
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	sin->sin_port = 0;
+	addrlen = sizeof( address );
+
+	if ( ioctlsocket( sock, FIONBIO, &_true ) == SOCKET_ERROR ||
+		bind( sock, (void *)sin, sizeof( *sin ) ) == SOCKET_ERROR ||
+		getsockname( sock, (struct sockaddr *)&address, &addrlen ) == SOCKET_ERROR ) {
+		Com_Printf( "net_sendbench: %s\n", NET_ErrorString() );
+		closesocket( sock );
+		return;
+	}
+	SockadrToNetadr( (struct sockaddr *)&address, &to );
+
+	// a frame doesn't have to fit, but the fewer drops the better
+	bufsize = 4 * 1024 * 1024;
+	setsockopt( sock, SOL_SOCKET, SO_RCVBUF, (char *)&bufsize, sizeof( bufsize ) );
+#ifdef SO_RXQ_OVFL
+	{
+		int one = 1;
+
+		// ioctlsocket wants a u_long, setsockopt an int
+		setsockopt( sock, SOL_SOCKET, SO_RXQ_OVFL, (char *)&one, sizeof( one ) );
+	}
+#endif
+
+	packet = Z_Malloc( size );
+	for ( i = 0; i < size; i++ ) {
+		packet[i] = i;
+	}
+	recvData = Z_Malloc( MAX_RECV_BATCH * ( size + 1 ) );
+
+	Q_strncpyz( batch, net_sendBatch->string, sizeof( batch ) );
+	Sys_FlushPackets();
+
+	for ( mode = 0; mode < 2; mode++ ) {
+		Cvar_Set( "net_sendBatch", mode ? "1" : "0" );
+
+		sent = netPacketsSent;
+		calls = netSendCalls;
+		received = dropped = 0;
+		drops = 0;
+
+		start = Sys_Milliseconds( );
+		for ( f = 0; f < frames; f++ ) {
+			for ( i = 0; i < count; i++ ) {
+				Sys_SendPacket( size, packet, to );
+			}
+			Sys_FlushPackets();
+
+			do {
+				for ( i = 0; i < MAX_RECV_BATCH; i++ ) {
+					MSG_Init( &msgs[i], recvData + i * ( size + 1 ), size + 1 );
+				}
+				n = NET_RecvBatch( sock, &drops, from, msgs, MAX_RECV_BATCH, &dropped );
+				received += n;
+			} while ( n );
+		}
+		msec = Sys_Milliseconds( ) - start;
+
+		sent = netPacketsSent - sent;
+		calls = netSendCalls - calls;
+		Com_Printf( "%s: %i packets in %i msec, %i packets/sec, %.2f syscalls/frame, %i received, %i dropped\n",
+			mode ? "sendmmsg" : "sendto", sent, msec, msec ? (int)( sent * 1000.0 / msec ) : 0,
+			(float)calls / frames, received, dropped );
+	}
+
+	Cvar_Set( "net_sendBatch", batch );
+	closesocket( sock );
+	Z_Free( recvData );
+	Z_Free( packet );
+#else
+	Com_Printf( "Batched sending is not built on this platform\n" );
+#endif
+}
+
+
 /*
 ====================
 NET_Init
@@ -1606,6 +2110,7 @@ void NET_Init( void ) {
 	NET_Config( qtrue );
 	
 	Cmd_AddCommand ("net_restart", NET_Restart_f);
+	Cmd_AddCommand ("net_sendbench", NET_SendBench_f);
 }
 
 
@@ -1628,14 +2133,68 @@ void NET_Shutdown( void ) {
 }
 
 
+#ifdef NET_EPOLL
+/*
+====================
+NET_WatchSocket
+====================
+*/
+static qboolean NET_WatchSocket( int fd ) {
+	struct epoll_event	ev;
+
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+
+	if( epoll_ctl( net_epoll, EPOLL_CTL_ADD, fd, &ev ) == -1 ) {
+		Com_Printf( "WARNING: NET_Sleep: epoll_ctl: %s\n", NET_ErrorString() );
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+/*
+====================
+NET_InitEpoll
+
+Puts the sockets and the frame timer in an epoll set
+====================
+*/
+static void NET_InitEpoll( void ) {
+	if( net_timer == -1 ) {
+		net_timer = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+		if( net_timer == -1 ) {
+			Com_Printf( "WARNING: NET_Sleep: timerfd_create: %s\n", NET_ErrorString() );
+			net_epoll = -2;
+			return;
+		}
+	}
+
+	net_epoll = epoll_create( 4 );
+	if( net_epoll == -1 ) {
+		Com_Printf( "WARNING: NET_Sleep: epoll_create: %s\n", NET_ErrorString() );
+		net_epoll = -2;
+		return;
+	}
+
+	if( !NET_WatchSocket( net_timer ) ||
+		( ip_socket != INVALID_SOCKET && !NET_WatchSocket( ip_socket ) ) ||
+		( ip6_socket != INVALID_SOCKET && !NET_WatchSocket( ip6_socket ) ) ) {
+		close( net_epoll );
+		net_epoll = -2;
+	}
+}
+#endif
+
 /*
 ====================
 NET_Sleep
 
-Sleeps msec or until something happens on the network
+Sleeps usec microseconds or until something happens on the network
 ====================
 */
-void NET_Sleep( int msec ) {
+void NET_Sleep( int usec ) {
 	struct timeval timeout;
 	fd_set	fdset;
 	int highestfd = -1;
@@ -1646,9 +2205,37 @@ void NET_Sleep( int msec ) {
 	if (ip_socket == INVALID_SOCKET && ip6_socket == INVALID_SOCKET)
 		return;
 
-	if (msec < 0 )
+	if (usec <= 0 )
 		return;
 
+#ifdef NET_EPOLL
+	if( net_epoll == -1 )
+		NET_InitEpoll();
+
+	if( net_epoll >= 0 )
+	{
+		struct itimerspec	its;
+		struct epoll_event	events[ 4 ];
+		uint64_t			expirations;
+
+		// epoll_wait only counts milliseconds, the timer
+		// wakes us up at the exact microsecond
+		memset( &its, 0, sizeof( its ) );
+		its.it_value.tv_sec = usec / 1000000;
+		its.it_value.tv_nsec = ( usec % 1000000 ) * 1000;
+
+		// an expiry left over from when a packet came first
+		// would end the wait right away
+		while( read( net_timer, &expirations, sizeof( expirations ) ) > 0 );
+
+		if( timerfd_settime( net_timer, 0, &its, NULL ) == 0 )
+		{
+			epoll_wait( net_epoll, events, 4, -1 );
+			return;
+		}
+	}
+#endif
+
 	FD_ZERO(&fdset);
 
 	if(ip_socket != INVALID_SOCKET)
@@ -1665,8 +2252,8 @@ void NET_Sleep( int msec ) {
 			highestfd = ip6_socket;
 	}
 
-	timeout.tv_sec = msec/1000;
-	timeout.tv_usec = (msec%1000)*1000;
+	timeout.tv_sec = usec/1000000;
+	timeout.tv_usec = usec%1000000;
 	select(highestfd + 1, &fdset, NULL, NULL, &timeout);
 }
 
@@ -47,6 +47,8 @@ typedef struct {
 	int		cursize;
 	int		readcount;
 	int		bit;				// for bitwise reads and writes
+	int		uncompsize;			// bits written before huffman coding, for net debugging
+	int		overflows;			// values written that didn't fit in their bits
 } msg_t;
 
 void MSG_Init (msg_t *buf, byte *data, int length);
@@ -66,6 +68,7 @@ struct entityState_s;
 struct playerState_s;
 
 void MSG_WriteBits( msg_t *msg, int value, int bits );
+void MSG_WriteCodedBits( msg_t *msg, const msg_t *src, int startBit, int endBit );
 
 void MSG_WriteChar (msg_t *sb, int c);
 void MSG_WriteByte (msg_t *sb, int c);
@@ -110,6 +113,7 @@ void MSG_ReadDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct pl
 
 
 void MSG_ReportChangeVectors_f( void );
+void MSG_HuffmanBench_f( void );
 
 //============================================================================
 
@@ -184,7 +188,7 @@ int		NET_StringToAdr ( const char *s, netadr_t *a, netadrtype_t family);
 qboolean	NET_GetLoopPacket (netsrc_t sock, netadr_t *net_from, msg_t *net_message);
 void		NET_JoinMulticast6(void);
 void		NET_LeaveMulticast6(void);
-void		NET_Sleep(int msec);
+void		NET_Sleep(int usec);
 
 
 #define	MAX_MSGLEN				16384		// max length of a message, which may
@@ -417,7 +421,8 @@ void	Cmd_RemoveCommand( const char *cmd_name );
 typedef void (*completionFunc_t)( char *args, int argNum );
 
 void	Cmd_CommandCompletion( void(*callback)(const char *s) );
-// callback with each valid string
+void	Cmd_PrefixCompletion( const char *prefix, void(*callback)(const char *s) );
+// callback with each valid string, in sorted order
 void Cmd_SetCommandCompletionFunc( const char *command,
 	completionFunc_t complete );
 void Cmd_CompleteArgument( const char *command, char *args, int argNum );
@@ -515,6 +520,9 @@ void	Cvar_CommandCompletion( void(*callback)(const char *s) );
 void 	Cvar_Reset( const char *var_name );
 void 	Cvar_ForceReset(const char *var_name);
 
+cvar_t	*Cvar_Unset( cvar_t *cv );
+// removes the cvar, returns the one after it in the list
+
 void	Cvar_SetCheatState( void );
 // reset all testing vars to a safe value
 
@@ -623,6 +631,10 @@ int		FS_FOpenFileRead( const char *qpath, fileHandle_t *file, qboolean uniqueFIL
 int		FS_FileIsInPAK(const char *filename, int *pChecksum );
 // returns 1 if a file is in the PAK file, otherwise -1
 
+int		FS_FileStamp( const char *qpath, int *stamp );
+// returns the length of a file without reading it, or -1, and a stamp
+// that changes when its contents do
+
 int		FS_Write( const void *buffer, int len, fileHandle_t f );
 
 int		FS_Read2( void *buffer, int len, fileHandle_t f );
@@ -646,6 +658,29 @@ void	FS_ForceFlush( fileHandle_t f );
 void	FS_FreeFile( void *buffer );
 // frees the memory returned by FS_ReadFile
 
+int		FS_MapFile( const char *qpath, void **buffer );
+// like FS_ReadFile, but entries stored uncompressed in a pk3 are mapped
+// straight from the pk3 instead of copied, so the buffer is read-only
+// and has no trailing 0
+
+int		FS_MapHomeFile( const char *qpath, void **buffer );
+// maps a file the engine wrote below fs_homepath/fs_gamedir, skipping the
+// search paths and pure checks, -1 if it is missing or can't be mapped
+
+void	FS_UnmapFile( void *buffer );
+// releases a buffer returned by FS_MapFile or FS_MapHomeFile
+
+void	FS_PrefetchFiles( const char **qpaths, int count );
+// inflates the pk3 entries among qpaths on fs_prefetchThreads worker
+// threads, so the FS_ReadFile calls that follow only copy them
+
+void	FS_FlushPrefetch( void );
+// drops whatever was prefetched but never read
+
+void	FS_BeginLoadStats( void );
+void	FS_EndLoadStats( const char *name );
+// brackets a level load for the loadstats command
+
 void	FS_WriteFile( const char *qpath, const void *buffer, int size );
 // writes a complete file, creating any subdirectories needed
 
@@ -763,7 +798,8 @@ typedef enum {
 	SE_MOUSE,	// evValue and evValue2 are reletive signed x / y moves
 	SE_JOYSTICK_AXIS,	// evValue is an axis number and evValue2 is the current state (-127 to 127)
 	SE_CONSOLE,	// evPtr is a char*
-	SE_PACKET	// evPtr is a netadr_t followed by data bytes to evPtrLength
+	SE_PACKET	// evPtr is a netadr_t followed by data bytes to evPtrLength,
+				// or NULL with evValue the packet slot it was received into
 } sysEventType_t;
 
 typedef struct {
@@ -1050,6 +1086,7 @@ void	Sys_Print( const char *msg );
 // Sys_Milliseconds should only be used for profiling purposes,
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds (void);
+int64_t	Sys_Microseconds( void );	// monotonic, for pacing and profiling
 
 void	Sys_SnapVector( float *v );
 
@@ -1062,8 +1099,33 @@ cpuFeatures_t Sys_GetProcessorFeatures( void );
 
 void	Sys_SetErrorText( const char *text );
 
+// worker threads for spreading independent jobs over several cores, the
+// thread calling Sys_RunWorkerJobs works on the batch too as thread 0
+#define MAX_WORKER_THREADS	16
+
+typedef struct workerPool_s workerPool_t;
+
+workerPool_t	*Sys_CreateWorkerPool( int numThreads );	// NULL if numThreads <= 0
+void	Sys_DestroyWorkerPool( workerPool_t *pool );
+int		Sys_WorkerPoolThreads( workerPool_t *pool );
+void	Sys_RunWorkerJobs( workerPool_t *pool, void (*func)( void *data, int index, int thread ),
+			void *data, int count );
+
+// state of the thread interrupted by the profiling timer
+typedef struct {
+	void		*pc;
+	intptr_t	regs[ 16 ];		// general registers in x86 encoding order, if known
+} profileContext_t;
+
+// calls sample from a signal handler every usec of cpu time that the calling
+// thread was using, context is its interrupted state
+qboolean	Sys_StartProfiler( int usec, void (*sample)( profileContext_t *context ) );
+void	Sys_StopProfiler( void );
+
 void	Sys_SendPacket( int length, const void *data, netadr_t to );
+void	Sys_FlushPackets( void );	// sends whatever Sys_SendPacket has batched up
 qboolean Sys_GetPacket( netadr_t *net_from, msg_t *net_message );
+int		Sys_GetPackets( netadr_t *net_from, msg_t *net_messages, int count, int *dropped );
 
 qboolean	Sys_StringToAdr( const char *s, netadr_t *a, netadrtype_t family );
 //Does NOT parse port numbers, only base addresses.
@@ -1072,6 +1134,9 @@ qboolean	Sys_IsLANAddress (netadr_t adr);
 void		Sys_ShowIP(void);
 
 qboolean Sys_Mkdir( const char *path );
+qboolean Sys_FileStat( const char *path, int *size, int *mtime );	// qfalse if it doesn't exist
+void	*Sys_MapFile( const char *path, int offset, int length );	// read-only, NULL if it can't be mapped
+void	Sys_UnmapFile( void *data, int offset, int length );
 char	*Sys_Cwd( void );
 void	Sys_SetDefaultInstallPath(const char *path);
 char	*Sys_DefaultInstallPath(void);
@@ -1132,20 +1197,44 @@ typedef struct {
 	huff_t		decompressor;
 } huffman_t;
 
+// flattened copies of a tree that no longer changes, so symbols can be
+// coded with a table lookup instead of walking the tree a bit at a time
+#define HUFF_LOOKUP_BITS	10
+#define HUFF_MAX_TABLE_CODE	56	// longer codes are sent through the tree
+
+typedef struct {
+	uint64_t	code[HMAX];		// prefix code, first transmitted bit in bit 0
+	byte		length[HMAX];	// 0 if the symbol must be sent through the tree
+} huffEncodeTable_t;
+
+typedef struct {
+	node_t		*node;			// where to continue if the code is longer
+	short		symbol;
+	byte		length;			// bits consumed, 0 if the code is longer
+} huffDecodeEntry_t;
+
+typedef struct {
+	huff_t				*huff;
+	huffDecodeEntry_t	entries[1 << HUFF_LOOKUP_BITS];
+} huffDecodeTable_t;
+
 void	Huff_Compress(msg_t *buf, int offset);
 void	Huff_Decompress(msg_t *buf, int offset);
 void	Huff_Init(huffman_t *huff);
 void	Huff_addRef(huff_t* huff, byte ch);
-int		Huff_Receive (node_t *node, int *ch, byte *fin);
-void	Huff_transmit (huff_t *huff, int ch, byte *fout);
+int		Huff_Receive (node_t *node, int *ch, byte *fin, int *offset);
+void	Huff_transmit (huff_t *huff, int ch, byte *fout, int *offset);
 void	Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset);
 void	Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset);
 void	Huff_putBit( int bit, byte *fout, int *offset);
 int		Huff_getBit( byte *fout, int *offset);
 
-// don't use if you don't know what you're doing.
-int		Huff_getBloc(void);
-void	Huff_setBloc(int _bloc);
+void	Huff_BuildEncodeTable( huff_t *huff, huffEncodeTable_t *table );
+void	Huff_BuildDecodeTable( huff_t *huff, huffDecodeTable_t *table );
+void	Huff_tableTransmit( const huffEncodeTable_t *table, huff_t *huff, int ch, byte *fout, int *offset, int maxsize );
+void	Huff_tableReceive( const huffDecodeTable_t *table, int *ch, byte *fin, int *offset, int maxsize );
+void	Huff_putBits( int value, int bits, byte *fout, int *offset, int maxsize );
+int		Huff_getBits( int bits, byte *fin, int *offset, int maxsize );
 
 extern huffman_t clientHuffTables;
 
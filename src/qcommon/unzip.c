@@ -1619,3 +1619,35 @@ extern int ZEXPORT unzSetOffset (file, pos)
     s->current_file_ok = (err == UNZ_OK);
     return err;
 }
+
+/* Get the position of the current file's data in the zipfile,
+   the current file must have been opened with unzOpenCurrentFile */
+extern uLong ZEXPORT unzGetCurrentFileDataOffset (file)
+        unzFile file;
+{
+    unz_s* s;
+
+    if (file==NULL)
+        return 0;
+    s=(unz_s*)file;
+    if (s->pfile_in_zip_read==NULL)
+        return 0;
+    return s->pfile_in_zip_read->pos_in_zipfile +
+           s->pfile_in_zip_read->byte_before_the_zipfile;
+}
+
+/* Get the position and size of the central directory in the zipfile */
+extern int ZEXPORT unzGetCentralDir (file, offset, size)
+        unzFile file;
+        uLong *offset;
+        uLong *size;
+{
+    unz_s* s;
+
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz_s*)file;
+    *offset = s->offset_central_dir;
+    *size = s->size_central_dir;
+    return UNZ_OK;
+}
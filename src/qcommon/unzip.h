@@ -346,6 +346,12 @@ extern uLong ZEXPORT unzGetOffset (unzFile file);
 /* Set the current file offset */
 extern int ZEXPORT unzSetOffset (unzFile file, uLong pos);
 
+/* Get the position of the current file's data in the zipfile */
+extern uLong ZEXPORT unzGetCurrentFileDataOffset (unzFile file);
+
+/* Get the position and size of the central directory in the zipfile */
+extern int ZEXPORT unzGetCentralDir (unzFile file, uLong *offset, uLong *size);
+
 
 
 #ifdef __cplusplus
@@ -50,6 +50,9 @@ vm_t	vmTable[MAX_VM];
 
 void VM_VmInfo_f( void );
 void VM_VmProfile_f( void );
+static void VM_ProfileFree( vm_t *vm );
+static void VM_ProfileCheck( void );
+void VM_CompileStats_f( void );
 
 
 
@@ -77,6 +80,7 @@ void VM_Init( void ) {
 
 	Cmd_AddCommand ("vmprofile", VM_VmProfile_f );
 	Cmd_AddCommand ("vminfo", VM_VmInfo_f );
+	Cmd_AddCommand ("vm_compileStats", VM_CompileStats_f );
 
 	Com_Memset( vmTable, 0, sizeof( vmTable ) );
 }
@@ -158,29 +162,22 @@ int VM_SymbolToValue( vm_t *vm, const char *symbol ) {
 VM_SymbolForCompiledPointer
 =====================
 */
-#if 0 // 64bit!
 const char *VM_SymbolForCompiledPointer( vm_t *vm, void *code ) {
 	int			i;
 
-	if ( code < (void *)vm->codeBase ) {
-		return "Before code block";
-	}
-	if ( code >= (void *)(vm->codeBase + vm->codeLength) ) {
-		return "After code block";
+	if ( !vm->instructionForPointer ) {
+		return "Unknown code block";
 	}
 
-	// find which original instruction it is after
-	for ( i = 0 ; i < vm->codeLength ; i++ ) {
-		if ( (void *)vm->instructionPointers[i] > code ) {
-			break;
-		}
+	// find which original instruction it is in
+	i = vm->instructionForPointer( vm, code );
+	if ( i < 0 ) {
+		return "Outside code block";
 	}
-	i--;
 
 	// now look up the bytecode instruction pointer
 	return VM_ValueToSymbol( vm, i );
 }
-#endif
 
 
 
@@ -590,8 +587,11 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 	}
 #else
 	if ( interpret >= VMI_COMPILED ) {
+		int		start = Sys_Milliseconds();
+
 		vm->compiled = qtrue;
 		VM_Compile( vm, header );
+		vm->compileTime = Sys_Milliseconds() - start;
 	}
 #endif
 	// VM_Compile may have reset vm->compiled if compilation failed
@@ -635,6 +635,8 @@ void VM_Free( vm_t *vm ) {
 		}
 	}
 
+	VM_ProfileFree( vm );
+
 	if(vm->destroy)
 		vm->destroy(vm);
 
@@ -742,6 +744,8 @@ intptr_t	QDECL VM_Call( vm_t *vm, int callnum, ... ) {
 		Com_Error( ERR_FATAL, "VM_Call with NULL vm" );
 	}
 
+	VM_ProfileCheck();
+
 	oldVM = currentVM;
 	currentVM = vm;
 	lastVM = vm;
@@ -801,6 +805,516 @@ intptr_t	QDECL VM_Call( vm_t *vm, int callnum, ... ) {
 	return r;
 }
 
+/*
+==============================================================
+
+SAMPLING PROFILER
+
+"vmprofile start [seconds]" samples where the VMs spend their cpu time
+and counts their syscalls, "vmprofile stop" ends it early and
+"vmprofile dump [file]" prints a summary and writes the samples as
+collapsed stacks for flamegraph tools.
+
+Samples in compiled code follow the return instructions the QVM CALLs
+store on the program stack, so every sample gets its whole QVM call
+stack, ending in the syscall it was made in if any.
+
+==============================================================
+*/
+
+#define PROFILE_INTERVAL		1000	// usec of cpu time between samples
+#define PROFILE_MAX_SAMPLES		16384
+#define PROFILE_MAX_DEPTH		24
+#define PROFILE_MAX_SYSCALLS	1024
+#define PROFILE_TOP_FUNCTIONS	20
+
+static int QDECL VM_ProfileSort( const void *a, const void *b );
+
+typedef struct {
+	short		vm;			// index in vmTable, -1 outside of the VMs
+	short		depth;
+	int			syscall;	// -1 in QVM code
+	int			stack[ PROFILE_MAX_DEPTH ];	// instructions, innermost first
+} vmProfileSample_t;
+
+typedef struct {
+	intptr_t		(*systemCall)( intptr_t *parms );	// the real one while profiling
+	volatile int	syscall;	// being executed, -1 for none
+
+	// for following the program stack
+	int				*funcStart;	// per instruction, the ENTER of its function
+	int				*frameSize;	// per ENTER, the size of its frame
+
+	int				syscallCalls[ PROFILE_MAX_SYSCALLS ];
+	int				syscallSamples[ PROFILE_MAX_SYSCALLS ];
+} vmProfileVM_t;
+
+static struct {
+	qboolean			running;
+	volatile qboolean	recording;
+	int					endTime;	// 0 to run until stopped
+	int					interval;
+
+	vmProfileSample_t	*samples;
+	volatile int		numSamples;
+
+	vmProfileVM_t		vms[ MAX_VM ];
+} vmProfile;
+
+/*
+==============
+VM_ProfileSystemCall
+
+Stands in for the systemCall of the VMs while profiling
+==============
+*/
+static intptr_t VM_ProfileSystemCall( intptr_t *args ) {
+	vmProfileVM_t	*pvm = &vmProfile.vms[ currentVM - vmTable ];
+	int				oldSyscall = pvm->syscall;
+	intptr_t		r;
+
+	if ( (unsigned)args[0] < PROFILE_MAX_SYSCALLS ) {
+		pvm->syscallCalls[ args[0] ]++;
+	}
+
+	pvm->syscall = args[0];
+	r = pvm->systemCall( args );
+	pvm->syscall = oldSyscall;
+
+	return r;
+}
+
+/*
+==============
+VM_ProfileSample
+
+Called from the signal handler of Sys_StartProfiler
+==============
+*/
+static void VM_ProfileSample( profileContext_t *context ) {
+	vm_t				*vm = currentVM;
+	vmProfileVM_t		*pvm;
+	vmProfileSample_t	*s;
+	int					instruction, programStack, func;
+
+	// only the thread that runs the VMs touches the samples
+	if ( !vmProfile.recording || !context ) {
+		return;
+	}
+
+	if ( vmProfile.numSamples >= PROFILE_MAX_SAMPLES ||
+		( vmProfile.endTime && Sys_Milliseconds() - vmProfile.endTime >= 0 ) ) {
+		vmProfile.recording = qfalse;
+		return;
+	}
+
+	s = &vmProfile.samples[ vmProfile.numSamples++ ];
+	s->vm = -1;
+	s->depth = 0;
+	s->syscall = -1;
+
+	if ( !vm || vm->callLevel <= 0 ) {
+		return;
+	}
+
+	s->vm = vm - vmTable;
+	pvm = &vmProfile.vms[ s->vm ];
+	s->syscall = pvm->syscall;
+
+	if ( !pvm->funcStart || !vm->sampleState ||
+		!vm->sampleState( vm, context, s->syscall >= 0, &instruction, &programStack ) ) {
+		return;
+	}
+
+	// the outermost frame returns to -1
+	while ( s->depth < PROFILE_MAX_DEPTH && (unsigned)instruction < vm->instructionCount ) {
+		s->stack[ s->depth++ ] = instruction;
+
+		// the ENTER may not have made the frame yet
+		func = pvm->funcStart[ instruction ];
+		if ( instruction != func ) {
+			programStack += pvm->frameSize[ func ];
+		}
+
+		instruction = *(int *)( vm->dataBase + ( programStack & vm->dataMask & ~3 ) ) - 1;
+	}
+}
+
+/*
+==============
+VM_ProfileFrames
+
+Reads the QVM again for the frame sizes of its functions
+==============
+*/
+static void VM_ProfileFrames( vm_t *vm, vmProfileVM_t *pvm ) {
+	char		filename[ MAX_QPATH ];
+	vmHeader_t	*header;
+	byte		*code;
+	int			instruction, pc, op, func, count;
+
+	Com_sprintf( filename, sizeof( filename ), "vm/%s.qvm", vm->name );
+	if ( FS_ReadFile( filename, (void **)&header ) < (int)sizeof( vmHeader_t ) ) {
+		return;
+	}
+
+	count = LittleLong( header->instructionCount );
+	if ( count != vm->instructionCount ) {
+		Com_Printf( "vmprofile: %s changed on disk, not following its stack\n", filename );
+		FS_FreeFile( header );
+		return;
+	}
+
+	pvm->funcStart = Z_Malloc( count * 2 * sizeof( int ) );
+	pvm->frameSize = pvm->funcStart + count;
+
+	code = (byte *)header + LittleLong( header->codeOffset );
+	func = 0;
+	pc = 0;
+	for ( instruction = 0 ; instruction < count ; instruction++ ) {
+		op = code[ pc++ ];
+		if ( op == OP_ENTER ) {
+			func = instruction;
+			pvm->frameSize[ func ] = LittleLong( *(int *)&code[ pc ] );
+		}
+		pvm->funcStart[ instruction ] = func;
+
+		switch ( op ) {
+		case OP_ENTER:
+		case OP_LEAVE:
+		case OP_CONST:
+		case OP_LOCAL:
+		case OP_BLOCK_COPY:
+			pc += 4;
+			break;
+		case OP_ARG:
+			pc += 1;
+			break;
+		default:
+			if ( op >= OP_EQ && op <= OP_GEF ) {
+				pc += 4;
+			}
+			break;
+		}
+	}
+
+	FS_FreeFile( header );
+}
+
+/*
+==============
+VM_ProfileClear
+==============
+*/
+static void VM_ProfileClear( void ) {
+	int		i;
+
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if ( vmProfile.vms[i].funcStart ) {
+			Z_Free( vmProfile.vms[i].funcStart );
+		}
+	}
+
+	if ( vmProfile.samples ) {
+		Z_Free( vmProfile.samples );
+	}
+
+	Com_Memset( &vmProfile, 0, sizeof( vmProfile ) );
+}
+
+/*
+==============
+VM_ProfileStart
+==============
+*/
+static void VM_ProfileStart( int seconds ) {
+	vm_t			*vm;
+	vmProfileVM_t	*pvm;
+	int				i;
+
+	if ( vmProfile.running ) {
+		Com_Printf( "vmprofile: already running\n" );
+		return;
+	}
+
+	VM_ProfileClear();
+
+	vmProfile.samples = Z_Malloc( PROFILE_MAX_SAMPLES * sizeof( *vmProfile.samples ) );
+	vmProfile.interval = PROFILE_INTERVAL;
+	if ( seconds > 0 ) {
+		// spread the samples over the whole time
+		if ( seconds * ( 1000000 / PROFILE_MAX_SAMPLES ) > vmProfile.interval ) {
+			vmProfile.interval = seconds * ( 1000000 / PROFILE_MAX_SAMPLES );
+		}
+		vmProfile.endTime = Sys_Milliseconds() + seconds * 1000;
+	}
+
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		vm = &vmTable[i];
+		pvm = &vmProfile.vms[i];
+		pvm->syscall = -1;
+		if ( !vm->name[0] || !vm->systemCall ) {
+			continue;
+		}
+
+		pvm->systemCall = vm->systemCall;
+		vm->systemCall = VM_ProfileSystemCall;
+
+		if ( vm->sampleState ) {
+			VM_ProfileFrames( vm, pvm );
+		}
+	}
+
+	vmProfile.running = qtrue;
+	vmProfile.recording = qtrue;
+
+	if ( !Sys_StartProfiler( vmProfile.interval, VM_ProfileSample ) ) {
+		Com_Printf( "vmprofile: no sampling on this platform, only counting syscalls\n" );
+	}
+
+	Com_Printf( "vmprofile: started, sampling every %i usec\n", vmProfile.interval );
+}
+
+/*
+==============
+VM_ProfileStop
+==============
+*/
+static void VM_ProfileStop( void ) {
+	int		i;
+
+	if ( !vmProfile.running ) {
+		return;
+	}
+
+	vmProfile.recording = qfalse;
+	Sys_StopProfiler();
+
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if ( vmTable[i].systemCall == VM_ProfileSystemCall ) {
+			vmTable[i].systemCall = vmProfile.vms[i].systemCall;
+		}
+	}
+
+	vmProfile.running = qfalse;
+	Com_Printf( "vmprofile: stopped with %i samples\n", vmProfile.numSamples );
+}
+
+/*
+==============
+VM_ProfileCheck
+
+Stops the profiler once the samples are complete
+==============
+*/
+static void VM_ProfileCheck( void ) {
+	if ( vmProfile.running && !vmProfile.recording ) {
+		VM_ProfileStop();
+	}
+}
+
+/*
+==============
+VM_ProfileFree
+
+The samples can't be resolved once the VM is gone
+==============
+*/
+static void VM_ProfileFree( vm_t *vm ) {
+	int		i;
+
+	for ( i = 0 ; i < vmProfile.numSamples ; i++ ) {
+		if ( vmProfile.samples[i].vm == vm - vmTable ) {
+			break;
+		}
+	}
+
+	if ( !vmProfile.running && i == vmProfile.numSamples ) {
+		return;
+	}
+
+	VM_ProfileStop();
+	Com_Printf( "vmprofile: %s was unloaded, dropping the samples\n", vm->name );
+	VM_ProfileClear();
+}
+
+static int QDECL VM_ProfileSampleSort( const void *a, const void *b ) {
+	const vmProfileSample_t	*sa = a, *sb = b;
+	int						i;
+
+	if ( sa->vm != sb->vm ) {
+		return sa->vm - sb->vm;
+	}
+	if ( sa->syscall != sb->syscall ) {
+		return sa->syscall - sb->syscall;
+	}
+	for ( i = 1 ; i <= sa->depth && i <= sb->depth ; i++ ) {
+		if ( sa->stack[ sa->depth - i ] != sb->stack[ sb->depth - i ] ) {
+			return sa->stack[ sa->depth - i ] - sb->stack[ sb->depth - i ];
+		}
+	}
+	return sa->depth - sb->depth;
+}
+
+/*
+==============
+VM_ProfileFunction
+==============
+*/
+static const char *VM_ProfileFunction( vm_t *vm, int instruction ) {
+	vmSymbol_t	*sym;
+
+	sym = VM_ValueToFunctionSymbol( vm, instruction );
+	if ( !sym->symName[0] ) {
+		return va( "func_%i", vmProfile.vms[ vm - vmTable ].funcStart[ instruction ] );
+	}
+
+	return sym->symName;
+}
+
+/*
+==============
+VM_ProfileWrite
+
+Writes one line of collapsed stack for count samples like s
+==============
+*/
+static void VM_ProfileWrite( fileHandle_t f, vmProfileSample_t *s, int count ) {
+	char	line[ 4096 ];
+	vm_t	*vm;
+	int		i;
+
+	if ( s->vm < 0 ) {
+		FS_Printf( f, "engine %i\n", count );
+		return;
+	}
+
+	vm = &vmTable[ s->vm ];
+	Q_strncpyz( line, vm->name, sizeof( line ) );
+	for ( i = s->depth - 1 ; i >= 0 ; i-- ) {
+		Q_strcat( line, sizeof( line ), va( ";%s", VM_ProfileFunction( vm, s->stack[i] ) ) );
+	}
+
+	if ( s->syscall >= 0 ) {
+		Q_strcat( line, sizeof( line ), va( ";syscall_%i", s->syscall ) );
+	} else if ( !s->depth ) {
+		Q_strcat( line, sizeof( line ), vm->compiled ? ";[native]" : ";[interpreted]" );
+	}
+
+	FS_Printf( f, "%s %i\n", line, count );
+}
+
+/*
+==============
+VM_ProfileDump
+==============
+*/
+static void VM_ProfileDump( const char *filename ) {
+	vmProfileSample_t	*s;
+	vmProfileVM_t		*pvm;
+	vmSymbol_t			**sorted, *sym;
+	fileHandle_t		f;
+	vm_t				*vm;
+	int					numSamples, engine, inCode, inSyscalls, numSorted;
+	int					i, j, start;
+
+	VM_ProfileStop();
+
+	numSamples = vmProfile.numSamples;
+	if ( !numSamples ) {
+		Com_Printf( "vmprofile: no samples\n" );
+		return;
+	}
+
+	qsort( vmProfile.samples, numSamples, sizeof( *vmProfile.samples ), VM_ProfileSampleSort );
+
+	f = FS_FOpenFileWrite( filename );
+	if ( !f ) {
+		Com_Printf( "vmprofile: can't write %s\n", filename );
+		return;
+	}
+
+	for ( start = 0, i = 1 ; i <= numSamples ; i++ ) {
+		if ( i == numSamples || VM_ProfileSampleSort( &vmProfile.samples[start], &vmProfile.samples[i] ) ) {
+			VM_ProfileWrite( f, &vmProfile.samples[start], i - start );
+			start = i;
+		}
+	}
+
+	FS_FCloseFile( f );
+
+	Com_Printf( "%i samples of %i usec written to %s\n", numSamples, vmProfile.interval, filename );
+
+	engine = 0;
+	for ( i = 0 ; i < numSamples ; i++ ) {
+		if ( vmProfile.samples[i].vm < 0 ) {
+			engine++;
+		}
+	}
+	Com_Printf( "%5.1f%% engine\n", 100.0f * engine / numSamples );
+
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		vm = &vmTable[i];
+		pvm = &vmProfile.vms[i];
+		if ( !vm->name[0] ) {
+			continue;
+		}
+
+		Com_Memset( pvm->syscallSamples, 0, sizeof( pvm->syscallSamples ) );
+		inCode = inSyscalls = 0;
+		for ( j = 0 ; j < numSamples ; j++ ) {
+			s = &vmProfile.samples[j];
+			if ( s->vm != i ) {
+				continue;
+			}
+
+			if ( s->syscall < 0 ) {
+				inCode++;
+				// the interpreter uses profileCount the same way
+				if ( s->depth ) {
+					VM_ValueToFunctionSymbol( vm, s->stack[0] )->profileCount++;
+				}
+			} else {
+				inSyscalls++;
+				if ( s->syscall < PROFILE_MAX_SYSCALLS ) {
+					pvm->syscallSamples[ s->syscall ]++;
+				}
+			}
+		}
+
+		Com_Printf( "%5.1f%% %s: %5.1f%% QVM code, %5.1f%% syscalls\n", 100.0f * ( inCode + inSyscalls ) / numSamples,
+			vm->name, 100.0f * inCode / numSamples, 100.0f * inSyscalls / numSamples );
+
+		if ( vm->numSymbols ) {
+			sorted = Z_Malloc( vm->numSymbols * sizeof( *sorted ) );
+			numSorted = 0;
+			for ( sym = vm->symbols ; sym ; sym = sym->next ) {
+				if ( sym->profileCount ) {
+					sorted[ numSorted++ ] = sym;
+				}
+			}
+
+			qsort( sorted, numSorted, sizeof( *sorted ), VM_ProfileSort );
+
+			for ( j = numSorted - 1 ; j >= 0 && j >= numSorted - PROFILE_TOP_FUNCTIONS ; j-- ) {
+				Com_Printf( "       %5.1f%% %s\n", 100.0f * sorted[j]->profileCount / numSamples, sorted[j]->symName );
+			}
+			for ( j = 0 ; j < numSorted ; j++ ) {
+				sorted[j]->profileCount = 0;
+			}
+
+			Z_Free( sorted );
+		}
+
+		for ( j = 0 ; j < PROFILE_MAX_SYSCALLS ; j++ ) {
+			if ( pvm->syscallCalls[j] || pvm->syscallSamples[j] ) {
+				Com_Printf( "       %5.1f%% syscall %4i, %8i calls\n", 100.0f * pvm->syscallSamples[j] / numSamples,
+					j, pvm->syscallCalls[j] );
+			}
+		}
+	}
+}
+
 //=================================================================
 
 static int QDECL VM_ProfileSort( const void *a, const void *b ) {
@@ -822,6 +1336,7 @@ static int QDECL VM_ProfileSort( const void *a, const void *b ) {
 ==============
 VM_VmProfile_f
 
+Without arguments lists the functions the interpreter counted
 ==============
 */
 void VM_VmProfile_f( void ) {
@@ -830,6 +1345,23 @@ void VM_VmProfile_f( void ) {
 	int			i;
 	double		total;
 
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "start" ) ) {
+		VM_ProfileStart( atoi( Cmd_Argv( 2 ) ) );
+		return;
+	}
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "stop" ) ) {
+		VM_ProfileStop();
+		return;
+	}
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "dump" ) ) {
+		VM_ProfileDump( Cmd_Argc() > 2 ? Cmd_Argv( 2 ) : "vmprofile.folded" );
+		return;
+	}
+	if ( Cmd_Argc() > 1 ) {
+		Com_Printf( "usage: vmprofile [start [seconds] | stop | dump [file]]\n" );
+		return;
+	}
+
 	if ( !lastVM ) {
 		return;
 	}
@@ -897,6 +1429,31 @@ void VM_VmInfo_f( void ) {
 	}
 }
 
+/*
+==============
+VM_CompileStats_f
+
+==============
+*/
+void VM_CompileStats_f( void ) {
+	vm_t	*vm;
+	int		i;
+
+	Com_Printf( "module     instructions  code bytes  bytes/instr   msec\n" );
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		vm = &vmTable[i];
+		if ( !vm->name[0] ) {
+			break;
+		}
+		if ( !vm->compiled ) {
+			Com_Printf( "%-10s %s\n", vm->name, vm->dllHandle ? "native" : "interpreted" );
+			continue;
+		}
+		Com_Printf( "%-10s %12i %11i %12.1f %6i\n", vm->name, vm->instructionCount,
+			vm->codeLength, (float)vm->codeLength / vm->instructionCount, vm->compileTime );
+	}
+}
+
 /*
 ===============
 VM_LogSyscalls
@@ -147,12 +147,18 @@ struct vm_s {
 	intptr_t			(QDECL *entryPoint)( int callNum, ... );
 	void (*destroy)(vm_t* self);
 
+	// set by compilers that let the profiler look into the running code
+	int			(*instructionForPointer)( vm_t *self, void *code );	// -1 if outside the code
+	qboolean	(*sampleState)( vm_t *self, profileContext_t *context, qboolean syscall,
+					int *instruction, int *programStack );
+
 	// for interpreted modules
 	qboolean	currentlyInterpreting;
 
 	qboolean	compiled;
 	byte		*codeBase;
 	int			codeLength;
+	int			compileTime;	// msec spent in VM_Compile
 
 	int			*instructionPointers;
 	int			instructionCount;
@@ -188,4 +194,5 @@ int	VM_CallInterpreted( vm_t *vm, int *args );
 vmSymbol_t *VM_ValueToFunctionSymbol( vm_t *vm, int value );
 int VM_SymbolToValue( vm_t *vm, const char *symbol );
 const char *VM_ValueToSymbol( vm_t *vm, int value );
+const char *VM_SymbolForCompiledPointer( vm_t *vm, void *code );
 void VM_LogSyscalls( int *args );
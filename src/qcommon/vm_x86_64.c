@@ -391,20 +391,1517 @@ static void jmpviolation(void)
 	exit(1);
 }
 
+static void stackviolation(void)
+{
+	Com_Error(ERR_DROP, "program stack overflow\n");
+	exit(1);
+}
+
 #ifdef DEBUG_VM
 static void memviolation(void)
 {
 	Com_Error(ERR_DROP, "program tried to access memory outside VM\n");
 	exit(1);
 }
-#endif
+#endif
+
+/*
+=================================================================
+
+DIRECT BACKEND
+
+Emits the machine code straight into a buffer in a single pass,
+instead of printing assembly text for the assembler to parse in two
+passes.  The instruction encodings are the ones the assembler picks,
+so both backends produce the same code for the same QVM.
+
+=================================================================
+*/
+
+// register numbers as used in the ModRM and SIB bytes
+enum {
+	REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+	REG_R8, REG_R9, REG_R10
+};
+
+#define REG_XMM0	0
+#define REG_NONE	-1
+
+// opcode extensions in the ModRM reg field
+enum {
+	ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7
+};
+
+// condition codes of the short jumps
+#define JCC_B		0x72
+#define JCC_NB		0x73
+#define JCC_Z		0x74
+#define JCC_NZ		0x75
+#define JCC_BE		0x76
+#define JCC_A		0x77
+#define JCC_P		0x7a
+#define JCC_L		0x7c
+#define JCC_NL		0x7d
+#define JCC_LE		0x7e
+#define JCC_G		0x7f
+
+// more than the longest sequence emitted for a single QVM instruction
+#define MAX_OP_CODE_SIZE	256
+
+typedef struct {
+	int			ofs;		// offset of the immediate
+	int			target;		// QVM instruction it has to point to, or -1-ADDR_*
+	qboolean	relative;	// rel32 of a jmp, jcc or call instead of an address
+} jitJump_t;
+
+// addresses outside the generated code it refers to, patched in like
+// the jumps so the code can be kept in the cache
+enum {
+	ADDR_JMPVIOLATION,
+	ADDR_STACKVIOLATION,
+	ADDR_EOP,
+	ADDR_CALLASMCALL,
+	ADDR_BLOCK_COPY,
+	ADDR_INSTRUCTION_POINTERS,
+
+	ADDR_NUM_ADDRESSES
+};
+
+// values the optimizer keeps off the operand stack
+typedef enum {
+	OPND_CONST,		// value
+	OPND_LOCAL,		// programStack + value
+	OPND_REG		// register number value
+} operandType_t;
+
+typedef struct {
+	operandType_t	type;
+	int				value;
+} jitOperand_t;
+
+#define MAX_OPERANDS	3
+
+typedef struct {
+	byte		*buf;
+	int			size;
+	int			allocated;
+
+	// absolute addresses of QVM instructions, patched in once the
+	// code has been copied to its final place
+	jitJump_t	*jumps;
+	int			numJumps;
+	int			maxJumps;
+
+	// jumps to the start of the next QVM instruction
+	int			nextOfs[4];
+	int			nextSize[4];
+	int			numNext;
+
+	qboolean	gotConst;
+	unsigned	constValue;
+
+	// vm_optimize
+	qboolean		optimize;
+	byte			*isTarget;		// per instruction, can be jumped to
+	int				maxInstructions;
+	jitOperand_t	operands[MAX_OPERANDS];	// top of the operand stack, last is the top
+	int				numOperands;
+} jitState_t;
+
+// the buffers are kept around for the next compile
+static jitState_t	jit;
+
+static void jit_reserve(int bytes)
+{
+	if(jit.size + bytes <= jit.allocated)
+		return;
+
+	jit.allocated = (jit.size + bytes) * 2;
+	jit.buf = realloc(jit.buf, jit.allocated);
+	if(!jit.buf)
+		Com_Error(ERR_DROP, "VM_CompileX86: can't allocate %d bytes for code", jit.allocated);
+}
+
+static void emit_byte(int v)
+{
+	jit.buf[jit.size++] = v;
+}
+
+static void emit_int(unsigned v)
+{
+	emit_byte(v & 0xff);
+	emit_byte((v >> 8) & 0xff);
+	emit_byte((v >> 16) & 0xff);
+	emit_byte((v >> 24) & 0xff);
+}
+
+static void emit_quad(unsigned long v)
+{
+	emit_int(v & 0xffffffff);
+	emit_int(v >> 32);
+}
+
+static void emit_rex(int w, int reg, int index, int base)
+{
+	int rex = 0;
+
+	if(w)
+		rex |= 0x08;
+	if(reg > 7)
+		rex |= 0x04;
+	if(index > 7)
+		rex |= 0x02;
+	if(base > 7)
+		rex |= 0x01;
+
+	if(rex)
+		emit_byte(0x40 | rex);
+}
+
+static void emit_opcode(int op)
+{
+	if(op > 0xff)
+		emit_byte(op >> 8);	// 0x0f escape
+	emit_byte(op & 0xff);
+}
+
+/* op with register operands, rm is the one in the r/m field */
+static void emit_rr(int prefix, int w, int op, int reg, int rm)
+{
+	if(prefix)
+		emit_byte(prefix);
+	emit_rex(w, reg, 0, rm);
+	emit_opcode(op);
+	emit_byte(0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* op with a memory operand disp(base, index, scale) */
+static void emit_rm(int prefix, int w, int op, int reg, int base, int index, int scale, int disp)
+{
+	int mod;
+
+	if(prefix)
+		emit_byte(prefix);
+	emit_rex(w, reg, index == REG_NONE ? 0 : index, base);
+	emit_opcode(op);
+
+	// like the assembler, only positive displacements get the short form
+	if(!disp)
+		mod = 0x00;
+	else if((unsigned)disp < 0x80)
+		mod = 0x40;
+	else
+		mod = 0x80;
+
+	if(index == REG_NONE)
+	{
+		emit_byte(mod | (reg & 7) << 3 | (base & 7));
+	}
+	else
+	{
+		emit_byte(mod | (reg & 7) << 3 | 0x04);
+		emit_byte((scale == 4 ? 2 : scale == 2 ? 1 : 0) << 6 | (index & 7) << 3 | (base & 7));
+	}
+
+	if(mod == 0x40)
+		emit_byte(disp);
+	else if(mod == 0x80)
+		emit_int(disp);
+}
+
+static void emit_alu_imm(int w, int alu, int reg, unsigned imm)
+{
+	emit_rex(w, 0, 0, reg);
+	emit_byte(0x81);
+	emit_byte(0xc0 | alu << 3 | (reg & 7));
+	emit_int(imm);
+}
+
+static void emit_mov_imm32(int reg, unsigned imm)
+{
+	emit_rex(0, 0, 0, reg);
+	emit_byte(0xb8 | (reg & 7));
+	emit_int(imm);
+}
+
+static void emit_mov_imm64(int reg, unsigned long imm)
+{
+	emit_rex(1, 0, 0, reg);
+	emit_byte(0xb8 | (reg & 7));
+	emit_quad(imm);
+}
+
+static void emit_push(int reg)
+{
+	emit_rex(0, 0, 0, reg);
+	emit_byte(0x50 | (reg & 7));
+}
+
+static void emit_pop(int reg)
+{
+	emit_rex(0, 0, 0, reg);
+	emit_byte(0x58 | (reg & 7));
+}
+
+/* movl disp(%rsi), %reg */
+static void emit_load(int reg, int disp)
+{
+	emit_rm(0, 0, 0x8b, reg, REG_RSI, REG_NONE, 0, disp);
+}
+
+/* movl %reg, disp(%rsi) */
+static void emit_store(int reg, int disp)
+{
+	emit_rm(0, 0, 0x89, reg, REG_RSI, REG_NONE, 0, disp);
+}
+
+/* callq *%rax */
+static void emit_call_rax(void)
+{
+	emit_byte(0xff);
+	emit_byte(0xd0);
+}
+
+static int emit_jcc_short(int cc)
+{
+	emit_byte(cc);
+	emit_byte(0);
+	return jit.size - 1;
+}
+
+static void set_jump_short(int ofs)
+{
+	int disp = jit.size - (ofs + 1);
+
+	if(disp > 127)
+		Com_Error(ERR_DROP, "VM_CompileX86: cannot jump that far (%x -> %x)", ofs, jit.size);
+
+	jit.buf[ofs] = disp;
+}
+
+static void emit_jcc_next(int cc)
+{
+	jit.nextOfs[jit.numNext] = emit_jcc_short(cc);
+	jit.nextSize[jit.numNext++] = 1;
+}
+
+static void emit_jmp_next(void)
+{
+	emit_byte(0xe9);
+	emit_int(0);
+	jit.nextOfs[jit.numNext] = jit.size - 4;
+	jit.nextSize[jit.numNext++] = 4;
+}
+
+/* patches the pending jumps to the next instruction, which starts here */
+static void set_jumps_next(void)
+{
+	int i, disp;
+
+	for(i = 0; i < jit.numNext; ++i)
+	{
+		if(jit.nextSize[i] == 1)
+		{
+			set_jump_short(jit.nextOfs[i]);
+		}
+		else
+		{
+			disp = jit.size - (jit.nextOfs[i] + 4);
+			memcpy(jit.buf + jit.nextOfs[i], &disp, 4);
+		}
+	}
+	jit.numNext = 0;
+}
+
+static void add_jump(int ofs, int target, qboolean relative)
+{
+	if(jit.numJumps == jit.maxJumps)
+	{
+		jit.maxJumps = jit.maxJumps * 2 + 256;
+		jit.jumps = realloc(jit.jumps, jit.maxJumps * sizeof(*jit.jumps));
+		if(!jit.jumps)
+			Com_Error(ERR_DROP, "VM_CompileX86: can't allocate jump table");
+	}
+	jit.jumps[jit.numJumps].ofs = ofs;
+	jit.jumps[jit.numJumps].target = target;
+	jit.jumps[jit.numJumps].relative = relative;
+	jit.numJumps++;
+}
+
+/* movq $address, %reg, with the address of a QVM instruction */
+static void emit_mov_instruction(int reg, int target)
+{
+	emit_mov_imm64(reg, 0);
+	add_jump(jit.size - 8, target, qfalse);
+}
+
+/* movq $address, %reg, with one of the ADDR_* addresses */
+static void emit_mov_address(int reg, int addr)
+{
+	emit_mov_instruction(reg, -1 - addr);
+}
+
+static void *jit_address(vm_t *vm, int addr)
+{
+	switch(addr)
+	{
+		case ADDR_JMPVIOLATION: return jmpviolation;
+		case ADDR_STACKVIOLATION: return stackviolation;
+		case ADDR_EOP: return eop;
+		case ADDR_CALLASMCALL: return callAsmCall;
+		case ADDR_BLOCK_COPY: return block_copy_vm;
+		case ADDR_INSTRUCTION_POINTERS: return vm->instructionPointers;
+	}
+
+	Com_Error(ERR_DROP, "VM_CompileX86: bad address %d", addr);
+	return NULL;
+}
+
+/* fills in the absolute addresses, with the code placed at code */
+static void set_addresses(vm_t *vm, byte *code, jitJump_t *jumps, int numJumps)
+{
+	void *target;
+	int i;
+
+	for(i = 0; i < numJumps; ++i)
+	{
+		if(jumps[i].relative)
+			continue;
+
+		if(jumps[i].target >= 0)
+			target = code + vm->instructionPointers[jumps[i].target];
+		else
+			target = jit_address(vm, -1 - jumps[i].target);
+
+		Com_Memcpy(code + jumps[i].ofs, &target, sizeof(target));
+	}
+}
+
+/* same as JMPIARG */
+static void emit_jump_instruction(vmHeader_t *header, int target, int pc)
+{
+	CHECK_INSTR(target);
+	emit_mov_instruction(REG_RAX, target);
+	emit_byte(0xff);	// jmpq *%rax
+	emit_byte(0xe0);
+}
+
+/* same as PREPARE_JMP(eax) */
+static void emit_prepare_jump(vm_t *vm, vmHeader_t *header)
+{
+	int ofs;
+
+	emit_alu_imm(0, ALU_CMP, REG_RAX, header->instructionCount);
+	ofs = emit_jcc_short(JCC_B);
+	emit_mov_address(REG_RAX, ADDR_JMPVIOLATION);
+	emit_call_rax();
+	set_jump_short(ofs);
+
+	emit_mov_address(REG_RBX, ADDR_INSTRUCTION_POINTERS);
+	emit_rm(0, 0, 0x8b, REG_RAX, REG_RBX, REG_RAX, 4, 0);
+	emit_rr(0, 1, 0x01, REG_R10, REG_RAX);	// addq %r10, %rax
+}
+
+/* same as RANGECHECK */
+static void emit_rangecheck(vm_t *vm, int reg, int bytes)
+{
+	emit_alu_imm(0, ALU_AND, reg, vm->dataMask &~(bytes-1));
+}
+
+/* same as MAYBE_EMIT_CONST */
+static void emit_pending_const(vm_t *vm, int instruction)
+{
+	if(!jit.gotConst)
+		return;
+
+	jit.gotConst = qfalse;
+	vm->instructionPointers[instruction-1] = jit.size;
+	emit_alu_imm(1, ALU_ADD, REG_RSI, 4);
+	emit_rm(0, 0, 0xc7, 0, REG_RSI, REG_NONE, 0, 0);
+	emit_int(jit.constValue);
+}
+
+static void emit_int_jump(vm_t *vm, vmHeader_t *header, int instruction, int cc, int target, int pc)
+{
+	emit_pending_const(vm, instruction);
+	emit_alu_imm(1, ALU_SUB, REG_RSI, 8);
+	emit_load(REG_RAX, 4);
+	emit_rm(0, 0, 0x3b, REG_RAX, REG_RSI, REG_NONE, 0, 8);	// cmpl 8(%rsi), %eax
+	emit_jcc_next(cc);
+	emit_jump_instruction(header, target, pc);
+}
+
+static void emit_float_compare(vm_t *vm, int instruction)
+{
+	emit_pending_const(vm, instruction);
+	emit_alu_imm(1, ALU_SUB, REG_RSI, 8);
+	emit_rm(0xf3, 0, 0x0f10, REG_XMM0, REG_RSI, REG_NONE, 0, 4);	// movss 4(%rsi), %xmm0
+	emit_rm(0, 0, 0x0f2e, REG_XMM0, REG_RSI, REG_NONE, 0, 8);		// ucomiss 8(%rsi), %xmm0
+}
+
+static void emit_float_jump(vm_t *vm, vmHeader_t *header, int instruction, int cc, int target, int pc)
+{
+	emit_float_compare(vm, instruction);
+	emit_jcc_next(JCC_P);
+	emit_jcc_next(cc);
+	emit_jump_instruction(header, target, pc);
+}
+
+static void emit_simple(vm_t *vm, int instruction, int op)
+{
+	emit_pending_const(vm, instruction);
+	emit_alu_imm(1, ALU_SUB, REG_RSI, 4);
+	emit_load(REG_RAX, 4);
+	emit_rm(0, 0, op, REG_RAX, REG_RSI, REG_NONE, 0, 0);	// op %eax, 0(%rsi)
+}
+
+static void emit_float_simple(vm_t *vm, int instruction, int op)
+{
+	emit_pending_const(vm, instruction);
+	emit_alu_imm(1, ALU_SUB, REG_RSI, 4);
+	emit_rm(0xf3, 0, 0x0f10, REG_XMM0, REG_RSI, REG_NONE, 0, 0);
+	emit_rm(0xf3, 0, op, REG_XMM0, REG_RSI, REG_NONE, 0, 4);
+	emit_rm(0xf3, 0, 0x0f11, REG_XMM0, REG_RSI, REG_NONE, 0, 0);
+}
+
+// how emit_muldiv sets up edx
+#define MD_XORL		1
+#define MD_XORQ		2
+#define MD_CDQ		4
+
+/* div, idiv, mul and imul of the two top values */
+static void emit_muldiv(vm_t *vm, int instruction, int ext, int flags, int result)
+{
+	emit_pending_const(vm, instruction);
+	emit_alu_imm(1, ALU_SUB, REG_RSI, 4);
+	emit_load(REG_RAX, 0);
+	if(flags & (MD_XORL|MD_XORQ))
+		emit_rr(0, flags & MD_XORQ, 0x31, REG_RDX, REG_RDX);	// xor %edx, %edx
+	if(flags & MD_CDQ)
+		emit_byte(0x99);	// cdq
+	emit_rm(0, 0, 0xf7, ext, REG_RSI, REG_NONE, 0, 4);
+	emit_store(result, 0);
+}
+
+static void emit_shift(vm_t *vm, int instruction, int ext)
+{
+	emit_pending_const(vm, instruction);
+	emit_alu_imm(1, ALU_SUB, REG_RSI, 4);
+	emit_load(REG_RCX, 4);
+	emit_load(REG_RAX, 0);
+	emit_rr(0, 0, 0xd3, ext, REG_RAX);	// op %cl, %eax
+	emit_store(REG_RAX, 0);
+}
+
+/* pushes and pops the registers that live across calls to C */
+static void emit_save_registers(void)
+{
+	emit_push(REG_RSI);
+	emit_push(REG_RDI);
+	emit_push(REG_R8);
+	emit_push(REG_R9);
+	emit_push(REG_R10);
+}
+
+static void emit_restore_registers(void)
+{
+	emit_pop(REG_R10);
+	emit_pop(REG_R9);
+	emit_pop(REG_R8);
+	emit_pop(REG_RDI);
+	emit_pop(REG_RSI);
+}
+
+/*
+=================================================================
+
+OPTIMIZER
+
+With vm_optimize 1 the top few values of the operand stack are kept
+as constants, local addresses or in registers instead of being stored
+at rsi right away, so sequences like LOCAL+LOAD4 or CONST+ADD need no
+operand stack traffic and compare+branch becomes a cmp and jcc.  The
+cached values are stored before every instruction that can be jumped
+to and before the instructions that still work on the memory stack, so
+the stack looks the same at every jump target as without optimization.
+
+Only accesses to constant addresses inside the data segment are done
+without masking the address, see opt_address.  Every access to a local
+is masked with dataMask like any other, a QVM can jump past the ENTER
+of a function so its frame can't be trusted to be in bounds.
+
+=================================================================
+*/
+
+/* puts a jump or call to a QVM instruction, relative to the next byte */
+static void emit_rel_instruction(vmHeader_t *header, int op, int target, int pc)
+{
+	CHECK_INSTR(target);
+	emit_opcode(op);
+	emit_int(0);
+	add_jump(jit.size - 4, target, qtrue);
+}
+
+static int opt_reg_mask(jitOperand_t *o)
+{
+	return o->type == OPND_REG ? 1 << o->value : 0;
+}
+
+/* returns one of eax, ecx, edx and ebx that holds no cached operand */
+static int opt_get_reg(int exclude)
+{
+	static const int regs[] = { REG_RAX, REG_RCX, REG_RDX, REG_RBX };
+	int i, used = exclude;
+
+	for(i = 0; i < jit.numOperands; ++i)
+		used |= opt_reg_mask(&jit.operands[i]);
+
+	for(i = 0; i < 4; ++i)
+	{
+		if(!(used & (1 << regs[i])))
+			return regs[i];
+	}
+
+	Com_Error(ERR_DROP, "VM_CompileX86: out of registers");
+	return REG_RAX;
+}
+
+/* returns the register holding the operand, loading it into one if needed */
+static int opt_load_operand(jitOperand_t *o, int exclude)
+{
+	int reg;
+
+	if(o->type == OPND_REG)
+		return o->value;
+
+	reg = opt_get_reg(exclude);
+	if(o->type == OPND_CONST)
+		emit_mov_imm32(reg, o->value);
+	else
+		emit_rm(0, 0, 0x8d, reg, REG_RDI, REG_NONE, 0, o->value);	// leal ofs(%rdi), %reg
+
+	return reg;
+}
+
+/* stores the lowest cached operand on the memory stack */
+static void opt_spill(int exclude)
+{
+	jitOperand_t *o = &jit.operands[0];
+
+	emit_alu_imm(1, ALU_ADD, REG_RSI, 4);
+	if(o->type == OPND_CONST)
+	{
+		emit_rm(0, 0, 0xc7, 0, REG_RSI, REG_NONE, 0, 0);
+		emit_int(o->value);
+	}
+	else
+	{
+		emit_store(opt_load_operand(o, exclude), 0);
+	}
+
+	jit.numOperands--;
+	memmove(jit.operands, jit.operands + 1, jit.numOperands * sizeof(jit.operands[0]));
+}
+
+static void opt_flush(int exclude)
+{
+	while(jit.numOperands)
+		opt_spill(exclude);
+}
+
+static void opt_push(operandType_t type, int value)
+{
+	jitOperand_t *o;
+
+	if(jit.numOperands == MAX_OPERANDS)
+		opt_spill(type == OPND_REG ? 1 << value : 0);
+
+	o = &jit.operands[jit.numOperands++];
+	o->type = type;
+	o->value = value;
+}
+
+/* takes the top operand, from the memory stack if none is cached */
+static void opt_pop(jitOperand_t *o, int exclude)
+{
+	if(jit.numOperands)
+	{
+		*o = jit.operands[--jit.numOperands];
+		return;
+	}
+
+	o->type = OPND_REG;
+	o->value = opt_get_reg(exclude);
+	emit_load(o->value, 0);
+	emit_alu_imm(1, ALU_SUB, REG_RSI, 4);
+}
+
+/*
+returns the register with the masked address, or REG_NONE if the
+address operand can be used as it is
+*/
+static int opt_address(vm_t *vm, jitOperand_t *addr, int size, int exclude)
+{
+	int reg;
+
+	if(addr->type == OPND_CONST &&
+		((unsigned)addr->value & (vm->dataMask &~(size-1))) == (unsigned)addr->value)
+		return REG_NONE;
+
+	reg = opt_load_operand(addr, exclude);
+	emit_rangecheck(vm, reg, size);
+	return reg;
+}
+
+/* op with the data segment memory the address points to */
+static void opt_emit_mem(int prefix, int op, int reg, jitOperand_t *addr, int addrReg)
+{
+	if(addrReg != REG_NONE)
+		emit_rm(prefix, 0, op, reg, REG_R8, addrReg, 1, 0);
+	else if(addr->type == OPND_CONST)
+		emit_rm(prefix, 0, op, reg, REG_R8, REG_NONE, 0, addr->value);
+	else
+		emit_rm(prefix, 0, op, reg, REG_R8, REG_RDI, 1, addr->value);
+}
+
+static void opt_load(vm_t *vm, int size)
+{
+	static const int ops[] = { 0, 0x0fb6, 0x0fb7, 0, 0x8b };	// movzbl, movzwl, movl
+	jitOperand_t addr;
+	int addrReg, reg;
+
+	opt_pop(&addr, 0);
+	addrReg = opt_address(vm, &addr, size, 0);
+	reg = addrReg != REG_NONE ? addrReg : opt_get_reg(0);
+	opt_emit_mem(0, ops[size], reg, &addr, addrReg);
+	opt_push(OPND_REG, reg);
+}
+
+static void opt_store(vm_t *vm, jitOperand_t *value, jitOperand_t *addr, int size)
+{
+	int prefix = size == 2 ? 0x66 : 0;
+	int exclude = opt_reg_mask(value) | opt_reg_mask(addr);
+	int valueReg = REG_NONE, addrReg;
+
+	if(value->type != OPND_CONST)
+	{
+		valueReg = opt_load_operand(value, exclude);
+		exclude |= 1 << valueReg;
+	}
+
+	addrReg = opt_address(vm, addr, size, exclude);
+
+	if(valueReg == REG_NONE)
+	{
+		opt_emit_mem(prefix, size == 1 ? 0xc6 : 0xc7, 0, addr, addrReg);
+		if(size == 1)
+			emit_byte(value->value);
+		else if(size == 2)
+		{
+			emit_byte(value->value);
+			emit_byte(value->value >> 8);
+		}
+		else
+			emit_int(value->value);
+	}
+	else
+	{
+		opt_emit_mem(prefix, size == 1 ? 0x88 : 0x89, valueReg, addr, addrReg);
+	}
+}
+
+static int opt_fold(int op, int a, int b)
+{
+	switch(op)
+	{
+		case OP_ADD: return (unsigned)a + (unsigned)b;
+		case OP_SUB: return (unsigned)a - (unsigned)b;
+		case OP_MULI:
+		case OP_MULU: return (unsigned)a * (unsigned)b;
+		case OP_BAND: return a & b;
+		case OP_BOR: return a | b;
+		default: return a ^ b;
+	}
+}
+
+/* add, sub, mul, and, or, xor and the shifts by a constant */
+static void opt_binary(int op)
+{
+	static const int alu[] = { ALU_ADD, ALU_SUB, ALU_AND, ALU_OR, ALU_XOR };
+	static const int rmcodes[] = { 0x01, 0x29, 0x21, 0x09, 0x31 };
+	jitOperand_t a, b;
+	int reg, breg, i;
+
+	opt_pop(&b, 0);
+	opt_pop(&a, opt_reg_mask(&b));
+
+	if(op != OP_LSH && op != OP_RSHI && op != OP_RSHU)
+	{
+		if(a.type == OPND_CONST && b.type == OPND_CONST)
+		{
+			opt_push(OPND_CONST, opt_fold(op, a.value, b.value));
+			return;
+		}
+
+		// address of a field in a local struct or array
+		if(op == OP_ADD && a.type == OPND_CONST && b.type == OPND_LOCAL)
+		{
+			opt_push(OPND_LOCAL, b.value + a.value);
+			return;
+		}
+		if((op == OP_ADD || op == OP_SUB) && a.type == OPND_LOCAL && b.type == OPND_CONST)
+		{
+			opt_push(OPND_LOCAL, op == OP_ADD ? a.value + b.value : a.value - b.value);
+			return;
+		}
+	}
+
+	reg = opt_load_operand(&a, opt_reg_mask(&b));
+
+	switch(op)
+	{
+		case OP_LSH:
+		case OP_RSHI:
+		case OP_RSHU:
+			// only called with a constant count
+			emit_rr(0, 0, 0xc1, op == OP_LSH ? 4 : op == OP_RSHI ? 7 : 5, reg);
+			emit_byte(b.value);
+			break;
+		case OP_MULI:
+		case OP_MULU:
+			if(b.type == OPND_CONST)
+			{
+				emit_rr(0, 0, 0x69, reg, reg);	// imull $imm, %reg, %reg
+				emit_int(b.value);
+			}
+			else
+			{
+				breg = opt_load_operand(&b, 1 << reg);
+				emit_rr(0, 0, 0x0faf, reg, breg);	// imull %breg, %reg
+			}
+			break;
+		default:
+			i = op == OP_ADD ? 0 : op == OP_SUB ? 1 : op == OP_BAND ? 2 : op == OP_BOR ? 3 : 4;
+			if(b.type == OPND_CONST)
+			{
+				emit_alu_imm(0, alu[i], reg, b.value);
+			}
+			else
+			{
+				breg = opt_load_operand(&b, 1 << reg);
+				emit_rr(0, 0, rmcodes[i], breg, reg);
+			}
+			break;
+	}
+
+	opt_push(OPND_REG, reg);
+}
+
+static void opt_unary(int op)
+{
+	jitOperand_t a;
+	int reg;
+
+	opt_pop(&a, 0);
+
+	if(a.type == OPND_CONST)
+	{
+		switch(op)
+		{
+			case OP_NEGI: a.value = -(unsigned)a.value; break;
+			case OP_BCOM: a.value = ~a.value; break;
+			case OP_SEX8: a.value = (signed char)a.value; break;
+			default: a.value = (short)a.value; break;
+		}
+		opt_push(OPND_CONST, a.value);
+		return;
+	}
+
+	reg = opt_load_operand(&a, 0);
+	switch(op)
+	{
+		case OP_NEGI: emit_rr(0, 0, 0xf7, 3, reg); break;
+		case OP_BCOM: emit_rr(0, 0, 0xf7, 2, reg); break;
+		case OP_SEX8: emit_rr(0, 0, 0x0fbe, reg, reg); break;	// movsbl
+		default: emit_rr(0, 0, 0x0fbf, reg, reg); break;		// movswl
+	}
+	opt_push(OPND_REG, reg);
+}
+
+static void opt_int_branch(vmHeader_t *header, int cc, int target, int pc)
+{
+	jitOperand_t a, b;
+	int exclude, reg, breg;
+
+	opt_pop(&b, 0);
+	opt_pop(&a, opt_reg_mask(&b));
+	exclude = opt_reg_mask(&a) | opt_reg_mask(&b);
+
+	// both branches continue with everything on the memory stack
+	opt_flush(exclude);
+
+	reg = opt_load_operand(&a, exclude);
+	if(b.type == OPND_CONST)
+	{
+		emit_alu_imm(0, ALU_CMP, reg, b.value);
+	}
+	else
+	{
+		breg = opt_load_operand(&b, exclude | 1 << reg);
+		emit_rr(0, 0, 0x39, breg, reg);	// cmpl %breg, %reg
+	}
+
+	emit_rel_instruction(header, 0x0f80 | (cc & 0x0f), target, pc);
+}
+
+static void opt_float_branch(vm_t *vm, vmHeader_t *header, int instruction, int cc, int target, int pc)
+{
+	int ofs;
+
+	opt_flush(0);
+	emit_float_compare(vm, instruction);
+
+	if(cc == JCC_NZ)
+	{
+		// unordered counts as not equal
+		emit_rel_instruction(header, 0x0f80 | (JCC_P & 0x0f), target, pc);
+		emit_rel_instruction(header, 0x0f80 | (JCC_NZ & 0x0f), target, pc);
+	}
+	else
+	{
+		ofs = emit_jcc_short(JCC_P);
+		emit_rel_instruction(header, 0x0f80 | (cc & 0x0f), target, pc);
+		set_jump_short(ofs);
+	}
+}
+
+/* call of a constant function or syscall */
+static void opt_call(vm_t *vm, vmHeader_t *header, int func, int instruction, int pc)
+{
+	jitOperand_t ret, addr;
+
+	opt_flush(0);
+
+	// save next instruction
+	ret.type = OPND_CONST;
+	ret.value = instruction + 1;
+	addr.type = OPND_LOCAL;
+	addr.value = 0;
+	opt_store(vm, &ret, &addr, 4);
+
+	if(func >= 0)
+	{
+		emit_rel_instruction(header, 0xe8, func, pc);	// call
+		return;
+	}
+
+	emit_save_registers();
+	// align the stack pointer
+	emit_rr(0, 1, 0x89, REG_RSP, REG_RBX);	// movq %rsp, %rbx
+	emit_alu_imm(1, ALU_SUB, REG_RBX, 8);
+	emit_alu_imm(1, ALU_AND, REG_RBX, 127);
+	emit_rr(0, 1, 0x29, REG_RBX, REG_RSP);	// subq %rbx, %rsp
+	emit_push(REG_RBX);
+	emit_mov_imm64(REG_RSI, (unsigned)(-1-func));	// second argument in rsi
+	emit_mov_address(REG_RAX, ADDR_CALLASMCALL);
+	emit_call_rax();
+	emit_pop(REG_RBX);
+	emit_rr(0, 1, 0x01, REG_RBX, REG_RSP);	// addq %rbx, %rsp
+	emit_restore_registers();
+
+	// keep the return value in eax
+	opt_push(OPND_REG, REG_RAX);
+}
+
+/*
+translates the instruction if it can be done with cached operands,
+otherwise stores them so the regular code can be used
+*/
+static qboolean opt_instruction(vm_t *vm, vmHeader_t *header, int op, int iarg, int barg, int instruction, int pc)
+{
+	jitOperand_t *top = jit.numOperands ? &jit.operands[jit.numOperands - 1] : NULL;
+	jitOperand_t a, b;
+
+	switch(op)
+	{
+		case OP_CONST:
+			opt_push(OPND_CONST, iarg);
+			return qtrue;
+		case OP_LOCAL:
+			opt_push(OPND_LOCAL, iarg);
+			return qtrue;
+		case OP_POP:
+			if(!top)
+				break;
+			jit.numOperands--;
+			return qtrue;
+		case OP_ENTER:
+			emit_alu_imm(0, ALU_SUB, REG_RDI, iarg);
+			return qtrue;
+		case OP_CALL:
+			if(!top || top->type != OPND_CONST)
+				break;
+			opt_pop(&a, 0);
+			opt_call(vm, header, a.value, instruction, pc);
+			return qtrue;
+		case OP_JUMP:
+			if(!top || top->type != OPND_CONST)
+				break;
+			opt_pop(&a, 0);
+			opt_flush(0);
+			emit_rel_instruction(header, 0xe9, a.value, pc);
+			return qtrue;
+		case OP_EQ:  opt_int_branch(header, JCC_Z, iarg, pc); return qtrue;
+		case OP_NE:  opt_int_branch(header, JCC_NZ, iarg, pc); return qtrue;
+		case OP_LTI: opt_int_branch(header, JCC_L, iarg, pc); return qtrue;
+		case OP_LEI: opt_int_branch(header, JCC_LE, iarg, pc); return qtrue;
+		case OP_GTI: opt_int_branch(header, JCC_G, iarg, pc); return qtrue;
+		case OP_GEI: opt_int_branch(header, JCC_NL, iarg, pc); return qtrue;
+		case OP_LTU: opt_int_branch(header, JCC_B, iarg, pc); return qtrue;
+		case OP_LEU: opt_int_branch(header, JCC_BE, iarg, pc); return qtrue;
+		case OP_GTU: opt_int_branch(header, JCC_A, iarg, pc); return qtrue;
+		case OP_GEU: opt_int_branch(header, JCC_NB, iarg, pc); return qtrue;
+		case OP_EQF: opt_float_branch(vm, header, instruction, JCC_Z, iarg, pc); return qtrue;
+		case OP_NEF: opt_float_branch(vm, header, instruction, JCC_NZ, iarg, pc); return qtrue;
+		case OP_LTF: opt_float_branch(vm, header, instruction, JCC_B, iarg, pc); return qtrue;
+		case OP_LEF: opt_float_branch(vm, header, instruction, JCC_BE, iarg, pc); return qtrue;
+		case OP_GTF: opt_float_branch(vm, header, instruction, JCC_A, iarg, pc); return qtrue;
+		case OP_GEF: opt_float_branch(vm, header, instruction, JCC_NB, iarg, pc); return qtrue;
+		case OP_LOAD1: opt_load(vm, 1); return qtrue;
+		case OP_LOAD2: opt_load(vm, 2); return qtrue;
+		case OP_LOAD4: opt_load(vm, 4); return qtrue;
+		case OP_STORE1:
+		case OP_STORE2:
+		case OP_STORE4:
+			opt_pop(&a, 0);
+			opt_pop(&b, opt_reg_mask(&a));
+			opt_store(vm, &a, &b, op == OP_STORE1 ? 1 : op == OP_STORE2 ? 2 : 4);
+			return qtrue;
+		case OP_ARG:
+			opt_pop(&a, 0);
+			b.type = OPND_LOCAL;
+			b.value = barg;
+			opt_store(vm, &a, &b, 4);
+			return qtrue;
+		case OP_LSH:
+		case OP_RSHI:
+		case OP_RSHU:
+			if(!top || top->type != OPND_CONST)
+				break;
+			/* fall through */
+		case OP_ADD:
+		case OP_SUB:
+		case OP_MULI:
+		case OP_MULU:
+		case OP_BAND:
+		case OP_BOR:
+		case OP_BXOR:
+			opt_binary(op);
+			return qtrue;
+		case OP_NEGI:
+		case OP_BCOM:
+		case OP_SEX8:
+		case OP_SEX16:
+			opt_unary(op);
+			return qtrue;
+	}
+
+	opt_flush(0);
+	return qfalse;
+}
+
+/*
+finds the instructions that can be jumped to
+*/
+static qboolean opt_analyze(vm_t *vm, vmHeader_t *header)
+{
+	byte *code = (byte *)header + header->codeOffset;
+	int instruction, pc, op, iarg = 0, lastOp = 0, lastArg = 0;
+	int count = header->instructionCount, i;
+
+	// without the jump table targets any instruction could be one
+	if(header->vmMagic != VM_MAGIC_VER2)
+		return qfalse;
+
+	if(jit.maxInstructions < count)
+	{
+		jit.maxInstructions = count;
+		jit.isTarget = realloc(jit.isTarget, count);
+		if(!jit.isTarget)
+			Com_Error(ERR_DROP, "VM_CompileX86: can't allocate optimizer tables");
+	}
+
+	Com_Memset(jit.isTarget, 0, count);
+	jit.isTarget[0] = 1;
+
+	for(i = 0; i < vm->numJumpTableTargets; ++i)
+	{
+		iarg = ((int *)vm->jumpTableTargets)[i];
+		if((unsigned)iarg < count)
+			jit.isTarget[iarg] = 1;
+	}
+
+	pc = 0;
+	for(instruction = 0; instruction < count; ++instruction)
+	{
+		op = code[pc++];
+		if(op_argsize[op] == 4)
+		{
+			iarg = *(int *)(code+pc);
+			pc += 4;
+		}
+		else if(op_argsize[op] == 1)
+		{
+			pc++;
+		}
+
+		switch(op)
+		{
+			case OP_ENTER:
+				// also reached through function pointers
+				jit.isTarget[instruction] = 1;
+				break;
+			case OP_JUMP:
+			case OP_CALL:
+				if(lastOp == OP_CONST && (unsigned)lastArg < count)
+					jit.isTarget[lastArg] = 1;
+				break;
+			default:
+				if(op >= OP_EQ && op <= OP_GEF && (unsigned)iarg < count)
+					jit.isTarget[iarg] = 1;
+				break;
+		}
+
+		lastOp = op;
+		lastArg = iarg;
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+VM_CompileDirect
+=================
+*/
+static void VM_CompileDirect( vm_t *vm, vmHeader_t *header ) {
+	unsigned char op;
+	int pc;
+	int instruction;
+	byte *code;
+	int iarg = 0;
+	int barg = 0;
+	int i, ofs;
+
+	jit.size = 0;
+	jit.numJumps = 0;
+	jit.numNext = 0;
+	jit.gotConst = qfalse;
+	jit.numOperands = 0;
+
+	if(jit.optimize && !opt_analyze(vm, header))
+	{
+		Com_Printf("VM file %s has no jump table targets, not optimizing\n", vm->name);
+		jit.optimize = qfalse;
+	}
+
+	// translate all instructions
+	pc = 0;
+	code = (byte *)header + header->codeOffset;
+
+	for ( instruction = 0; instruction < header->instructionCount; ++instruction )
+	{
+		jit_reserve(MAX_OP_CODE_SIZE);
+
+		op = code[ pc ];
+		++pc;
+
+		if(jit.optimize && jit.isTarget[instruction])
+			opt_flush(0);
+
+		vm->instructionPointers[instruction] = jit.size;
+		set_jumps_next();
+
+		if(op_argsize[op] == 4)
+		{
+			iarg = *(int*)(code+pc);
+			pc += 4;
+		}
+		else if(op_argsize[op] == 1)
+		{
+			barg = code[pc++];
+		}
+
+		if(jit.optimize && opt_instruction(vm, header, op, iarg, barg, instruction, pc))
+			continue;
+
+		switch ( op )
+		{
+			case OP_IGNORE:
+				emit_pending_const(vm, instruction);
+				emit_byte(0x90);	// nop
+				break;
+			case OP_BREAK:
+				emit_pending_const(vm, instruction);
+				emit_byte(0xcc);	// int3
+				break;
+			case OP_ENTER:
+				emit_pending_const(vm, instruction);
+				emit_alu_imm(0, ALU_SUB, REG_RDI, iarg);
+				break;
+			case OP_LEAVE:
+				emit_pending_const(vm, instruction);
+				emit_alu_imm(0, ALU_ADD, REG_RDI, iarg);	// get rid of stack frame
+				emit_byte(0xc3);	// ret
+				break;
+			case OP_CALL:
+				emit_rangecheck(vm, REG_RDI, 4);
+				// save next instruction
+				emit_rm(0, 0, 0xc7, 0, REG_R8, REG_RDI, 1, 0);
+				emit_int(instruction+1);
+				if(jit.gotConst)
+				{
+					if ((int)jit.constValue < 0)
+						goto emit_do_syscall;
+
+					CHECK_INSTR((int)jit.constValue);
+					emit_mov_instruction(REG_RAX, jit.constValue);
+					emit_call_rax();
+					jit.gotConst = qfalse;
+					break;
+				}
+				else
+				{
+					emit_load(REG_RAX, 0);	// get instr from stack
+					emit_alu_imm(1, ALU_SUB, REG_RSI, 4);
+
+					emit_rr(0, 0, 0x09, REG_RAX, REG_RAX);	// orl %eax, %eax
+					ofs = emit_jcc_short(JCC_L);
+
+					emit_prepare_jump(vm, header);
+					emit_call_rax();
+
+					emit_jmp_next();
+					set_jump_short(ofs);
+				}
+emit_do_syscall:
+				emit_save_registers();
+				// align the stack pointer
+				emit_rr(0, 1, 0x89, REG_RSP, REG_RBX);	// movq %rsp, %rbx
+				emit_alu_imm(1, ALU_SUB, REG_RBX, 8);
+				emit_alu_imm(1, ALU_AND, REG_RBX, 127);
+				emit_rr(0, 1, 0x29, REG_RBX, REG_RSP);	// subq %rbx, %rsp
+				emit_push(REG_RBX);
+				if(jit.gotConst) {
+					jit.gotConst = qfalse;
+					emit_mov_imm64(REG_RSI, (unsigned)(-1-jit.constValue));	// second argument in rsi
+				} else {
+					// convert to actual number
+					emit_rr(0, 0, 0xf7, 3, REG_RAX);	// negl %eax
+					emit_rr(0, 0, 0xff, 1, REG_RAX);	// decl %eax
+					// first argument already in rdi
+					emit_rr(0, 1, 0x89, REG_RAX, REG_RSI);	// second argument in rsi
+				}
+				emit_mov_address(REG_RAX, ADDR_CALLASMCALL);
+				emit_call_rax();
+				emit_pop(REG_RBX);
+				emit_rr(0, 1, 0x01, REG_RBX, REG_RSP);	// addq %rbx, %rsp
+				emit_restore_registers();
+				emit_alu_imm(1, ALU_ADD, REG_RSI, 4);
+				emit_store(REG_RAX, 0);	// store return value
+				break;
+			case OP_PUSH:
+				emit_pending_const(vm, instruction);
+				emit_alu_imm(1, ALU_ADD, REG_RSI, 4);
+				break;
+			case OP_POP:
+				emit_pending_const(vm, instruction);
+				emit_alu_imm(1, ALU_SUB, REG_RSI, 4);
+				break;
+			case OP_CONST:
+				emit_pending_const(vm, instruction);
+				jit.gotConst = qtrue;
+				jit.constValue = iarg;
+				break;
+			case OP_LOCAL:
+				emit_pending_const(vm, instruction);
+				emit_rr(0, 0, 0x89, REG_RDI, REG_RBX);	// movl %edi, %ebx
+				emit_alu_imm(0, ALU_ADD, REG_RBX, iarg);
+				emit_alu_imm(1, ALU_ADD, REG_RSI, 4);
+				emit_store(REG_RBX, 0);
+				break;
+			case OP_JUMP:
+				if(jit.gotConst) {
+					jit.gotConst = qfalse;
+					emit_jump_instruction(header, jit.constValue, pc);
+				} else {
+					emit_load(REG_RAX, 0);	// get instr from stack
+					emit_alu_imm(1, ALU_SUB, REG_RSI, 4);
+
+					emit_prepare_jump(vm, header);
+					emit_byte(0xff);	// jmpq *%rax
+					emit_byte(0xe0);
+				}
+				break;
+			case OP_EQ:
+				emit_int_jump(vm, header, instruction, JCC_NZ, iarg, pc);
+				break;
+			case OP_NE:
+				emit_int_jump(vm, header, instruction, JCC_Z, iarg, pc);
+				break;
+			case OP_LTI:
+				emit_int_jump(vm, header, instruction, JCC_NL, iarg, pc);
+				break;
+			case OP_LEI:
+				emit_int_jump(vm, header, instruction, JCC_G, iarg, pc);
+				break;
+			case OP_GTI:
+				emit_int_jump(vm, header, instruction, JCC_LE, iarg, pc);
+				break;
+			case OP_GEI:
+				emit_int_jump(vm, header, instruction, JCC_L, iarg, pc);
+				break;
+			case OP_LTU:
+				emit_int_jump(vm, header, instruction, JCC_NB, iarg, pc);
+				break;
+			case OP_LEU:
+				emit_int_jump(vm, header, instruction, JCC_A, iarg, pc);
+				break;
+			case OP_GTU:
+				emit_int_jump(vm, header, instruction, JCC_BE, iarg, pc);
+				break;
+			case OP_GEU:
+				emit_int_jump(vm, header, instruction, JCC_B, iarg, pc);
+				break;
+			case OP_EQF:
+				emit_float_jump(vm, header, instruction, JCC_NZ, iarg, pc);
+				break;
+			case OP_NEF:
+				emit_float_compare(vm, instruction);
+				ofs = emit_jcc_short(JCC_P);
+				emit_jcc_next(JCC_Z);
+				set_jump_short(ofs);
+				emit_jump_instruction(header, iarg, pc);
+				break;
+			case OP_LTF:
+				emit_float_jump(vm, header, instruction, JCC_NB, iarg, pc);
+				break;
+			case OP_LEF:
+				emit_float_jump(vm, header, instruction, JCC_A, iarg, pc);
+				break;
+			case OP_GTF:
+				emit_float_jump(vm, header, instruction, JCC_BE, iarg, pc);
+				break;
+			case OP_GEF:
+				emit_float_jump(vm, header, instruction, JCC_B, iarg, pc);
+				break;
+			case OP_LOAD1:
+				emit_pending_const(vm, instruction);
+				emit_load(REG_RAX, 0);	// get value from stack
+				emit_rangecheck(vm, REG_RAX, 1);
+				emit_rm(0, 0, 0x8a, REG_RAX, REG_R8, REG_RAX, 1, 0);	// deref into al
+				emit_alu_imm(1, ALU_AND, REG_RAX, 255);
+				emit_store(REG_RAX, 0);	// store on stack
+				break;
+			case OP_LOAD2:
+				emit_pending_const(vm, instruction);
+				emit_load(REG_RAX, 0);
+				emit_rangecheck(vm, REG_RAX, 2);
+				emit_rm(0x66, 0, 0x8b, REG_RAX, REG_R8, REG_RAX, 1, 0);	// deref into ax
+				emit_store(REG_RAX, 0);
+				break;
+			case OP_LOAD4:
+				emit_pending_const(vm, instruction);
+				emit_load(REG_RAX, 0);
+				emit_rangecheck(vm, REG_RAX, 4);
+				emit_rm(0, 0, 0x8b, REG_RAX, REG_R8, REG_RAX, 1, 0);	// deref into eax
+				emit_store(REG_RAX, 0);
+				break;
+			case OP_STORE1:
+				emit_pending_const(vm, instruction);
+				emit_load(REG_RAX, 0);	// get value from stack
+				emit_alu_imm(1, ALU_AND, REG_RAX, 255);
+				emit_load(REG_RBX, -4);	// get pointer from stack
+				emit_rangecheck(vm, REG_RBX, 1);
+				emit_rm(0, 0, 0x88, REG_RAX, REG_R8, REG_RBX, 1, 0);	// store in memory
+				emit_alu_imm(1, ALU_SUB, REG_RSI, 8);
+				break;
+			case OP_STORE2:
+				emit_pending_const(vm, instruction);
+				emit_load(REG_RAX, 0);
+				emit_load(REG_RBX, -4);
+				emit_rangecheck(vm, REG_RBX, 2);
+				emit_rm(0x66, 0, 0x89, REG_RAX, REG_R8, REG_RBX, 1, 0);
+				emit_alu_imm(1, ALU_SUB, REG_RSI, 8);
+				break;
+			case OP_STORE4:
+				emit_pending_const(vm, instruction);
+				emit_load(REG_RBX, -4);
+				emit_rangecheck(vm, REG_RBX, 4);
+				emit_load(REG_RCX, 0);
+				emit_rm(0, 0, 0x89, REG_RCX, REG_R8, REG_RBX, 1, 0);
+				emit_alu_imm(1, ALU_SUB, REG_RSI, 8);
+				break;
+			case OP_ARG:
+				emit_pending_const(vm, instruction);
+				emit_alu_imm(1, ALU_SUB, REG_RSI, 4);
+				emit_load(REG_RAX, 4);	// get value from stack
+				emit_mov_imm32(REG_RBX, barg);
+				emit_rr(0, 0, 0x01, REG_RDI, REG_RBX);	// addl %edi, %ebx
+				emit_rangecheck(vm, REG_RBX, 4);
+				emit_rm(0, 0, 0x89, REG_RAX, REG_R8, REG_RBX, 1, 0);	// store in args space
+				break;
+			case OP_BLOCK_COPY:
+				emit_pending_const(vm, instruction);
+				emit_alu_imm(1, ALU_SUB, REG_RSI, 8);
+				emit_save_registers();
+				emit_load(REG_RDI, 4);	// 1st argument dest
+				emit_load(REG_RSI, 8);	// 2nd argument src
+				emit_mov_imm32(REG_RDX, iarg);	// 3rd argument count
+				emit_mov_address(REG_RAX, ADDR_BLOCK_COPY);
+				emit_call_rax();
+				emit_restore_registers();
+				break;
+			case OP_SEX8:
+				emit_pending_const(vm, instruction);
+				emit_rm(0x66, 0, 0x8b, REG_RAX, REG_RSI, REG_NONE, 0, 0);	// movw 0(%rsi), %ax
+				emit_alu_imm(1, ALU_AND, REG_RAX, 255);
+				emit_byte(0x66);	// cbw
+				emit_byte(0x98);
+				emit_byte(0x98);	// cwde
+				emit_store(REG_RAX, 0);
+				break;
+			case OP_SEX16:
+				emit_pending_const(vm, instruction);
+				emit_rm(0x66, 0, 0x8b, REG_RAX, REG_RSI, REG_NONE, 0, 0);
+				emit_byte(0x98);	// cwde
+				emit_store(REG_RAX, 0);
+				break;
+			case OP_NEGI:
+				emit_pending_const(vm, instruction);
+				emit_rm(0, 0, 0xf7, 3, REG_RSI, REG_NONE, 0, 0);	// negl 0(%rsi)
+				break;
+			case OP_ADD:
+				emit_simple(vm, instruction, 0x01);
+				break;
+			case OP_SUB:
+				emit_simple(vm, instruction, 0x29);
+				break;
+			case OP_DIVI:
+				emit_muldiv(vm, instruction, 7, MD_CDQ, REG_RAX);
+				break;
+			case OP_DIVU:
+				emit_muldiv(vm, instruction, 6, MD_XORQ, REG_RAX);
+				break;
+			case OP_MODI:
+				emit_muldiv(vm, instruction, 7, MD_XORL|MD_CDQ, REG_RDX);
+				break;
+			case OP_MODU:
+				emit_muldiv(vm, instruction, 6, MD_XORL, REG_RDX);
+				break;
+			case OP_MULI:
+				emit_muldiv(vm, instruction, 5, 0, REG_RAX);
+				break;
+			case OP_MULU:
+				emit_muldiv(vm, instruction, 4, 0, REG_RAX);
+				break;
+			case OP_BAND:
+				emit_simple(vm, instruction, 0x21);
+				break;
+			case OP_BOR:
+				emit_simple(vm, instruction, 0x09);
+				break;
+			case OP_BXOR:
+				emit_simple(vm, instruction, 0x31);
+				break;
+			case OP_BCOM:
+				emit_pending_const(vm, instruction);
+				emit_rm(0, 0, 0xf7, 2, REG_RSI, REG_NONE, 0, 0);	// notl 0(%rsi)
+				break;
+			case OP_LSH:
+				emit_shift(vm, instruction, 4);
+				break;
+			case OP_RSHI:
+				emit_shift(vm, instruction, 7);
+				break;
+			case OP_RSHU:
+				emit_shift(vm, instruction, 5);
+				break;
+			case OP_NEGF:
+				emit_pending_const(vm, instruction);
+				emit_mov_imm32(REG_RAX, 0x80000000);
+				emit_rm(0, 0, 0x31, REG_RAX, REG_RSI, REG_NONE, 0, 0);	// xorl %eax, 0(%rsi)
+				break;
+			case OP_ADDF:
+				emit_float_simple(vm, instruction, 0x0f58);
+				break;
+			case OP_SUBF:
+				emit_float_simple(vm, instruction, 0x0f5c);
+				break;
+			case OP_DIVF:
+				emit_float_simple(vm, instruction, 0x0f5e);
+				break;
+			case OP_MULF:
+				emit_float_simple(vm, instruction, 0x0f59);
+				break;
+			case OP_CVIF:
+				emit_pending_const(vm, instruction);
+				emit_load(REG_RAX, 0);
+				emit_rr(0xf3, 0, 0x0f2a, REG_XMM0, REG_RAX);	// cvtsi2ss %eax, %xmm0
+				emit_rm(0xf3, 0, 0x0f11, REG_XMM0, REG_RSI, REG_NONE, 0, 0);
+				break;
+			case OP_CVFI:
+				emit_pending_const(vm, instruction);
+				emit_rm(0xf3, 0, 0x0f10, REG_XMM0, REG_RSI, REG_NONE, 0, 0);
+				emit_rr(0xf3, 0, 0x0f2c, REG_RAX, REG_XMM0);	// cvttss2si %xmm0, %eax
+				emit_store(REG_RAX, 0);
+				break;
+			default:
+				NOTIMPL(op);
+				break;
+		}
+	}
+
+	if(jit.gotConst) {
+		Com_Error(ERR_DROP, "leftover const\n");
+	}
+
+	if(jit.optimize)
+		opt_flush(0);
+
+	set_jumps_next();
+	emit_mov_address(REG_RAX, ADDR_EOP);
+	emit_call_rax();
+
+	// move the code to its final place and point the jumps to it
+	vm->codeLength = jit.size;
+	vm->codeBase = mmap(NULL, jit.size, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(vm->codeBase == (void*)-1)
+		Com_Error(ERR_DROP, "VM_CompileX86: can't mmap memory");
+
+	for(i = 0; i < jit.numJumps; ++i)
+	{
+		if(jit.jumps[i].relative)
+		{
+			ofs = vm->instructionPointers[jit.jumps[i].target] - (jit.jumps[i].ofs + 4);
+			Com_Memcpy(jit.buf + jit.jumps[i].ofs, &ofs, 4);
+		}
+	}
+
+	Com_Memcpy(vm->codeBase, jit.buf, jit.size);
+	set_addresses(vm, vm->codeBase, jit.jumps, jit.numJumps);
+}
 
 /*
 =================
-VM_Compile
+VM_CompileAssembler
+
+Generates the code as assembly text for vm_x86_64_assembler.c.
+With checkBuf set the code is assembled into a separate buffer
+returned there, for comparing it to the already compiled code.
 =================
 */
-void VM_Compile( vm_t *vm, vmHeader_t *header ) {
+static void VM_CompileAssembler( vm_t *vm, vmHeader_t *header, byte **checkBuf ) {
 	unsigned char op;
 	int pc;
 	unsigned instruction;
@@ -412,7 +1909,6 @@ void VM_Compile( vm_t *vm, vmHeader_t *header ) {
 	unsigned iarg = 0;
 	unsigned char barg = 0;
 	int neednilabel = 0;
-	struct timeval tvstart =  {0, 0};
 #ifdef DEBUG_VM
 	char fn_d[MAX_QPATH]; // disassembled
 #endif
@@ -423,19 +1919,32 @@ void VM_Compile( vm_t *vm, vmHeader_t *header ) {
 	// const optimization
 	unsigned got_const = 0, const_value = 0;
 
-	gettimeofday(&tvstart, NULL);
-
 	for (pass = 0; pass < 2; ++pass) {
 
 	if(pass)
 	{
 		compiledOfs = assembler_get_code_size();
-		vm->codeLength = compiledOfs;
-		vm->codeBase = mmap(NULL, compiledOfs, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
-		if(vm->codeBase == (void*)-1)
-			Com_Error(ERR_DROP, "VM_CompileX86: can't mmap memory");
+		if(checkBuf)
+		{
+			if(compiledOfs != vm->codeLength)
+			{
+				Com_Printf( S_COLOR_YELLOW "VM file %s: assembler output is %lu bytes, direct output %i bytes\n",
+					vm->name, (unsigned long)compiledOfs, vm->codeLength );
+				assembler_init(0);
+				return;
+			}
+			*checkBuf = Z_Malloc(compiledOfs);
+			assembler_set_output((char*)*checkBuf);
+		}
+		else
+		{
+			vm->codeLength = compiledOfs;
+			vm->codeBase = mmap(NULL, compiledOfs, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+			if(vm->codeBase == (void*)-1)
+				Com_Error(ERR_DROP, "VM_CompileX86: can't mmap memory");
 
-		assembler_set_output((char*)vm->codeBase);
+			assembler_set_output((char*)vm->codeBase);
+		}
 	}
 
 	assembler_init(pass);
@@ -917,11 +2426,6 @@ emit_do_syscall:
 
 	assembler_init(0);
 
-	if(mprotect(vm->codeBase, compiledOfs, PROT_READ|PROT_EXEC))
-		Com_Error(ERR_DROP, "VM_CompileX86: mprotect failed");
-
-	vm->destroy = VM_Destroy_Compiled;
-
 #ifdef DEBUG_VM
 	fflush(qdasmout);
 	fclose(qdasmout);
@@ -935,17 +2439,425 @@ emit_do_syscall:
 	fclose(qdasmout);
 #endif
 #endif
-	
-	if(vm->compiled)
-	{
-		struct timeval tvdone =  {0, 0};
-		struct timeval dur =  {0, 0};
-		Com_Printf( "VM file %s compiled to %i bytes of code (%p - %p)\n", vm->name, vm->codeLength, vm->codeBase, vm->codeBase+vm->codeLength );
+}
+
+/*
+=================
+VM_CheckAssembler
+
+Compiles the QVM again with the assembler and compares the result to
+the code the direct backend generated
+=================
+*/
+static void VM_CheckAssembler( vm_t *vm, vmHeader_t *header ) {
+	int		*instructionPointers;
+	byte	*checkBuf;
+	int		i;
+
+	instructionPointers = Z_Malloc( header->instructionCount * sizeof( int ) );
+	Com_Memcpy( instructionPointers, vm->instructionPointers, header->instructionCount * sizeof( int ) );
+
+	checkBuf = NULL;
+	VM_CompileAssembler( vm, header, &checkBuf );
+
+	for ( i = 0 ; i < header->instructionCount ; i++ ) {
+		if ( instructionPointers[i] != vm->instructionPointers[i] ) {
+			Com_Printf( S_COLOR_YELLOW "VM file %s: instruction %i at 0x%x with the assembler, 0x%x direct\n",
+				vm->name, i, vm->instructionPointers[i], instructionPointers[i] );
+			break;
+		}
+	}
+
+	if ( checkBuf && i == header->instructionCount ) {
+		for ( i = 0 ; i < vm->codeLength ; i++ ) {
+			if ( checkBuf[i] != vm->codeBase[i] ) {
+				Com_Printf( S_COLOR_YELLOW "VM file %s: code differs from the assembler at 0x%x\n", vm->name, i );
+				break;
+			}
+		}
+		if ( i == vm->codeLength ) {
+			Com_Printf( "VM file %s: direct and assembler output are identical\n", vm->name );
+		}
+	}
+
+	// keep the jump targets of the code that is used
+	Com_Memcpy( vm->instructionPointers, instructionPointers, header->instructionCount * sizeof( int ) );
+	Z_Free( instructionPointers );
+	if ( checkBuf ) {
+		Z_Free( checkBuf );
+	}
+}
+
+/*
+=================================================================
 
-		gettimeofday(&tvdone, NULL);
-		timersub(&tvdone, &tvstart, &dur);
-		Com_Printf( "compilation took %lu.%06lu seconds\n", dur.tv_sec, dur.tv_usec );
+CODE CACHE
+
+The code of the direct backend is saved under fs_homepath/vmcache,
+together with the instruction pointers and the list of absolute
+addresses in it.  Loading a QVM with the same checksum, by the same
+engine build on a machine with the same CPU features, maps that file
+and fills in the addresses instead of compiling again.
+
+=================================================================
+*/
+
+#define JIT_CACHE_IDENT		(('C'<<24)+('T'<<16)+('I'<<8)+'J')
+#define JIT_CACHE_VERSION	2	// bump whenever the generated code changes
+#define JIT_CACHE_BUILD		Q3_VERSION " " __DATE__ " " __TIME__
+
+// the code starts on a page of its own so it can be mapped
+#define JIT_CACHE_CODE_OFS	4096
+
+typedef struct {
+	int			ident;
+	int			version;
+	char		build[64];
+	int			cpuFeatures;
+	unsigned	checksum;		// of the QVM code and jump table targets
+	int			optimize;
+	int			instructionCount;
+	int			codeLength;
+	int			numJumps;		// absolute addresses after the instruction pointers
+} jitCacheHeader_t;
+
+/*
+=================
+VM_CacheChecksum
+=================
+*/
+static unsigned VM_CacheChecksum( vm_t *vm, vmHeader_t *header ) {
+	unsigned checksum;
+
+	checksum = Com_BlockChecksum( header, header->codeOffset + header->codeLength );
+	if ( vm->numJumpTableTargets ) {
+		checksum ^= Com_BlockChecksum( vm->jumpTableTargets, vm->numJumpTableTargets * 4 );
+	}
+
+	return checksum;
+}
+
+static void VM_CacheHeader( jitCacheHeader_t *cache, vmHeader_t *header, unsigned checksum ) {
+	Com_Memset( cache, 0, sizeof( *cache ) );
+	cache->ident = JIT_CACHE_IDENT;
+	cache->version = JIT_CACHE_VERSION;
+	Q_strncpyz( cache->build, JIT_CACHE_BUILD, sizeof( cache->build ) );
+	cache->cpuFeatures = Sys_GetProcessorFeatures();
+	cache->checksum = checksum;
+	cache->optimize = jit.optimize && header->vmMagic == VM_MAGIC_VER2;
+	cache->instructionCount = header->instructionCount;
+}
+
+// optimized and plain code for the same QVM live side by side
+static char *VM_CachePath( vm_t *vm, vmHeader_t *header, unsigned checksum ) {
+	return FS_BuildOSPath( Cvar_VariableString( "fs_homepath" ), "vmcache",
+		va( "%s-%08x-v%i%s.jit", vm->name, checksum, JIT_CACHE_VERSION,
+		( jit.optimize && header->vmMagic == VM_MAGIC_VER2 ) ? "-opt" : "" ) );
+}
+
+/*
+=================
+VM_CheckCache
+
+Makes sure the instruction pointers and addresses read from a cache
+file can't point outside the code or patch anything outside it
+=================
+*/
+static qboolean VM_CheckCache( vm_t *vm, jitCacheHeader_t *cache, jitJump_t *jumps ) {
+	int		i, last;
+
+	last = 0;
+	for ( i = 0 ; i < cache->instructionCount ; i++ ) {
+		if ( vm->instructionPointers[i] < last || vm->instructionPointers[i] >= cache->codeLength ) {
+			return qfalse;
+		}
+		last = vm->instructionPointers[i];
+	}
+
+	for ( i = 0 ; i < cache->numJumps ; i++ ) {
+		if ( jumps[i].relative || jumps[i].ofs < 0 ||
+			jumps[i].ofs > cache->codeLength - (int)sizeof( void * ) ) {
+			return qfalse;
+		}
+		if ( jumps[i].target >= cache->instructionCount ||
+			jumps[i].target < -ADDR_NUM_ADDRESSES ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+VM_LoadCache
+
+Maps the cached code for the QVM, returns qfalse if there is none
+=================
+*/
+static qboolean VM_LoadCache( vm_t *vm, vmHeader_t *header, unsigned checksum ) {
+	jitCacheHeader_t	cache, expected;
+	struct stat			st;
+	byte				*code;
+	int					fd, ofs, ipSize, jumpsSize;
+
+	fd = open( VM_CachePath( vm, header, checksum ), O_RDONLY );
+	if ( fd == -1 ) {
+		return qfalse;
+	}
+
+	VM_CacheHeader( &expected, header, checksum );
+	if ( fstat( fd, &st ) || read( fd, &cache, sizeof( cache ) ) != sizeof( cache ) ) {
+		close( fd );
+		return qfalse;
+	}
+
+	expected.codeLength = cache.codeLength;
+	expected.numJumps = cache.numJumps;
+	ipSize = header->instructionCount * sizeof( int );
+
+	if ( memcmp( &cache, &expected, sizeof( cache ) ) ||
+		cache.codeLength <= (int)sizeof( void * ) || cache.numJumps < 0 ||
+		st.st_size != JIT_CACHE_CODE_OFS + (off_t)cache.codeLength + ipSize +
+			(off_t)cache.numJumps * sizeof( jitJump_t ) ) {
+		Com_Printf( "VM file %s: cached code is out of date\n", vm->name );
+		close( fd );
+		return qfalse;
+	}
+
+	jumpsSize = cache.numJumps * sizeof( jitJump_t );
+	ofs = JIT_CACHE_CODE_OFS + cache.codeLength;
+
+	if ( jit.maxJumps < cache.numJumps ) {
+		jit.maxJumps = cache.numJumps;
+		jit.jumps = realloc( jit.jumps, jit.maxJumps * sizeof( *jit.jumps ) );
+		if ( !jit.jumps ) {
+			Com_Error( ERR_DROP, "VM_CompileX86: can't allocate jump table" );
+		}
+	}
+
+	if ( pread( fd, vm->instructionPointers, ipSize, ofs ) != ipSize ||
+		pread( fd, jit.jumps, jumpsSize, ofs + ipSize ) != jumpsSize ) {
+		close( fd );
+		return qfalse;
+	}
+
+	if ( !VM_CheckCache( vm, &cache, jit.jumps ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: VM file %s: cached code is corrupt\n", vm->name );
+		close( fd );
+		return qfalse;
+	}
+
+	code = mmap( NULL, cache.codeLength, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, JIT_CACHE_CODE_OFS );
+	close( fd );
+	if ( code == (void *)-1 ) {
+		return qfalse;
+	}
+
+	set_addresses( vm, code, jit.jumps, cache.numJumps );
+	vm->codeBase = code;
+	vm->codeLength = cache.codeLength;
+
+	return qtrue;
+}
+
+/*
+=================
+VM_SaveCache
+
+Writes the code VM_CompileDirect just generated to the cache
+=================
+*/
+static void VM_SaveCache( vm_t *vm, vmHeader_t *header, unsigned checksum ) {
+	jitCacheHeader_t	cache;
+	char				path[ MAX_OSPATH ];
+	char				tmpPath[ MAX_OSPATH ];
+	static byte			pad[ JIT_CACHE_CODE_OFS ];
+	FILE				*f;
+	int					i, numJumps;
+	qboolean			ok;
+
+	// the relative jumps are already in the code
+	numJumps = 0;
+	for ( i = 0 ; i < jit.numJumps ; i++ ) {
+		if ( !jit.jumps[i].relative ) {
+			jit.jumps[numJumps++] = jit.jumps[i];
+		}
+	}
+	jit.numJumps = numJumps;
+
+	VM_CacheHeader( &cache, header, checksum );
+	cache.codeLength = jit.size;
+	cache.numJumps = jit.numJumps;
+
+	Q_strncpyz( path, VM_CachePath( vm, header, checksum ), sizeof( path ) );
+	Com_sprintf( tmpPath, sizeof( tmpPath ), "%s.%i", path, (int)getpid() );
+	FS_CreatePath( tmpPath );
+
+	// write to another file first so nobody maps a half written one
+	f = fopen( tmpPath, "wb" );
+	if ( !f ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: can't write %s\n", tmpPath );
+		return;
+	}
+
+	ok = fwrite( &cache, sizeof( cache ), 1, f ) == 1 &&
+		fwrite( pad, JIT_CACHE_CODE_OFS - sizeof( cache ), 1, f ) == 1 &&
+		fwrite( jit.buf, jit.size, 1, f ) == 1 &&
+		fwrite( vm->instructionPointers, header->instructionCount * sizeof( int ), 1, f ) == 1 &&
+		( !jit.numJumps || fwrite( jit.jumps, jit.numJumps * sizeof( jitJump_t ), 1, f ) == 1 );
+	ok = !fclose( f ) && ok;
+
+	if ( !ok || rename( tmpPath, path ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: can't write %s\n", path );
+		remove( tmpPath );
+	}
+}
+
+/*
+=================
+VM_InstructionForPointer
+
+Returns the QVM instruction the code at the address belongs to
+=================
+*/
+static int VM_InstructionForPointer( vm_t *vm, void *code ) {
+	int		ofs, low, high, mid;
+
+	if ( (byte *)code < vm->codeBase || (byte *)code >= vm->codeBase + vm->codeLength ) {
+		return -1;
+	}
+
+	// the last instruction starting at or before ofs
+	ofs = (byte *)code - vm->codeBase;
+	low = 0;
+	high = vm->instructionCount - 1;
+	while ( low < high ) {
+		mid = ( low + high + 1 ) / 2;
+		if ( vm->instructionPointers[mid] <= ofs ) {
+			low = mid;
+		} else {
+			high = mid - 1;
+		}
+	}
+
+	return low;
+}
+
+/*
+=================
+VM_SampleState
+
+Finds the instruction and program stack the VM is at for the profiler,
+either in the signal context or, during a syscall, at the CALL of the
+syscall.  Runs in a signal handler.
+=================
+*/
+static qboolean VM_SampleState( vm_t *vm, profileContext_t *context, qboolean syscall,
+	int *instruction, int *programStack ) {
+	if ( syscall ) {
+		// callAsmCall saved the stack of the calling function, where the
+		// CALL stored the instruction following it
+		*programStack = vm->programStack + 4;
+		*instruction = *(int *)( vm->dataBase + ( *programStack & vm->dataMask & ~3 ) ) - 1;
+		return qtrue;
+	}
+
+	*instruction = VM_InstructionForPointer( vm, context->pc );
+	*programStack = context->regs[REG_RDI];
+	return *instruction >= 0;
+}
+
+/*
+=================
+VM_Compile
+
+vm_assembler 1 uses the old assembler backend, 2 compiles with both
+backends and reports any difference between their output.
+vm_optimize 1 turns on the optimizer of the direct backend.
+vm_cache 1 keeps the code of the direct backend in the cache.
+=================
+*/
+void VM_Compile( vm_t *vm, vmHeader_t *header ) {
+	struct timeval tvstart =  {0, 0};
+	struct timeval tvdone =  {0, 0};
+	struct timeval dur =  {0, 0};
+	cvar_t *vm_assembler;
+	cvar_t *vm_optimize;
+	cvar_t *vm_cache;
+	unsigned checksum = 0;
+	qboolean useCache = qfalse;
+
+	vm_assembler = Cvar_Get( "vm_assembler", "0", 0 );
+	vm_optimize = Cvar_Get( "vm_optimize", "1", CVAR_ARCHIVE );
+	vm_cache = Cvar_Get( "vm_cache", "1", CVAR_ARCHIVE );
+
+	// the backends can only be compared without optimization
+	jit.optimize = vm_optimize->integer && !vm_assembler->integer;
+
+	gettimeofday(&tvstart, NULL);
+
+#ifdef USE_X87
+	// the direct backend only emits SSE
+	VM_CompileAssembler( vm, header, NULL );
+#else
+	if ( vm_cache->integer && !vm_assembler->integer ) {
+		useCache = qtrue;
+		checksum = VM_CacheChecksum( vm, header );
+
+		if ( VM_LoadCache( vm, header, checksum ) ) {
+			if ( !mprotect( vm->codeBase, vm->codeLength, PROT_READ|PROT_EXEC ) ) {
+				vm->destroy = VM_Destroy_Compiled;
+				vm->instructionForPointer = VM_InstructionForPointer;
+				vm->sampleState = VM_SampleState;
+
+				gettimeofday(&tvdone, NULL);
+				timersub(&tvdone, &tvstart, &dur);
+				Com_Printf( "VM file %s loaded %i bytes of cached code in %lu.%06lu seconds\n",
+					vm->name, vm->codeLength, dur.tv_sec, dur.tv_usec );
+				return;
+			}
+
+			// probably mounted noexec
+			Com_Printf( S_COLOR_YELLOW "WARNING: can't execute cached code for %s\n", vm->name );
+			munmap( vm->codeBase, vm->codeLength );
+			useCache = qfalse;
+		}
+	}
+
+	if ( vm_assembler->integer == 1 ) {
+		VM_CompileAssembler( vm, header, NULL );
+	} else {
+		VM_CompileDirect( vm, header );
+		if ( useCache ) {
+			VM_SaveCache( vm, header, checksum );
+		}
+	}
+#endif
+
+	if ( !vm->compiled ) {
+		return;
+	}
+
+	gettimeofday(&tvdone, NULL);
+
+#ifndef USE_X87
+	if ( vm_assembler->integer == 2 ) {
+		VM_CheckAssembler( vm, header );
 	}
+#endif
+
+	if(mprotect(vm->codeBase, vm->codeLength, PROT_READ|PROT_EXEC))
+		Com_Error(ERR_DROP, "VM_CompileX86: mprotect failed");
+
+	vm->destroy = VM_Destroy_Compiled;
+	vm->instructionForPointer = VM_InstructionForPointer;
+	vm->sampleState = VM_SampleState;
+
+	Com_Printf( "VM file %s compiled to %i bytes of code (%p - %p)\n", vm->name, vm->codeLength, vm->codeBase, vm->codeBase+vm->codeLength );
+
+	timersub(&tvdone, &tvstart, &dur);
+	Com_Printf( "compilation took %lu.%06lu seconds\n", dur.tv_sec, dur.tv_usec );
 }
 
 
@@ -1708,9 +1708,12 @@ void R_LoadEntities( lump_t *l ) {
 
 	// store for reference by the cgame
 	w->entityString = ri.Hunk_Alloc( l->filelen + 1, h_low );
-	strcpy( w->entityString, p );
+	Q_strncpyz( w->entityString, p, l->filelen + 1 );
 	w->entityParsePoint = w->entityString;
 
+	// a mapped bsp is not 0 terminated, parse the copy
+	p = w->entityString;
+
 	token = COM_ParseExt( &p, qtrue );
 	if (!*token || *token != '{') {
 		return;
@@ -1795,7 +1798,7 @@ Called directly from cgame
 */
 void RE_LoadWorldMap( const char *name ) {
 	int			i;
-	dheader_t	*header;
+	dheader_t	header;
 	union {
 		byte *b;
 		void *v;
@@ -1817,7 +1820,7 @@ void RE_LoadWorldMap( const char *name ) {
 	tr.worldMapLoaded = qtrue;
 
 	// load it
-    ri.FS_ReadFile( name, &buffer.v );
+	ri.FS_MapFile( name, &buffer.v );
 	if ( !buffer.b ) {
 		ri.Error (ERR_DROP, "RE_LoadWorldMap: %s not found", name);
 	}
@@ -1835,10 +1838,11 @@ void RE_LoadWorldMap( const char *name ) {
 	startMarker = ri.Hunk_Alloc(0, h_low);
 	c_gridVerts = 0;
 
-	header = (dheader_t *)buffer.b;
-	fileBase = (byte *)header;
+	// the buffer may be mapped read-only, swap a copy of the header
+	header = *(dheader_t *)buffer.b;
+	fileBase = buffer.b;
 
-	i = LittleLong (header->version);
+	i = LittleLong (header.version);
 	if ( i != BSP_VERSION ) {
 		ri.Error (ERR_DROP, "RE_LoadWorldMap: %s has wrong version number (%i should be %i)", 
 			name, i, BSP_VERSION);
@@ -1846,27 +1850,28 @@ void RE_LoadWorldMap( const char *name ) {
 
 	// swap all the lumps
 	for (i=0 ; i<sizeof(dheader_t)/4 ; i++) {
-		((int *)header)[i] = LittleLong ( ((int *)header)[i]);
+		((int *)&header)[i] = LittleLong ( ((int *)&header)[i]);
 	}
 
 	// load into heap
-	R_LoadShaders( &header->lumps[LUMP_SHADERS] );
-	R_LoadLightmaps( &header->lumps[LUMP_LIGHTMAPS] );
-	R_LoadPlanes (&header->lumps[LUMP_PLANES]);
-	R_LoadFogs( &header->lumps[LUMP_FOGS], &header->lumps[LUMP_BRUSHES], &header->lumps[LUMP_BRUSHSIDES] );
-	R_LoadSurfaces( &header->lumps[LUMP_SURFACES], &header->lumps[LUMP_DRAWVERTS], &header->lumps[LUMP_DRAWINDEXES] );
-	R_LoadMarksurfaces (&header->lumps[LUMP_LEAFSURFACES]);
-	R_LoadNodesAndLeafs (&header->lumps[LUMP_NODES], &header->lumps[LUMP_LEAFS]);
-	R_LoadSubmodels (&header->lumps[LUMP_MODELS]);
-	R_LoadVisibility( &header->lumps[LUMP_VISIBILITY] );
-	R_LoadEntities( &header->lumps[LUMP_ENTITIES] );
-	R_LoadLightGrid( &header->lumps[LUMP_LIGHTGRID] );
+	R_LoadShaders( &header.lumps[LUMP_SHADERS] );
+	R_PrefetchShaders( s_worldData.shaders, s_worldData.numShaders );
+	R_LoadLightmaps( &header.lumps[LUMP_LIGHTMAPS] );
+	R_LoadPlanes (&header.lumps[LUMP_PLANES]);
+	R_LoadFogs( &header.lumps[LUMP_FOGS], &header.lumps[LUMP_BRUSHES], &header.lumps[LUMP_BRUSHSIDES] );
+	R_LoadSurfaces( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], &header.lumps[LUMP_DRAWINDEXES] );
+	R_LoadMarksurfaces (&header.lumps[LUMP_LEAFSURFACES]);
+	R_LoadNodesAndLeafs (&header.lumps[LUMP_NODES], &header.lumps[LUMP_LEAFS]);
+	R_LoadSubmodels (&header.lumps[LUMP_MODELS]);
+	R_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
+	R_LoadEntities( &header.lumps[LUMP_ENTITIES] );
+	R_LoadLightGrid( &header.lumps[LUMP_LIGHTGRID] );
 
 	s_worldData.dataSize = (byte *)ri.Hunk_Alloc(0, h_low) - startMarker;
 
 	// only set tr.world now that we know the entire level has loaded properly
 	tr.world = &s_worldData;
 
-    ri.FS_FreeFile( buffer.v );
+	ri.FS_UnmapFile( buffer.v );
 }
 
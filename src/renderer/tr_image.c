@@ -23,6 +23,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // tr_image.c
 #include "tr_local.h"
 
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#define IMAGE_SIMD 1
+#include <emmintrin.h>
+#else
+#define IMAGE_SIMD 0
+#endif
+
 static byte			 s_intensitytable[256];
 static unsigned char s_gammatable[256];
 
@@ -224,8 +231,125 @@ void R_ImageList_f( void ) {
 	ri.Printf (PRINT_ALL, " %i total images\n\n", c );
 }
 
+/*
+===============
+R_PNGBench_f
+
+Times the PNG decoder over every .png in a directory
+===============
+*/
+void R_PNGBench_f( void ) {
+	char	**fileList;
+	char	fileName[MAX_QPATH];
+	int		numFiles;
+	int		iterations;
+	int		i, j;
+	int		width, height;
+	int		start, msec;
+	int		decoded, pixels;
+	byte	*pic;
+
+	if ( ri.Cmd_Argc() < 2 ) {
+		ri.Printf( PRINT_ALL, "usage: pngbench <directory> [iterations]\n" );
+		return;
+	}
+
+	iterations = 1;
+	if ( ri.Cmd_Argc() > 2 ) {
+		iterations = atoi( ri.Cmd_Argv( 2 ) );
+		if ( iterations < 1 ) {
+			iterations = 1;
+		}
+	}
+
+	fileList = ri.FS_ListFiles( ri.Cmd_Argv( 1 ), ".png", &numFiles );
+
+	decoded = 0;
+	pixels = 0;
+	start = ri.Milliseconds();
+
+	for ( j = 0 ; j < iterations ; j++ ) {
+		for ( i = 0 ; i < numFiles ; i++ ) {
+			Com_sprintf( fileName, sizeof( fileName ), "%s/%s", ri.Cmd_Argv( 1 ), fileList[i] );
+
+			pic = NULL;
+			R_LoadPNG( fileName, &pic, &width, &height );
+			if ( !pic ) {
+				if ( !j ) {
+					ri.Printf( PRINT_WARNING, "WARNING: pngbench: couldn't decode %s\n", fileName );
+				}
+				continue;
+			}
+
+			decoded++;
+			pixels += width * height;
+			ri.Free( pic );
+		}
+	}
+
+	msec = ri.Milliseconds() - start;
+
+	ri.FS_FreeFileList( fileList );
+
+	ri.Printf( PRINT_ALL, "%i images, %i pixels decoded in %i msec", decoded, pixels, msec );
+	if ( decoded ) {
+		ri.Printf( PRINT_ALL, " (%.3f msec per image)", (float)msec / decoded );
+	}
+	ri.Printf( PRINT_ALL, "\n" );
+}
+
 //=======================================================================
 
+#if IMAGE_SIMD
+/*
+================
+ResampleSumSIMD
+
+pix1 + pix3 in the low four 16 bit lanes, pix2 + pix4 in the high ones
+================
+*/
+static ID_INLINE __m128i ResampleSumSIMD( const byte *inrow, const byte *inrow2,
+										unsigned offset1, unsigned offset2, __m128i zero ) {
+	__m128i	top, bottom;
+
+	top = _mm_unpacklo_epi32( _mm_cvtsi32_si128( *(const int *)( inrow + offset1 ) ),
+		_mm_cvtsi32_si128( *(const int *)( inrow + offset2 ) ) );
+	bottom = _mm_unpacklo_epi32( _mm_cvtsi32_si128( *(const int *)( inrow2 + offset1 ) ),
+		_mm_cvtsi32_si128( *(const int *)( inrow2 + offset2 ) ) );
+
+	return _mm_add_epi16( _mm_unpacklo_epi8( top, zero ), _mm_unpacklo_epi8( bottom, zero ) );
+}
+
+/*
+================
+ResampleRowSIMD
+
+Same sums and shifts as the scalar loop, two output pixels at a time
+================
+*/
+static void ResampleRowSIMD( unsigned *out, const byte *inrow, const byte *inrow2,
+							const unsigned *p1, const unsigned *p2, int outwidth ) {
+	__m128i	zero, s0, s1;
+	int		j;
+
+	zero = _mm_setzero_si128();
+
+	for ( j = 0 ; j + 1 < outwidth ; j += 2 ) {
+		s0 = ResampleSumSIMD( inrow, inrow2, p1[j], p2[j], zero );
+		s1 = ResampleSumSIMD( inrow, inrow2, p1[j+1], p2[j+1], zero );
+		s0 = _mm_add_epi16( _mm_unpacklo_epi64( s0, s1 ), _mm_unpackhi_epi64( s0, s1 ) );
+		s0 = _mm_srli_epi16( s0, 2 );
+		_mm_storel_epi64( (__m128i *)( out + j ), _mm_packus_epi16( s0, s0 ) );
+	}
+
+	if ( j < outwidth ) {
+		s0 = ResampleSumSIMD( inrow, inrow2, p1[j], p2[j], zero );
+		s0 = _mm_srli_epi16( _mm_add_epi16( s0, _mm_srli_si128( s0, 8 ) ), 2 );
+		out[j] = _mm_cvtsi128_si32( _mm_packus_epi16( s0, s0 ) );
+	}
+}
+#endif
+
 /*
 ================
 ResampleTexture
@@ -266,6 +390,12 @@ static void ResampleTexture( unsigned *in, int inwidth, int inheight, unsigned *
 	for (i=0 ; i<outheight ; i++, out += outwidth) {
 		inrow = in + inwidth*(int)((i+0.25)*inheight/outheight);
 		inrow2 = in + inwidth*(int)((i+0.75)*inheight/outheight);
+#if IMAGE_SIMD
+		if ( r_imageSimd->integer ) {
+			ResampleRowSIMD( out, (byte *)inrow, (byte *)inrow2, p1, p2, outwidth );
+			continue;
+		}
+#endif
 		frac = fracstep >> 1;
 		for (j=0 ; j<outwidth ; j++) {
 			pix1 = (byte *)inrow + p1[j];
@@ -339,6 +469,28 @@ void R_LightScaleTexture (unsigned *in, int inwidth, int inheight, qboolean only
 }
 
 
+#if IMAGE_SIMD
+/*
+================
+MipMap2RowSIMD
+
+The 1 2 2 1 weighted sum of the four pixels at row, in the low four
+16 bit lanes
+================
+*/
+static ID_INLINE __m128i MipMap2RowSIMD( const unsigned *row, __m128i zero ) {
+	__m128i	pixels, sum;
+
+	pixels = _mm_loadu_si128( (const __m128i *)row );
+
+	// ( p0 + p2, p1 + p3 ) + ( p1, p2 ), then the two halves added
+	sum = _mm_add_epi16( _mm_unpacklo_epi8( pixels, zero ), _mm_unpackhi_epi8( pixels, zero ) );
+	sum = _mm_add_epi16( sum, _mm_unpacklo_epi8( _mm_srli_si128( pixels, 4 ), zero ) );
+
+	return _mm_add_epi16( sum, _mm_srli_si128( sum, 8 ) );
+}
+#endif
+
 /*
 ================
 R_MipMap2
@@ -364,6 +516,26 @@ static void R_MipMap2( unsigned *in, int inWidth, int inHeight ) {
 
 	for ( i = 0 ; i < outHeight ; i++ ) {
 		for ( j = 0 ; j < outWidth ; j++ ) {
+#if IMAGE_SIMD
+			// only the first and last columns wrap around
+			if ( r_imageSimd->integer && j > 0 && j*2+2 < inWidth ) {
+				__m128i	zero, sum;
+
+				zero = _mm_setzero_si128();
+				sum = MipMap2RowSIMD( &in[ ((i*2-1)&inHeightMask)*inWidth + j*2-1 ], zero );
+				sum = _mm_add_epi16( sum, _mm_slli_epi16(
+					MipMap2RowSIMD( &in[ ((i*2)&inHeightMask)*inWidth + j*2-1 ], zero ), 1 ) );
+				sum = _mm_add_epi16( sum, _mm_slli_epi16(
+					MipMap2RowSIMD( &in[ ((i*2+1)&inHeightMask)*inWidth + j*2-1 ], zero ), 1 ) );
+				sum = _mm_add_epi16( sum,
+					MipMap2RowSIMD( &in[ ((i*2+2)&inHeightMask)*inWidth + j*2-1 ], zero ) );
+
+				// total / 36, exact for totals up to 36 * 255
+				sum = _mm_srli_epi16( _mm_mulhi_epu16( sum, _mm_set1_epi16( 14564 ) ), 3 );
+				temp[ i * outWidth + j ] = _mm_cvtsi128_si32( _mm_packus_epi16( sum, sum ) );
+				continue;
+			}
+#endif
 			outpix = (byte *) ( temp + i * outWidth + j );
 			for ( k = 0 ; k < 4 ; k++ ) {
 				total = 
@@ -395,6 +567,31 @@ static void R_MipMap2( unsigned *in, int inWidth, int inHeight ) {
 	ri.Hunk_FreeTempMemory( temp );
 }
 
+#if IMAGE_SIMD
+/*
+================
+MipMapPairSIMD
+
+Two output pixels of R_MipMap from four input pixels on each of two rows
+================
+*/
+static ID_INLINE void MipMapPairSIMD( byte *out, const byte *in, int row ) {
+	__m128i	zero, top, bottom, left, right, sum;
+
+	zero = _mm_setzero_si128();
+	top = _mm_loadu_si128( (const __m128i *)in );
+	bottom = _mm_loadu_si128( (const __m128i *)( in + row ) );
+
+	// column sums, then the left and right columns of each output pixel
+	left = _mm_add_epi16( _mm_unpacklo_epi8( top, zero ), _mm_unpacklo_epi8( bottom, zero ) );
+	right = _mm_add_epi16( _mm_unpackhi_epi8( top, zero ), _mm_unpackhi_epi8( bottom, zero ) );
+	sum = _mm_add_epi16( _mm_unpacklo_epi64( left, right ), _mm_unpackhi_epi64( left, right ) );
+	sum = _mm_srli_epi16( sum, 2 );
+
+	_mm_storel_epi64( (__m128i *)out, _mm_packus_epi16( sum, sum ) );
+}
+#endif
+
 /*
 ================
 R_MipMap
@@ -433,7 +630,15 @@ static void R_MipMap (byte *in, int width, int height) {
 	}
 
 	for (i=0 ; i<height ; i++, in+=row) {
-		for (j=0 ; j<width ; j++, out+=4, in+=8) {
+		j = 0;
+#if IMAGE_SIMD
+		if ( r_imageSimd->integer ) {
+			for ( ; j+1<width ; j+=2, out+=8, in+=16) {
+				MipMapPairSIMD( out, in, row );
+			}
+		}
+#endif
+		for ( ; j<width ; j++, out+=4, in+=8) {
 			out[0] = (in[0] + in[4] + in[row+0] + in[row+4])>>2;
 			out[1] = (in[1] + in[5] + in[row+1] + in[row+5])>>2;
 			out[2] = (in[2] + in[6] + in[row+2] + in[row+6])>>2;
@@ -443,6 +648,111 @@ static void R_MipMap (byte *in, int width, int height) {
 }
 
 
+/*
+================
+R_ImageSimd_f
+
+Resamples and mipmaps random images with and without the SIMD kernels
+and compares the results
+================
+*/
+void R_ImageSimd_f( void ) {
+#if IMAGE_SIMD
+	char		simd[ MAX_CVAR_VALUE_STRING ];
+	unsigned	*source, *reference, *result;
+	int			images, i, k, size;
+	int			width, height, scaledWidth, scaledHeight;
+	int			scalarMsec[3], simdMsec[3], start;
+	int			mismatches;
+
+	images = 100;
+	if ( ri.Cmd_Argc() > 1 ) {
+		images = atoi( ri.Cmd_Argv( 1 ) );
+	}
+	if ( images <= 0 ) {
+		ri.Printf( PRINT_ALL, "usage: imagesimd [images]\n" );
+		return;
+	}
+
+	Q_strncpyz( simd, r_imageSimd->string, sizeof( simd ) );
+
+	// sizes up to 512 round up to at most 512
+	size = 512 * 512 * 4;
+	source = malloc( size );
+	reference = malloc( size );
+	result = malloc( size );
+
+	srand( 0x5eed );
+	Com_Memset( scalarMsec, 0, sizeof( scalarMsec ) );
+	Com_Memset( simdMsec, 0, sizeof( simdMsec ) );
+	mismatches = 0;
+
+	for ( i = 0 ; i < images ; i++ ) {
+		width = 1 + rand() % 512;
+		height = 1 + rand() % 512;
+		for ( k = 0 ; k < width * height ; k++ ) {
+			source[k] = ( rand() & 0xffff ) | ( ( rand() & 0xffff ) << 16 );
+		}
+
+		for ( scaledWidth = 1 ; scaledWidth < width ; scaledWidth <<= 1 )
+			;
+		for ( scaledHeight = 1 ; scaledHeight < height ; scaledHeight <<= 1 )
+			;
+
+		// ResampleTexture, then R_MipMap and R_MipMap2 on its result
+		for ( k = 0 ; k < 3 ; k++ ) {
+			ri.Cvar_Set( "r_imageSimd", "0" );
+			start = ri.Milliseconds();
+			if ( k == 0 ) {
+				ResampleTexture( source, width, height, reference, scaledWidth, scaledHeight );
+			} else if ( k == 1 ) {
+				Com_Memcpy( result, reference, scaledWidth * scaledHeight * 4 );
+				R_MipMap( (byte *)reference, scaledWidth, scaledHeight );
+			} else {
+				Com_Memcpy( result, reference, scaledWidth * scaledHeight * 4 );
+				R_MipMap2( reference, scaledWidth, scaledHeight );
+			}
+			scalarMsec[k] += ri.Milliseconds() - start;
+
+			ri.Cvar_Set( "r_imageSimd", "1" );
+			start = ri.Milliseconds();
+			if ( k == 0 ) {
+				ResampleTexture( source, width, height, result, scaledWidth, scaledHeight );
+			} else if ( k == 1 ) {
+				R_MipMap( (byte *)result, scaledWidth, scaledHeight );
+			} else {
+				R_MipMap2( result, scaledWidth, scaledHeight );
+			}
+			simdMsec[k] += ri.Milliseconds() - start;
+
+			if ( k ) {
+				scaledWidth = MAX( scaledWidth >> 1, 1 );
+				scaledHeight = MAX( scaledHeight >> 1, 1 );
+			}
+
+			if ( memcmp( reference, result, scaledWidth * scaledHeight * 4 ) ) {
+				if ( !mismatches ) {
+					ri.Printf( PRINT_ALL, "mismatch: kernel %i, %ix%i image\n", k, width, height );
+				}
+				mismatches++;
+			}
+		}
+	}
+
+	ri.Cvar_Set( "r_imageSimd", simd );
+	free( source );
+	free( reference );
+	free( result );
+
+	ri.Printf( PRINT_ALL, "%i images: resample %i/%i msec, mipmap %i/%i msec, "
+		"mipmap2 %i/%i msec (scalar/simd), %i mismatches\n", images,
+		scalarMsec[0], simdMsec[0], scalarMsec[1], simdMsec[1],
+		scalarMsec[2], simdMsec[2], mismatches );
+#else
+	ri.Printf( PRINT_ALL, "The SIMD image kernels are not built on this platform\n" );
+#endif
+}
+
 /*
 ==================
 R_BlendOverTexture
@@ -487,6 +797,402 @@ byte	mipBlendColors[16][4] = {
 };
 
 
+/*
+===============
+R_InternalFormat
+
+Picks the GL format for an image with samples 3 or 4
+===============
+*/
+static GLenum R_InternalFormat( int samples, qboolean lightMap )
+{
+	if(lightMap)
+	{
+		if(r_greyscale->integer)
+			return GL_LUMINANCE;
+		else
+			return GL_RGB;
+	}
+
+	if ( samples == 3 )
+	{
+		if(r_greyscale->integer)
+		{
+			if(r_texturebits->integer == 16)
+				return GL_LUMINANCE8;
+			else if(r_texturebits->integer == 32)
+				return GL_LUMINANCE16;
+			else
+				return GL_LUMINANCE;
+		}
+		else
+		{
+			if ( glConfig.textureCompression == TC_S3TC_ARB )
+			{
+				return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+			}
+			else if ( glConfig.textureCompression == TC_S3TC )
+			{
+				return GL_RGB4_S3TC;
+			}
+			else if ( r_texturebits->integer == 16 )
+			{
+				return GL_RGB5;
+			}
+			else if ( r_texturebits->integer == 32 )
+			{
+				return GL_RGB8;
+			}
+			else
+			{
+				return GL_RGB;
+			}
+		}
+	}
+
+	if(r_greyscale->integer)
+	{
+		if(r_texturebits->integer == 16)
+			return GL_LUMINANCE8_ALPHA8;
+		else if(r_texturebits->integer == 32)
+			return GL_LUMINANCE16_ALPHA16;
+		else
+			return GL_LUMINANCE_ALPHA;
+	}
+	else
+	{
+		if ( r_texturebits->integer == 16 )
+		{
+			return GL_RGBA4;
+		}
+		else if ( r_texturebits->integer == 32 )
+		{
+			return GL_RGBA8;
+		}
+		else
+		{
+			return GL_RGBA;
+		}
+	}
+}
+
+/*
+===============
+R_UploadFilter
+
+Sets the filtering of the texture just uploaded
+===============
+*/
+static void R_UploadFilter( qboolean mipmap )
+{
+	if (mipmap)
+	{
+		if ( glConfig.textureFilterAnisotropic )
+			qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT,
+					(GLint)Com_Clamp( 1, glConfig.maxAnisotropy, r_ext_max_anisotropy->integer ) );
+
+		qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gl_filter_min);
+		qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_filter_max);
+	}
+	else
+	{
+		if ( glConfig.textureFilterAnisotropic )
+			qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 1 );
+
+		qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+		qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	}
+
+	GL_CheckErrors();
+}
+
+/*
+============================================================================
+
+IMAGE CACHE
+
+With r_imageCache set, the levels Upload32 hands to GL for an image file
+are also written to imagecache/ below the homepath, along with the
+length and stamp of the source file and the checksum of every setting the
+resampling, picmip, light scaling and mipmapping depend on.  Later loads of
+the image map that file and upload the levels as they are.
+
+The stamp is the checksum of the pk3 the source is in, or the modification
+time of a loose file, so finding the cached levels doesn't read the source.
+
+The texture mode only affects the filtering set after the upload, and the
+internal format is picked again from the samples, so neither is part of
+the key.
+
+============================================================================
+*/
+
+#define	IMAGECACHE_IDENT	(('C'<<24)+('M'<<16)+('I'<<8)+'R')	// "RIMC"
+#define	IMAGECACHE_VERSION	2
+
+typedef struct {
+	int			ident;
+	int			version;
+	char		name[MAX_QPATH];		// as passed to R_FindImageFile
+	unsigned	settings;
+	int			sourceLength;
+	int			sourceStamp;
+	int			width, height;			// of the source image
+	int			uploadWidth, uploadHeight;
+	int			samples;
+	int			numLevels;
+} imageCacheHeader_t;
+
+typedef struct {
+	char				fileName[MAX_QPATH];	// the image file it comes from
+	char				path[MAX_QPATH];		// the cache file
+	qboolean			mipmap;
+	imageCacheHeader_t	header;
+
+	byte				*buffer;				// header and levels, while uploading
+	int					size;
+	int					used;
+	qboolean			failed;
+} imageCache_t;
+
+/*
+================
+R_ImageCacheLevels
+================
+*/
+static int R_ImageCacheLevels( int width, int height, qboolean mipmap ) {
+	int		levels;
+
+	levels = 1;
+	while ( mipmap && ( width > 1 || height > 1 ) ) {
+		width = MAX( width >> 1, 1 );
+		height = MAX( height >> 1, 1 );
+		levels++;
+	}
+	return levels;
+}
+
+/*
+================
+R_ImageCacheSize
+
+Bytes taken by the first numLevels levels
+================
+*/
+static int R_ImageCacheSize( int width, int height, int numLevels ) {
+	int		size;
+
+	size = 0;
+	while ( numLevels-- > 0 ) {
+		size += width * height * 4;
+		width = MAX( width >> 1, 1 );
+		height = MAX( height >> 1, 1 );
+	}
+	return size;
+}
+
+/*
+================
+R_ImageCacheSettings
+
+Checksums everything besides the source image that Upload32's output
+depends on
+================
+*/
+static unsigned R_ImageCacheSettings( qboolean mipmap, qboolean allowPicmip ) {
+	struct {
+		int		mipmap;
+		int		picmip;
+		int		roundImagesDown;
+		int		simpleMipMaps;
+		int		maxTextureSize;
+		int		deviceSupportsGamma;
+		byte	gammatable[256];
+		byte	intensitytable[256];
+	} settings;
+
+	Com_Memset( &settings, 0, sizeof( settings ) );
+	settings.mipmap = mipmap;
+	settings.picmip = allowPicmip ? r_picmip->integer : 0;
+	settings.roundImagesDown = r_roundImagesDown->integer;
+	settings.simpleMipMaps = r_simpleMipMaps->integer;
+	settings.maxTextureSize = glConfig.maxTextureSize;
+	settings.deviceSupportsGamma = glConfig.deviceSupportsGamma;
+	Com_Memcpy( settings.gammatable, s_gammatable, sizeof( settings.gammatable ) );
+	Com_Memcpy( settings.intensitytable, s_intensitytable, sizeof( settings.intensitytable ) );
+
+	return Com_BlockChecksum( &settings, sizeof( settings ) );
+}
+
+/*
+================
+R_ImageCacheKey
+
+Finds the file R_LoadImage would load name from and fills in what
+identifies its cached levels.  qfalse if there is no such file.
+================
+*/
+static qboolean R_ImageCacheKey( const char *name, qboolean mipmap, qboolean allowPicmip, imageCache_t *cache ) {
+	int		len, stamp;
+
+	Com_Memset( cache, 0, sizeof( *cache ) );
+
+	if ( strlen( name ) >= MAX_QPATH ) {
+		return qfalse;
+	}
+	if ( !R_ImageFileName( name, cache->fileName, sizeof( cache->fileName ) ) ) {
+		return qfalse;
+	}
+
+	len = ri.FS_FileStamp( cache->fileName, &stamp );
+	if ( len < 0 ) {
+		return qfalse;
+	}
+
+	cache->mipmap = mipmap;
+	cache->header.ident = IMAGECACHE_IDENT;
+	cache->header.version = IMAGECACHE_VERSION;
+	Q_strncpyz( cache->header.name, name, sizeof( cache->header.name ) );
+	cache->header.settings = R_ImageCacheSettings( mipmap, allowPicmip );
+	cache->header.sourceLength = len;
+	cache->header.sourceStamp = stamp;
+
+	// a changed source replaces its old levels instead of adding a file
+	Com_sprintf( cache->path, sizeof( cache->path ), "imagecache/%08x.img",
+		Com_BlockChecksum( cache->header.name, sizeof( cache->header.name ) ) ^ cache->header.settings );
+
+	return qtrue;
+}
+
+/*
+================
+R_MapCachedImage
+
+Maps the cache file, NULL unless it holds the levels the key asks for
+================
+*/
+static imageCacheHeader_t *R_MapCachedImage( const imageCache_t *cache ) {
+	imageCacheHeader_t	*header;
+	const imageCacheHeader_t	*key;
+	int					len;
+
+	len = ri.FS_MapHomeFile( cache->path, (void **)&header );
+	if ( !header ) {
+		return NULL;
+	}
+
+	key = &cache->header;
+	if ( len < (int)sizeof( *header )
+		|| header->ident != key->ident
+		|| header->version != key->version
+		|| strncmp( header->name, key->name, sizeof( header->name ) )
+		|| header->settings != key->settings
+		|| header->sourceLength != key->sourceLength
+		|| header->sourceStamp != key->sourceStamp
+		|| header->width < 1 || header->height < 1
+		|| header->uploadWidth < 1 || header->uploadWidth > glConfig.maxTextureSize
+		|| header->uploadHeight < 1 || header->uploadHeight > glConfig.maxTextureSize
+		|| ( header->samples != 3 && header->samples != 4 )
+		|| header->numLevels != R_ImageCacheLevels( header->uploadWidth, header->uploadHeight, cache->mipmap )
+		|| len != (int)sizeof( *header ) + R_ImageCacheSize( header->uploadWidth, header->uploadHeight, header->numLevels ) ) {
+		ri.FS_UnmapFile( header );
+		return NULL;
+	}
+
+	return header;
+}
+
+/*
+================
+UploadCached
+
+Uploads the levels following header
+================
+*/
+static void UploadCached( const imageCacheHeader_t *header, qboolean mipmap,
+						int *format, int *pUploadWidth, int *pUploadHeight )
+{
+	const byte	*data;
+	GLenum		internalFormat;
+	int			width, height;
+	int			level;
+
+	internalFormat = R_InternalFormat( header->samples, qfalse );
+
+	data = (const byte *)( header + 1 );
+	width = header->uploadWidth;
+	height = header->uploadHeight;
+
+	for ( level = 0 ; level < header->numLevels ; level++ ) {
+		qglTexImage2D (GL_TEXTURE_2D, level, internalFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
+		data += width * height * 4;
+		width = MAX( width >> 1, 1 );
+		height = MAX( height >> 1, 1 );
+	}
+
+	*pUploadWidth = header->uploadWidth;
+	*pUploadHeight = header->uploadHeight;
+	*format = internalFormat;
+
+	R_UploadFilter( mipmap );
+}
+
+/*
+================
+R_CacheImageLevel
+
+Keeps a copy of each level Upload32 hands to GL
+================
+*/
+static void R_CacheImageLevel( imageCache_t *cache, const void *data, int width, int height ) {
+	int		size;
+
+	if ( !cache || cache->failed ) {
+		return;
+	}
+
+	if ( !cache->buffer ) {
+		// the first level, make room for the whole chain
+		cache->header.uploadWidth = width;
+		cache->header.uploadHeight = height;
+		cache->size = sizeof( imageCacheHeader_t ) + R_ImageCacheSize( width, height,
+			R_ImageCacheLevels( width, height, cache->mipmap ) );
+		cache->buffer = malloc( cache->size );
+		if ( !cache->buffer ) {
+			cache->failed = qtrue;
+			return;
+		}
+		cache->used = sizeof( imageCacheHeader_t );
+	}
+
+	size = width * height * 4;
+	if ( cache->used + size > cache->size ) {
+		cache->failed = qtrue;
+		return;
+	}
+
+	Com_Memcpy( cache->buffer + cache->used, data, size );
+	cache->used += size;
+	cache->header.numLevels++;
+}
+
+/*
+================
+R_WriteCachedImage
+================
+*/
+static void R_WriteCachedImage( imageCache_t *cache ) {
+	if ( cache->buffer && !cache->failed && cache->used == cache->size ) {
+		Com_Memcpy( cache->buffer, &cache->header, sizeof( cache->header ) );
+		ri.FS_WriteFile( cache->path, cache->buffer, cache->size );
+	}
+
+	free( cache->buffer );
+	cache->buffer = NULL;
+}
+
+//=======================================================================
+
 /*
 ===============
 Upload32
@@ -500,7 +1206,8 @@ static void Upload32( unsigned *data,
 						  qboolean picmip, 
 							qboolean lightMap,
 						  int *format, 
-						  int *pUploadWidth, int *pUploadHeight )
+						  int *pUploadWidth, int *pUploadHeight,
+						  imageCache_t *cache )
 {
 	int			samples;
 	unsigned	*scaledBuffer = NULL;
@@ -570,14 +1277,7 @@ static void Upload32( unsigned *data,
 	scan = ((byte *)data);
 	samples = 3;
 
-	if(lightMap)
-	{
-		if(r_greyscale->integer)
-			internalFormat = GL_LUMINANCE;
-		else
-			internalFormat = GL_RGB;
-	}
-	else
+	if(!lightMap)
 	{
 		for ( i = 0; i < c; i++ )
 		{
@@ -599,69 +1299,11 @@ static void Upload32( unsigned *data,
 				break;
 			}
 		}
-		// select proper internal format
-		if ( samples == 3 )
-		{
-			if(r_greyscale->integer)
-			{
-				if(r_texturebits->integer == 16)
-					internalFormat = GL_LUMINANCE8;
-				else if(r_texturebits->integer == 32)
-					internalFormat = GL_LUMINANCE16;
-				else
-					internalFormat = GL_LUMINANCE;
-			}
-			else
-			{
-				if ( glConfig.textureCompression == TC_S3TC_ARB )
-				{
-					internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-				}
-				else if ( glConfig.textureCompression == TC_S3TC )
-				{
-					internalFormat = GL_RGB4_S3TC;
-				}
-				else if ( r_texturebits->integer == 16 )
-				{
-					internalFormat = GL_RGB5;
-				}
-				else if ( r_texturebits->integer == 32 )
-				{
-					internalFormat = GL_RGB8;
-				}
-				else
-				{
-					internalFormat = GL_RGB;
-				}
-			}
-		}
-		else if ( samples == 4 )
-		{
-			if(r_greyscale->integer)
-			{
-				if(r_texturebits->integer == 16)
-					internalFormat = GL_LUMINANCE8_ALPHA8;
-				else if(r_texturebits->integer == 32)
-					internalFormat = GL_LUMINANCE16_ALPHA16;
-				else
-					internalFormat = GL_LUMINANCE_ALPHA;
-			}
-			else
-			{
-				if ( r_texturebits->integer == 16 )
-				{
-					internalFormat = GL_RGBA4;
-				}
-				else if ( r_texturebits->integer == 32 )
-				{
-					internalFormat = GL_RGBA8;
-				}
-				else
-				{
-					internalFormat = GL_RGBA;
-				}
-			}
-		}
+	}
+
+	internalFormat = R_InternalFormat( samples, lightMap );
+	if ( cache ) {
+		cache->header.samples = samples;
 	}
 
 	// copy or resample data as appropriate for first MIP level
@@ -670,6 +1312,7 @@ static void Upload32( unsigned *data,
 		if (!mipmap)
 		{
 			qglTexImage2D (GL_TEXTURE_2D, 0, internalFormat, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+			R_CacheImageLevel( cache, data, scaled_width, scaled_height );
 			*pUploadWidth = scaled_width;
 			*pUploadHeight = scaled_height;
 			*format = internalFormat;
@@ -702,6 +1345,7 @@ static void Upload32( unsigned *data,
 	*format = internalFormat;
 
 	qglTexImage2D (GL_TEXTURE_2D, 0, internalFormat, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaledBuffer );
+	R_CacheImageLevel( cache, scaledBuffer, scaled_width, scaled_height );
 
 	if (mipmap)
 	{
@@ -724,29 +1368,11 @@ static void Upload32( unsigned *data,
 			}
 
 			qglTexImage2D (GL_TEXTURE_2D, miplevel, internalFormat, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaledBuffer );
+			R_CacheImageLevel( cache, scaledBuffer, scaled_width, scaled_height );
 		}
 	}
 done:
-
-	if (mipmap)
-	{
-		if ( glConfig.textureFilterAnisotropic )
-			qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT,
-					(GLint)Com_Clamp( 1, glConfig.maxAnisotropy, r_ext_max_anisotropy->integer ) );
-
-		qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gl_filter_min);
-		qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_filter_max);
-	}
-	else
-	{
-		if ( glConfig.textureFilterAnisotropic )
-			qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 1 );
-
-		qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-		qglTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-	}
-
-	GL_CheckErrors();
+	R_UploadFilter( mipmap );
 
 	if ( scaledBuffer != 0 )
 		ri.Hunk_FreeTempMemory( scaledBuffer );
@@ -757,16 +1383,15 @@ done:
 
 /*
 ================
-R_CreateImage
+R_AllocImage
 
-This is the only way any image_t are created
+Takes a free image slot and binds it for the upload
 ================
 */
-image_t *R_CreateImage( const char *name, const byte *pic, int width, int height, 
+static image_t *R_AllocImage( const char *name, int width, int height, 
 					   qboolean mipmap, qboolean allowPicmip, int glWrapClampMode ) {
 	image_t		*image = NULL;
 	qboolean	isLightmap = qfalse;
-	long		hash;
   int     i;
 
 	if (strlen(name) >= MAX_QPATH ) {
@@ -813,16 +1438,21 @@ image_t *R_CreateImage( const char *name, const byte *pic, int width, int height
 
 	GL_Bind(image);
 
-	Upload32( (unsigned *)pic, image->width, image->height, 
-								image->mipmap,
-								allowPicmip,
-								isLightmap,
-								&image->internalFormat,
-								&image->uploadWidth,
-								&image->uploadHeight );
+	return image;
+}
+
+/*
+================
+R_FinishImage
 
-	qglTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, glWrapClampMode );
-	qglTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, glWrapClampMode );
+Sets the wrap mode once the image is uploaded and makes it findable
+================
+*/
+static void R_FinishImage( image_t *image ) {
+	long		hash;
+
+	qglTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, image->wrapClampMode );
+	qglTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, image->wrapClampMode );
 
 	qglBindTexture( GL_TEXTURE_2D, 0 );
 
@@ -830,9 +1460,34 @@ image_t *R_CreateImage( const char *name, const byte *pic, int width, int height
 		GL_SelectTexture( 0 );
 	}
 
-	hash = generateHashValue(name);
+	hash = generateHashValue(image->imgName);
 	image->next = hashTable[hash];
 	hashTable[hash] = image;
+}
+
+/*
+================
+R_CreateImage
+
+This is the only way any image_t are created
+================
+*/
+image_t *R_CreateImage( const char *name, const byte *pic, int width, int height, 
+					   qboolean mipmap, qboolean allowPicmip, int glWrapClampMode ) {
+	image_t		*image;
+
+	image = R_AllocImage( name, width, height, mipmap, allowPicmip, glWrapClampMode );
+
+	Upload32( (unsigned *)pic, image->width, image->height, 
+								image->mipmap,
+								allowPicmip,
+								!strncmp( name, "*lightmap", 9 ),
+								&image->internalFormat,
+								&image->uploadWidth,
+								&image->uploadHeight,
+								NULL );
+
+	R_FinishImage( image );
 
 	return image;
 }
@@ -969,6 +1624,55 @@ void R_LoadImage( const char *name, byte **pic, int *width, int *height )
 }
 
 
+/*
+=================
+R_ImageFileName
+
+Finds the file R_LoadImage would load for name, without loading it
+=================
+*/
+qboolean R_ImageFileName( const char *name, char *fileName, int size )
+{
+	int i;
+	char localName[ MAX_QPATH ];
+	const char *ext;
+
+	Q_strncpyz( localName, name, MAX_QPATH );
+
+	ext = COM_GetExtension( localName );
+
+	if( *ext )
+	{
+		for( i = 0; i < numImageLoaders; i++ )
+		{
+			if( !Q_stricmp( ext, imageLoaders[ i ].ext ) )
+				break;
+		}
+
+		// A loader was found
+		if( i < numImageLoaders )
+		{
+			if( ri.FS_ReadFile( localName, NULL ) > 0 )
+			{
+				Q_strncpyz( fileName, localName, size );
+				return qtrue;
+			}
+
+			COM_StripExtension( name, localName, MAX_QPATH );
+		}
+	}
+
+	for( i = 0; i < numImageLoaders; i++ )
+	{
+		Com_sprintf( fileName, size, "%s.%s", localName, imageLoaders[ i ].ext );
+
+		if( ri.FS_ReadFile( fileName, NULL ) > 0 )
+			return qtrue;
+	}
+
+	return qfalse;
+}
+
 /*
 ===============
 R_FindImageFile
@@ -982,6 +1686,8 @@ image_t	*R_FindImageFile( const char *name, qboolean mipmap, qboolean allowPicmi
 	int		width, height;
 	byte	*pic;
 	long	hash;
+	imageCache_t		cache;
+	imageCacheHeader_t	*header;
 
 	if (!name) {
 		return NULL;
@@ -1010,16 +1716,53 @@ image_t	*R_FindImageFile( const char *name, qboolean mipmap, qboolean allowPicmi
 		}
 	}
 
+	if ( !r_imageCache->integer || ( mipmap && r_colorMipLevels->integer ) ||
+		!R_ImageCacheKey( name, mipmap, allowPicmip, &cache ) ) {
+		//
+		// load the pic from disk
+		//
+		R_LoadImage( name, &pic, &width, &height );
+		if ( pic == NULL ) {
+			return NULL;
+		}
+
+		image = R_CreateImage( ( char * ) name, pic, width, height, mipmap, allowPicmip, glWrapClampMode );
+		ri.Free( pic );
+		return image;
+	}
+
 	//
-	// load the pic from disk
+	// upload the cached levels if they are still good
 	//
-	R_LoadImage( name, &pic, &width, &height );
+	header = R_MapCachedImage( &cache );
+	if ( header ) {
+		image = R_AllocImage( name, header->width, header->height, mipmap, allowPicmip, glWrapClampMode );
+		UploadCached( header, mipmap, &image->internalFormat,
+			&image->uploadWidth, &image->uploadHeight );
+		R_FinishImage( image );
+
+		ri.FS_UnmapFile( header );
+		return image;
+	}
+
+	//
+	// otherwise process the file R_ImageCacheKey found and keep the levels
+	//
+	R_LoadImage( cache.fileName, &pic, &width, &height );
 	if ( pic == NULL ) {
 		return NULL;
 	}
 
-	image = R_CreateImage( ( char * ) name, pic, width, height, mipmap, allowPicmip, glWrapClampMode );
+	cache.header.width = width;
+	cache.header.height = height;
+
+	image = R_AllocImage( name, width, height, mipmap, allowPicmip, glWrapClampMode );
+	Upload32( (unsigned *)pic, width, height, mipmap, allowPicmip, qfalse,
+		&image->internalFormat, &image->uploadWidth, &image->uploadHeight, &cache );
+	R_FinishImage( image );
+
 	ri.Free( pic );
+	R_WriteCachedImage( &cache );
 	return image;
 }
 
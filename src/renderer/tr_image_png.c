@@ -21,7 +21,18 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "tr_local.h"
 
-#include "../qcommon/puff.h"
+#ifdef USE_LOCAL_HEADERS
+#include "../zlib/zlib.h"
+#else
+#include <zlib.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define PNG_SIMD 1
+#include <emmintrin.h>
+#else
+#define PNG_SIMD 0
+#endif
 
 // we could limit the png size to a lower value here
 #ifndef INT_MAX
@@ -501,52 +512,38 @@ static qboolean FindChunk(struct BufferedFile *BF, uint32_t ChunkType)
 }
 
 /*
- *  Decompress all IDATs
+ *  The IDAT chunks are streamed through zlib's inflate straight out of
+ *  the file buffer, one chunk at a time.
  */
 
-static uint32_t DecompressIDATs(struct BufferedFile *BF, uint8_t **Buffer)
+struct PNG_Inflater
 {
-	uint8_t  *DecompressedData;
-	uint32_t  DecompressedDataLength;
+	struct BufferedFile *BF;
+	z_stream             Stream;
+	uint32_t             ChunkBytesLeft;
+	qboolean             StreamEnd;
+};
 
-	uint8_t  *CompressedData;
-	uint8_t  *CompressedDataPtr;
-	uint32_t  CompressedDataLength;
+/*
+ *  Start inflating at the first IDAT chunk.
+ */
 
+static qboolean InitInflater(struct PNG_Inflater *Inflater, struct BufferedFile *BF)
+{
 	struct PNG_ChunkHeader *CH;
 
-	uint32_t Length;
-	uint32_t Type;
-
-	int BytesToRewind;
-
-	int32_t   puffResult;
-	uint8_t  *puffDest;
-	uint32_t  puffDestLen;
-	uint8_t  *puffSrc;
-	uint32_t  puffSrcLen;
-
 	/*
 	 *  input verification
 	 */
 
-	if(!(BF && Buffer))
+	if(!(Inflater && BF))
 	{
-		return(-1);
+		return(qfalse);
 	}
 
-	/*
-	 *  some zeroing
-	 */
-
-	DecompressedData = NULL;
-	DecompressedDataLength = 0;
-	*Buffer = DecompressedData;
+	memset(Inflater, 0, sizeof(struct PNG_Inflater));
 
-	CompressedData = NULL;
-	CompressedDataLength = 0;
-
-	BytesToRewind = 0;
+	Inflater->BF = BF;
 
 	/*
 	 *  Find the first IDAT chunk.
@@ -554,225 +551,182 @@ static uint32_t DecompressIDATs(struct BufferedFile *BF, uint8_t **Buffer)
 
 	if(!FindChunk(BF, PNG_ChunkType_IDAT))
 	{
-		return(-1);
+		return(qfalse);
 	}
 
+	CH = BufferedFileRead(BF, PNG_ChunkHeader_Size);
+	if(!CH)
+	{
+		return(qfalse);
+	}
+
+	Inflater->ChunkBytesLeft = BigLong(CH->Length);
+
 	/*
-	 *  Count the size of the uncompressed data
+	 *  The IDATs hold a zlib stream, zlib takes care of its header.
 	 */
 
-	while(qtrue)
+	if(inflateInit(&Inflater->Stream) != Z_OK)
 	{
-		/*
-		 *  Read chunk header
-		 */
+		return(qfalse);
+	}
 
-		CH = BufferedFileRead(BF, PNG_ChunkHeader_Size);
-		if(!CH)
-		{
-			/*
-			 *  Rewind to the start of this adventure
-			 *  and return unsuccessfull
-			 */
+	return(qtrue);
+}
 
-			BufferedFileRewind(BF, BytesToRewind);
+/*
+ *  Stop inflating.
+ */
 
-			return(-1);
-		}
+static void EndInflater(struct PNG_Inflater *Inflater)
+{
+	inflateEnd(&Inflater->Stream);
+}
 
-		/*
-		 *  Length and Type of chunk
-		 */
+/*
+ *  Hand the rest of the current IDAT chunk, or the next one, to inflate.
+ */
 
-		Length = BigLong(CH->Length);
-		Type   = BigLong(CH->Type);
+static qboolean NextInflaterInput(struct PNG_Inflater *Inflater)
+{
+	struct PNG_ChunkHeader *CH;
+	uint8_t *Data;
 
+	while(!Inflater->ChunkBytesLeft)
+	{
 		/*
-		 *  We have reached the end of the IDAT chunks
+		 *  Skip the CRC of the last chunk and look at the next one.
 		 */
 
-		if(!(Type == PNG_ChunkType_IDAT))
+		if(!BufferedFileSkip(Inflater->BF, PNG_ChunkCRC_Size))
 		{
-			BufferedFileRewind(BF, PNG_ChunkHeader_Size); 
-
-			break;
+			return(qfalse);
 		}
 
-		/*
-		 *  Add chunk header to count.
-		 */
-
-		BytesToRewind += PNG_ChunkHeader_Size;
+		CH = BufferedFileRead(Inflater->BF, PNG_ChunkHeader_Size);
+		if(!CH)
+		{
+			return(qfalse);
+		}
 
 		/*
-		 *  Skip to next chunk
+		 *  We have reached the end of the IDAT chunks
 		 */
 
-		if(Length)
+		if(!(BigLong(CH->Type) == PNG_ChunkType_IDAT))
 		{
-			if(!BufferedFileSkip(BF, Length + PNG_ChunkCRC_Size))
-			{
-				BufferedFileRewind(BF, BytesToRewind);
+			BufferedFileRewind(Inflater->BF, PNG_ChunkHeader_Size);
 
-				return(-1);
-			}
+			return(qfalse);
+		}
 
-			BytesToRewind += Length + PNG_ChunkCRC_Size;
-			CompressedDataLength += Length;
-		} 
+		Inflater->ChunkBytesLeft = BigLong(CH->Length);
 	}
 
-	BufferedFileRewind(BF, BytesToRewind);
-
-	CompressedData = ri.Malloc(CompressedDataLength);
-	if(!CompressedData)
+	Data = BufferedFileRead(Inflater->BF, Inflater->ChunkBytesLeft);
+	if(!Data)
 	{
-		return(-1);
+		return(qfalse);
 	}
 
-	CompressedDataPtr = CompressedData;
-
-	/*
-	 *  Collect the compressed Data
-	 */
-
-	while(qtrue)
-	{
-		/*
-		 *  Read chunk header
-		 */
-
-		CH = BufferedFileRead(BF, PNG_ChunkHeader_Size);
-		if(!CH)
-		{
-			ri.Free(CompressedData); 
-
-			return(-1);
-		}
-
-		/*
-		 *  Length and Type of chunk
-		 */
+	Inflater->Stream.next_in  = Data;
+	Inflater->Stream.avail_in = Inflater->ChunkBytesLeft;
 
-		Length = BigLong(CH->Length);
-		Type   = BigLong(CH->Type);
+	Inflater->ChunkBytesLeft = 0;
 
-		/*
-		 *  We have reached the end of the IDAT chunks
-		 */
+	return(qtrue);
+}
 
-		if(!(Type == PNG_ChunkType_IDAT))
-		{
-			BufferedFileRewind(BF, PNG_ChunkHeader_Size); 
+/*
+ *  Inflate the next Length bytes.
+ *
+ *  Returns the number of bytes inflated, which is only less than Length
+ *  at the end of the data, or -1 if the data is broken.
+ */
 
-			break;
-		}
+static int InflateBytes(struct PNG_Inflater *Inflater, uint8_t *Dest, uint32_t Length)
+{
+	int Result;
 
-		/*
-		 *  Copy the Data
-		 */
+	Inflater->Stream.next_out  = Dest;
+	Inflater->Stream.avail_out = Length;
 
-		if(Length)
+	while(Inflater->Stream.avail_out && !Inflater->StreamEnd)
+	{
+		if(!Inflater->Stream.avail_in)
 		{
-			uint8_t *OrigCompressedData;
-
-			OrigCompressedData = BufferedFileRead(BF, Length);
-			if(!OrigCompressedData)
+			if(!NextInflaterInput(Inflater))
 			{
-				ri.Free(CompressedData); 
-
-				return(-1);
+				break;
 			}
+		}
 
-			if(!BufferedFileSkip(BF, PNG_ChunkCRC_Size))
-			{
-				ri.Free(CompressedData); 
-
-				return(-1);
-			}
+		Result = inflate(&Inflater->Stream, Z_NO_FLUSH);
 
-			memcpy(CompressedDataPtr, OrigCompressedData, Length);
-			CompressedDataPtr += Length;
-		} 
+		if(Result == Z_STREAM_END)
+		{
+			Inflater->StreamEnd = qtrue;
+		}
+		else if(Result != Z_OK)
+		{
+			return(-1);
+		}
 	}
 
-	/*
-	 *  Let puff() calculate the decompressed data length.
-	 */
-
-	puffDest    = NULL;
-	puffDestLen = 0;
+	return(Length - Inflater->Stream.avail_out);
+}
 
-	/*
-	 *  The zlib header and checkvalue don't belong to the compressed data.
-	 */
+/*
+ *  Decompress all IDATs
+ *
+ *  Only the interlaced images need all of the data at once,
+ *  and they know exactly how much of it there is.
+ */
 
-	puffSrc    = CompressedData + PNG_ZlibHeader_Size;
-	puffSrcLen = CompressedDataLength - PNG_ZlibHeader_Size - PNG_ZlibCheckValue_Size;
+static uint32_t DecompressIDATs(struct PNG_Inflater *Inflater, uint32_t Length, uint8_t **Buffer)
+{
+	uint8_t  *DecompressedData;
+	uint8_t   Extra;
+	int       Inflated;
 
 	/*
-	 *  first puff() to calculate the size of the uncompressed data
+	 *  input verification
 	 */
 
-	puffResult = puff(puffDest, &puffDestLen, puffSrc, &puffSrcLen);
-	if(!((puffResult == 0) && (puffDestLen > 0)))
+	if(!(Inflater && Length && Buffer))
 	{
-		ri.Free(CompressedData);
-
-		return(-1);
+		return(0);
 	}
 
-	/*
-	 *  Allocate the buffer for the uncompressed data.
-	 */
+	*Buffer = NULL;
 
-	DecompressedData = ri.Malloc(puffDestLen);
+	DecompressedData = ri.Malloc(Length);
 	if(!DecompressedData)
 	{
-		ri.Free(CompressedData);
-
-		return(-1);
+		return(0);
 	}
 
-	/*
-	 *  Set the input again in case something was changed by the last puff() .
-	 */
-
-	puffDest   = DecompressedData;
-	puffSrc    = CompressedData + PNG_ZlibHeader_Size;
-	puffSrcLen = CompressedDataLength - PNG_ZlibHeader_Size - PNG_ZlibCheckValue_Size;
+	Inflated = InflateBytes(Inflater, DecompressedData, Length);
 
 	/*
-	 *  decompression puff()
+	 *  Data past the end of the image means it is broken.
 	 */
 
-	puffResult = puff(puffDest, &puffDestLen, puffSrc, &puffSrcLen);
-
-	/*
-	 *  The compressed data is not needed anymore.
-	 */
-
-	ri.Free(CompressedData);
-
-	/*
-	 *  Check if the last puff() was successfull.
-	 */
+	if(Inflated == (int) Length && InflateBytes(Inflater, &Extra, 1))
+	{
+		Inflated = -1;
+	}
 
-	if(!((puffResult == 0) && (puffDestLen > 0)))
+	if(Inflated < 0)
 	{
 		ri.Free(DecompressedData);
 
-		return(-1);
+		return(0);
 	}
 
-	/*
-	 *  Set the output of this function.
-	 */
-
-	DecompressedDataLength = puffDestLen;
 	*Buffer = DecompressedData;
 
-	return(DecompressedDataLength);
+	return(Inflated);
 }
 
 /*
@@ -815,178 +769,316 @@ static uint8_t PredictPaeth(uint8_t a, uint8_t b, uint8_t c)
 
 }
 
+#if PNG_SIMD
+
 /*
- *  Reverse the filters.
+ *  The Average and Paeth filters depend on the pixel to the left, so
+ *  the SIMD versions work on the bytes of one pixel at a time.
+ *  Only 3 and 4 bytes per pixel, 8 bit RGB and RGBA, are worth it.
+ *  They are inlined with a constant BytesPerPixel so the pixel loads
+ *  and stores become single moves.
  */
 
-static qboolean UnfilterImage(uint8_t  *DecompressedData, 
-		uint32_t  ImageHeight,
-		uint32_t  BytesPerScanline, 
-		uint32_t  BytesPerPixel)
+static ID_INLINE __m128i LoadPixel(const uint8_t *Pixel, uint32_t BytesPerPixel)
 {
-	uint8_t   *DecompPtr;
-	uint8_t   FilterType;
-	uint8_t  *PixelLeft, *PixelUp, *PixelUpLeft;
-	uint32_t  w, h, p;
+	int Value = 0;
 
-	/*
-	 *  some zeros for the filters
-	 */
+	memcpy(&Value, Pixel, BytesPerPixel);
 
-	uint8_t Zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	return(_mm_cvtsi32_si128(Value));
+}
 
-	/*
-	 *  input verification
-	 */
+static ID_INLINE void StorePixel(uint8_t *Pixel, __m128i Value, uint32_t BytesPerPixel)
+{
+	int Packed = _mm_cvtsi128_si32(Value);
 
-	if(!(DecompressedData && BytesPerPixel))
-	{
-		return(qfalse);
-	}
+	memcpy(Pixel, &Packed, BytesPerPixel);
+}
 
-	/*
-	 *  ImageHeight and BytesPerScanline can be zero in small interlaced images.
-	 */
+static ID_INLINE void UnfilterAverageSIMD(uint8_t *Row, const uint8_t *PrevRow,
+		uint32_t BytesPerScanline, uint32_t BytesPerPixel)
+{
+	__m128i a, b, d, Avg;
+	__m128i One = _mm_set1_epi8(1);
+	uint32_t i;
 
-	if((!ImageHeight) || (!BytesPerScanline))
+	a = _mm_setzero_si128();
+
+	for(i = 0; i < BytesPerScanline; i += BytesPerPixel)
 	{
-		return(qtrue);
-	}
+		b = LoadPixel(PrevRow + i, BytesPerPixel);
 
-	/*
-	 *  Set the pointer to the start of the decompressed Data.
-	 */
+		/*
+		 *  _mm_avg_epu8 rounds up, the filter rounds down.
+		 */
 
-	DecompPtr = DecompressedData;
+		Avg = _mm_avg_epu8(a, b);
+		Avg = _mm_sub_epi8(Avg, _mm_and_si128(_mm_xor_si128(a, b), One));
 
-	/*
-	 *  Un-filtering is done in place.
-	 */
+		d = _mm_add_epi8(LoadPixel(Row + i, BytesPerPixel), Avg);
+		StorePixel(Row + i, d, BytesPerPixel);
+
+		a = d;
+	}
+}
+
+static ID_INLINE void UnfilterPaethSIMD(uint8_t *Row, const uint8_t *PrevRow,
+		uint32_t BytesPerScanline, uint32_t BytesPerPixel)
+{
+	__m128i a, b, c, d, pa, pb, pc, Smallest, Nearest;
+	__m128i Zero = _mm_setzero_si128();
+	uint32_t i;
 
 	/*
-	 *  Go trough all scanlines.
+	 *  16 bit lanes, a + b - c does not fit into a byte.
 	 */
 
-	for(h = 0; h < ImageHeight; h++)
+	b = d = Zero;
+
+	for(i = 0; i < BytesPerScanline; i += BytesPerPixel)
 	{
+		c = b;
+		b = _mm_unpacklo_epi8(LoadPixel(PrevRow + i, BytesPerPixel), Zero);
+		a = d;
+		d = _mm_unpacklo_epi8(LoadPixel(Row + i, BytesPerPixel), Zero);
+
 		/*
-		 *  Every scanline starts with a FilterType byte.
+		 *  p - a == b - c, p - b == a - c, p - c == (b - c) + (a - c)
 		 */
 
-		FilterType = *DecompPtr;
-		DecompPtr++;
+		pa = _mm_sub_epi16(b, c);
+		pb = _mm_sub_epi16(a, c);
+		pc = _mm_add_epi16(pa, pb);
+
+		pa = _mm_max_epi16(pa, _mm_sub_epi16(Zero, pa));
+		pb = _mm_max_epi16(pb, _mm_sub_epi16(Zero, pb));
+		pc = _mm_max_epi16(pc, _mm_sub_epi16(Zero, pc));
+
+		Smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
 
 		/*
-		 *  Left pixel of the first byte in a scanline is zero.
+		 *  a if pa is the smallest, else b if pb is, else c
 		 */
 
-		PixelLeft = Zeros;
+		Nearest = _mm_cmpeq_epi16(Smallest, pb);
+		Nearest = _mm_or_si128(_mm_and_si128(Nearest, b), _mm_andnot_si128(Nearest, c));
+		pa = _mm_cmpeq_epi16(Smallest, pa);
+		Nearest = _mm_or_si128(_mm_and_si128(pa, a), _mm_andnot_si128(pa, Nearest));
 
 		/*
-		 *  Set PixelUp to previous line only if we are on the second line or above.
-		 *
-		 *  Plus one byte for the FilterType
+		 *  Byte adds keep the sum modulo 256 and the high bytes zero.
 		 */
 
-		if(h > 0)
-		{
-			PixelUp = DecompPtr - (BytesPerScanline + 1);
-		}
-		else
+		d = _mm_add_epi8(d, Nearest);
+		StorePixel(Row + i, _mm_packus_epi16(d, d), BytesPerPixel);
+	}
+}
+
+#endif
+
+/*
+ *  Reverse the filter of a scanline in place.
+ *
+ *  PrevRow is the unfiltered scanline above, NULL for the first one.
+ */
+
+static qboolean UnfilterScanline(uint8_t   FilterType,
+		uint8_t  *Row,
+		const uint8_t *PrevRow,
+		uint32_t  BytesPerScanline,
+		uint32_t  BytesPerPixel)
+{
+	uint32_t i;
+
+	/*
+	 *  The scanline above the first one is all zeros.
+	 */
+
+	if(!PrevRow)
+	{
+		switch(FilterType)
 		{
-			PixelUp = Zeros;
-		}
+			case PNG_FilterType_Up :
+			{
+				FilterType = PNG_FilterType_None;
 
-		/*
-		 * The pixel left to the first pixel of the previous scanline is zero too.
-		 */
+				break;
+			}
 
-		PixelUpLeft = Zeros;
+			case PNG_FilterType_Paeth :
+			{
+				FilterType = PNG_FilterType_Sub;
 
-		/*
-		 *  Cycle trough all pixels of the scanline.
-		 */
+				break;
+			}
 
-		for(w = 0; w < (BytesPerScanline / BytesPerPixel); w++)
+			case PNG_FilterType_Average :
+			{
+				for(i = BytesPerPixel; i < BytesPerScanline; i++)
+				{
+					Row[i] += Row[i - BytesPerPixel] / 2;
+				}
+
+				return(qtrue);
+			}
+		}
+	}
+
+	switch(FilterType)
+	{
+		case PNG_FilterType_None :
 		{
 			/*
-			 *  Cycle trough the bytes of the pixel.
+			 *  The bytes are unfiltered.
 			 */
 
-			for(p = 0; p < BytesPerPixel; p++)
-			{
-				switch(FilterType)
-				{ 
-					case PNG_FilterType_None :
-					{
-						/*
-						 *  The byte is unfiltered.
-						 */
-
-						break;
-					}
+			break;
+		}
 
-					case PNG_FilterType_Sub :
-					{
-						DecompPtr[p] += PixelLeft[p];
+		case PNG_FilterType_Sub :
+		{
+			for(i = BytesPerPixel; i < BytesPerScanline; i++)
+			{
+				Row[i] += Row[i - BytesPerPixel];
+			}
 
-						break;
-					}
+			break;
+		}
 
-					case PNG_FilterType_Up :
-					{
-						DecompPtr[p] += PixelUp[p];
+		case PNG_FilterType_Up :
+		{
+			for(i = 0; i < BytesPerScanline; i++)
+			{
+				Row[i] += PrevRow[i];
+			}
 
-						break;
-					}
+			break;
+		}
 
-					case PNG_FilterType_Average :
-					{
-						DecompPtr[p] += ((uint8_t) ((((uint16_t) PixelLeft[p]) + ((uint16_t) PixelUp[p])) / 2));
+		case PNG_FilterType_Average :
+		{
+#if PNG_SIMD
+			if(BytesPerPixel == 4)
+			{
+				UnfilterAverageSIMD(Row, PrevRow, BytesPerScanline, 4);
 
-						break;
-					}
+				break;
+			}
 
-					case PNG_FilterType_Paeth :
-					{
-						DecompPtr[p] += PredictPaeth(PixelLeft[p], PixelUp[p], PixelUpLeft[p]);
+			if(BytesPerPixel == 3)
+			{
+				UnfilterAverageSIMD(Row, PrevRow, BytesPerScanline, 3);
 
-						break;
-					}
+				break;
+			}
+#endif
 
-					default :
-					{
-						return(qfalse);
-					}
-				}
+			for(i = 0; (i < BytesPerPixel) && (i < BytesPerScanline); i++)
+			{
+				Row[i] += PrevRow[i] / 2;
 			}
 
-			PixelLeft = DecompPtr;
+			for(; i < BytesPerScanline; i++)
+			{
+				Row[i] += (uint8_t) ((((uint16_t) Row[i - BytesPerPixel]) + ((uint16_t) PrevRow[i])) / 2);
+			}
 
-			/*
-			 *  We only have a upleft pixel if we are on the second line or above.
-			 */
+			break;
+		}
 
-			if(h > 0)
+		case PNG_FilterType_Paeth :
+		{
+#if PNG_SIMD
+			if(BytesPerPixel == 4)
 			{
-				PixelUpLeft = DecompPtr - (BytesPerScanline + 1);
+				UnfilterPaethSIMD(Row, PrevRow, BytesPerScanline, 4);
+
+				break;
 			}
 
-			/*
-			 *  Skip to the next pixel.
-			 */
+			if(BytesPerPixel == 3)
+			{
+				UnfilterPaethSIMD(Row, PrevRow, BytesPerScanline, 3);
 
-			DecompPtr += BytesPerPixel;
+				break;
+			}
+#endif
 
 			/*
-			 *  We only have a previous line if we are on the second line and above.
+			 *  Left and UpLeft of the first pixel are zero.
 			 */
 
-			if(h > 0)
+			for(i = 0; (i < BytesPerPixel) && (i < BytesPerScanline); i++)
 			{
-				PixelUp = DecompPtr - (BytesPerScanline + 1);
+				Row[i] += PrevRow[i];
 			}
+
+			for(; i < BytesPerScanline; i++)
+			{
+				Row[i] += PredictPaeth(Row[i - BytesPerPixel], PrevRow[i], PrevRow[i - BytesPerPixel]);
+			}
+
+			break;
+		}
+
+		default :
+		{
+			return(qfalse);
+		}
+	}
+
+	return(qtrue);
+}
+
+/*
+ *  Reverse the filters.
+ */
+
+static qboolean UnfilterImage(uint8_t  *DecompressedData, 
+		uint32_t  ImageHeight,
+		uint32_t  BytesPerScanline, 
+		uint32_t  BytesPerPixel)
+{
+	uint8_t   *DecompPtr;
+	uint8_t   *PrevRow;
+	uint32_t  h;
+
+	/*
+	 *  input verification
+	 */
+
+	if(!(DecompressedData && BytesPerPixel))
+	{
+		return(qfalse);
+	}
+
+	/*
+	 *  ImageHeight and BytesPerScanline can be zero in small interlaced images.
+	 */
+
+	if((!ImageHeight) || (!BytesPerScanline))
+	{
+		return(qtrue);
+	}
+
+	/*
+	 *  Un-filtering is done in place.
+	 *
+	 *  Every scanline starts with a FilterType byte.
+	 */
+
+	DecompPtr = DecompressedData;
+	PrevRow = NULL;
+
+	for(h = 0; h < ImageHeight; h++)
+	{
+		if(!UnfilterScanline(DecompPtr[0], DecompPtr + 1, PrevRow, BytesPerScanline, BytesPerPixel))
+		{
+			return(qfalse);
 		}
+
+		PrevRow = DecompPtr + 1;
+		DecompPtr += BytesPerScanline + 1;
 	}
 
 	return(qtrue);
@@ -1251,14 +1343,102 @@ static qboolean ConvertPixel(struct PNG_Chunk_IHDR *IHDR,
 }
 
 
+/*
+ *  Convert an unfiltered scanline to the Quake 3 RGBA format.
+ */
+
+static qboolean ConvertScanline(struct PNG_Chunk_IHDR *IHDR,
+		byte                  *OutPtr,
+		uint8_t               *Row,
+		uint32_t               Width,
+		uint32_t               BytesPerScanline,
+		uint32_t               BytesPerPixel,
+		uint32_t               PixelsPerByte,
+		qboolean               HasTransparentColour,
+		uint8_t               *TransparentColour,
+		uint8_t               *OutPal)
+{
+	uint32_t w, p;
+
+	/*
+	 *  8 bit RGB without a transparent colour is by far the most common
+	 *  case that needs converting, expand it directly.
+	 */
+
+	if((IHDR->ColourType == PNG_ColourType_True) && (IHDR->BitDepth == PNG_BitDepth_8) && !HasTransparentColour)
+	{
+		for(w = 0; w < Width; w++)
+		{
+			OutPtr[0] = Row[0];
+			OutPtr[1] = Row[1];
+			OutPtr[2] = Row[2];
+			OutPtr[3] = 0xFF;
+
+			OutPtr += Q3IMAGE_BYTESPERPIXEL;
+			Row += 3;
+		}
+
+		return(qtrue);
+	}
+
+	/*
+	 *  Count the pixels on the scanline for those multipixel bytes
+	 */
+
+	for(w = 0; w < (BytesPerScanline / BytesPerPixel); w++)
+	{
+		if(PixelsPerByte > 1)
+		{
+			uint8_t  Mask;
+			uint32_t Shift;
+			uint8_t  SinglePixel;
+
+			for(p = 0; p < PixelsPerByte; p++)
+			{
+				if(w * PixelsPerByte + p < Width)
+				{
+					Mask  = (1 << IHDR->BitDepth) - 1;
+					Shift = (PixelsPerByte - 1 - p) * IHDR->BitDepth;
+
+					SinglePixel = ((Row[0] & (Mask << Shift)) >> Shift);
+
+					if(!ConvertPixel(IHDR, OutPtr, &SinglePixel, HasTransparentColour, TransparentColour, OutPal))
+					{
+						return(qfalse);
+					}
+
+					OutPtr += Q3IMAGE_BYTESPERPIXEL;
+				}
+			}
+
+		}
+		else
+		{
+			if(!ConvertPixel(IHDR, OutPtr, Row, HasTransparentColour, TransparentColour, OutPal))
+			{
+				return(qfalse);
+			}
+
+
+			OutPtr += Q3IMAGE_BYTESPERPIXEL;
+		}
+
+		Row += BytesPerPixel;
+	}
+
+	return(qtrue);
+}
+
 /*
  *  Decode a non-interlaced image.
+ *
+ *  The scanlines are inflated, unfiltered and converted one at a time,
+ *  without ever holding all of the decompressed data.
  */
 
 static qboolean DecodeImageNonInterlaced(struct PNG_Chunk_IHDR *IHDR,
 		byte                  *OutBuffer, 
-		uint8_t               *DecompressedData,
-		uint32_t               DecompressedDataLength,
+		struct PNG_Inflater   *Inflater,
 		qboolean               HasTransparentColour,
 		uint8_t               *TransparentColour,
 		uint8_t               *OutPal)
@@ -1266,15 +1446,17 @@ static qboolean DecodeImageNonInterlaced(struct PNG_Chunk_IHDR *IHDR,
 	uint32_t IHDR_Width;
 	uint32_t IHDR_Height;
 	uint32_t BytesPerScanline, BytesPerPixel, PixelsPerByte;
-	uint32_t  w, h, p;
+	uint32_t h;
 	byte *OutPtr;
-	uint8_t *DecompPtr;
+	uint8_t *Rows, *Row, *PrevRow;
+	uint8_t FilterType;
+	qboolean Success;
 
 	/*
 	 *  input verification
 	 */
 
-	if(!(IHDR && OutBuffer && DecompressedData && DecompressedDataLength && TransparentColour && OutPal))
+	if(!(IHDR && OutBuffer && Inflater && TransparentColour && OutPal))
 	{
 		return(qfalse);
 	}
@@ -1434,98 +1616,84 @@ static qboolean DecodeImageNonInterlaced(struct PNG_Chunk_IHDR *IHDR,
 	BytesPerScanline = (IHDR_Width * BytesPerPixel + (PixelsPerByte - 1)) / PixelsPerByte;
 
 	/*
-	 *  Check if we have enough data for the whole image.
+	 *  8 bit RGBA scanlines are the output format already, so they are
+	 *  inflated and unfiltered right where they belong.
 	 */
 
-	if(!(DecompressedDataLength == ((BytesPerScanline + 1) * IHDR_Height)))
+	if((IHDR->ColourType == PNG_ColourType_TrueAlpha) && (IHDR->BitDepth == PNG_BitDepth_8))
 	{
-		return(qfalse);
+		OutPtr = OutBuffer;
+		PrevRow = NULL;
+
+		for(h = 0; h < IHDR_Height; h++)
+		{
+			if(!((InflateBytes(Inflater, &FilterType, 1) == 1) &&
+				(InflateBytes(Inflater, OutPtr, BytesPerScanline) == (int) BytesPerScanline)))
+			{
+				return(qfalse);
+			}
+
+			if(!UnfilterScanline(FilterType, OutPtr, PrevRow, BytesPerScanline, BytesPerPixel))
+			{
+				return(qfalse);
+			}
+
+			PrevRow = OutPtr;
+			OutPtr += BytesPerScanline;
+		}
+
+		return(qtrue);
 	}
 
 	/*
-	 *  Unfilter the image.
+	 *  Everything else goes through two scanline buffers,
+	 *  the current one and the one above.
 	 */
 
-	if(!UnfilterImage(DecompressedData, IHDR_Height, BytesPerScanline, BytesPerPixel))
+	Rows = ri.Malloc(2 * BytesPerScanline);
+	if(!Rows)
 	{
 		return(qfalse);
 	}
 
-	/*
-	 *  Set the working pointers to the beginning of the buffers.
-	 */
-
 	OutPtr = OutBuffer;
-	DecompPtr = DecompressedData;
-
-	/*
-	 *  Create the output image.
-	 */
+	PrevRow = NULL;
+	Success = qtrue;
 
 	for(h = 0; h < IHDR_Height; h++)
 	{
-		/*
-		 *  Count the pixels on the scanline for those multipixel bytes
-		 */
-
-		uint32_t CurrPixel;
-
-		/*
-		 *  skip FilterType
-		 */
-
-		DecompPtr++;
-
-		/*
-		 *  Reset the pixel count.
-		 */
-
-		CurrPixel = 0;
+		Row = Rows + (h & 1) * BytesPerScanline;
 
-		for(w = 0; w < (BytesPerScanline / BytesPerPixel); w++)
+		if(!((InflateBytes(Inflater, &FilterType, 1) == 1) &&
+			(InflateBytes(Inflater, Row, BytesPerScanline) == (int) BytesPerScanline)))
 		{
-			if(PixelsPerByte > 1)
-			{
-				uint8_t  Mask;
-				uint32_t Shift;
-				uint8_t  SinglePixel;
-
-				for(p = 0; p < PixelsPerByte; p++)
-				{
-					if(CurrPixel < IHDR_Width)
-					{
-						Mask  = (1 << IHDR->BitDepth) - 1;
-						Shift = (PixelsPerByte - 1 - p) * IHDR->BitDepth;
-
-						SinglePixel = ((DecompPtr[0] & (Mask << Shift)) >> Shift);
-
-						if(!ConvertPixel(IHDR, OutPtr, &SinglePixel, HasTransparentColour, TransparentColour, OutPal))
-						{
-							return(qfalse);
-						}
+			Success = qfalse;
 
-						OutPtr += Q3IMAGE_BYTESPERPIXEL;
-						CurrPixel++;
-					}
-				}
+			break;
+		}
 
-			}
-			else
-			{
-				if(!ConvertPixel(IHDR, OutPtr, DecompPtr, HasTransparentColour, TransparentColour, OutPal))
-				{
-					return(qfalse);
-				}
+		if(!UnfilterScanline(FilterType, Row, PrevRow, BytesPerScanline, BytesPerPixel))
+		{
+			Success = qfalse;
 
+			break;
+		}
 
-				OutPtr += Q3IMAGE_BYTESPERPIXEL;
-			}
+		if(!ConvertScanline(IHDR, OutPtr, Row, IHDR_Width, BytesPerScanline, BytesPerPixel, PixelsPerByte,
+				HasTransparentColour, TransparentColour, OutPal))
+		{
+			Success = qfalse;
 
-			DecompPtr += BytesPerPixel;
+			break;
 		}
+
+		PrevRow = Row;
+		OutPtr += IHDR_Width * Q3IMAGE_BYTESPERPIXEL;
 	}
 
-	return(qtrue);
+	ri.Free(Rows);
+
+	return(Success);
 }
 
 /*
@@ -1534,8 +1702,7 @@ static qboolean DecodeImageNonInterlaced(struct PNG_Chunk_IHDR *IHDR,
 
 static qboolean DecodeImageInterlaced(struct PNG_Chunk_IHDR *IHDR,
 		byte                  *OutBuffer, 
-		uint8_t               *DecompressedData,
-		uint32_t               DecompressedDataLength,
+		struct PNG_Inflater   *Inflater,
 		qboolean               HasTransparentColour,
 		uint8_t               *TransparentColour,
 		uint8_t               *OutPal)
@@ -1547,6 +1714,8 @@ static qboolean DecodeImageInterlaced(struct PNG_Chunk_IHDR *IHDR,
 	uint32_t WSkip[PNG_Adam7_NumPasses], WOffset[PNG_Adam7_NumPasses], HSkip[PNG_Adam7_NumPasses], HOffset[PNG_Adam7_NumPasses];
 	uint32_t w, h, p, a;
 	byte *OutPtr;
+	uint8_t *DecompressedData;
+	uint32_t DecompressedDataLength;
 	uint8_t *DecompPtr;
 	uint32_t TargetLength;
 
@@ -1554,7 +1723,7 @@ static qboolean DecodeImageInterlaced(struct PNG_Chunk_IHDR *IHDR,
 	 *  input verification
 	 */
 
-	if(!(IHDR && OutBuffer && DecompressedData && DecompressedDataLength && TransparentColour && OutPal))
+	if(!(IHDR && OutBuffer && Inflater && TransparentColour && OutPal))
 	{
 		return(qfalse);
 	}
@@ -1791,12 +1960,25 @@ static qboolean DecodeImageInterlaced(struct PNG_Chunk_IHDR *IHDR,
 		TargetLength += ((BytesPerScanline[a] + (BytesPerScanline[a] ? 1 : 0)) * PassHeight[a]);
 	}
 
+	/*
+	 *  The passes are scattered over the whole image,
+	 *  so they are inflated in one go.
+	 */
+
+	DecompressedDataLength = DecompressIDATs(Inflater, TargetLength, &DecompressedData);
+	if(!(DecompressedDataLength && DecompressedData))
+	{
+		return(qfalse);
+	}
+
 	/*
 	 *  Check if we have enough data for the whole image.
 	 */
 
 	if(!(DecompressedDataLength == TargetLength))
 	{
+		ri.Free(DecompressedData);
+
 		return(qfalse);
 	}
 
@@ -1810,6 +1992,8 @@ static qboolean DecodeImageInterlaced(struct PNG_Chunk_IHDR *IHDR,
 	{
 		if(!UnfilterImage(DecompPtr, PassHeight[a], BytesPerScanline[a], BytesPerPixel))
 		{
+			ri.Free(DecompressedData);
+
 			return(qfalse);
 		}
 
@@ -1873,6 +2057,8 @@ static qboolean DecodeImageInterlaced(struct PNG_Chunk_IHDR *IHDR,
 
 							if(!ConvertPixel(IHDR, OutPtr, &SinglePixel, HasTransparentColour, TransparentColour, OutPal))
 							{
+								ri.Free(DecompressedData);
+
 								return(qfalse);
 							}
 
@@ -1887,6 +2073,8 @@ static qboolean DecodeImageInterlaced(struct PNG_Chunk_IHDR *IHDR,
 
 					if(!ConvertPixel(IHDR, OutPtr, DecompPtr, HasTransparentColour, TransparentColour, OutPal))
 					{
+						ri.Free(DecompressedData);
+
 						return(qfalse);
 					}
 				}
@@ -1896,6 +2084,8 @@ static qboolean DecodeImageInterlaced(struct PNG_Chunk_IHDR *IHDR,
 		}
 	}
 
+	ri.Free(DecompressedData);
+
 	return(qtrue);
 }
 
@@ -1916,8 +2106,7 @@ void R_LoadPNG(const char *name, byte **pic, int *width, int *height)
 	uint32_t IHDR_Height;
 	PNG_ChunkCRC *CRC;
 	uint8_t *InPal;
-	uint8_t *DecompressedData;
-	uint32_t DecompressedDataLength;
+	struct PNG_Inflater Inflater;
 	uint32_t i;
 
 	/*
@@ -2386,11 +2575,10 @@ void R_LoadPNG(const char *name, byte **pic, int *width, int *height)
 	}
 
 	/*
-	 *  Decompress all IDAT chunks
+	 *  Start inflating the IDAT chunks.
 	 */
 
-	DecompressedDataLength = DecompressIDATs(ThePNG, &DecompressedData);
-	if(!(DecompressedDataLength && DecompressedData))
+	if(!InitInflater(&Inflater, ThePNG))
 	{
 		CloseBufferedFile(ThePNG);
 
@@ -2404,7 +2592,7 @@ void R_LoadPNG(const char *name, byte **pic, int *width, int *height)
 	OutBuffer = ri.Malloc(IHDR_Width * IHDR_Height * Q3IMAGE_BYTESPERPIXEL); 
 	if(!OutBuffer)
 	{
-		ri.Free(DecompressedData); 
+		EndInflater(&Inflater);
 		CloseBufferedFile(ThePNG);
 
 		return;  
@@ -2418,10 +2606,10 @@ void R_LoadPNG(const char *name, byte **pic, int *width, int *height)
 	{
 		case PNG_InterlaceMethod_NonInterlaced :
 		{
-			if(!DecodeImageNonInterlaced(IHDR, OutBuffer, DecompressedData, DecompressedDataLength, HasTransparentColour, TransparentColour, OutPal))
+			if(!DecodeImageNonInterlaced(IHDR, OutBuffer, &Inflater, HasTransparentColour, TransparentColour, OutPal))
 			{
 				ri.Free(OutBuffer); 
-				ri.Free(DecompressedData); 
+				EndInflater(&Inflater);
 				CloseBufferedFile(ThePNG);
 
 				return;
@@ -2432,10 +2620,10 @@ void R_LoadPNG(const char *name, byte **pic, int *width, int *height)
 
 		case PNG_InterlaceMethod_Interlaced :
 		{
-			if(!DecodeImageInterlaced(IHDR, OutBuffer, DecompressedData, DecompressedDataLength, HasTransparentColour, TransparentColour, OutPal))
+			if(!DecodeImageInterlaced(IHDR, OutBuffer, &Inflater, HasTransparentColour, TransparentColour, OutPal))
 			{
 				ri.Free(OutBuffer); 
-				ri.Free(DecompressedData); 
+				EndInflater(&Inflater);
 				CloseBufferedFile(ThePNG);
 
 				return;
@@ -2447,7 +2635,7 @@ void R_LoadPNG(const char *name, byte **pic, int *width, int *height)
 		default :
 		{
 			ri.Free(OutBuffer); 
-			ri.Free(DecompressedData); 
+			EndInflater(&Inflater);
 			CloseBufferedFile(ThePNG);
 
 			return;
@@ -2475,10 +2663,10 @@ void R_LoadPNG(const char *name, byte **pic, int *width, int *height)
 	}
 
 	/*
-	 *  DecompressedData is not needed anymore.
+	 *  The inflater is not needed anymore.
 	 */
 
-	ri.Free(DecompressedData); 
+	EndInflater(&Inflater);
 
 	/*
 	 *  We have all data, so close the file.
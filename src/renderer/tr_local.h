@@ -1106,6 +1106,8 @@ extern	cvar_t	*r_mapOverBrightBits;
 
 extern	cvar_t	*r_debugSurface;
 extern	cvar_t	*r_simpleMipMaps;
+extern	cvar_t	*r_imageCache;		// keep processed mip chains below the homepath
+extern	cvar_t	*r_imageSimd;
 
 extern	cvar_t	*r_showImages;
 extern	cvar_t	*r_debugSort;
@@ -1216,6 +1218,7 @@ model_t		*R_AllocModel( void );
 
 void    	R_Init( void );
 image_t		*R_FindImageFile( const char *name, qboolean mipmap, qboolean allowPicmip, int glWrapClampMode );
+qboolean	R_ImageFileName( const char *name, char *fileName, int size );
 
 image_t		*R_CreateImage( const char *name, const byte *pic, int width, int height, qboolean mipmap,
             qboolean allowPicmip, int wrapClampMode );
@@ -1226,6 +1229,8 @@ void		R_SetColorMappings( void );
 void		R_GammaCorrect( byte *buffer, int bufSize );
 
 void	R_ImageList_f( void );
+void	R_PNGBench_f( void );
+void	R_ImageSimd_f( void );
 void	R_SkinList_f( void );
 // https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=516
 const void *RB_TakeScreenshotCmd( const void *data );
@@ -1255,6 +1260,7 @@ shader_t	*R_FindShader( const char *name, int lightmapIndex, qboolean mipRawImag
 shader_t	*R_GetShaderByHandle( qhandle_t hShader );
 shader_t	*R_GetShaderByState( int index, long *cycleTime );
 shader_t *R_FindShaderByName( const char *name );
+void		R_PrefetchShaders( const dshader_t *shaders, int count );
 void		R_InitShaders( void );
 void		R_ShaderList_f( void );
 void    R_RemapShader(const char *oldShader, const char *newShader, const char *timeOffset);
@@ -156,7 +156,12 @@ typedef struct {
 	// NULL can be passed for buf to just determine existance
 	int		(*FS_FileIsInPAK)( const char *name, int *pCheckSum );
 	int		(*FS_ReadFile)( const char *name, void **buf );
+	int		(*FS_FileStamp)( const char *name, int *stamp );
 	void	(*FS_FreeFile)( void *buf );
+	int		(*FS_MapFile)( const char *name, void **buf );	// read-only buf
+	int		(*FS_MapHomeFile)( const char *name, void **buf );	// read-only buf
+	void	(*FS_UnmapFile)( void *buf );
+	void	(*FS_PrefetchFiles)( const char **names, int count );
 	char **	(*FS_ListFiles)( const char *name, const char *extension, int *numfilesfound );
 	void	(*FS_FreeFileList)( char **filelist );
 	void	(*FS_WriteFile)( const char *qpath, const void *buffer, int size );
@@ -2365,6 +2365,87 @@ static char *FindShaderInShaderText( const char *shadername ) {
 }
 
 
+/*
+==================
+R_PrefetchShaders
+
+Collects the images the given shaders are going to load and has the
+filesystem read them ahead on its worker threads
+==================
+*/
+#define	MAX_PREFETCH_IMAGES	1024
+
+void R_PrefetchShaders( const dshader_t *shaders, int count ) {
+	static char	images[MAX_PREFETCH_IMAGES][MAX_QPATH];
+	const char	*names[MAX_PREFETCH_IMAGES];
+	char		strippedName[MAX_QPATH];
+	char		*token, *p;
+	shader_t	*sh;
+	int			i, j, depth, numImages;
+
+	numImages = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		COM_StripExtension( shaders[i].shader, strippedName, sizeof( strippedName ) );
+
+		// already registered, its images are loaded
+		for ( sh = hashTable[generateHashValue( strippedName, FILE_HASH_SIZE )]; sh; sh = sh->next ) {
+			if ( !Q_stricmp( sh->name, strippedName ) ) {
+				break;
+			}
+		}
+		if ( sh ) {
+			continue;
+		}
+
+		p = FindShaderInShaderText( strippedName );
+		if ( !p ) {
+			// implicit shader, a single image of the same name
+			if ( numImages < MAX_PREFETCH_IMAGES
+				&& R_ImageFileName( shaders[i].shader, images[numImages], MAX_QPATH ) ) {
+				numImages++;
+			}
+			continue;
+		}
+
+		for ( depth = 0 ; numImages < MAX_PREFETCH_IMAGES ; ) {
+			token = COM_ParseExt( &p, qtrue );
+			if ( !token[0] ) {
+				break;
+			}
+			if ( token[0] == '{' ) {
+				depth++;
+			} else if ( token[0] == '}' ) {
+				if ( --depth == 0 ) {
+					break;
+				}
+			} else if ( !Q_stricmp( token, "map" ) || !Q_stricmp( token, "clampmap" ) ) {
+				token = COM_ParseExt( &p, qfalse );
+				if ( token[0] && token[0] != '$'
+					&& R_ImageFileName( token, images[numImages], MAX_QPATH ) ) {
+					numImages++;
+				}
+			} else if ( !Q_stricmp( token, "animMap" ) ) {
+				COM_ParseExt( &p, qfalse );		// frequency
+				while ( numImages < MAX_PREFETCH_IMAGES ) {
+					token = COM_ParseExt( &p, qfalse );
+					if ( !token[0] ) {
+						break;
+					}
+					if ( R_ImageFileName( token, images[numImages], MAX_QPATH ) ) {
+						numImages++;
+					}
+				}
+			}
+		}
+	}
+
+	// the filesystem skips duplicates
+	for ( j = 0 ; j < numImages ; j++ ) {
+		names[j] = images[j];
+	}
+	ri.FS_PrefetchFiles( names, numImages );
+}
+
 /*
 ==================
 R_FindShaderByName
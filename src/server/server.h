@@ -48,16 +48,26 @@ typedef struct voipServerPacket_s
 } voipServerPacket_t;
 #endif
 
+// links an entity into the per-cluster lists used for snapshot building
+typedef struct clusterLink_s {
+	struct svEntity_s		*ent;
+	int						cluster;
+	struct clusterLink_s	*prev, *next;
+} clusterLink_t;
+
 typedef struct svEntity_s {
-	struct worldSector_s *worldSector;
-	struct svEntity_s *nextEntityInWorldSector;
+	int			broadLeaf;			// node + 1 in the broadphase tree, 0 if not linked
 	
 	entityState_t	baseline;		// for delta compression of initial sighting
 	int			numClusters;		// if -1, use headnode instead
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
-	int			snapshotCounter;	// used to prevent double adding from portal views
+
+	clusterLink_t	clusterLinks[MAX_ENT_CLUSTERS];	// one per distinct entry in clusternums
+	int			numClusterLinks;
+	qboolean	largeEntity;		// lastCluster is set, so it is on sv.largeEntities
+	struct svEntity_s *nextLargeEntity;
 } svEntity_t;
 
 typedef enum {
@@ -82,8 +92,8 @@ typedef struct {
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=475
 	// the serverId associated with the current checksumFeed (always <= serverId)
 	int       checksumFeedServerId;	
-	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
+	int64_t			frameDeadline;		// Sys_Microseconds the next frame is due, dedicated only
 	int				nextFrameTime;		// when time > nextFrameTime, process world
 	struct cmodel_s	*models[MAX_MODELS];
 	configString_t	configstrings[MAX_CONFIGSTRINGS];
@@ -99,6 +109,20 @@ typedef struct {
 	playerState_t	*gameClients;
 	int				gameClientSize;		// will be > sizeof(playerState_t) due to game private data
 
+	// entities that can be seen from each PVS cluster, maintained by
+	// SV_LinkEntity / SV_UnlinkEntity so snapshots only visit visible clusters
+	clusterLink_t	**clusterEntities;	// [numClusters]
+	int				numClusters;
+	svEntity_t		*largeEntities;		// entities with more clusters than clusternums holds
+
+	// entities that go to every client regardless of PVS, gathered once
+	// per frame because the game may flag them after linking
+	int				broadcastEntities[MAX_GENTITIES];
+	int				numBroadcastEntities;
+	int				broadcastTime;		// sv.time the broadcast list was built for
+
+	int				statsTime;			// last time the sv_snapshotStats counters were summed
+
 	int				restartTime;
 	int				time;
 } server_t;
@@ -278,6 +302,8 @@ extern	cvar_t	*sv_maxPing;
 extern	cvar_t	*sv_pure;
 extern	cvar_t	*sv_lanForceRate;
 extern	cvar_t	*sv_dequeuePeriod;
+extern	cvar_t	*sv_snapshotStats;
+extern	cvar_t	*sv_snapshotThreads;
 
 #ifdef USE_VOIP
 extern	cvar_t	*sv_voip;
@@ -296,6 +322,8 @@ void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ...);
 void SV_AddOperatorCommands (void);
 void SV_RemoveOperatorCommands (void);
 
+void SV_FrameStats_f( void );
+
 
 void SV_MasterHeartbeat (void);
 void SV_MasterShutdown (void);
@@ -357,6 +385,7 @@ void SV_WriteFrameToClient (client_t *client, msg_t *msg);
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
+void SV_ShutdownSnapshotThreads( void );
 
 //
 // sv_game.c
@@ -395,6 +424,7 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 
 void SV_SectorList_f( void );
+void SV_BroadphaseBench_f( void );
 
 
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
@@ -425,6 +455,9 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, traceType_t type );
 // clip to a specific entity
 
+void SV_TraceBatch( trace_t *results, const traceRequest_t *requests, int count );
+// the same as an AABB SV_Trace for each request, sharing the entity lookup
+
 //
 // sv_net_chan.c
 //
@@ -264,6 +264,117 @@ static void SV_KillServer_f( void ) {
 	SV_Shutdown( "killserver" );
 }
 
+
+/*
+=================
+SV_GameBench_f
+
+Times GAME_RUN_FRAME with the interpreter, the JIT and the optimizing
+JIT.  The map is reloaded for each of them, so every run starts from
+the same state.  "gamebench backend <backend>", "gamebench run <backend>
+<frames>" and "gamebench report" are queued by "gamebench [frames]", and
+the report puts vm_game and vm_optimize back the way they were.
+=================
+*/
+#define GAMEBENCH_BACKENDS	3
+
+static const char *gameBenchNames[ GAMEBENCH_BACKENDS ] = {
+	"interpreter", "JIT", "optimized JIT"
+};
+static const char *gameBenchVmGame[ GAMEBENCH_BACKENDS ] = { "1", "2", "2" };
+static const char *gameBenchVmOptimize[ GAMEBENCH_BACKENDS ] = { "0", "0", "1" };
+static int64_t	gameBenchUsec[ GAMEBENCH_BACKENDS ];
+static int	gameBenchFrames[ GAMEBENCH_BACKENDS ];
+static char	gameBenchSavedVmGame[ MAX_CVAR_VALUE_STRING ];
+static char	gameBenchSavedVmOptimize[ MAX_CVAR_VALUE_STRING ];
+static qboolean	gameBenchSaved;
+
+static void SV_GameBench_f( void ) {
+	char	map[ MAX_QPATH ];
+	char	*cmd;
+	int		frames;
+	int		backend;
+	int64_t	start;
+	int		i;
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "backend" ) ) {
+		backend = atoi( Cmd_Argv( 2 ) );
+		if ( backend < 0 || backend >= GAMEBENCH_BACKENDS ) {
+			return;
+		}
+		Cvar_Set( "vm_game", gameBenchVmGame[ backend ] );
+		Cvar_Set( "vm_optimize", gameBenchVmOptimize[ backend ] );
+		return;
+	}
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "run" ) ) {
+		backend = atoi( Cmd_Argv( 2 ) );
+		frames = atoi( Cmd_Argv( 3 ) );
+		if ( backend < 0 || backend >= GAMEBENCH_BACKENDS || !gvm ) {
+			return;
+		}
+
+		start = Sys_Microseconds();
+		for ( i = 0; i < frames; i++ ) {
+			sv.time += 1000 / sv_fps->integer;
+			VM_Call( gvm, GAME_RUN_FRAME, sv.time );
+		}
+		gameBenchUsec[ backend ] = Sys_Microseconds() - start;
+		gameBenchFrames[ backend ] = frames;
+		return;
+	}
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "report" ) ) {
+		Com_Printf( "GAME_RUN_FRAME timings:\n" );
+		for ( i = 0; i < GAMEBENCH_BACKENDS; i++ ) {
+			if ( !gameBenchFrames[ i ] ) {
+				Com_Printf( "%14s: not run\n", gameBenchNames[ i ] );
+				continue;
+			}
+			Com_Printf( "%14s: %i frames, %.0f ns/frame\n", gameBenchNames[ i ], gameBenchFrames[ i ],
+				gameBenchUsec[ i ] * 1000.0 / gameBenchFrames[ i ] );
+		}
+
+		// put everything back the way it was
+		if ( gameBenchSaved ) {
+			Cvar_Set( "vm_game", gameBenchSavedVmGame );
+			Cvar_Set( "vm_optimize", gameBenchSavedVmOptimize );
+			gameBenchSaved = qfalse;
+		}
+		return;
+	}
+
+	frames = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 1000;
+	if ( frames <= 0 ) {
+		Com_Printf( "usage: gamebench [frames]\n" );
+		return;
+	}
+
+	// a bench that was cut short has already saved the real values
+	if ( !gameBenchSaved ) {
+		Cvar_VariableStringBuffer( "vm_game", gameBenchSavedVmGame, sizeof( gameBenchSavedVmGame ) );
+		Cvar_VariableStringBuffer( "vm_optimize", gameBenchSavedVmOptimize, sizeof( gameBenchSavedVmOptimize ) );
+		gameBenchSaved = qtrue;
+	}
+
+	Com_Memset( gameBenchFrames, 0, sizeof( gameBenchFrames ) );
+	Q_strncpyz( map, Cvar_VariableString( "mapname" ), sizeof( map ) );
+	cmd = Cvar_VariableIntegerValue( "sv_cheats" ) ? "devmap" : "map";
+
+	for ( i = 0; i < GAMEBENCH_BACKENDS; i++ ) {
+		Cbuf_AddText( va( "gamebench backend %i\n", i ) );
+		Cbuf_AddText( va( "%s %s\n", cmd, map ) );
+		Cbuf_AddText( va( "gamebench run %i %i\n", i, frames ) );
+	}
+	Cbuf_AddText( "gamebench report\n" );
+	Cbuf_AddText( va( "%s %s\n", cmd, map ) );
+}
+
 //===========================================================
 
 /*
@@ -300,6 +411,9 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("devmap", SV_Map_f);
 	Cmd_SetCommandCompletionFunc( "devmap", SV_CompleteMapName );
 	Cmd_AddCommand ("killserver", SV_KillServer_f);
+	Cmd_AddCommand ("gamebench", SV_GameBench_f);
+	Cmd_AddCommand ("sv_broadphaseBench", SV_BroadphaseBench_f);
+	Cmd_AddCommand ("sv_frameStats", SV_FrameStats_f);
 }
 
 /*
@@ -450,6 +450,10 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 		Cmd_RemoveCommand( VMA(1) );
 		return 0;
 
+	case G_TRACE_BATCH:
+		SV_TraceBatch( VMA(1), VMA(2), args[3] );
+		return 0;
+
 	case TRAP_MEMSET:
 		Com_Memset( VMA(1), args[2], args[3] );
 		return 0;
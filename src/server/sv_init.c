@@ -441,6 +441,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 
 	Com_Printf ("------ Server Initialization ------\n");
 	Com_Printf ("Server: %s\n",server);
+	FS_BeginLoadStats();
 
 	// if not running a dedicated server CL_MapLoading will connect the client to the server
 	// also print some status stuff
@@ -608,6 +609,8 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 
 	Hunk_SetMark();
 
+	FS_EndLoadStats( server );
+
 	Com_Printf ("-----------------------------------\n");
 }
 
@@ -671,6 +674,9 @@ void SV_Init (void) {
 	sv_mapChecksum = Cvar_Get ("sv_mapChecksum", "", CVAR_ROM);
 	sv_lanForceRate = Cvar_Get ("sv_lanForceRate", "1", CVAR_ARCHIVE );
 	sv_dequeuePeriod = Cvar_Get ("sv_dequeuePeriod", "500", CVAR_ARCHIVE );
+	sv_snapshotStats = Cvar_Get ("sv_snapshotStats", "0", 0 );
+	sv_snapshotThreads = Cvar_Get ("sv_snapshotThreads", "0", CVAR_ARCHIVE );
+	Cvar_CheckRange( sv_snapshotThreads, 0, MAX_WORKER_THREADS, qtrue );
 }
 
 
@@ -730,6 +736,7 @@ void SV_Shutdown( char *finalmsg ) {
 	SV_RemoveOperatorCommands();
 	SV_MasterShutdown();
 	SV_ShutdownGameProgs();
+	SV_ShutdownSnapshotThreads();
 
 	// free current level
 	SV_ClearServer();
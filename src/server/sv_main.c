@@ -56,6 +56,8 @@ cvar_t	*sv_maxPing;
 cvar_t	*sv_pure;
 cvar_t	*sv_lanForceRate; // dedicated 1 (LAN) server forces local client rates to 99999 (bug #491)
 cvar_t	*sv_dequeuePeriod;
+cvar_t	*sv_snapshotStats;		// report entities examined versus sent in snapshots
+cvar_t	*sv_snapshotThreads;	// worker threads for building snapshots, 0 builds them all on the main thread
 
 /*
 =============================================================================
@@ -1001,6 +1003,125 @@ static qboolean SV_CheckPaused( void ) {
 	return qtrue;
 }
 
+/*
+==================
+SV_FrameStat
+
+Dedicated servers keep histograms of how late each frame started and
+how long it took, sv_frameStats prints them
+==================
+*/
+#define	FRAME_STAT_BUCKETS	10
+
+static const int frameStatLimits[ FRAME_STAT_BUCKETS - 1 ] = {
+	50, 100, 250, 500, 1000, 2000, 5000, 10000, 25000
+};
+
+typedef struct {
+	int		count[ FRAME_STAT_BUCKETS ];
+	int		max;
+	int64_t	total;
+} frameHistogram_t;
+
+static int				frameStatFrames;
+static frameHistogram_t	frameStatLate;
+static frameHistogram_t	frameStatWork;
+
+static void SV_FrameStat( frameHistogram_t *h, int64_t usec ) {
+	int		i;
+
+	for ( i = 0; i < FRAME_STAT_BUCKETS - 1; i++ ) {
+		if ( usec < frameStatLimits[ i ] ) {
+			break;
+		}
+	}
+	h->count[ i ]++;
+	h->total += usec;
+	if ( usec > h->max ) {
+		h->max = usec > 0x7fffffff ? 0x7fffffff : usec;
+	}
+}
+
+/*
+==================
+SV_FrameStats_f
+==================
+*/
+void SV_FrameStats_f( void ) {
+	char	*label;
+	int		i;
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		frameStatFrames = 0;
+		Com_Memset( &frameStatLate, 0, sizeof( frameStatLate ) );
+		Com_Memset( &frameStatWork, 0, sizeof( frameStatWork ) );
+		return;
+	}
+
+	if ( !frameStatFrames ) {
+		Com_Printf( "No frames recorded, only dedicated servers keep frame statistics\n" );
+		return;
+	}
+
+	Com_Printf( "%15s %17s %17s\n", va( "%i frames", frameStatFrames ), "start late", "frame time" );
+	for ( i = 0; i < FRAME_STAT_BUCKETS; i++ ) {
+		if ( i < FRAME_STAT_BUCKETS - 1 ) {
+			label = va( "< %i usec", frameStatLimits[ i ] );
+		} else {
+			label = va( ">= %i usec", frameStatLimits[ i - 1 ] );
+		}
+		Com_Printf( "%15s %10i %5.1f%% %10i %5.1f%%\n", label,
+			frameStatLate.count[ i ], frameStatLate.count[ i ] * 100.0f / frameStatFrames,
+			frameStatWork.count[ i ], frameStatWork.count[ i ] * 100.0f / frameStatFrames );
+	}
+	Com_Printf( "%15s %10i usec     %10i usec\n", "average",
+		(int)( frameStatLate.total / frameStatFrames ), (int)( frameStatWork.total / frameStatFrames ) );
+	Com_Printf( "%15s %10i usec     %10i usec\n", "max", frameStatLate.max, frameStatWork.max );
+}
+
+/*
+==================
+SV_FrameDue
+
+Dedicated servers run their frames on fixed microsecond deadlines, so a
+late frame doesn't push back the ones after it.  Until the next one is
+due this sleeps, or returns early to let the event loop handle packets.
+==================
+*/
+static qboolean SV_FrameDue( int frameMsec ) {
+	int64_t	now, frameUsec;
+
+	frameUsec = frameMsec * 1000;
+	if ( com_timescale->value > 0 ) {
+		frameUsec /= com_timescale->value;
+	}
+
+	now = Sys_Microseconds();
+	if ( !sv.frameDeadline ) {
+		sv.frameDeadline = now;
+	}
+
+	if ( now < sv.frameDeadline ) {
+		NET_Sleep( sv.frameDeadline - now );
+		return qfalse;
+	}
+
+	frameStatFrames++;
+	SV_FrameStat( &frameStatLate, now - sv.frameDeadline );
+
+	// don't catch up on more than Com_ModifyMsec would let through
+	if ( now - sv.frameDeadline > 5000000 ) {
+		sv.frameDeadline = now - 5000000;
+	}
+
+	while ( sv.frameDeadline <= now ) {
+		sv.timeResidual += frameMsec;
+		sv.frameDeadline += frameUsec;
+	}
+
+	return qtrue;
+}
+
 /*
 ==================
 SV_Frame
@@ -1012,6 +1133,7 @@ happen before SV_Frame is called
 void SV_Frame( int msec ) {
 	int		frameMsec;
 	int		startTime;
+	int64_t	frameStart;
 
 	// the menu kills the server with this cvar
 	if ( sv_killserver->integer ) {
@@ -1049,13 +1171,14 @@ void SV_Frame( int msec ) {
 		frameMsec = 1;
 	}
 
-	sv.timeResidual += msec;
-
-	if ( com_dedicated->integer && sv.timeResidual < frameMsec ) {
-		// NET_Sleep will give the OS time slices until either get a packet
-		// or time enough for a server frame has gone by
-		NET_Sleep(frameMsec - sv.timeResidual);
-		return;
+	if ( com_dedicated->integer ) {
+		if ( !SV_FrameDue( frameMsec ) ) {
+			return;
+		}
+		frameStart = Sys_Microseconds();
+	} else {
+		sv.timeResidual += msec;
+		frameStart = -1;
 	}
 
 	// if time is about to hit the 32nd bit, kick all clients
@@ -1121,6 +1244,13 @@ void SV_Frame( int msec ) {
 
 	// send a heartbeat to the master if needed
 	SV_MasterHeartbeat();
+
+	// everything for this frame has been queued up
+	Sys_FlushPackets();
+
+	if ( frameStart >= 0 ) {
+		SV_FrameStat( &frameStatWork, Sys_Microseconds() - frameStart );
+	}
 }
 
 //============================================================================
@@ -46,6 +46,15 @@ A normal server packet will look like:
 =============================================================================
 */
 
+// where a delta encoded entity list ended up in a message, so other
+// clients with the same delta base and entities can copy it instead
+// of encoding it again
+typedef struct {
+	const msg_t		*msg;			// NULL until it has been written
+	int				startBit;
+	int				endBit;
+} encodedEntities_t;
+
 /*
 =============
 SV_EmitPacketEntities
@@ -117,42 +126,59 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_SnapshotDeltaFrame
+
+Picks the previous frame the snapshot being built is delta compressed
+from, NULL if the client gets a full snapshot.  This must be done after
+all the entities of the frame have been put in svs.snapshotEntities, so
+the old frame can't be overwritten while it is being read.
 ==================
 */
-static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
-	clientSnapshot_t	*frame, *oldframe;
-	int					lastframe;
-	int					i;
-	int					snapFlags;
-
-	// this is the snapshot we are creating
-	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+static clientSnapshot_t *SV_SnapshotDeltaFrame( client_t *client, int *lastframe ) {
+	clientSnapshot_t	*oldframe;
 
 	// try to use a previous frame as the source for delta compressing the snapshot
 	if ( client->deltaMessage <= 0 || client->state != CS_ACTIVE ) {
 		// client is asking for a retransmit
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	} else if ( client->netchan.outgoingSequence - client->deltaMessage 
 		>= (PACKET_BACKUP - 3) ) {
 		// client hasn't gotten a good message through in a long time
 		Com_DPrintf ("%s: Delta request from out of date packet.\n", client->name);
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	} else {
 		// we have a valid snapshot to delta from
 		oldframe = &client->frames[ client->deltaMessage & PACKET_MASK ];
-		lastframe = client->netchan.outgoingSequence - client->deltaMessage;
+		*lastframe = client->netchan.outgoingSequence - client->deltaMessage;
 
 		// the snapshot's entities may still have rolled off the buffer, though
 		if ( oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities ) {
 			Com_DPrintf ("%s: Delta request from out of date entities.\n", client->name);
 			oldframe = NULL;
-			lastframe = 0;
+			*lastframe = 0;
 		}
 	}
 
+	return oldframe;
+}
+
+/*
+==================
+SV_WriteSnapshotToClient
+==================
+*/
+static void SV_WriteSnapshotToClient( client_t *client, clientSnapshot_t *oldframe, int lastframe,
+									const encodedEntities_t *shared, encodedEntities_t *written, msg_t *msg ) {
+	clientSnapshot_t	*frame;
+	int					i;
+	int					snapFlags;
+	int					startBit;
+
+	// this is the snapshot we are creating
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
 	MSG_WriteByte (msg, svc_snapshot);
 
 	// NOTE, MRE: now sent at the start of every message from server to client
@@ -197,8 +223,20 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 		MSG_WriteDeltaPlayerstate( msg, NULL, &frame->ps );
 	}
 
-	// delta encode the entities
-	SV_EmitPacketEntities (oldframe, frame, msg);
+	// delta encode the entities, or reuse another client's identical ones
+	if ( shared && shared->msg ) {
+		MSG_WriteCodedBits( msg, shared->msg, shared->startBit, shared->endBit );
+	} else {
+		startBit = msg->bit;
+		SV_EmitPacketEntities (oldframe, frame, msg);
+
+		// an overflowed message is thrown away, so don't share it
+		if ( written && !msg->overflowed ) {
+			written->msg = msg;
+			written->startBit = startBit;
+			written->endBit = msg->bit;
+		}
+	}
 
 	// padding for rate debugging
 	if ( sv_padPackets->integer ) {
@@ -242,6 +280,36 @@ typedef struct {
 	int		snapshotEntities[MAX_SNAPSHOT_ENTITIES];	
 } snapshotEntityNumbers_t;
 
+// the entities that can be seen from a viewpoint, before the per
+// client filters are applied
+typedef struct {
+	int		numEntities;
+	int		entities[MAX_GENTITIES];
+} visibleEntities_t;
+
+// the marks left on entities while a snapshot is built, kept per thread
+// so several clients can be culled at the same time
+typedef struct {
+	int		snapshotCounter;					// incremented for each snapshot built
+	int		visCheckCounter;					// incremented for each snapshot viewpoint
+	int		entitySnapshot[MAX_GENTITIES];		// used to prevent double adding from portal views
+	int		entityVisCheck[MAX_GENTITIES];		// used to prevent examining an entity twice per viewpoint
+
+	// Com_Error can only be raised from the main thread
+	const char	*error;
+
+	// sv_snapshotStats
+	int		snapshots;
+	int		entitiesExamined;
+	int		entitiesScanned;	// what a full entity scan would have examined
+	int		entitiesSent;
+	int		visLookups, visHits;		// viewpoints sharing visible entities
+	int		encodeLookups, encodeHits;	// snapshots sharing encoded entities
+} snapshotContext_t;
+
+// [0] is used by the main thread
+static snapshotContext_t	snapshotContexts[MAX_WORKER_THREADS + 1];
+
 /*
 =======================
 SV_QsortEntityNumbers
@@ -253,15 +321,16 @@ static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
 	ea = (int *)a;
 	eb = (int *)b;
 
-	if ( *ea == *eb ) {
-		Com_Error( ERR_DROP, "SV_QsortEntityStates: duplicated entity" );
-	}
-
 	if ( *ea < *eb ) {
 		return -1;
 	}
 
-	return 1;
+	if ( *ea > *eb ) {
+		return 1;
+	}
+
+	// duplicates are caught after sorting
+	return 0;
 }
 
 
@@ -270,58 +339,43 @@ static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
 SV_AddEntToSnapshot
 ===============
 */
-static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+static void SV_AddEntToSnapshot( snapshotContext_t *ctx, int e, snapshotEntityNumbers_t *eNums ) {
 	// if we have already added this entity to this snapshot, don't add again
-	if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+	if ( ctx->entitySnapshot[e] == ctx->snapshotCounter ) {
 		return;
 	}
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	ctx->entitySnapshot[e] = ctx->snapshotCounter;
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES ) {
 		return;
 	}
 
-	eNums->snapshotEntities[ eNums->numSnapshotEntities ] = gEnt->s.number;
+	eNums->snapshotEntities[ eNums->numSnapshotEntities ] = e;
 	eNums->numSnapshotEntities++;
 }
 
 /*
 ===============
-SV_AddEntitiesVisibleFromPoint
-===============
-*/
-static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame, 
-									snapshotEntityNumbers_t *eNums, qboolean portal ) {
-	int		e, i;
-	sharedEntity_t *ent;
-	svEntity_t	*svEnt;
-	int		l;
-	int		clientarea, clientcluster;
-	int		leafnum;
-	byte	*clientpvs;
-	byte	*bitvector;
-
-	// during an error shutdown message we may need to transmit
-	// the shutdown message after the server has shutdown, so
-	// specfically check for it
-	if ( !sv.state ) {
-		return;
-	}
+SV_PrepareSnapshotEntities
 
-	leafnum = CM_PointLeafnum (origin);
-	clientarea = CM_LeafArea (leafnum);
-	clientcluster = CM_LeafCluster (leafnum);
+Gathers the entities that are sent regardless of PVS.  This is done once
+per frame rather than in SV_LinkEntity, because the game is free to set
+SVF_BROADCAST on an entity after it has been linked.
 
-	// calculate the visible areas
-	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
+Entity numbers are repaired here as well, so that building the snapshots
+never has to write to the game's entities.
+===============
+*/
+static void SV_PrepareSnapshotEntities( void ) {
+	int				e;
+	sharedEntity_t	*ent;
 
-	clientpvs = CM_ClusterPVS (clientcluster);
+	sv.numBroadcastEntities = 0;
+	sv.broadcastTime = sv.time;
 
 	for ( e = 0 ; e < sv.num_entities ; e++ ) {
 		ent = SV_GentityNum(e);
-
-		// never send entities that aren't linked in
 		if ( !ent->r.linked ) {
 			continue;
 		}
@@ -331,90 +385,221 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 			ent->s.number = e;
 		}
 
-		// entities can be flagged to explicitly not be sent to the client
-		if ( ent->r.svFlags & SVF_NOCLIENT ) {
-			continue;
+		if ( ent->r.svFlags & SVF_BROADCAST ) {
+			sv.broadcastEntities[ sv.numBroadcastEntities++ ] = e;
 		}
+	}
+}
 
-		// entities can be flagged to be sent to only one client
-		if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
-			if ( ent->r.singleClient != frame->ps.clientNum ) {
-				continue;
-			}
+/*
+===============
+SV_EntityVisibleInPVS
+
+Checks the clusters of an entity against a PVS row
+===============
+*/
+static qboolean SV_EntityVisibleInPVS( svEntity_t *svEnt, byte *bitvector ) {
+	int		i, l;
+
+	// check individual leafs
+	if ( !svEnt->numClusters ) {
+		return qfalse;
+	}
+	l = 0;
+	for ( i=0 ; i < svEnt->numClusters ; i++ ) {
+		l = svEnt->clusternums[i];
+		if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+			return qtrue;
 		}
-		// entities can be flagged to be sent to everyone but one client
-		if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
-			if ( ent->r.singleClient == frame->ps.clientNum ) {
-				continue;
+	}
+
+	// if we haven't found it to be visible,
+	// check overflow clusters that coudln't be stored
+	if ( svEnt->lastCluster ) {
+		for ( ; l <= svEnt->lastCluster ; l++ ) {
+			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+				break;
 			}
 		}
-		// entities can be flagged to be sent to a given mask of clients
-		if ( ent->r.svFlags & SVF_CLIENTMASK ) {
-			if (frame->ps.clientNum >= 32)
-				Com_Error( ERR_DROP, "SVF_CLIENTMASK: cientNum > 32\n" );
-			if (~ent->r.singleClient & (1 << frame->ps.clientNum))
-				continue;
+		if ( l == svEnt->lastCluster ) {
+			return qfalse;	// not visible
 		}
+		return qtrue;
+	}
 
-		svEnt = SV_SvEntityForGentity( ent );
+	return qfalse;
+}
 
-		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
-			continue;
-		}
+/*
+===============
+SV_AddEntityIfVisible
 
-		// broadcast entities are always sent
-		if ( ent->r.svFlags & SVF_BROADCAST ) {
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
-			continue;
-		}
+Adds a candidate entity to the list of entities visible from a point.
+Only the checks that are the same for every client looking from there are
+done here, the per client filters are left to SV_AddEntitiesToSnapshot.
+If pvsKnown is set the entity was found through a visible cluster, so only
+the areaportal check remains.
+===============
+*/
+static void SV_AddEntityIfVisible( snapshotContext_t *ctx, svEntity_t *svEnt, visibleEntities_t *vis,
+									int clientarea, byte *clientpvs, int checkCount, qboolean pvsKnown ) {
+	int				e;
+	sharedEntity_t	*ent;
+
+	e = svEnt - sv.svEntities;
+	if ( e >= sv.num_entities ) {
+		return;
+	}
+
+	// don't examine an entity twice from the same viewpoint
+	if ( ctx->entityVisCheck[e] == checkCount ) {
+		return;
+	}
+	ctx->entityVisCheck[e] = checkCount;
+
+	ctx->entitiesExamined++;
 
+	ent = SV_GentityNum(e);
+
+	// never send entities that aren't linked in
+	if ( !ent->r.linked ) {
+		return;
+	}
+
+	// entities can be flagged to explicitly not be sent to the client
+	if ( ent->r.svFlags & SVF_NOCLIENT ) {
+		return;
+	}
+
+	// broadcast entities are always sent
+	if ( !( ent->r.svFlags & SVF_BROADCAST ) ) {
 		// ignore if not touching a PV leaf
 		// check area
 		if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
 			// doors can legally straddle two areas, so
 			// we may need to check another one
 			if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
-				continue;		// blocked by a door
+				return;		// blocked by a door
 			}
 		}
 
-		bitvector = clientpvs;
+		if ( !pvsKnown && !SV_EntityVisibleInPVS( svEnt, clientpvs ) ) {
+			return;
+		}
+	}
+
+	vis->entities[ vis->numEntities++ ] = e;
+}
+
+/*
+===============
+SV_GatherVisibleEntities
+
+Lists the entities that can be seen from a cluster and area.  Only the
+entities linked into clusters set in the PVS row are examined, plus the
+broadcast and large entity lists.
+===============
+*/
+static void SV_GatherVisibleEntities( snapshotContext_t *ctx, int clientcluster, int clientarea,
+									visibleEntities_t *vis ) {
+	int		i, j;
+	int		cluster;
+	int		checkCount;
+	byte	*clientpvs;
+	clusterLink_t	*link, *next;
+	svEntity_t		*svEnt;
+
+	vis->numEntities = 0;
 
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
+	clientpvs = CM_ClusterPVS (clientcluster);
+
+	checkCount = ++ctx->visCheckCounter;
+	ctx->entitiesScanned += sv.num_entities;
+
+	for ( i = 0 ; i < sv.numBroadcastEntities ; i++ ) {
+		svEnt = &sv.svEntities[ sv.broadcastEntities[i] ];
+		SV_AddEntityIfVisible( ctx, svEnt, vis, clientarea, clientpvs, checkCount, qfalse );
+	}
+
+	for ( i = 0 ; i < sv.numClusters ; i += 8 ) {
+		if ( !clientpvs[i >> 3] ) {
 			continue;
 		}
-		l = 0;
-		for ( i=0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+
+		for ( j = 0 ; j < 8 ; j++ ) {
+			if ( !( clientpvs[i >> 3] & ( 1 << j ) ) ) {
+				continue;
+			}
+
+			cluster = i + j;
+			if ( cluster >= sv.numClusters ) {
 				break;
 			}
+
+			for ( link = sv.clusterEntities[cluster] ; link ; link = next ) {
+				next = link->next;
+				SV_AddEntityIfVisible( ctx, link->ent, vis, clientarea, clientpvs, checkCount, qtrue );
+			}
 		}
+	}
 
-		// if we haven't found it to be visible,
-		// check overflow clusters that coudln't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-						break;
-					}
-				}
-				if ( l == svEnt->lastCluster ) {
-					continue;	// not visible
-				}
-			} else {
+	for ( svEnt = sv.largeEntities ; svEnt ; svEnt = svEnt->nextLargeEntity ) {
+		SV_AddEntityIfVisible( ctx, svEnt, vis, clientarea, clientpvs, checkCount, qfalse );
+	}
+}
+
+static void SV_AddEntitiesVisibleFromPoint( snapshotContext_t *ctx, vec3_t origin, clientSnapshot_t *frame, 
+									snapshotEntityNumbers_t *eNums );
+
+/*
+===============
+SV_AddEntitiesToSnapshot
+
+Runs the per client filters over the entities visible from a viewpoint
+and adds the ones that pass to the snapshot
+===============
+*/
+static void SV_AddEntitiesToSnapshot( snapshotContext_t *ctx, vec3_t origin, clientSnapshot_t *frame,
+									const visibleEntities_t *vis, snapshotEntityNumbers_t *eNums ) {
+	int				i, e;
+	sharedEntity_t	*ent;
+
+	for ( i = 0 ; i < vis->numEntities ; i++ ) {
+		e = vis->entities[i];
+		ent = SV_GentityNum(e);
+
+		// entities can be flagged to be sent to only one client
+		if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
+			if ( ent->r.singleClient != frame->ps.clientNum ) {
+				continue;
+			}
+		}
+		// entities can be flagged to be sent to everyone but one client
+		if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
+			if ( ent->r.singleClient == frame->ps.clientNum ) {
 				continue;
 			}
 		}
+		// entities can be flagged to be sent to a given mask of clients
+		if ( ent->r.svFlags & SVF_CLIENTMASK ) {
+			if (frame->ps.clientNum >= 32) {
+				ctx->error = "SVF_CLIENTMASK: cientNum > 32\n";
+				return;
+			}
+			if (~ent->r.singleClient & (1 << frame->ps.clientNum))
+				continue;
+		}
+
+		// don't double add an entity through portals
+		if ( ctx->entitySnapshot[e] == ctx->snapshotCounter ) {
+			continue;
+		}
 
 		// add it
-		SV_AddEntToSnapshot( svEnt, ent, eNums );
+		SV_AddEntToSnapshot( ctx, e, eNums );
 
 		// if its a portal entity, add everything visible from its camera position
-		if ( ent->r.svFlags & SVF_PORTAL ) {
+		if ( ( ent->r.svFlags & SVF_PORTAL ) && !( ent->r.svFlags & SVF_BROADCAST ) ) {
 			if ( ent->s.generic1 ) {
 				vec3_t dir;
 				VectorSubtract(ent->s.origin, origin, dir);
@@ -422,10 +607,68 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 					continue;
 				}
 			}
-			SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, qtrue );
+			SV_AddEntitiesVisibleFromPoint( ctx, ent->s.origin2, frame, eNums );
 		}
+	}
+}
 
+/*
+===============
+SV_AddEntitiesVisibleFromPoint
+
+Used for the views through portals, which aren't shared between clients
+===============
+*/
+static void SV_AddEntitiesVisibleFromPoint( snapshotContext_t *ctx, vec3_t origin, clientSnapshot_t *frame, 
+									snapshotEntityNumbers_t *eNums ) {
+	int					leafnum;
+	int					clientarea, clientcluster;
+	visibleEntities_t	vis;
+
+	leafnum = CM_PointLeafnum (origin);
+	clientarea = CM_LeafArea (leafnum);
+	clientcluster = CM_LeafCluster (leafnum);
+
+	// calculate the visible areas
+	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
+
+	SV_GatherVisibleEntities( ctx, clientcluster, clientarea, &vis );
+	SV_AddEntitiesToSnapshot( ctx, origin, frame, &vis, eNums );
+}
+
+/*
+=============
+SV_FindSnapshotViewpoint
+
+Finds the cluster and area the client is looking from.  Returns qfalse if
+the client doesn't get any entities.
+=============
+*/
+static qboolean SV_FindSnapshotViewpoint( client_t *client, vec3_t org, int *cluster, int *area ) {
+	playerState_t	*ps;
+	int				leafnum;
+
+	// during an error shutdown message we may need to transmit
+	// the shutdown message after the server has shutdown, so
+	// specfically check for it
+	if ( !sv.state ) {
+		return qfalse;
 	}
+
+	if ( !client->gentity || client->state == CS_ZOMBIE ) {
+		return qfalse;
+	}
+
+	// find the client's viewpoint
+	ps = SV_GameClientNum( client - svs.clients );
+	VectorCopy( ps->origin, org );
+	org[2] += ps->viewheight;
+
+	leafnum = CM_PointLeafnum (org);
+	*area = CM_LeafArea (leafnum);
+	*cluster = CM_LeafCluster (leafnum);
+
+	return qtrue;
 }
 
 /*
@@ -433,92 +676,144 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 SV_BuildClientSnapshot
 
 Decides which entities are going to be visible to the client, and
-copies off the playerstate and areabits.
+copies off the playerstate and areabits.  vis holds the entities seen
+from the client's viewpoint, NULL if the client gets none.
 
 This properly handles multiple recursive portals, but the render
 currently doesn't.
 
 For viewing through other player's eyes, clent can be something other than client->gentity
+
+Nothing outside the client and ctx is written, so this can run for
+several clients at once.  The entity states are stored separately by
+SV_StoreSnapshotEntities.
 =============
 */
-static void SV_BuildClientSnapshot( client_t *client ) {
-	vec3_t						org;
+static void SV_BuildClientSnapshot( snapshotContext_t *ctx, client_t *client, vec3_t org, int area,
+									const visibleEntities_t *vis, snapshotEntityNumbers_t *eNums ) {
 	clientSnapshot_t			*frame;
-	snapshotEntityNumbers_t		entityNumbers;
 	int							i;
-	sharedEntity_t				*ent;
-	entityState_t				*state;
-	svEntity_t					*svEnt;
-	sharedEntity_t				*clent;
 	int							clientNum;
-	playerState_t				*ps;
 
 	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
+	ctx->snapshotCounter++;
 
 	// this is the frame we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
 	// clear everything in this snapshot
-	entityNumbers.numSnapshotEntities = 0;
+	eNums->numSnapshotEntities = 0;
 	Com_Memset( frame->areabits, 0, sizeof( frame->areabits ) );
 
   // https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=62
 	frame->num_entities = 0;
 	
-	clent = client->gentity;
-	if ( !clent || client->state == CS_ZOMBIE ) {
+	if ( !vis ) {
 		return;
 	}
 
 	// grab the current playerState_t
-	ps = SV_GameClientNum( client - svs.clients );
-	frame->ps = *ps;
+	frame->ps = *SV_GameClientNum( client - svs.clients );
 
 	// never send client's own entity, because it can
 	// be regenerated from the playerstate
 	clientNum = frame->ps.clientNum;
 	if ( clientNum < 0 || clientNum >= MAX_GENTITIES ) {
-		Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
+		ctx->error = "SV_SvEntityForGentity: bad gEnt";
+		return;
 	}
-	svEnt = &sv.svEntities[ clientNum ];
 
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	ctx->entitySnapshot[ clientNum ] = ctx->snapshotCounter;
 
-	// find the client's viewpoint
-	VectorCopy( ps->origin, org );
-	org[2] += ps->viewheight;
+	// calculate the visible areas
+	frame->areabytes = CM_WriteAreaBits( frame->areabits, area );
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	SV_AddEntitiesVisibleFromPoint( org, frame, &entityNumbers, qfalse );
+	SV_AddEntitiesToSnapshot( ctx, org, frame, vis, eNums );
 
 	// if there were portals visible, there may be out of order entities
 	// in the list which will need to be resorted for the delta compression
 	// to work correctly.  This also catches the error condition
 	// of an entity being included twice.
-	qsort( entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities, 
-		sizeof( entityNumbers.snapshotEntities[0] ), SV_QsortEntityNumbers );
+	qsort( eNums->snapshotEntities, eNums->numSnapshotEntities, 
+		sizeof( eNums->snapshotEntities[0] ), SV_QsortEntityNumbers );
+
+	for ( i = 1 ; i < eNums->numSnapshotEntities ; i++ ) {
+		if ( eNums->snapshotEntities[i] == eNums->snapshotEntities[i - 1] ) {
+			ctx->error = "SV_QsortEntityStates: duplicated entity";
+			return;
+		}
+	}
+
+	ctx->snapshots++;
+	ctx->entitiesSent += eNums->numSnapshotEntities;
 
 	// now that all viewpoint's areabits have been OR'd together, invert
 	// all of them to make it a mask vector, which is what the renderer wants
 	for ( i = 0 ; i < MAX_MAP_AREA_BYTES/4 ; i++ ) {
 		((int *)frame->areabits)[i] = ((int *)frame->areabits)[i] ^ -1;
 	}
+}
+
+/*
+=============
+SV_AllocSnapshotEntities
+
+Reserves room in svs.snapshotEntities for the entities picked by
+SV_BuildClientSnapshot.  Only called from the main thread.
+=============
+*/
+static void SV_AllocSnapshotEntities( client_t *client, snapshotEntityNumbers_t *eNums ) {
+	clientSnapshot_t	*frame;
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
-	// copy the entity states out
-	frame->num_entities = 0;
 	frame->first_entity = svs.nextSnapshotEntities;
-	for ( i = 0 ; i < entityNumbers.numSnapshotEntities ; i++ ) {
-		ent = SV_GentityNum(entityNumbers.snapshotEntities[i]);
-		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
-		*state = ent->s;
-		svs.nextSnapshotEntities++;
-		// this should never hit, map should always be restarted first in SV_Frame
-		if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
-			Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
-		}
-		frame->num_entities++;
+	frame->num_entities = eNums->numSnapshotEntities;
+	svs.nextSnapshotEntities += frame->num_entities;
+
+	// this should never hit, map should always be restarted first in SV_Frame
+	if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
+		Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
+	}
+}
+
+/*
+=============
+SV_ShareSnapshotEntities
+
+Points the snapshot at the entity states of another client's
+snapshot from the same frame, when they hold the same entities
+=============
+*/
+static void SV_ShareSnapshotEntities( client_t *client, client_t *other ) {
+	clientSnapshot_t	*frame, *otherFrame;
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+	otherFrame = &other->frames[ other->netchan.outgoingSequence & PACKET_MASK ];
+
+	frame->first_entity = otherFrame->first_entity;
+	frame->num_entities = otherFrame->num_entities;
+}
+
+/*
+=============
+SV_StoreSnapshotEntities
+
+Copies the entity states out into the room reserved for them
+=============
+*/
+static void SV_StoreSnapshotEntities( client_t *client, snapshotEntityNumbers_t *eNums ) {
+	clientSnapshot_t	*frame;
+	sharedEntity_t		*ent;
+	int					i;
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
+	for ( i = 0 ; i < frame->num_entities ; i++ ) {
+		ent = SV_GentityNum(eNums->snapshotEntities[i]);
+		svs.snapshotEntities[(frame->first_entity + i) % svs.numSnapshotEntities] = ent->s;
 	}
 }
 
@@ -613,49 +908,356 @@ void SV_SendMessageToClient( msg_t *msg, client_t *client ) {
 }
 
 
+/*
+=============================================================================
+
+Snapshot jobs
+
+Each client's snapshot goes through the same steps whether it is sent on
+its own or together with the others in SV_SendClientMessages.  Culling and
+encoding only read the world, so with sv_snapshotThreads they are spread
+over the worker threads; reserving room in svs.snapshotEntities, picking
+the delta frame, downloads and the netchan stay on the main thread.
+
+=============================================================================
+*/
+
+typedef struct snapshotJob_s {
+	client_t				*client;
+
+	// clients looking from the same cluster and area share the
+	// visible entities gathered for the first of them
+	vec3_t					origin;
+	int						cluster, area;
+	struct snapshotJob_s	*visSource;		// NULL if the client gets no entities
+	visibleEntities_t		visible;		// used if visSource is this job
+
+	snapshotEntityNumbers_t	entityNumbers;
+	const char				*error;			// from SV_BuildClientSnapshot
+	qboolean				storeEntities;	// qfalse if another job's snapshot entities are shared
+
+	clientSnapshot_t		*oldframe;		// delta base, NULL for a full snapshot
+	int						lastframe;
+	struct snapshotJob_s	*encodeSource;	// job with identical delta encoded entities
+	encodedEntities_t		encoded;
+
+	msg_t					msg;
+	byte					msgBuf[MAX_MSGLEN];
+} snapshotJob_t;
+
+static workerPool_t		*snapshotWorkers;
+static snapshotJob_t	*snapshotJobs;
+static int				numSnapshotJobs;
+
 /*
 =======================
-SV_SendClientSnapshot
+SV_GatherSnapshotJob
+=======================
+*/
+static void SV_GatherSnapshotJob( void *data, int index, int thread ) {
+	snapshotJob_t	*job = (snapshotJob_t *)data + index;
 
-Also called by SV_FinalMessage
+	if ( job->visSource == job ) {
+		SV_GatherVisibleEntities( &snapshotContexts[thread], job->cluster, job->area, &job->visible );
+	}
+}
 
+/*
+=======================
+SV_BuildSnapshotJob
 =======================
 */
-void SV_SendClientSnapshot( client_t *client ) {
-	byte		msg_buf[MAX_MSGLEN];
-	msg_t		msg;
+static void SV_BuildSnapshotJob( void *data, int index, int thread ) {
+	snapshotJob_t		*job = (snapshotJob_t *)data + index;
+	snapshotContext_t	*ctx = &snapshotContexts[thread];
+
+	ctx->error = NULL;
+	SV_BuildClientSnapshot( ctx, job->client, job->origin, job->area,
+		job->visSource ? &job->visSource->visible : NULL, &job->entityNumbers );
+	job->error = ctx->error;
+}
 
-	// build the snapshot
-	SV_BuildClientSnapshot( client );
+/*
+=======================
+SV_StoreSnapshotJob
+=======================
+*/
+static void SV_StoreSnapshotJob( void *data, int index, int thread ) {
+	snapshotJob_t	*job = (snapshotJob_t *)data + index;
+
+	if ( job->storeEntities ) {
+		SV_StoreSnapshotEntities( job->client, &job->entityNumbers );
+	}
+}
+
+/*
+=======================
+SV_EncodeSnapshot
+=======================
+*/
+static void SV_EncodeSnapshot( snapshotJob_t *job ) {
+	client_t		*client = job->client;
 
-	MSG_Init (&msg, msg_buf, sizeof(msg_buf));
-	msg.allowoverflow = qtrue;
+	MSG_Init (&job->msg, job->msgBuf, sizeof(job->msgBuf));
+	job->msg.allowoverflow = qtrue;
 
 	// NOTE, MRE: all server->client messages now acknowledge
 	// let the client know which reliable clientCommands we have received
-	MSG_WriteLong( &msg, client->lastClientCommand );
+	MSG_WriteLong( &job->msg, client->lastClientCommand );
 
 	// (re)send any reliable server commands
-	SV_UpdateServerCommandsToClient( client, &msg );
+	SV_UpdateServerCommandsToClient( client, &job->msg );
 
 	// send over all the relevant entityState_t
 	// and the playerState_t
-	SV_WriteSnapshotToClient( client, &msg );
+	SV_WriteSnapshotToClient( client, job->oldframe, job->lastframe,
+		job->encodeSource ? &job->encodeSource->encoded : NULL, &job->encoded, &job->msg );
+}
+
+/*
+=======================
+SV_EncodeSnapshotJob
+
+Encodes the snapshots that don't copy another client's entities
+=======================
+*/
+static void SV_EncodeSnapshotJob( void *data, int index, int thread ) {
+	snapshotJob_t	*job = (snapshotJob_t *)data + index;
+
+	if ( !job->encodeSource ) {
+		SV_EncodeSnapshot( job );
+	}
+}
+
+/*
+=======================
+SV_EncodeSharedSnapshotJob
+
+Encodes the rest, once the entities they copy have been written
+=======================
+*/
+static void SV_EncodeSharedSnapshotJob( void *data, int index, int thread ) {
+	snapshotJob_t	*job = (snapshotJob_t *)data + index;
+
+	if ( job->encodeSource ) {
+		SV_EncodeSnapshot( job );
+	}
+}
+
+/*
+=======================
+SV_FinishSnapshotJob
+=======================
+*/
+static void SV_FinishSnapshotJob( snapshotJob_t *job ) {
+	client_t	*client = job->client;
 
 	// Add any download data if the client is downloading
-	SV_WriteDownloadToClient( client, &msg );
+	SV_WriteDownloadToClient( client, &job->msg );
 
 #ifdef USE_VOIP
-	SV_WriteVoipToClient( client, &msg );
+	SV_WriteVoipToClient( client, &job->msg );
 #endif
 
 	// check for overflow
-	if ( msg.overflowed ) {
+	if ( job->msg.overflowed ) {
 		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		MSG_Clear (&msg);
+		MSG_Clear (&job->msg);
 	}
 
-	SV_SendMessageToClient( &msg, client );
+	SV_SendMessageToClient( &job->msg, client );
+}
+
+/*
+=======================
+SV_SameSnapshotEntities
+=======================
+*/
+static qboolean SV_SameSnapshotEntities( snapshotEntityNumbers_t *a, snapshotEntityNumbers_t *b ) {
+	if ( a->numSnapshotEntities != b->numSnapshotEntities ) {
+		return qfalse;
+	}
+	return !memcmp( a->snapshotEntities, b->snapshotEntities,
+		a->numSnapshotEntities * sizeof( a->snapshotEntities[0] ) );
+}
+
+/*
+=======================
+SV_SameEncodedEntities
+
+Checks if two snapshots delta encode their entities to the same bits,
+which is the case if they share their entity states and delta base
+=======================
+*/
+static qboolean SV_SameEncodedEntities( snapshotJob_t *a, snapshotJob_t *b ) {
+	clientSnapshot_t	*frameA, *frameB;
+
+	frameA = &a->client->frames[ a->client->netchan.outgoingSequence & PACKET_MASK ];
+	frameB = &b->client->frames[ b->client->netchan.outgoingSequence & PACKET_MASK ];
+
+	if ( frameA->first_entity != frameB->first_entity || frameA->num_entities != frameB->num_entities ) {
+		return qfalse;
+	}
+
+	if ( !a->oldframe || !b->oldframe ) {
+		return a->oldframe == b->oldframe;
+	}
+
+	return a->oldframe->first_entity == b->oldframe->first_entity &&
+		a->oldframe->num_entities == b->oldframe->num_entities;
+}
+
+/*
+=======================
+SV_RunSnapshotJobs
+=======================
+*/
+static void SV_RunSnapshotJobs( snapshotJob_t *jobs, int count ) {
+	int					i, j;
+	int					numShared;
+	snapshotJob_t		*job;
+	snapshotContext_t	*ctx = &snapshotContexts[0];
+
+	if ( sv.state && sv.broadcastTime != sv.time ) {
+		SV_PrepareSnapshotEntities();
+	}
+
+	// find the viewpoints, the entities visible from each one
+	// are only gathered once
+	for ( i = 0, job = jobs ; i < count ; i++, job++ ) {
+		job->visSource = NULL;
+		if ( !SV_FindSnapshotViewpoint( job->client, job->origin, &job->cluster, &job->area ) ) {
+			continue;
+		}
+
+		ctx->visLookups++;
+		for ( j = 0 ; j < i ; j++ ) {
+			if ( jobs[j].visSource == &jobs[j] &&
+				jobs[j].cluster == job->cluster && jobs[j].area == job->area ) {
+				job->visSource = &jobs[j];
+				ctx->visHits++;
+				break;
+			}
+		}
+		if ( !job->visSource ) {
+			job->visSource = job;
+		}
+	}
+
+	Sys_RunWorkerJobs( snapshotWorkers, SV_GatherSnapshotJob, jobs, count );
+	Sys_RunWorkerJobs( snapshotWorkers, SV_BuildSnapshotJob, jobs, count );
+
+	// clients that ended up with the same entities, like spectators
+	// following the same player, share their entity states
+	for ( i = 0, job = jobs ; i < count ; i++, job++ ) {
+		if ( job->error ) {
+			Com_Error( ERR_DROP, "%s", job->error );
+		}
+
+		job->storeEntities = qtrue;
+		for ( j = 0 ; j < i && job->visSource ; j++ ) {
+			if ( jobs[j].storeEntities && jobs[j].visSource == job->visSource &&
+				SV_SameSnapshotEntities( &jobs[j].entityNumbers, &job->entityNumbers ) ) {
+				SV_ShareSnapshotEntities( job->client, jobs[j].client );
+				job->storeEntities = qfalse;
+				break;
+			}
+		}
+
+		if ( job->storeEntities ) {
+			SV_AllocSnapshotEntities( job->client, &job->entityNumbers );
+		}
+	}
+
+	// only now that everything has been allocated is it known
+	// which old frames are still intact
+	for ( i = 0, job = jobs ; i < count ; i++, job++ ) {
+		job->oldframe = SV_SnapshotDeltaFrame( job->client, &job->lastframe );
+	}
+
+	Sys_RunWorkerJobs( snapshotWorkers, SV_StoreSnapshotJob, jobs, count );
+
+	// if they also delta from shared entity states, the encoded
+	// entities are copied from the first of them
+	numShared = 0;
+	for ( i = 0, job = jobs ; i < count ; i++, job++ ) {
+		job->encodeSource = NULL;
+		job->encoded.msg = NULL;
+
+		ctx->encodeLookups++;
+		for ( j = 0 ; j < i ; j++ ) {
+			if ( !jobs[j].encodeSource && SV_SameEncodedEntities( &jobs[j], job ) ) {
+				job->encodeSource = &jobs[j];
+				ctx->encodeHits++;
+				numShared++;
+				break;
+			}
+		}
+	}
+
+	Sys_RunWorkerJobs( snapshotWorkers, SV_EncodeSnapshotJob, jobs, count );
+	if ( numShared ) {
+		Sys_RunWorkerJobs( snapshotWorkers, SV_EncodeSharedSnapshotJob, jobs, count );
+	}
+
+	for ( i = 0, job = jobs ; i < count ; i++, job++ ) {
+		SV_FinishSnapshotJob( job );
+	}
+}
+
+/*
+=======================
+SV_StartSnapshotThreads
+=======================
+*/
+static void SV_StartSnapshotThreads( void ) {
+	sv_snapshotThreads->modified = qfalse;
+
+	Sys_DestroyWorkerPool( snapshotWorkers );
+	snapshotWorkers = Sys_CreateWorkerPool( sv_snapshotThreads->integer );
+
+	if ( snapshotWorkers ) {
+		Com_Printf( "Building snapshots with %i worker threads\n",
+			Sys_WorkerPoolThreads( snapshotWorkers ) );
+	}
+}
+
+/*
+=======================
+SV_ShutdownSnapshotThreads
+
+Called by SV_Shutdown
+=======================
+*/
+void SV_ShutdownSnapshotThreads( void ) {
+	Sys_DestroyWorkerPool( snapshotWorkers );
+	snapshotWorkers = NULL;
+
+	if ( snapshotJobs ) {
+		Z_Free( snapshotJobs );
+		snapshotJobs = NULL;
+	}
+	numSnapshotJobs = 0;
+
+	// start them again with the next server
+	if ( sv_snapshotThreads ) {
+		sv_snapshotThreads->modified = qtrue;
+	}
+}
+
+/*
+=======================
+SV_SendClientSnapshot
+
+Also called by SV_FinalMessage
+
+=======================
+*/
+void SV_SendClientSnapshot( client_t *client ) {
+	snapshotJob_t	job;
+
+	job.client = client;
+	SV_RunSnapshotJobs( &job, 1 );
 }
 
 
@@ -666,7 +1268,26 @@ SV_SendClientMessages
 */
 void SV_SendClientMessages( void ) {
 	int			i;
+	int			numJobs;
 	client_t	*c;
+	snapshotContext_t	*ctx;
+
+	if ( sv_snapshotThreads->modified ) {
+		SV_StartSnapshotThreads();
+	}
+
+	// the snapshots are gathered up and built together so clients can
+	// share viewpoints and encodings, which needs a message buffer for
+	// every client; without worker threads the jobs just run in turn
+	if ( numSnapshotJobs != sv_maxclients->integer ) {
+		if ( snapshotJobs ) {
+			Z_Free( snapshotJobs );
+		}
+		numSnapshotJobs = sv_maxclients->integer;
+		snapshotJobs = Z_Malloc( numSnapshotJobs * sizeof( snapshotJob_t ) );
+	}
+
+	numJobs = 0;
 
 	// send a message to each connected client
 	for (i=0, c = svs.clients ; i < sv_maxclients->integer ; i++, c++) {
@@ -688,7 +1309,38 @@ void SV_SendClientMessages( void ) {
 		}
 
 		// generate and send a new message
-		SV_SendClientSnapshot( c );
+		snapshotJobs[numJobs++].client = c;
 	}
-}
 
+	if ( numJobs ) {
+		SV_RunSnapshotJobs( snapshotJobs, numJobs );
+	}
+
+	// sum up the counters of all the threads once a second
+	if ( svs.time - sv.statsTime >= 1000 ) {
+		snapshotContext_t	total;
+
+		Com_Memset( &total, 0, sizeof( total ) );
+		for ( i = 0, ctx = snapshotContexts ; i <= MAX_WORKER_THREADS ; i++, ctx++ ) {
+			total.snapshots += ctx->snapshots;
+			total.entitiesExamined += ctx->entitiesExamined;
+			total.entitiesScanned += ctx->entitiesScanned;
+			total.entitiesSent += ctx->entitiesSent;
+			total.visLookups += ctx->visLookups;
+			total.visHits += ctx->visHits;
+			total.encodeLookups += ctx->encodeLookups;
+			total.encodeHits += ctx->encodeHits;
+			ctx->snapshots = ctx->entitiesExamined = ctx->entitiesScanned = ctx->entitiesSent = 0;
+			ctx->visLookups = ctx->visHits = ctx->encodeLookups = ctx->encodeHits = 0;
+		}
+
+		if ( sv_snapshotStats->integer && total.snapshots ) {
+			Com_Printf( "snapshots: %i, entities examined: %i (full scan %i), sent: %i\n",
+				total.snapshots, total.entitiesExamined,
+				total.entitiesScanned, total.entitiesSent );
+			Com_Printf( "shared viewpoints: %i/%i, shared entity encodings: %i/%i\n",
+				total.visHits, total.visLookups, total.encodeHits, total.encodeLookups );
+		}
+		sv.statsTime = svs.time;
+	}
+}
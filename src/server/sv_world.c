@@ -55,144 +55,493 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent ) {
 ENTITY CHECKING
 
 To avoid linearly searching through lists of entities during environment testing,
-the world is carved up with an evenly spaced, axially aligned bsp tree.  Entities
-are kept in chains either at the final leafs, or at the first node that splits
-them, which prevents having to deal with multiple fragments of a single entity.
+linked entities are kept in a dynamic bounding box tree.  Every leaf holds one
+entity with its box grown by BROAD_MARGIN, so an entity that moves a little
+doesn't need to be moved in the tree each time it is linked, and the tree is
+kept balanced with rotations as leafs come and go.
 
 ===============================================================================
 */
 
-typedef struct worldSector_s {
-	int		axis;		// -1 = leaf node
-	float	dist;
-	struct worldSector_s	*children[2];
-	svEntity_t	*entities;
-} worldSector_t;
+typedef struct {
+	vec3_t	mins, maxs;
+	int		parent;			// next free node for free nodes
+	int		children[2];	// -1 for leafs
+	int		height;			// 0 for leafs, -1 for free nodes
+	int		entityNum;		// leafs only
+} broadNode_t;
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	64
+#define	MAX_BROAD_NODES		( 2 * MAX_GENTITIES )
+#define	MAX_BROAD_DEPTH		128
+#define	BROAD_MARGIN		16
+
+static broadNode_t	sv_broadNodes[MAX_BROAD_NODES];
+static int			sv_broadRoot;
+static int			sv_broadFree;
+
+/*
+===============
+SV_BoxArea
+
+Surface area of a box, the cost of a node in the tree
+===============
+*/
+static float SV_BoxArea( const vec3_t mins, const vec3_t maxs ) {
+	float	x, y, z;
 
-worldSector_t	sv_worldSectors[AREA_NODES];
-int			sv_numworldSectors;
+	x = maxs[0] - mins[0];
+	y = maxs[1] - mins[1];
+	z = maxs[2] - mins[2];
 
+	return 2 * ( x * y + y * z + z * x );
+}
 
 /*
 ===============
-SV_SectorList_f
+SV_UnionArea
 ===============
 */
-void SV_SectorList_f( void ) {
-	int				i, c;
-	worldSector_t	*sec;
-	svEntity_t		*ent;
+static float SV_UnionArea( const broadNode_t *a, const broadNode_t *b ) {
+	vec3_t	mins, maxs;
+	int		i;
 
-	for ( i = 0 ; i < AREA_NODES ; i++ ) {
-		sec = &sv_worldSectors[i];
+	for ( i = 0 ; i < 3 ; i++ ) {
+		mins[i] = MIN( a->mins[i], b->mins[i] );
+		maxs[i] = MAX( a->maxs[i], b->maxs[i] );
+	}
 
-		c = 0;
-		for ( ent = sec->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
-			c++;
-		}
-		Com_Printf( "sector %i: %i entities\n", i, c );
+	return SV_BoxArea( mins, maxs );
+}
+
+/*
+===============
+SV_RefitBroadNode
+
+Recalculates the box and height of a node from its children
+===============
+*/
+static void SV_RefitBroadNode( int index ) {
+	broadNode_t	*node, *a, *b;
+	int			i;
+
+	node = &sv_broadNodes[index];
+	a = &sv_broadNodes[node->children[0]];
+	b = &sv_broadNodes[node->children[1]];
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		node->mins[i] = MIN( a->mins[i], b->mins[i] );
+		node->maxs[i] = MAX( a->maxs[i], b->maxs[i] );
 	}
+	node->height = 1 + MAX( a->height, b->height );
 }
 
 /*
 ===============
-SV_CreateworldSector
+SV_AllocBroadNode
+===============
+*/
+static int SV_AllocBroadNode( void ) {
+	int		index;
 
-Builds a uniformly subdivided tree for the given world size
+	if ( sv_broadFree == -1 ) {
+		Com_Error( ERR_DROP, "SV_AllocBroadNode: out of nodes" );
+	}
+
+	index = sv_broadFree;
+	sv_broadFree = sv_broadNodes[index].parent;
+	sv_broadNodes[index].parent = -1;
+	sv_broadNodes[index].children[0] = sv_broadNodes[index].children[1] = -1;
+	sv_broadNodes[index].height = 0;
+
+	return index;
+}
+
+/*
+===============
+SV_FreeBroadNode
 ===============
 */
-static worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs ) {
-	worldSector_t	*anode;
-	vec3_t		size;
-	vec3_t		mins1, maxs1, mins2, maxs2;
+static void SV_FreeBroadNode( int index ) {
+	sv_broadNodes[index].parent = sv_broadFree;
+	sv_broadNodes[index].height = -1;
+	sv_broadFree = index;
+}
 
-	anode = &sv_worldSectors[sv_numworldSectors];
-	sv_numworldSectors++;
+/*
+===============
+SV_RotateBroadNode
 
-	if (depth == AREA_DEPTH) {
-		anode->axis = -1;
-		anode->children[0] = anode->children[1] = NULL;
-		return anode;
+If one child of a node is more than a level taller than the other, lift it
+up in place of the node, which takes over its shorter child; returns the
+node now in its place
+===============
+*/
+static int SV_RotateBroadNode( int iA ) {
+	broadNode_t	*A, *up, *F, *G;
+	int			iUp, iF, iG;
+	int			side, balance;
+
+	A = &sv_broadNodes[iA];
+	if ( A->height < 2 ) {
+		return iA;
 	}
-	
-	VectorSubtract (maxs, mins, size);
-	if (size[0] > size[1]) {
-		anode->axis = 0;
+
+	balance = sv_broadNodes[A->children[1]].height - sv_broadNodes[A->children[0]].height;
+	if ( balance > 1 ) {
+		side = 1;
+	} else if ( balance < -1 ) {
+		side = 0;
 	} else {
-		anode->axis = 1;
+		return iA;
 	}
 
-	anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
-	VectorCopy (mins, mins1);	
-	VectorCopy (mins, mins2);	
-	VectorCopy (maxs, maxs1);	
-	VectorCopy (maxs, maxs2);	
-	
-	maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
-	
-	anode->children[0] = SV_CreateworldSector (depth+1, mins2, maxs2);
-	anode->children[1] = SV_CreateworldSector (depth+1, mins1, maxs1);
+	iUp = A->children[side];
+	up = &sv_broadNodes[iUp];
+	iF = up->children[0];
+	iG = up->children[1];
+	F = &sv_broadNodes[iF];
+	G = &sv_broadNodes[iG];
 
-	return anode;
+	// lift up into the place of A
+	up->parent = A->parent;
+	if ( up->parent != -1 ) {
+		broadNode_t	*parent = &sv_broadNodes[up->parent];
+
+		parent->children[parent->children[0] == iA ? 0 : 1] = iUp;
+	} else {
+		sv_broadRoot = iUp;
+	}
+
+	// A goes under up, together with the taller of its children
+	up->children[0] = iA;
+	A->parent = iUp;
+	if ( F->height > G->height ) {
+		up->children[1] = iF;
+		A->children[side] = iG;
+		G->parent = iA;
+	} else {
+		up->children[1] = iG;
+		A->children[side] = iF;
+		F->parent = iA;
+	}
+
+	SV_RefitBroadNode( iA );
+	SV_RefitBroadNode( iUp );
+
+	return iUp;
 }
 
 /*
 ===============
-SV_ClearWorld
+SV_FixBroadAncestors
 
+Walks up from a node that has changed, refitting and rebalancing the tree
 ===============
 */
-void SV_ClearWorld( void ) {
-	clipHandle_t	h;
-	vec3_t			mins, maxs;
+static void SV_FixBroadAncestors( int index ) {
+	while ( index != -1 ) {
+		index = SV_RotateBroadNode( index );
+		SV_RefitBroadNode( index );
+		index = sv_broadNodes[index].parent;
+	}
+}
 
-	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
-	sv_numworldSectors = 0;
+/*
+===============
+SV_InsertBroadLeaf
 
-	// get world map bounds
-	h = CM_InlineModel( 0 );
-	CM_ModelBounds( h, mins, maxs );
-	SV_CreateworldSector( 0, mins, maxs );
+Adds a leaf next to the node that makes the tree grow least
+===============
+*/
+static void SV_InsertBroadLeaf( int leaf ) {
+	broadNode_t	*node, *child;
+	float		area, combined, inheritance;
+	float		cost, childCost[2];
+	int			index, sibling, parent;
+	int			i;
+
+	if ( sv_broadRoot == -1 ) {
+		sv_broadRoot = leaf;
+		sv_broadNodes[leaf].parent = -1;
+		return;
+	}
+
+	index = sv_broadRoot;
+	while ( sv_broadNodes[index].children[0] != -1 ) {
+		node = &sv_broadNodes[index];
+
+		area = SV_BoxArea( node->mins, node->maxs );
+		combined = SV_UnionArea( node, &sv_broadNodes[leaf] );
+
+		// cost of making the leaf a sibling of this node
+		cost = 2 * combined;
+
+		// the minimum cost of pushing the leaf further down
+		inheritance = 2 * ( combined - area );
+
+		for ( i = 0 ; i < 2 ; i++ ) {
+			child = &sv_broadNodes[node->children[i]];
+			childCost[i] = SV_UnionArea( child, &sv_broadNodes[leaf] ) + inheritance;
+			if ( child->children[0] != -1 ) {
+				childCost[i] -= SV_BoxArea( child->mins, child->maxs );
+			}
+		}
+
+		if ( cost < childCost[0] && cost < childCost[1] ) {
+			break;
+		}
+
+		index = node->children[childCost[0] < childCost[1] ? 0 : 1];
+	}
+	sibling = index;
+
+	// a new parent takes the place of the sibling
+	parent = SV_AllocBroadNode();
+	sv_broadNodes[parent].parent = sv_broadNodes[sibling].parent;
+	sv_broadNodes[parent].children[0] = sibling;
+	sv_broadNodes[parent].children[1] = leaf;
+
+	if ( sv_broadNodes[parent].parent != -1 ) {
+		node = &sv_broadNodes[sv_broadNodes[parent].parent];
+		node->children[node->children[0] == sibling ? 0 : 1] = parent;
+	} else {
+		sv_broadRoot = parent;
+	}
+	sv_broadNodes[sibling].parent = parent;
+	sv_broadNodes[leaf].parent = parent;
+
+	SV_FixBroadAncestors( parent );
 }
 
+/*
+===============
+SV_RemoveBroadLeaf
+
+Takes a leaf out of the tree, its sibling takes the place of their parent
+===============
+*/
+static void SV_RemoveBroadLeaf( int leaf ) {
+	broadNode_t	*node;
+	int			parent, grandParent, sibling;
+
+	if ( leaf == sv_broadRoot ) {
+		sv_broadRoot = -1;
+		return;
+	}
+
+	parent = sv_broadNodes[leaf].parent;
+	grandParent = sv_broadNodes[parent].parent;
+	node = &sv_broadNodes[parent];
+	sibling = node->children[node->children[0] == leaf ? 1 : 0];
+
+	sv_broadNodes[sibling].parent = grandParent;
+	if ( grandParent != -1 ) {
+		node = &sv_broadNodes[grandParent];
+		node->children[node->children[0] == parent ? 0 : 1] = sibling;
+	} else {
+		sv_broadRoot = sibling;
+	}
+	SV_FreeBroadNode( parent );
+
+	SV_FixBroadAncestors( grandParent );
+}
 
 /*
 ===============
-SV_UnlinkEntity
+SV_LinkBroadphase
 
+Makes sure the leaf of an entity contains its absolute box
 ===============
 */
-void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
-	svEntity_t		*ent;
-	svEntity_t		*scan;
-	worldSector_t	*ws;
+static void SV_LinkBroadphase( svEntity_t *ent, sharedEntity_t *gEnt ) {
+	broadNode_t	*leaf;
+
+	if ( ent->broadLeaf ) {
+		leaf = &sv_broadNodes[ent->broadLeaf - 1];
+		if ( leaf->mins[0] <= gEnt->r.absmin[0] && leaf->maxs[0] >= gEnt->r.absmax[0]
+			&& leaf->mins[1] <= gEnt->r.absmin[1] && leaf->maxs[1] >= gEnt->r.absmax[1]
+			&& leaf->mins[2] <= gEnt->r.absmin[2] && leaf->maxs[2] >= gEnt->r.absmax[2] ) {
+			return;
+		}
+		SV_RemoveBroadLeaf( ent->broadLeaf - 1 );
+	} else {
+		ent->broadLeaf = SV_AllocBroadNode() + 1;
+	}
 
-	ent = SV_SvEntityForGentity( gEnt );
+	leaf = &sv_broadNodes[ent->broadLeaf - 1];
+	leaf->entityNum = ent - sv.svEntities;
+	VectorSet( leaf->mins, gEnt->r.absmin[0] - BROAD_MARGIN,
+		gEnt->r.absmin[1] - BROAD_MARGIN, gEnt->r.absmin[2] - BROAD_MARGIN );
+	VectorSet( leaf->maxs, gEnt->r.absmax[0] + BROAD_MARGIN,
+		gEnt->r.absmax[1] + BROAD_MARGIN, gEnt->r.absmax[2] + BROAD_MARGIN );
 
-	gEnt->r.linked = qfalse;
+	SV_InsertBroadLeaf( ent->broadLeaf - 1 );
+}
+
+/*
+===============
+SV_UnlinkBroadphase
+===============
+*/
+static void SV_UnlinkBroadphase( svEntity_t *ent ) {
+	if ( !ent->broadLeaf ) {
+		return;
+	}
+
+	SV_RemoveBroadLeaf( ent->broadLeaf - 1 );
+	SV_FreeBroadNode( ent->broadLeaf - 1 );
+	ent->broadLeaf = 0;
+}
+
+/*
+===============
+SV_SectorList_f
+===============
+*/
+void SV_SectorList_f( void ) {
+	int		i, leafs, nodes;
+
+	leafs = nodes = 0;
+	for ( i = 0 ; i < MAX_BROAD_NODES ; i++ ) {
+		if ( sv_broadNodes[i].height == 0 ) {
+			leafs++;
+		} else if ( sv_broadNodes[i].height > 0 ) {
+			nodes++;
+		}
+	}
+
+	Com_Printf( "%i entities, %i nodes, height %i\n", leafs, nodes,
+		sv_broadRoot == -1 ? 0 : sv_broadNodes[sv_broadRoot].height );
+}
+
+/*
+===============
+SV_ClearWorld
+
+===============
+*/
+void SV_ClearWorld( void ) {
+	int		i;
 
-	ws = ent->worldSector;
-	if ( !ws ) {
-		return;		// not linked in anywhere
+	for ( i = 0 ; i < MAX_BROAD_NODES ; i++ ) {
+		sv_broadNodes[i].parent = i + 1;
+		sv_broadNodes[i].height = -1;
 	}
-	ent->worldSector = NULL;
+	sv_broadNodes[MAX_BROAD_NODES - 1].parent = -1;
+	sv_broadFree = 0;
+	sv_broadRoot = -1;
+
+	// one entity list per PVS cluster
+	sv.numClusters = CM_NumClusters();
+	sv.clusterEntities = Hunk_Alloc( sv.numClusters * sizeof( *sv.clusterEntities ), h_high );
+	sv.largeEntities = NULL;
+	sv.broadcastTime = -1;
+}
+
+
+/*
+===============
+SV_UnlinkEntityClusters
 
-	if ( ws->entities == ent ) {
-		ws->entities = ent->nextEntityInWorldSector;
+===============
+*/
+static void SV_UnlinkEntityClusters( svEntity_t *ent ) {
+	int				i;
+	clusterLink_t	*link;
+	svEntity_t		**prev;
+
+	for ( i = 0 ; i < ent->numClusterLinks ; i++ ) {
+		link = &ent->clusterLinks[i];
+		if ( link->prev ) {
+			link->prev->next = link->next;
+		} else {
+			sv.clusterEntities[link->cluster] = link->next;
+		}
+		if ( link->next ) {
+			link->next->prev = link->prev;
+		}
+	}
+	ent->numClusterLinks = 0;
+
+	if ( !ent->largeEntity ) {
 		return;
 	}
+	ent->largeEntity = qfalse;
 
-	for ( scan = ws->entities ; scan ; scan = scan->nextEntityInWorldSector ) {
-		if ( scan->nextEntityInWorldSector == ent ) {
-			scan->nextEntityInWorldSector = ent->nextEntityInWorldSector;
-			return;
+	// large entities are rare, so a scan is fine here
+	for ( prev = &sv.largeEntities ; *prev ; prev = &(*prev)->nextLargeEntity ) {
+		if ( *prev == ent ) {
+			*prev = ent->nextLargeEntity;
+			break;
 		}
 	}
+}
+
+
+/*
+===============
+SV_LinkEntityClusters
+
+Adds the entity to the list of every distinct cluster it touches
+===============
+*/
+static void SV_LinkEntityClusters( svEntity_t *ent ) {
+	int				i, j;
+	int				cluster;
+	clusterLink_t	*link;
+
+	for ( i = 0 ; i < ent->numClusters ; i++ ) {
+		cluster = ent->clusternums[i];
+		if ( cluster < 0 || cluster >= sv.numClusters ) {
+			continue;
+		}
+
+		// several leafs often share a cluster
+		for ( j = 0 ; j < ent->numClusterLinks ; j++ ) {
+			if ( ent->clusterLinks[j].cluster == cluster ) {
+				break;
+			}
+		}
+		if ( j != ent->numClusterLinks ) {
+			continue;
+		}
+
+		link = &ent->clusterLinks[ent->numClusterLinks++];
+		link->ent = ent;
+		link->cluster = cluster;
+		link->prev = NULL;
+		link->next = sv.clusterEntities[cluster];
+		if ( link->next ) {
+			link->next->prev = link;
+		}
+		sv.clusterEntities[cluster] = link;
+	}
 
-	Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldSector\n" );
+	// the clusters that didn't fit in clusternums aren't indexed,
+	// so these have to be checked against every viewpoint
+	if ( ent->lastCluster ) {
+		ent->largeEntity = qtrue;
+		ent->nextLargeEntity = sv.largeEntities;
+		sv.largeEntities = ent;
+	}
+}
+
+
+/*
+===============
+SV_UnlinkEntity
+
+===============
+*/
+void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
+	svEntity_t		*ent;
+
+	ent = SV_SvEntityForGentity( gEnt );
+
+	gEnt->r.linked = qfalse;
+
+	SV_UnlinkEntityClusters( ent );
+	SV_UnlinkBroadphase( ent );
 }
 
 
@@ -204,7 +553,6 @@ SV_LinkEntity
 */
 #define MAX_TOTAL_ENT_LEAFS		128
 void SV_LinkEntity( sharedEntity_t *gEnt ) {
-	worldSector_t	*node;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			cluster;
 	int			num_leafs;
@@ -216,9 +564,9 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	ent = SV_SvEntityForGentity( gEnt );
 
-	if ( ent->worldSector ) {
-		SV_UnlinkEntity( gEnt );	// unlink from old position
-	}
+	// unlink from the old clusters, the broadphase leaf is only
+	// moved if the entity has left it
+	SV_UnlinkEntityClusters( ent );
 
 	// encode the size into the entityState_t for client prediction
 	if ( gEnt->r.bmodel ) {
@@ -293,6 +641,7 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	// if none of the leafs were inside the map, the
 	// entity is outside the world and can be considered unlinked
 	if ( !num_leafs ) {
+		SV_UnlinkEntity( gEnt );
 		return;
 	}
 
@@ -334,7 +683,190 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	gEnt->r.linkcount++;
 
-	// find the first world sector node that the ent's box crosses
+	SV_LinkBroadphase( ent, gEnt );
+	SV_LinkEntityClusters( ent );
+
+	gEnt->r.linked = qtrue;
+}
+
+/*
+============================================================================
+
+AREA QUERY
+
+Fills in a list of all entities who's absmin / absmax intersects the given
+bounds.  This does NOT mean that they actually touch in the case of bmodels.
+============================================================================
+*/
+
+typedef struct {
+	vec3_t	mins, maxs;
+	int		contentmask;
+} broadQuery_t;
+
+static broadQuery_t	*sv_broadQueries;	// recorded for sv_broadphaseBench
+static int			sv_numBroadQueries, sv_maxBroadQueries;
+
+/*
+================
+SV_AreaEntitiesFiltered
+
+If contentmask is not 0, only entities with some of those contents are listed
+================
+*/
+static int SV_AreaEntitiesFiltered( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount, int contentmask ) {
+	int				stack[MAX_BROAD_DEPTH];
+	int				depth, count;
+	broadNode_t		*node;
+	sharedEntity_t	*gcheck;
+
+	if ( sv_numBroadQueries < sv_maxBroadQueries ) {
+		broadQuery_t	*query = &sv_broadQueries[sv_numBroadQueries++];
+
+		VectorCopy( mins, query->mins );
+		VectorCopy( maxs, query->maxs );
+		query->contentmask = contentmask;
+		if ( sv_numBroadQueries == sv_maxBroadQueries ) {
+			Com_Printf( "sv_broadphaseBench: %i queries recorded\n", sv_numBroadQueries );
+		}
+	}
+
+	if ( sv_broadRoot == -1 ) {
+		return 0;
+	}
+
+	count = 0;
+	depth = 0;
+	stack[depth++] = sv_broadRoot;
+
+	while ( depth ) {
+		node = &sv_broadNodes[stack[--depth]];
+
+		if ( node->mins[0] > maxs[0] || node->mins[1] > maxs[1] || node->mins[2] > maxs[2]
+			|| node->maxs[0] < mins[0] || node->maxs[1] < mins[1] || node->maxs[2] < mins[2] ) {
+			continue;
+		}
+
+		if ( node->children[0] != -1 ) {
+			if ( depth + 2 > MAX_BROAD_DEPTH ) {
+				Com_Error( ERR_DROP, "SV_AreaEntities: tree too deep" );
+			}
+			stack[depth++] = node->children[1];
+			stack[depth++] = node->children[0];
+			continue;
+		}
+
+		gcheck = SV_GentityNum( node->entityNum );
+
+		if ( contentmask && !( gcheck->r.contents & contentmask ) ) {
+			continue;
+		}
+
+		if ( gcheck->r.absmin[0] > maxs[0]
+		|| gcheck->r.absmin[1] > maxs[1]
+		|| gcheck->r.absmin[2] > maxs[2]
+		|| gcheck->r.absmax[0] < mins[0]
+		|| gcheck->r.absmax[1] < mins[1]
+		|| gcheck->r.absmax[2] < mins[2]) {
+			continue;
+		}
+
+		if ( count == maxcount ) {
+			Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+			break;
+		}
+
+		entityList[count++] = node->entityNum;
+	}
+
+	return count;
+}
+
+/*
+================
+SV_AreaEntities
+================
+*/
+int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
+	return SV_AreaEntitiesFiltered( mins, maxs, entityList, maxcount, 0 );
+}
+
+/*
+===============================================================================
+
+The uniformly subdivided tree SV_AreaEntities used to use, only built from the
+linked entities by sv_broadphaseBench to compare against.
+
+===============================================================================
+*/
+
+typedef struct worldSector_s {
+	int		axis;		// -1 = leaf node
+	float	dist;
+	struct worldSector_s	*children[2];
+	int		entities;	// -1 terminated through sectorNext
+} worldSector_t;
+
+#define	AREA_DEPTH	4
+#define	AREA_NODES	64
+
+static worldSector_t	*sv_worldSectors;
+static int				sv_numworldSectors;
+static int				*sectorNext;
+
+/*
+===============
+SV_CreateworldSector
+
+Builds a uniformly subdivided tree for the given world size
+===============
+*/
+static worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs ) {
+	worldSector_t	*anode;
+	vec3_t		size;
+	vec3_t		mins1, maxs1, mins2, maxs2;
+
+	anode = &sv_worldSectors[sv_numworldSectors];
+	sv_numworldSectors++;
+	anode->entities = -1;
+
+	if (depth == AREA_DEPTH) {
+		anode->axis = -1;
+		anode->children[0] = anode->children[1] = NULL;
+		return anode;
+	}
+	
+	VectorSubtract (maxs, mins, size);
+	if (size[0] > size[1]) {
+		anode->axis = 0;
+	} else {
+		anode->axis = 1;
+	}
+
+	anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
+	VectorCopy (mins, mins1);	
+	VectorCopy (mins, mins2);	
+	VectorCopy (maxs, maxs1);	
+	VectorCopy (maxs, maxs2);	
+	
+	maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
+	
+	anode->children[0] = SV_CreateworldSector (depth+1, mins2, maxs2);
+	anode->children[1] = SV_CreateworldSector (depth+1, mins1, maxs1);
+
+	return anode;
+}
+
+/*
+===============
+SV_SectorLinkEntity
+
+Puts an entity in the first sector node its box crosses
+===============
+*/
+static void SV_SectorLinkEntity( sharedEntity_t *gEnt ) {
+	worldSector_t	*node;
+
 	node = sv_worldSectors;
 	while (1)
 	{
@@ -347,25 +879,11 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 		else
 			break;		// crosses the node
 	}
-	
-	// link it in
-	ent->worldSector = node;
-	ent->nextEntityInWorldSector = node->entities;
-	node->entities = ent;
 
-	gEnt->r.linked = qtrue;
+	sectorNext[gEnt->s.number] = node->entities;
+	node->entities = gEnt->s.number;
 }
 
-/*
-============================================================================
-
-AREA QUERY
-
-Fills in a list of all entities who's absmin / absmax intersects the given
-bounds.  This does NOT mean that they actually touch in the case of bmodels.
-============================================================================
-*/
-
 typedef struct {
 	const float	*mins;
 	const float	*maxs;
@@ -373,24 +891,18 @@ typedef struct {
 	int			count, maxcount;
 } areaParms_t;
 
-
 /*
 ====================
-SV_AreaEntities_r
+SV_SectorAreaEntities_r
 
 ====================
 */
-static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
-	svEntity_t	*check, *next;
+static void SV_SectorAreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
+	int			check;
 	sharedEntity_t *gcheck;
-	int			count;
-
-	count = 0;
 
-	for ( check = node->entities  ; check ; check = next ) {
-		next = check->nextEntityInWorldSector;
-
-		gcheck = SV_GEntityForSvEntity( check );
+	for ( check = node->entities ; check != -1 ; check = sectorNext[check] ) {
+		gcheck = SV_GentityNum( check );
 
 		if ( gcheck->r.absmin[0] > ap->maxs[0]
 		|| gcheck->r.absmin[1] > ap->maxs[1]
@@ -402,11 +914,10 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 		}
 
 		if ( ap->count == ap->maxcount ) {
-			Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
 			return;
 		}
 
-		ap->list[ap->count] = check - sv.svEntities;
+		ap->list[ap->count] = check;
 		ap->count++;
 	}
 	
@@ -416,19 +927,19 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 
 	// recurse down both sides
 	if ( ap->maxs[node->axis] > node->dist ) {
-		SV_AreaEntities_r ( node->children[0], ap );
+		SV_SectorAreaEntities_r ( node->children[0], ap );
 	}
 	if ( ap->mins[node->axis] < node->dist ) {
-		SV_AreaEntities_r ( node->children[1], ap );
+		SV_SectorAreaEntities_r ( node->children[1], ap );
 	}
 }
 
 /*
 ================
-SV_AreaEntities
+SV_SectorAreaEntities
 ================
 */
-int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
+static int SV_SectorAreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
 	areaParms_t		ap;
 
 	ap.mins = mins;
@@ -437,11 +948,141 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 	ap.count = 0;
 	ap.maxcount = maxcount;
 
-	SV_AreaEntities_r( sv_worldSectors, &ap );
+	SV_SectorAreaEntities_r( sv_worldSectors, &ap );
 
 	return ap.count;
 }
 
+/*
+================
+SV_BroadphaseBench_f
+
+"sv_broadphaseBench record [queries]" records the area queries made while
+the game runs, "sv_broadphaseBench [passes]" then replays them against the
+current entities, with the tree and with the old sector tree, and compares
+their times and results
+================
+*/
+void SV_BroadphaseBench_f( void ) {
+	static int		list[MAX_GENTITIES], sectorList[MAX_GENTITIES];
+	static byte		found[MAX_GENTITIES];
+	vec3_t			mins, maxs;
+	broadQuery_t	*query;
+	int				passes, pass;
+	int				i, j, num, sectorNum;
+	int				mismatches, results;
+	int64_t			start, usec[3];
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "record" ) ) {
+		num = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 10000;
+		if ( num <= 0 ) {
+			Com_Printf( "usage: sv_broadphaseBench record [queries]\n" );
+			return;
+		}
+
+		sv_maxBroadQueries = 0;
+		if ( sv_broadQueries ) {
+			Z_Free( sv_broadQueries );
+		}
+		sv_broadQueries = Z_Malloc( num * sizeof( *sv_broadQueries ) );
+		sv_numBroadQueries = 0;
+		sv_maxBroadQueries = num;
+		Com_Printf( "sv_broadphaseBench: recording %i queries\n", num );
+		return;
+	}
+
+	if ( !sv_numBroadQueries ) {
+		Com_Printf( "No queries recorded, use \"sv_broadphaseBench record [queries]\" first.\n" );
+		return;
+	}
+
+	passes = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 10;
+	if ( passes <= 0 ) {
+		Com_Printf( "usage: sv_broadphaseBench [passes]\n" );
+		return;
+	}
+
+	// don't record the replay
+	sv_maxBroadQueries = sv_numBroadQueries;
+
+	// build the sector tree from the entities linked now
+	sv_worldSectors = Z_Malloc( AREA_NODES * sizeof( *sv_worldSectors ) );
+	sectorNext = Z_Malloc( MAX_GENTITIES * sizeof( *sectorNext ) );
+	sv_numworldSectors = 0;
+	CM_ModelBounds( CM_InlineModel( 0 ), mins, maxs );
+	SV_CreateworldSector( 0, mins, maxs );
+	for ( i = 0 ; i < MAX_GENTITIES ; i++ ) {
+		if ( sv.svEntities[i].broadLeaf ) {
+			SV_SectorLinkEntity( SV_GentityNum( i ) );
+		}
+	}
+
+	// compare the results
+	mismatches = results = 0;
+	for ( i = 0, query = sv_broadQueries ; i < sv_numBroadQueries ; i++, query++ ) {
+		num = SV_AreaEntitiesFiltered( query->mins, query->maxs, list, MAX_GENTITIES, 0 );
+		sectorNum = SV_SectorAreaEntities( query->mins, query->maxs, sectorList, MAX_GENTITIES );
+		results += num;
+
+		for ( j = 0 ; j < num ; j++ ) {
+			found[list[j]] = 1;
+		}
+		for ( j = 0 ; j < sectorNum ; j++ ) {
+			if ( !found[sectorList[j]] ) {
+				break;
+			}
+		}
+		if ( num != sectorNum || j != sectorNum ) {
+			mismatches++;
+		}
+		for ( j = 0 ; j < num ; j++ ) {
+			found[list[j]] = 0;
+		}
+	}
+
+	// and the times
+	start = Sys_Microseconds();
+	for ( pass = 0 ; pass < passes ; pass++ ) {
+		for ( i = 0, query = sv_broadQueries ; i < sv_numBroadQueries ; i++, query++ ) {
+			SV_SectorAreaEntities( query->mins, query->maxs, sectorList, MAX_GENTITIES );
+		}
+	}
+	usec[0] = Sys_Microseconds() - start;
+
+	start = Sys_Microseconds();
+	for ( pass = 0 ; pass < passes ; pass++ ) {
+		for ( i = 0, query = sv_broadQueries ; i < sv_numBroadQueries ; i++, query++ ) {
+			SV_AreaEntitiesFiltered( query->mins, query->maxs, list, MAX_GENTITIES, 0 );
+		}
+	}
+	usec[1] = Sys_Microseconds() - start;
+
+	start = Sys_Microseconds();
+	for ( pass = 0 ; pass < passes ; pass++ ) {
+		for ( i = 0, query = sv_broadQueries ; i < sv_numBroadQueries ; i++, query++ ) {
+			SV_AreaEntitiesFiltered( query->mins, query->maxs, list, MAX_GENTITIES, query->contentmask );
+		}
+	}
+	usec[2] = Sys_Microseconds() - start;
+
+	Z_Free( sectorNext );
+	Z_Free( sv_worldSectors );
+	sectorNext = NULL;
+	sv_worldSectors = NULL;
+
+	num = sv_numBroadQueries * passes;
+	Com_Printf( "%i queries, %.1f entities per query, %i mismatches\n",
+		sv_numBroadQueries, (float)results / sv_numBroadQueries, mismatches );
+	Com_Printf( "  sector tree: %8i usec, %6.1f nsec/query\n", (int)usec[0], usec[0] * 1000.0 / num );
+	Com_Printf( "  box tree:    %8i usec, %6.1f nsec/query\n", (int)usec[1], usec[1] * 1000.0 / num );
+	Com_Printf( "  filtered:    %8i usec, %6.1f nsec/query\n", (int)usec[2], usec[2] * 1000.0 / num );
+}
+
 
 
 //===========================================================================
@@ -504,21 +1145,19 @@ void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, con
 
 /*
 ====================
-SV_ClipMoveToEntities
+SV_ClipMoveToEntityList
 
+Clips the move against each of the listed entities
 ====================
 */
-static void SV_ClipMoveToEntities( moveclip_t *clip ) {
-	int			i, num;
-	int			touchlist[MAX_GENTITIES];
+static void SV_ClipMoveToEntityList( moveclip_t *clip, const int *touchlist, int num ) {
+	int			i;
 	sharedEntity_t *touch;
 	int			passOwnerNum;
 	trace_t		trace;
 	clipHandle_t	clipHandle;
 	float		*origin, *angles;
 
-	num = SV_AreaEntities( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
-
 	if ( clip->passEntityNum != ENTITYNUM_NONE ) {
 		passOwnerNum = ( SV_GentityNum( clip->passEntityNum ) )->r.ownerNum;
 		if ( passOwnerNum == ENTITYNUM_NONE ) {
@@ -590,6 +1229,45 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 }
 
 
+/*
+====================
+SV_ClipMoveToEntities
+
+====================
+*/
+static void SV_ClipMoveToEntities( moveclip_t *clip ) {
+	int			num;
+	int			touchlist[MAX_GENTITIES];
+
+	// entities without any of the contents we are looking for are left out
+	num = SV_AreaEntitiesFiltered( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES, clip->contentmask );
+
+	SV_ClipMoveToEntityList( clip, touchlist, num );
+}
+
+
+/*
+==================
+SV_MoveBounds
+
+The box enclosing the whole move, plus an epsilon
+==================
+*/
+static void SV_MoveBounds( const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, vec3_t boxmins, vec3_t boxmaxs ) {
+	int		i;
+
+	for ( i=0 ; i<3 ; i++ ) {
+		if ( end[i] > start[i] ) {
+			boxmins[i] = start[i] + mins[i] - 1;
+			boxmaxs[i] = end[i] + maxs[i] + 1;
+		} else {
+			boxmins[i] = end[i] + mins[i] - 1;
+			boxmaxs[i] = start[i] + maxs[i] + 1;
+		}
+	}
+}
+
+
 /*
 ==================
 SV_Trace
@@ -600,7 +1278,6 @@ passEntityNum and entities owned by passEntityNum are explicitly not checked.
 */
 void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, traceType_t type ) {
 	moveclip_t	clip;
-	int			i;
 
 	if ( !mins ) {
 		mins = vec3_origin;
@@ -632,15 +1309,7 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 	// we can limit it to the part of the move not
 	// already clipped off by the world, which can be
 	// a significant savings for line of sight and shot traces
-	for ( i=0 ; i<3 ; i++ ) {
-		if ( end[i] > start[i] ) {
-			clip.boxmins[i] = clip.start[i] + clip.mins[i] - 1;
-			clip.boxmaxs[i] = clip.end[i] + clip.maxs[i] + 1;
-		} else {
-			clip.boxmins[i] = clip.end[i] + clip.mins[i] - 1;
-			clip.boxmaxs[i] = clip.start[i] + clip.maxs[i] + 1;
-		}
-	}
+	SV_MoveBounds( clip.start, clip.mins, clip.maxs, clip.end, clip.boxmins, clip.boxmaxs );
 
 	// clip to other solid entities
 	SV_ClipMoveToEntities ( &clip );
@@ -649,6 +1318,88 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 }
 
 
+/*
+==================
+SV_TraceBatch
+
+Gives the same results as an AABB SV_Trace for each request.  The entities
+around all of the moves are looked up once and each move is only clipped
+against the ones touching its own bounds, so traces from a common origin,
+like splash damage and turret line of sight checks, share the broadphase.
+==================
+*/
+void SV_TraceBatch( trace_t *results, const traceRequest_t *requests, int count ) {
+	moveclip_t		clip;
+	int				touchlist[MAX_GENTITIES];
+	int				cliplist[MAX_GENTITIES];
+	vec3_t			boxmins, boxmaxs;
+	vec3_t			mins, maxs;
+	const traceRequest_t	*req;
+	sharedEntity_t	*touch;
+	int				contentmask;
+	int				i, j, k, num, numClip;
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	// everything any of the moves could touch
+	ClearBounds( mins, maxs );
+	contentmask = 0;
+	for ( i = 0, req = requests ; i < count ; i++, req++ ) {
+		SV_MoveBounds( req->start, req->mins, req->maxs, req->end, boxmins, boxmaxs );
+		AddPointToBounds( boxmins, mins, maxs );
+		AddPointToBounds( boxmaxs, mins, maxs );
+		contentmask |= req->contentmask;
+	}
+
+	num = SV_AreaEntitiesFiltered( mins, maxs, touchlist, MAX_GENTITIES, contentmask );
+
+	for ( i = 0, req = requests ; i < count ; i++, req++ ) {
+		Com_Memset( &clip, 0, sizeof( moveclip_t ) );
+
+		// clip to world
+		CM_BoxTrace( &clip.trace, req->start, req->end, (float *)req->mins, (float *)req->maxs,
+			0, req->contentmask, TT_AABB );
+		clip.trace.entityNum = clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
+		if ( clip.trace.fraction == 0 || !num ) {
+			results[i] = clip.trace;
+			continue;
+		}
+
+		clip.contentmask = req->contentmask;
+		clip.start = req->start;
+		VectorCopy( req->end, clip.end );
+		clip.mins = req->mins;
+		clip.maxs = req->maxs;
+		clip.passEntityNum = req->passEntityNum;
+		clip.collisionType = TT_AABB;
+		SV_MoveBounds( clip.start, clip.mins, clip.maxs, clip.end, clip.boxmins, clip.boxmaxs );
+
+		// the entities SV_AreaEntitiesFiltered would have given for this move alone
+		numClip = 0;
+		for ( j = 0 ; j < num ; j++ ) {
+			touch = SV_GentityNum( touchlist[j] );
+			if ( !( touch->r.contents & clip.contentmask ) ) {
+				continue;
+			}
+			for ( k = 0 ; k < 3 ; k++ ) {
+				if ( touch->r.absmin[k] > clip.boxmaxs[k] || touch->r.absmax[k] < clip.boxmins[k] ) {
+					break;
+				}
+			}
+			if ( k == 3 ) {
+				cliplist[ numClip++ ] = touchlist[j];
+			}
+		}
+
+		SV_ClipMoveToEntityList( &clip, cliplist, numClip );
+
+		results[i] = clip.trace;
+	}
+}
+
+
 
 /*
 =============
@@ -137,6 +137,9 @@ Single exit point (regular exit or in case of error)
 */
 void Sys_Exit( int ex )
 {
+	// don't lose the last disconnect messages
+	Sys_FlushPackets( );
+
 	CON_Shutdown( );
 
 #ifndef DEDICATED
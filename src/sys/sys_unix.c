@@ -21,6 +21,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 
+#ifdef __linux__
+#define _GNU_SOURCE		// register names in ucontext_t for the profiler
+#endif
+
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
 #include "sys_local.h"
@@ -39,6 +43,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <fcntl.h>
 #include <locale.h>
 #include <libintl.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <ucontext.h>
+#endif
 
 qboolean stdinIsATTY;
 
@@ -104,6 +112,29 @@ int Sys_Milliseconds (void)
 	return curtime;
 }
 
+/*
+================
+Sys_Microseconds
+
+Monotonic time since the first call, unlike Sys_Milliseconds
+it doesn't jump when the wall clock is changed
+================
+*/
+int64_t Sys_Microseconds( void )
+{
+	static int64_t	base;
+	struct timespec	ts;
+	int64_t			now;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	now = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+	if( !base )
+		base = now;
+
+	return now - base;
+}
+
 #if !id386
 /*
 ==================
@@ -226,6 +257,77 @@ qboolean Sys_Mkdir( const char *path )
 	return qtrue;
 }
 
+/*
+==================
+Sys_FileStat
+==================
+*/
+qboolean Sys_FileStat( const char *path, int *size, int *mtime )
+{
+	struct stat st;
+
+	if( stat( path, &st ) == -1 )
+		return qfalse;
+
+	*size = (int)st.st_size;
+	*mtime = (int)st.st_mtime;
+	return qtrue;
+}
+
+/*
+==================
+Sys_MapFile
+
+Maps length bytes at offset of a file read-only, mmap wants a page
+aligned offset so the mapping may start a little before the data.
+Touching a page past the end of the file raises SIGBUS, so the range
+has to be inside the file as it is now.
+==================
+*/
+void *Sys_MapFile( const char *path, int offset, int length )
+{
+	int fd;
+	int pageOffset;
+	struct stat st;
+	void *base;
+
+	if( length <= 0 || offset < 0 )
+		return NULL;
+
+	fd = open( path, O_RDONLY );
+	if( fd == -1 )
+		return NULL;
+
+	if( fstat( fd, &st ) || !S_ISREG( st.st_mode ) ||
+		(off_t)offset + length > st.st_size )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	pageOffset = offset % sysconf( _SC_PAGESIZE );
+	base = mmap( NULL, length + pageOffset, PROT_READ, MAP_PRIVATE, fd,
+		offset - pageOffset );
+	close( fd );
+
+	if( base == MAP_FAILED )
+		return NULL;
+
+	return (byte *)base + pageOffset;
+}
+
+/*
+==================
+Sys_UnmapFile
+==================
+*/
+void Sys_UnmapFile( void *data, int offset, int length )
+{
+	int pageOffset = offset % sysconf( _SC_PAGESIZE );
+
+	munmap( (byte *)data - pageOffset, length + pageOffset );
+}
+
 /*
 ==================
 Sys_Cwd
@@ -654,3 +756,314 @@ void Sys_SetEnv(const char *name, const char *value)
 	else
 		unsetenv(name);
 }
+
+/*
+==============================================================
+
+Worker threads
+
+==============================================================
+*/
+
+typedef struct
+{
+	workerPool_t	*pool;
+	int				thread;
+} workerArgs_t;
+
+struct workerPool_s
+{
+	pthread_t		threads[ MAX_WORKER_THREADS ];
+	workerArgs_t	args[ MAX_WORKER_THREADS ];
+	int				numThreads;
+
+	pthread_mutex_t	lock;
+	pthread_cond_t	start;
+	pthread_cond_t	done;
+
+	void			(*func)( void *data, int index, int thread );
+	void			*data;
+	int				count;			// jobs in the current batch
+	int				next;			// next job to be taken
+	int				finished;		// jobs completed
+	int				batch;			// bumped for each Sys_RunWorkerJobs
+	qboolean		quit;
+};
+
+/*
+==================
+Sys_WorkOnJobs
+
+Takes jobs from the current batch until there are none left,
+called with the pool locked
+==================
+*/
+static void Sys_WorkOnJobs( workerPool_t *pool, int thread )
+{
+	int index;
+
+	while( pool->next < pool->count )
+	{
+		index = pool->next++;
+
+		pthread_mutex_unlock( &pool->lock );
+		pool->func( pool->data, index, thread );
+		pthread_mutex_lock( &pool->lock );
+
+		if( ++pool->finished == pool->count )
+			pthread_cond_signal( &pool->done );
+	}
+}
+
+/*
+==================
+Sys_WorkerThread
+==================
+*/
+static void *Sys_WorkerThread( void *arg )
+{
+	workerArgs_t *args = arg;
+	workerPool_t *pool = args->pool;
+	int batch = 0;
+
+	pthread_mutex_lock( &pool->lock );
+	while( 1 )
+	{
+		while( pool->batch == batch && !pool->quit )
+			pthread_cond_wait( &pool->start, &pool->lock );
+
+		if( pool->quit )
+			break;
+
+		batch = pool->batch;
+		Sys_WorkOnJobs( pool, args->thread );
+	}
+	pthread_mutex_unlock( &pool->lock );
+
+	CM_FreeThreadData( );
+
+	return NULL;
+}
+
+/*
+==================
+Sys_CreateWorkerPool
+==================
+*/
+workerPool_t *Sys_CreateWorkerPool( int numThreads )
+{
+	workerPool_t *pool;
+	int i;
+
+	if( numThreads <= 0 )
+		return NULL;
+
+	if( numThreads > MAX_WORKER_THREADS )
+		numThreads = MAX_WORKER_THREADS;
+
+	pool = Z_Malloc( sizeof( *pool ) );
+	pthread_mutex_init( &pool->lock, NULL );
+	pthread_cond_init( &pool->start, NULL );
+	pthread_cond_init( &pool->done, NULL );
+
+	for( i = 0; i < numThreads; i++ )
+	{
+		pool->args[ i ].pool = pool;
+		pool->args[ i ].thread = i + 1;
+
+		if( pthread_create( &pool->threads[ i ], NULL, Sys_WorkerThread, &pool->args[ i ] ) )
+		{
+			Com_Printf( "WARNING: could only start %d of %d worker threads\n", i, numThreads );
+			break;
+		}
+	}
+	pool->numThreads = i;
+
+	if( !pool->numThreads )
+	{
+		Sys_DestroyWorkerPool( pool );
+		return NULL;
+	}
+
+	return pool;
+}
+
+/*
+==================
+Sys_DestroyWorkerPool
+==================
+*/
+void Sys_DestroyWorkerPool( workerPool_t *pool )
+{
+	int i;
+
+	if( !pool )
+		return;
+
+	pthread_mutex_lock( &pool->lock );
+	pool->quit = qtrue;
+	pthread_cond_broadcast( &pool->start );
+	pthread_mutex_unlock( &pool->lock );
+
+	for( i = 0; i < pool->numThreads; i++ )
+		pthread_join( pool->threads[ i ], NULL );
+
+	pthread_cond_destroy( &pool->done );
+	pthread_cond_destroy( &pool->start );
+	pthread_mutex_destroy( &pool->lock );
+	Z_Free( pool );
+}
+
+/*
+==================
+Sys_WorkerPoolThreads
+==================
+*/
+int Sys_WorkerPoolThreads( workerPool_t *pool )
+{
+	return pool ? pool->numThreads : 0;
+}
+
+/*
+==================
+Sys_RunWorkerJobs
+
+Calls func for every index below count, spread over the pool and the
+calling thread, and returns once all of them have finished
+==================
+*/
+void Sys_RunWorkerJobs( workerPool_t *pool, void (*func)( void *data, int index, int thread ),
+	void *data, int count )
+{
+	int i;
+
+	if( !pool || count <= 1 )
+	{
+		for( i = 0; i < count; i++ )
+			func( data, i, 0 );
+		return;
+	}
+
+	pthread_mutex_lock( &pool->lock );
+	pool->func = func;
+	pool->data = data;
+	pool->count = count;
+	pool->next = 0;
+	pool->finished = 0;
+	pool->batch++;
+	pthread_cond_broadcast( &pool->start );
+
+	Sys_WorkOnJobs( pool, 0 );
+
+	while( pool->finished < pool->count )
+		pthread_cond_wait( &pool->done, &pool->lock );
+	pthread_mutex_unlock( &pool->lock );
+}
+
+/*
+==============================================================
+
+Profiling timer
+
+==============================================================
+*/
+
+static void		(*profileSample)( profileContext_t *context );
+static pthread_t	profileThread;
+
+/*
+==================
+Sys_ProfileSignal
+==================
+*/
+static void Sys_ProfileSignal( int signum, siginfo_t *info, void *context )
+{
+	profileContext_t	state;
+
+	if( !profileSample )
+		return;
+
+	// the timer counts the cpu time of all threads, only the one that
+	// started it runs the VMs and gets sampled
+	if( !pthread_equal( pthread_self( ), profileThread ) )
+		return;
+
+	memset( &state, 0, sizeof( state ) );
+#if defined( __linux__ ) && defined( __x86_64__ )
+	{
+		greg_t	*gregs = ( (ucontext_t *)context )->uc_mcontext.gregs;
+
+		state.pc = (void *)gregs[ REG_RIP ];
+		state.regs[ 0 ] = gregs[ REG_RAX ];
+		state.regs[ 1 ] = gregs[ REG_RCX ];
+		state.regs[ 2 ] = gregs[ REG_RDX ];
+		state.regs[ 3 ] = gregs[ REG_RBX ];
+		state.regs[ 4 ] = gregs[ REG_RSP ];
+		state.regs[ 5 ] = gregs[ REG_RBP ];
+		state.regs[ 6 ] = gregs[ REG_RSI ];
+		state.regs[ 7 ] = gregs[ REG_RDI ];
+		state.regs[ 8 ] = gregs[ REG_R8 ];
+		state.regs[ 9 ] = gregs[ REG_R9 ];
+		state.regs[ 10 ] = gregs[ REG_R10 ];
+		state.regs[ 11 ] = gregs[ REG_R11 ];
+		state.regs[ 12 ] = gregs[ REG_R12 ];
+		state.regs[ 13 ] = gregs[ REG_R13 ];
+		state.regs[ 14 ] = gregs[ REG_R14 ];
+		state.regs[ 15 ] = gregs[ REG_R15 ];
+	}
+#endif
+
+	profileSample( &state );
+}
+
+/*
+==================
+Sys_StartProfiler
+
+Calls sample from a signal handler with the interrupted context of the
+calling thread, when it is the one running as another usec microseconds
+of cpu time used by the process run out.  SIGPROF is blocked while the
+handler runs, so sample is never entered twice at once.
+==================
+*/
+qboolean Sys_StartProfiler( int usec, void (*sample)( profileContext_t *context ) )
+{
+	struct sigaction	sa;
+	struct itimerval	timer;
+
+	profileSample = sample;
+	profileThread = pthread_self( );
+
+	memset( &sa, 0, sizeof( sa ) );
+	sa.sa_sigaction = Sys_ProfileSignal;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset( &sa.sa_mask );
+	if( sigaction( SIGPROF, &sa, NULL ) )
+		return qfalse;
+
+	timer.it_interval.tv_sec = usec / 1000000;
+	timer.it_interval.tv_usec = usec % 1000000;
+	timer.it_value = timer.it_interval;
+	if( setitimer( ITIMER_PROF, &timer, NULL ) )
+	{
+		signal( SIGPROF, SIG_IGN );
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+/*
+==================
+Sys_StopProfiler
+==================
+*/
+void Sys_StopProfiler( void )
+{
+	struct itimerval	timer;
+
+	memset( &timer, 0, sizeof( timer ) );
+	setitimer( ITIMER_PROF, &timer, NULL );
+	signal( SIGPROF, SIG_IGN );
+	profileSample = NULL;
+}
@@ -35,6 +35,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <stdio.h>
 #include <direct.h>
 #include <io.h>
+#include <sys/stat.h>
 #include <conio.h>
 #include <wincrypt.h>
 #include <shlobj.h>
@@ -106,6 +107,30 @@ int Sys_Milliseconds (void)
 	return sys_curtime;
 }
 
+/*
+================
+Sys_Microseconds
+================
+*/
+int64_t Sys_Microseconds( void )
+{
+	static LARGE_INTEGER	frequency, base;
+	LARGE_INTEGER			now;
+	int64_t					ticks;
+
+	if( !frequency.QuadPart )
+	{
+		QueryPerformanceFrequency( &frequency );
+		QueryPerformanceCounter( &base );
+	}
+	QueryPerformanceCounter( &now );
+
+	// split so the multiply can't overflow
+	ticks = now.QuadPart - base.QuadPart;
+	return ( ticks / frequency.QuadPart ) * 1000000 +
+		( ticks % frequency.QuadPart ) * 1000000 / frequency.QuadPart;
+}
+
 #ifndef __GNUC__ //see snapvectora.s
 /*
 ================
@@ -286,6 +311,77 @@ qboolean Sys_Mkdir( const char *path )
 	return qtrue;
 }
 
+/*
+==============
+Sys_FileStat
+==============
+*/
+qboolean Sys_FileStat( const char *path, int *size, int *mtime )
+{
+	struct _stat st;
+
+	if( _stat( path, &st ) == -1 )
+		return qfalse;
+
+	*size = (int)st.st_size;
+	*mtime = (int)st.st_mtime;
+	return qtrue;
+}
+
+/*
+==============
+Sys_MapFile
+
+Maps length bytes at offset of a file read-only, views have to start on
+the allocation granularity so the view may start a little before the data
+==============
+*/
+void *Sys_MapFile( const char *path, int offset, int length )
+{
+	SYSTEM_INFO info;
+	HANDLE file, mapping;
+	int viewOffset;
+	void *base;
+
+	if( length <= 0 || offset < 0 )
+		return NULL;
+
+	file = CreateFile( path, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( file == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	mapping = CreateFileMapping( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	CloseHandle( file );
+	if( !mapping )
+		return NULL;
+
+	GetSystemInfo( &info );
+	viewOffset = offset % info.dwAllocationGranularity;
+	base = MapViewOfFile( mapping, FILE_MAP_READ, 0, offset - viewOffset,
+		length + viewOffset );
+	// the view keeps the mapping alive
+	CloseHandle( mapping );
+
+	if( !base )
+		return NULL;
+
+	return (byte *)base + viewOffset;
+}
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile( void *data, int offset, int length )
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo( &info );
+	UnmapViewOfFile( (byte *)data - offset % info.dwAllocationGranularity );
+}
+
 /*
 ==============
 Sys_Cwd
@@ -707,3 +803,231 @@ void Sys_SetEnv(const char *name, const char *value)
 {
 	_putenv(va("%s=%s", name, value));
 }
+
+/*
+==============================================================
+
+Worker threads
+
+==============================================================
+*/
+
+typedef struct
+{
+	workerPool_t	*pool;
+	int				thread;
+} workerArgs_t;
+
+struct workerPool_s
+{
+	HANDLE			threads[ MAX_WORKER_THREADS ];
+	HANDLE			start[ MAX_WORKER_THREADS ];	// auto reset, one per thread
+	workerArgs_t	args[ MAX_WORKER_THREADS ];
+	int				numThreads;
+
+	CRITICAL_SECTION	lock;
+	HANDLE			done;
+
+	void			(*func)( void *data, int index, int thread );
+	void			*data;
+	int				count;			// jobs in the current batch
+	int				next;			// next job to be taken
+	int				finished;		// jobs completed
+	qboolean		quit;
+};
+
+/*
+==================
+Sys_WorkOnJobs
+
+Takes jobs from the current batch until there are none left
+==================
+*/
+static void Sys_WorkOnJobs( workerPool_t *pool, int thread )
+{
+	int index;
+
+	while( 1 )
+	{
+		EnterCriticalSection( &pool->lock );
+		if( pool->next >= pool->count )
+		{
+			LeaveCriticalSection( &pool->lock );
+			break;
+		}
+		index = pool->next++;
+		LeaveCriticalSection( &pool->lock );
+
+		pool->func( pool->data, index, thread );
+
+		EnterCriticalSection( &pool->lock );
+		if( ++pool->finished == pool->count )
+			SetEvent( pool->done );
+		LeaveCriticalSection( &pool->lock );
+	}
+}
+
+/*
+==================
+Sys_WorkerThread
+==================
+*/
+static DWORD WINAPI Sys_WorkerThread( LPVOID arg )
+{
+	workerArgs_t *args = arg;
+	workerPool_t *pool = args->pool;
+
+	while( 1 )
+	{
+		WaitForSingleObject( pool->start[ args->thread - 1 ], INFINITE );
+
+		if( pool->quit )
+			break;
+
+		Sys_WorkOnJobs( pool, args->thread );
+	}
+
+	CM_FreeThreadData( );
+
+	return 0;
+}
+
+/*
+==================
+Sys_CreateWorkerPool
+==================
+*/
+workerPool_t *Sys_CreateWorkerPool( int numThreads )
+{
+	workerPool_t *pool;
+	int i;
+
+	if( numThreads <= 0 )
+		return NULL;
+
+	if( numThreads > MAX_WORKER_THREADS )
+		numThreads = MAX_WORKER_THREADS;
+
+	pool = Z_Malloc( sizeof( *pool ) );
+	InitializeCriticalSection( &pool->lock );
+	pool->done = CreateEvent( NULL, FALSE, FALSE, NULL );
+
+	for( i = 0; i < numThreads; i++ )
+	{
+		pool->args[ i ].pool = pool;
+		pool->args[ i ].thread = i + 1;
+		pool->start[ i ] = CreateEvent( NULL, FALSE, FALSE, NULL );
+		pool->threads[ i ] = CreateThread( NULL, 0, Sys_WorkerThread, &pool->args[ i ], 0, NULL );
+
+		if( !pool->threads[ i ] )
+		{
+			CloseHandle( pool->start[ i ] );
+			Com_Printf( "WARNING: could only start %d of %d worker threads\n", i, numThreads );
+			break;
+		}
+	}
+	pool->numThreads = i;
+
+	if( !pool->numThreads )
+	{
+		Sys_DestroyWorkerPool( pool );
+		return NULL;
+	}
+
+	return pool;
+}
+
+/*
+==================
+Sys_DestroyWorkerPool
+==================
+*/
+void Sys_DestroyWorkerPool( workerPool_t *pool )
+{
+	int i;
+
+	if( !pool )
+		return;
+
+	pool->quit = qtrue;
+	for( i = 0; i < pool->numThreads; i++ )
+		SetEvent( pool->start[ i ] );
+
+	for( i = 0; i < pool->numThreads; i++ )
+	{
+		WaitForSingleObject( pool->threads[ i ], INFINITE );
+		CloseHandle( pool->threads[ i ] );
+		CloseHandle( pool->start[ i ] );
+	}
+
+	CloseHandle( pool->done );
+	DeleteCriticalSection( &pool->lock );
+	Z_Free( pool );
+}
+
+/*
+==================
+Sys_WorkerPoolThreads
+==================
+*/
+int Sys_WorkerPoolThreads( workerPool_t *pool )
+{
+	return pool ? pool->numThreads : 0;
+}
+
+/*
+==================
+Sys_RunWorkerJobs
+
+Calls func for every index below count, spread over the pool and the
+calling thread, and returns once all of them have finished
+==================
+*/
+void Sys_RunWorkerJobs( workerPool_t *pool, void (*func)( void *data, int index, int thread ),
+	void *data, int count )
+{
+	int i;
+
+	if( !pool || count <= 1 )
+	{
+		for( i = 0; i < count; i++ )
+			func( data, i, 0 );
+		return;
+	}
+
+	EnterCriticalSection( &pool->lock );
+	pool->func = func;
+	pool->data = data;
+	pool->count = count;
+	pool->next = 0;
+	pool->finished = 0;
+	LeaveCriticalSection( &pool->lock );
+
+	for( i = 0; i < pool->numThreads; i++ )
+		SetEvent( pool->start[ i ] );
+
+	Sys_WorkOnJobs( pool, 0 );
+
+	WaitForSingleObject( pool->done, INFINITE );
+}
+
+/*
+==================
+Sys_StartProfiler
+
+Not implemented, there are no cpu time signals
+==================
+*/
+qboolean Sys_StartProfiler( int usec, void (*sample)( profileContext_t *context ) )
+{
+	return qfalse;
+}
+
+/*
+==================
+Sys_StopProfiler
+==================
+*/
+void Sys_StopProfiler( void )
+{
+}